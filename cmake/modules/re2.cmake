@@ -0,0 +1,37 @@
+#
+# Copyright (C) 2022 The Falco Authors.
+#
+# Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+# the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+# specific language governing permissions and limitations under the License.
+#
+mark_as_advanced(RE2_INCLUDE RE2_LIB)
+if(NOT USE_BUNDLED_DEPS)
+  find_path(RE2_INCLUDE NAMES re2/re2.h)
+  find_library(RE2_LIB NAMES re2)
+  if(RE2_INCLUDE AND RE2_LIB)
+    message(STATUS "Found re2: include: ${RE2_INCLUDE}, lib: ${RE2_LIB}")
+  else()
+    message(FATAL_ERROR "Couldn't find system re2")
+  endif()
+else()
+  set(RE2_PREFIX "${PROJECT_BINARY_DIR}/re2-prefix")
+  set(RE2_INCLUDE "${RE2_PREFIX}/include")
+  set(RE2_LIB "${RE2_PREFIX}/lib/libre2.a")
+  message(STATUS "Using bundled re2 in '${RE2_PREFIX}'")
+  ExternalProject_Add(
+    re2
+    URL "https://github.com/google/re2/archive/refs/tags/2022-06-01.tar.gz"
+    URL_HASH "SHA256=f89c61410a072e5cbcf8c27e3a778da7d6fd2f2b5b1445cd4f4508bee946ab0f"
+    CMAKE_ARGS -DCMAKE_INSTALL_PREFIX=${RE2_PREFIX}
+               -DCMAKE_INSTALL_LIBDIR=lib
+               -DCMAKE_POSITION_INDEPENDENT_CODE=ON
+               -DBUILD_SHARED_LIBS=OFF
+               -DRE2_BUILD_TESTING=OFF
+    BUILD_BYPRODUCTS ${RE2_LIB})
+endif()
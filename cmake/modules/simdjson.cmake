@@ -0,0 +1,40 @@
+#
+# Copyright (C) 2022 The Falco Authors.
+#
+# Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance with
+# the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+# specific language governing permissions and limitations under the License.
+#
+
+include(ExternalProject)
+
+# simdjson is built from its single header/single source distribution,
+# which is compiled directly into the engine.
+set(SIMDJSON_SRC "${PROJECT_BINARY_DIR}/simdjson-prefix/src/simdjson")
+set(SIMDJSON_INCLUDE "${SIMDJSON_SRC}/singleheader")
+set(SIMDJSON_SOURCES "${SIMDJSON_INCLUDE}/simdjson.cpp")
+message(STATUS "Using bundled simdjson in '${SIMDJSON_SRC}'")
+
+# The release archive is checked against its SHA256, which must be
+# provided with -DSIMDJSON_CHECKSUM=<sha256>
+set(SIMDJSON_VERSION "1.0.2")
+set(SIMDJSON_URL "https://github.com/simdjson/simdjson/archive/refs/tags/v${SIMDJSON_VERSION}.tar.gz")
+set(SIMDJSON_CHECKSUM "" CACHE STRING "SHA256 of the simdjson release archive")
+if(NOT SIMDJSON_CHECKSUM)
+  message(FATAL_ERROR "USE_SIMDJSON requires SIMDJSON_CHECKSUM, the SHA256 of ${SIMDJSON_URL}")
+endif()
+
+ExternalProject_Add(
+  simdjson
+  URL "${SIMDJSON_URL}"
+  URL_HASH "SHA256=${SIMDJSON_CHECKSUM}"
+  CONFIGURE_COMMAND ""
+  BUILD_COMMAND ""
+  UPDATE_COMMAND ""
+  INSTALL_COMMAND ""
+  BUILD_BYPRODUCTS ${SIMDJSON_SOURCES})
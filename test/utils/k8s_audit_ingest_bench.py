@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2022 The Falco Authors.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# Compare the rate at which a running Falco accepts k8s audit events
+# over http (with keep-alive) and over the unix socket configured with
+# webserver.k8s_audit_unix_socket.
+#
+# Example:
+#   k8s_audit_ingest_bench.py --events 100000 \
+#       --unix-socket /var/run/falco-k8s-audit.sock \
+#       test/trace_files/k8s_audit/*.json
+
+import argparse
+import http.client
+import json
+import socket
+import struct
+import time
+
+
+def load_events(filenames):
+    events = []
+    for filename in filenames:
+        with open(filename) as f:
+            try:
+                events.append(json.load(f))
+            except ValueError:
+                continue
+    return [json.dumps(e, separators=(",", ":")).encode() for e in events]
+
+
+def bench_http(host, port, endpoint, events, count):
+    conn = http.client.HTTPConnection(host, port)
+    headers = {"Content-Type": "application/json"}
+    start = time.monotonic()
+    for i in range(count):
+        while True:
+            conn.request("POST", endpoint, events[i % len(events)], headers)
+            resp = conn.getresponse()
+            resp.read()
+            if resp.status != 429:
+                break
+            time.sleep(float(resp.getheader("Retry-After", "1")))
+        if resp.status >= 300:
+            raise RuntimeError("Unexpected status {}".format(resp.status))
+    elapsed = time.monotonic() - start
+    conn.close()
+    return elapsed
+
+
+def bench_unix_socket(path, framing, events, count):
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(path)
+    if framing == "newline":
+        messages = [e + b"\n" for e in events]
+    else:
+        messages = [struct.pack(">I", len(e)) + e for e in events]
+    start = time.monotonic()
+    for i in range(count):
+        sock.sendall(messages[i % len(messages)])
+    sock.close()
+    return time.monotonic() - start
+
+
+def report(name, count, elapsed):
+    print("{:12s} {:10d} events {:8.3f}s {:12.1f} events/s".format(
+        name, count, elapsed, count / elapsed if elapsed > 0 else 0))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare k8s audit ingestion over http and a unix socket")
+    parser.add_argument("--host", default="localhost")
+    parser.add_argument("--port", type=int, default=8765)
+    parser.add_argument("--endpoint", default="/k8s-audit")
+    parser.add_argument("--unix-socket", default="",
+                        help="Path of webserver.k8s_audit_unix_socket, skipped if empty")
+    parser.add_argument("--framing", choices=["newline", "length"], default="newline")
+    parser.add_argument("--events", type=int, default=10000,
+                        help="Number of events to send with each transport")
+    parser.add_argument("files", nargs="+",
+                        help="Files holding an Event or EventList each")
+    args = parser.parse_args()
+
+    events = load_events(args.files)
+    if not events:
+        parser.error("No events could be read")
+
+    report("http", args.events,
+           bench_http(args.host, args.port, args.endpoint, events, args.events))
+
+    # As with http requests answered with a 202, this only waits for
+    # the events to be queued, not evaluated.
+    if args.unix_socket:
+        report("unix socket", args.events,
+               bench_unix_socket(args.unix_socket, args.framing, events, args.events))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2022 The Falco Authors.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# Replay the trace files in test/trace_files with falco --bench, and
+# compare the reports with the baselines of a previous run. Exits with
+# an error if the event rate dropped, or the allocations per event or
+# the peak RSS grew, by more than the given tolerance, or if the
+# number of alerts changed.
+#
+# Falco should be built with -DBUILD_FALCO_ALLOC_COUNTER=ON to compare
+# the allocations.
+#
+# Example:
+#   replay_bench.py --falco build/userspace/falco/falco \
+#       --baselines falco_bench_baselines.json --update-baselines
+#   (change things)
+#   replay_bench.py --falco build/userspace/falco/falco \
+#       --baselines falco_bench_baselines.json
+
+import argparse
+import glob
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+# Compared metrics, and whether higher values are better
+METRICS = {
+    "events_per_sec": True,
+    "allocs_per_event": False,
+    "peak_rss_kb": False,
+}
+
+
+def benchmarks(source_dir):
+    rules_dir = os.path.join(source_dir, "rules")
+    trace_dir = os.path.join(source_dir, "test", "trace_files")
+    benches = {}
+
+    for scap in sorted(glob.glob(os.path.join(trace_dir, "*.scap"))):
+        name = "scap/" + os.path.basename(scap)
+        benches[name] = ["-r", os.path.join(rules_dir, "falco_rules.yaml"),
+                         "-e", scap]
+
+    # The k8s audit traces hold a few events each, so they are all
+    # replayed in a single run.
+    audit_files = sorted(glob.glob(os.path.join(trace_dir, "k8s_audit", "*.json")))
+    if audit_files:
+        args = ["-r", os.path.join(rules_dir, "k8s_audit_rules.yaml")]
+        for f in audit_files:
+            args += ["--k8s-audit-replay", f]
+        benches["k8s_audit"] = args
+
+    return benches
+
+
+def run(falco, config, loops, args, labels):
+    env = dict(os.environ)
+    for key, val in labels.items():
+        env["FALCO_STATS_EXTRA_" + key] = val
+
+    with tempfile.NamedTemporaryFile(suffix=".json") as report:
+        cmd = [falco, "-c", config, "--bench", str(loops),
+               "--bench-report", report.name] + args
+        subprocess.run(cmd, env=env, check=True,
+                       stdout=subprocess.DEVNULL)
+        return json.load(report)
+
+
+def compare(name, report, baseline, tolerance):
+    failures = []
+
+    if report["alerts"] != baseline["alerts"]:
+        failures.append("{}: {} alerts, {} in baseline".format(
+            name, report["alerts"], baseline["alerts"]))
+
+    for metric, higher_is_better in METRICS.items():
+        cur = report.get(metric)
+        base = baseline.get(metric)
+        if cur is None or base is None or base == 0:
+            continue
+        change = (cur - base) * 100.0 / base
+        if (higher_is_better and change < -tolerance) or \
+           (not higher_is_better and change > tolerance):
+            failures.append("{}: {} {:.2f}, {:.2f} in baseline ({:+.1f}%)".format(
+                name, metric, cur, base, change))
+
+    return failures
+
+
+def print_report(name, report):
+    stages = report["stages"]
+    allocs = report["allocs_per_event"]
+    print("{:36s} {:12.1f} events/s {:10.1f} alerts/s  "
+          "read {:8.1f} match {:8.1f} format {:8.1f} ns/event  "
+          "rss {:8d} kB  allocs/event {}".format(
+              name, report["events_per_sec"], report["alerts_per_sec"],
+              stages["read"]["ns_per_event"],
+              stages["match"]["ns_per_event"],
+              stages["format"]["ns_per_event"],
+              report["peak_rss_kb"],
+              "n/a" if allocs is None else "{:.2f}".format(allocs)))
+
+
+def main():
+    source_dir = os.path.abspath(os.path.join(os.path.dirname(__file__), "..", ".."))
+
+    parser = argparse.ArgumentParser(description="Replay trace files with falco --bench and compare with baselines")
+    parser.add_argument("--falco", required=True, help="Path of the falco binary")
+    parser.add_argument("--config", default=os.path.join(source_dir, "falco.yaml"))
+    parser.add_argument("--loops", type=int, default=100,
+                        help="Number of times each trace is replayed")
+    parser.add_argument("--baselines", required=True,
+                        help="File holding the reports of the baseline run")
+    parser.add_argument("--update-baselines", action="store_true",
+                        help="Write the reports of this run as the new baselines")
+    parser.add_argument("--tolerance", type=float, default=10.0,
+                        help="Allowed regression, in percent")
+    parser.add_argument("--label", action="append", default=[],
+                        help="<key>=<value> added to the reports. Can be specified multiple times.")
+    parser.add_argument("--filter", default="",
+                        help="Only run the benchmarks with this substring in their name")
+    args = parser.parse_args()
+
+    labels = dict(l.split("=", 1) for l in args.label)
+
+    reports = {}
+    for name, bench_args in benchmarks(source_dir).items():
+        if args.filter not in name:
+            continue
+        reports[name] = run(args.falco, args.config, args.loops, bench_args, labels)
+        print_report(name, reports[name])
+
+    if args.update_baselines:
+        with open(args.baselines, "w") as f:
+            json.dump(reports, f, indent=4, sort_keys=True)
+        return 0
+
+    with open(args.baselines) as f:
+        baselines = json.load(f)
+
+    failures = []
+    for name, report in reports.items():
+        if name not in baselines:
+            print("{}: no baseline, skipped".format(name))
+            continue
+        failures += compare(name, report, baselines[name], args.tolerance)
+
+    for failure in failures:
+        print("REGRESSION " + failure)
+
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,115 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <arpa/inet.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "cidr_set.h"
+
+// Matching addresses with state.range(0) /24 networks, with a
+// cidr_set and with a scan of the networks, as "in" compares an
+// address with each of the values of the list.
+
+struct ipv4_net
+{
+	uint32_t ip;
+	uint32_t netmask;
+};
+
+static std::vector<std::string> make_networks(int64_t n)
+{
+	std::vector<std::string> nets;
+
+	for(int64_t i = 0; i < n; i++)
+	{
+		nets.push_back("10." + std::to_string((i >> 8) & 0xff) + "." +
+			       std::to_string(i & 0xff) + ".0/24");
+	}
+
+	return nets;
+}
+
+// Addresses in and out of the networks
+static std::vector<uint32_t> make_addresses(int64_t n)
+{
+	std::vector<uint32_t> addrs;
+
+	for(int64_t i = 0; i < 256; i++)
+	{
+		addrs.push_back(htonl((10u << 24) | ((uint32_t) ((i * 7) % (n * 2)) << 8) | 1));
+	}
+
+	return addrs;
+}
+
+static void BM_cidr_set_match(benchmark::State &state)
+{
+	cidr_set set;
+	for(auto &net : make_networks(state.range(0)))
+	{
+		set.add(net);
+	}
+	std::vector<uint32_t> addrs = make_addresses(state.range(0));
+
+	for(auto _ : state)
+	{
+		for(auto &addr : addrs)
+		{
+			benchmark::DoNotOptimize(set.match_ipv4((const uint8_t *) &addr));
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * addrs.size());
+}
+BENCHMARK(BM_cidr_set_match)->RangeMultiplier(8)->Range(8, 8 << 9);
+
+static void BM_cidr_linear_match(benchmark::State &state)
+{
+	std::vector<ipv4_net> nets;
+	for(auto &net : make_networks(state.range(0)))
+	{
+		ipv4_net n;
+		size_t slash = net.find('/');
+		inet_pton(AF_INET, net.substr(0, slash).c_str(), &n.ip);
+		n.netmask = htonl(0xffffffffu << (32 - std::stoul(net.substr(slash + 1))));
+		nets.push_back(n);
+	}
+	std::vector<uint32_t> addrs = make_addresses(state.range(0));
+
+	for(auto _ : state)
+	{
+		for(auto &addr : addrs)
+		{
+			bool found = false;
+			for(auto &n : nets)
+			{
+				if((addr & n.netmask) == (n.ip & n.netmask))
+				{
+					found = true;
+					break;
+				}
+			}
+			benchmark::DoNotOptimize(found);
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * addrs.size());
+}
+BENCHMARK(BM_cidr_linear_match)->RangeMultiplier(8)->Range(8, 8 << 9);
@@ -0,0 +1,179 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <list>
+#include <memory>
+
+#include <benchmark/benchmark.h>
+
+#include <sinsp.h>
+#include <filter.h>
+#include <eventformatter.h>
+
+#include "falco_engine.h"
+#include "formats.h"
+#include "json_evt.h"
+#include "bench_utils.h"
+
+// Evaluation and formatting of the k8s audit events in
+// test/trace_files/k8s_audit against rules/k8s_audit_rules.yaml. The
+// events are split once between those matching a rule (hits) and
+// the others (misses).
+
+static std::string s_k8s_audit_source = "k8s_audit";
+
+struct k8s_audit_engine
+{
+	sinsp inspector;
+	std::unique_ptr<falco_engine> engine;
+	std::shared_ptr<gen_event_formatter_factory> formatter_factory;
+	std::list<json_event> hits;
+	std::list<json_event> misses;
+};
+
+// With programs false, the conditions are run by gen_event_filter
+// rather than compiled into filter_program
+static k8s_audit_engine &get_k8s_audit_engine(bool programs = true)
+{
+	static k8s_audit_engine engines[2];
+	k8s_audit_engine &e = engines[programs ? 1 : 0];
+
+	if(!e.engine)
+	{
+		e.engine.reset(new falco_engine(false));
+		e.engine->set_compile_programs(programs);
+
+		// As in falco, macros and lists are compiled for the
+		// syscall source too
+		std::shared_ptr<gen_event_filter_factory> syscall_filter_factory(new sinsp_filter_factory(&e.inspector));
+		std::shared_ptr<gen_event_formatter_factory> syscall_formatter_factory(new sinsp_evt_formatter_factory(&e.inspector));
+		std::shared_ptr<gen_event_filter_factory> k8s_audit_filter_factory(new json_event_filter_factory());
+		e.formatter_factory.reset(new json_event_formatter_factory(k8s_audit_filter_factory));
+
+		e.engine->add_source("syscall", syscall_filter_factory, syscall_formatter_factory);
+		e.engine->add_source(s_k8s_audit_source, k8s_audit_filter_factory, e.formatter_factory);
+		e.engine->load_rules_file(FALCO_RULES_DIR "/k8s_audit_rules.yaml", false, false);
+
+		for(auto &line : k8s_audit_trace_lines())
+		{
+			std::list<json_event> evts;
+			nlohmann::json j = nlohmann::json::parse(line);
+			falco_k8s_audit::parse_k8s_audit_json(j, evts);
+
+			for(auto &evt : evts)
+			{
+				if(e.engine->process_event(s_k8s_audit_source, &evt))
+				{
+					e.hits.push_back(evt);
+				}
+				else
+				{
+					e.misses.push_back(evt);
+				}
+			}
+		}
+	}
+
+	return e;
+}
+
+// The values extracted from each event are forgotten before
+// evaluating it again, as if every iteration saw new events.
+static void process_events(benchmark::State &state, falco_engine &engine, std::list<json_event> &evts)
+{
+	if(evts.empty())
+	{
+		state.SkipWithError("No events");
+		return;
+	}
+
+	for(auto _ : state)
+	{
+		for(auto &evt : evts)
+		{
+			evt.clear_extracted_values();
+			benchmark::DoNotOptimize(engine.process_event(s_k8s_audit_source, &evt));
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * evts.size());
+}
+
+// Arg: 0 for gen_event_filter, 1 for filter_program
+static void BM_engine_process_event_hit(benchmark::State &state)
+{
+	k8s_audit_engine &e = get_k8s_audit_engine(state.range(0) != 0);
+	process_events(state, *e.engine, e.hits);
+	state.SetLabel(state.range(0) ? "program" : "tree");
+}
+BENCHMARK(BM_engine_process_event_hit)->Arg(0)->Arg(1);
+
+static void BM_engine_process_event_miss(benchmark::State &state)
+{
+	k8s_audit_engine &e = get_k8s_audit_engine();
+	process_events(state, *e.engine, e.misses);
+}
+BENCHMARK(BM_engine_process_event_miss);
+
+// Arg: 0 for text output, 1 for json output. The output format is
+// built as in falco_outputs::handle_event().
+static void BM_formats_format_event(benchmark::State &state)
+{
+	k8s_audit_engine &e = get_k8s_audit_engine();
+	falco_formats formats(e.engine.get(), true, true);
+
+	struct alert
+	{
+		json_event *evt;
+		std::unique_ptr<falco_engine::rule_result> res;
+		std::string format;
+	};
+	std::list<alert> alerts;
+
+	for(auto &evt : e.hits)
+	{
+		alert a;
+		a.evt = &evt;
+		a.res = e.engine->process_event(s_k8s_audit_source, &evt);
+		a.format = "*%jevt.time: " + falco_common::priority_names[a.res->priority_num] + " " +
+			(a.res->format[0] == '*' ? a.res->format.substr(1) : a.res->format);
+		alerts.push_back(std::move(a));
+	}
+
+	if(alerts.empty())
+	{
+		state.SkipWithError("No events");
+		return;
+	}
+
+	e.formatter_factory->set_output_format(state.range(0) ? gen_event_formatter::OF_JSON : gen_event_formatter::OF_NORMAL);
+
+	for(auto _ : state)
+	{
+		for(auto &a : alerts)
+		{
+			benchmark::DoNotOptimize(formats.format_event(a.evt, a.res->rule, a.res->source,
+								      falco_common::priority_names[a.res->priority_num],
+								      a.format, a.res->tags));
+		}
+	}
+
+	e.formatter_factory->set_output_format(gen_event_formatter::OF_NORMAL);
+
+	state.SetItemsProcessed(state.iterations() * alerts.size());
+	state.SetLabel(state.range(0) ? "json" : "text");
+}
+BENCHMARK(BM_formats_format_event)->Arg(0)->Arg(1);
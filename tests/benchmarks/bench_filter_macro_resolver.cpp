@@ -0,0 +1,125 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <memory>
+
+#include <benchmark/benchmark.h>
+#include <yaml-cpp/yaml.h>
+
+#include "filter_macro_resolver.h"
+
+using namespace libsinsp::filter;
+
+// Macro resolution for all the rules of rules/falco_rules.yaml
+
+struct parsed_rules
+{
+	std::vector<std::pair<std::string, std::shared_ptr<ast::expr>>> macros;
+	std::vector<std::shared_ptr<ast::expr>> rules;
+};
+
+static std::shared_ptr<ast::expr> parse_condition(const std::string &cond)
+{
+	try
+	{
+		parser p(cond);
+		return std::shared_ptr<ast::expr>(p.parse());
+	}
+	catch(...)
+	{
+		return nullptr;
+	}
+}
+
+static const parsed_rules &get_falco_rules()
+{
+	static parsed_rules parsed;
+	static bool loaded = false;
+
+	if(!loaded)
+	{
+		YAML::Node doc = YAML::LoadFile(FALCO_RULES_DIR "/falco_rules.yaml");
+		for(auto item : doc)
+		{
+			if(!item.IsMap() || !item["condition"])
+			{
+				continue;
+			}
+
+			auto ast = parse_condition(item["condition"].as<std::string>());
+			if(!ast)
+			{
+				continue;
+			}
+
+			if(item["macro"])
+			{
+				parsed.macros.emplace_back(item["macro"].as<std::string>(), ast);
+			}
+			else if(item["rule"])
+			{
+				parsed.rules.push_back(ast);
+			}
+		}
+		loaded = true;
+	}
+
+	return parsed;
+}
+
+// Rule conditions are cloned for every run, as the resolver modifies
+// them. BM_filter_clone_falco_rules measures the clones alone.
+static void BM_filter_macro_resolver_falco_rules(benchmark::State &state)
+{
+	const parsed_rules &parsed = get_falco_rules();
+	filter_macro_resolver resolver;
+
+	for(auto &m : parsed.macros)
+	{
+		resolver.set_macro(m.first, m.second);
+	}
+
+	for(auto _ : state)
+	{
+		for(auto &rule : parsed.rules)
+		{
+			ast::expr *filter = ast::clone(rule.get());
+			benchmark::DoNotOptimize(resolver.run(filter));
+			delete filter;
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * parsed.rules.size());
+}
+BENCHMARK(BM_filter_macro_resolver_falco_rules);
+
+static void BM_filter_clone_falco_rules(benchmark::State &state)
+{
+	const parsed_rules &parsed = get_falco_rules();
+
+	for(auto _ : state)
+	{
+		for(auto &rule : parsed.rules)
+		{
+			ast::expr *filter = ast::clone(rule.get());
+			benchmark::DoNotOptimize(filter);
+			delete filter;
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * parsed.rules.size());
+}
+BENCHMARK(BM_filter_clone_falco_rules);
@@ -0,0 +1,141 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include <sinsp.h>
+#include <filter.h>
+#include <filter/parser.h>
+
+#include "filter_program.h"
+#include "test_utils.h"
+
+// Running a condition shaped like the rules once their macros are
+// expanded, with the tree of gen_event_filter and with a
+// filter_program. The checks look up a field in a small map, so that
+// the time mostly goes to walking the condition rather than to
+// extracting fields.
+
+// As "spawned_process and container and not proc.name in (...) and
+// not (user_known_x or user_known_y) and ...", with c0 repeated as
+// the same macros are often used several times
+static const std::string s_condition =
+	"c0 = 1 and c1 = 1 and not c2 = 1 "
+	"and not (c3 = 1 or c4 = 1 or (c5 = 1 and c6 = 1)) "
+	"and (c7 = 1 or c8 = 1 or c9 = 1) "
+	"and not (c0 = 1 and c10 = 1) "
+	"and not (c11 = 1 or c12 = 1 or c13 = 1 or c14 = 1) "
+	"and c15 = 1";
+
+// The bits of the checks cN of the condition above that are true on
+// the event for which every check is evaluated, and the condition is
+// false on the last one
+static const uint64_t s_true_checks = (1 << 0) | (1 << 1) | (1 << 9);
+static const int s_num_checks = 16;
+
+// Arg: 0 for gen_event_filter, 1 for filter_program
+static void BM_filter_run(benchmark::State &state)
+{
+	std::shared_ptr<gen_event_filter_factory> factory(new test_filter_factory());
+	libsinsp::filter::parser p(s_condition);
+	std::unique_ptr<libsinsp::filter::ast::expr> ast(p.parse());
+
+	sinsp_filter_compiler compiler(factory, ast.get());
+	std::unique_ptr<gen_event_filter> filter(compiler.compile());
+	filter_program program(ast.get(), factory, 0);
+
+	test_event evt;
+	for(int i = 0; i < s_num_checks; i++)
+	{
+		evt.fields["c" + std::to_string(i)] = ((s_true_checks >> i) & 1) ? "1" : "0";
+	}
+
+	if(state.range(0) == 0)
+	{
+		for(auto _ : state)
+		{
+			benchmark::DoNotOptimize(filter->run(&evt));
+		}
+	}
+	else
+	{
+		for(auto _ : state)
+		{
+			benchmark::DoNotOptimize(program.run(&evt));
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations());
+	state.SetLabel(state.range(0) ? "program" : "tree");
+}
+BENCHMARK(BM_filter_run)->Arg(0)->Arg(1);
+
+// As "not user_known_x and not user_known_y and ...", where each macro
+// checks "proc.name in (...)" with its own list, and the name is in
+// none of them
+static const std::string s_name_condition =
+	"not f in (n0, n1, n2, n3, n4, n5) and not f in (n6, n7, n8, n9, n10, n11) "
+	"and not f in (n12, n13, n14, n15, n16, n17) and not f in (n18, n19, n20, n21, n22, n23) "
+	"and not f in (n24, n25, n26, n27, n28, n29) and not f in (n30, n31, n32, n33, n34, n35) "
+	"and not f in (n36, n37, n38, n39, n40, n41) and not f in (n42, n43, n44, n45, n46, n47)";
+
+// Arg: 0 for gen_event_filter, 1 for filter_program, 2 for
+// filter_program extracting f once for all its checks
+static void BM_filter_run_string_field(benchmark::State &state)
+{
+	std::shared_ptr<gen_event_filter_factory> factory(new test_filter_factory());
+	libsinsp::filter::parser p(s_name_condition);
+	std::unique_ptr<libsinsp::filter::ast::expr> ast(p.parse());
+
+	sinsp_filter_compiler compiler(factory, ast.get());
+	std::unique_ptr<gen_event_filter> filter(compiler.compile());
+	filter_program program(ast.get(), factory, 0,
+		[&state](const std::string &field)
+		{
+			std::shared_ptr<rule_guard_field> ret;
+			if(state.range(0) == 2)
+			{
+				ret = std::make_shared<test_string_field>(field);
+			}
+			return ret;
+		});
+
+	test_event evt;
+	evt.fields["f"] = "bash";
+
+	if(state.range(0) == 0)
+	{
+		for(auto _ : state)
+		{
+			benchmark::DoNotOptimize(filter->run(&evt));
+		}
+	}
+	else
+	{
+		for(auto _ : state)
+		{
+			benchmark::DoNotOptimize(program.run(&evt));
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations());
+	const char *labels[] = {"tree", "program", "program, string field"};
+	state.SetLabel(labels[state.range(0)]);
+}
+BENCHMARK(BM_filter_run_string_field)->Arg(0)->Arg(1)->Arg(2);
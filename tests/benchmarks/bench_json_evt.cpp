@@ -0,0 +1,277 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+
+#include <memory>
+
+#include <benchmark/benchmark.h>
+
+#include "json_evt.h"
+#include "bench_utils.h"
+
+// Parsing and field extraction for k8s audit events, over all the
+// events in test/trace_files/k8s_audit.
+
+static void set_counters(benchmark::State &state, uint64_t num_evts)
+{
+	int64_t bytes = 0;
+	for(auto &line : k8s_audit_trace_lines())
+	{
+		bytes += line.size();
+	}
+
+	state.SetItemsProcessed(state.iterations() * num_evts);
+	state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+static void BM_k8s_audit_parse_nlohmann(benchmark::State &state)
+{
+	uint64_t num_evts = 0;
+
+	for(auto _ : state)
+	{
+		num_evts = 0;
+		for(auto &line : k8s_audit_trace_lines())
+		{
+			std::list<json_event> evts;
+			nlohmann::json j = nlohmann::json::parse(line);
+			falco_k8s_audit::parse_k8s_audit_json(j, evts);
+			num_evts += evts.size();
+			benchmark::DoNotOptimize(evts);
+		}
+	}
+
+	set_counters(state, num_evts);
+}
+BENCHMARK(BM_k8s_audit_parse_nlohmann);
+
+static void BM_k8s_audit_parse_stream(benchmark::State &state)
+{
+	uint64_t num_evts = 0;
+
+	for(auto _ : state)
+	{
+		num_evts = 0;
+		for(auto &line : k8s_audit_trace_lines())
+		{
+			falco_k8s_audit::event_stream_parser parser;
+			std::string errstr;
+			size_t pos = 0;
+
+			auto reader = [&line, &pos](char *buf, size_t len) -> int64_t {
+				size_t n = std::min(len, line.size() - pos);
+				memcpy(buf, line.data() + pos, n);
+				pos += n;
+				return n;
+			};
+
+			auto cb = [](json_event &evt, std::string &errstr) -> bool {
+				benchmark::DoNotOptimize(evt);
+				return true;
+			};
+
+			parser.parse(reader, cb, errstr);
+			num_evts += parser.num_events();
+		}
+	}
+
+	set_counters(state, num_evts);
+}
+BENCHMARK(BM_k8s_audit_parse_stream);
+
+#ifdef HAS_SIMDJSON
+static void BM_k8s_audit_parse_simdjson(benchmark::State &state)
+{
+	simdjson::dom::parser parser;
+	uint64_t num_evts = 0;
+
+	for(auto _ : state)
+	{
+		num_evts = 0;
+		for(auto &line : k8s_audit_trace_lines())
+		{
+			std::list<json_event> evts;
+			std::string errstr;
+			falco_k8s_audit::parse_k8s_audit_data(parser, line.data(), line.size(), evts, errstr);
+			num_evts += evts.size();
+			benchmark::DoNotOptimize(evts);
+		}
+	}
+
+	set_counters(state, num_evts);
+}
+BENCHMARK(BM_k8s_audit_parse_simdjson);
+#endif
+
+// Fields commonly used by the k8s audit rules
+static const std::vector<std::string> s_extract_fields = {
+	"ka.verb",
+	"ka.user.name",
+	"ka.target.resource",
+	"ka.target.namespace",
+	"ka.req.pod.containers.image",
+	"ka.req.pod.containers.privileged",
+	"jevt.value[/objectRef/name]"};
+
+// Unless memoize is true, the values extracted from each event are
+// forgotten before evaluating it again, as if every iteration saw new
+// events.
+static void extract_all(benchmark::State &state, std::list<json_event> &evts, bool memoize)
+{
+	json_event_filter_factory factory;
+	std::list<std::unique_ptr<gen_event_filter_check>> checks;
+
+	for(auto &field : s_extract_fields)
+	{
+		checks.emplace_back(factory.new_filtercheck(field.c_str()));
+	}
+
+	for(auto _ : state)
+	{
+		for(auto &evt : evts)
+		{
+			if(!memoize)
+			{
+				evt.clear_extracted_values();
+			}
+
+			for(auto &chk : checks)
+			{
+				std::vector<extract_value_t> values;
+				chk->extract(&evt, values);
+				benchmark::DoNotOptimize(values);
+			}
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * evts.size());
+}
+
+static void BM_k8s_audit_extract_nlohmann(benchmark::State &state)
+{
+	std::list<json_event> evts;
+
+	for(auto &line : k8s_audit_trace_lines())
+	{
+		nlohmann::json j = nlohmann::json::parse(line);
+		falco_k8s_audit::parse_k8s_audit_json(j, evts);
+	}
+
+	extract_all(state, evts, state.range(0));
+}
+BENCHMARK(BM_k8s_audit_extract_nlohmann)->Arg(0)->Arg(1);
+
+#ifdef HAS_SIMDJSON
+static void BM_k8s_audit_extract_simdjson(benchmark::State &state)
+{
+	simdjson::dom::parser parser;
+	std::list<json_event> evts;
+	std::string errstr;
+
+	for(auto &line : k8s_audit_trace_lines())
+	{
+		falco_k8s_audit::parse_k8s_audit_data(parser, line.data(), line.size(), evts, errstr);
+	}
+
+	extract_all(state, evts, state.range(0));
+}
+BENCHMARK(BM_k8s_audit_extract_simdjson)->Arg(0)->Arg(1);
+#endif
+
+// Cost of each comparison operator on its own. The values extracted
+// from the event are memoized, so after the first iteration only the
+// comparison itself is measured.
+struct compare_case
+{
+	const char *label;
+	const char *field;
+	cmpop op;
+	std::vector<std::string> values;
+};
+
+static std::vector<std::string> many_values(const std::string &prefix, size_t num, const std::string &last)
+{
+	std::vector<std::string> ret;
+
+	for(size_t i = 0; i < num; i++)
+	{
+		ret.push_back(prefix + std::to_string(i));
+	}
+	ret.push_back(last);
+
+	return ret;
+}
+
+static const std::vector<compare_case> s_compare_cases = {
+	{"eq", "ka.verb", CO_EQ, {"create"}},
+	{"ne", "ka.verb", CO_NE, {"delete"}},
+	{"in_small", "ka.verb", CO_IN, {"get", "list", "create"}},
+	{"in_large", "ka.target.namespace", CO_IN, many_values("ns-", 100, "kube-system")},
+	{"intersects_small", "ka.user.groups", CO_INTERSECTS, {"system:masters", "system:nodes"}},
+	{"intersects_large", "ka.user.groups", CO_INTERSECTS, many_values("group-", 100, "system:nodes")},
+	{"startswith", "ka.req.pod.containers.image", CO_STARTSWITH, {"docker.io/"}},
+	{"contains", "ka.target.name", CO_CONTAINS, {"sensitive"}},
+	{"lt", "ka.response.code", CO_LT, {"400"}},
+	{"eq_range", "ka.response.code", CO_EQ, {"200:299"}},
+	{"exists", "ka.target.name", CO_EXISTS, {}},
+	{"pmatch", "ka.req.pod.volumes.hostpath", CO_PMATCH, {"/proc", "/var/run/docker.sock", "/"}}};
+
+static void BM_k8s_audit_compare(benchmark::State &state)
+{
+	const compare_case &cc = s_compare_cases[state.range(0)];
+
+	nlohmann::json j = nlohmann::json::parse(R"({"kind":"Event","stageTimestamp":"2019-07-01T00:00:00.000000Z",)"
+		R"("verb":"create","user":{"username":"u","groups":["system:authenticated","system:nodes","tenant-a"]},)"
+		R"("objectRef":{"resource":"pods","namespace":"kube-system","name":"my-sensitive-pod"},)"
+		R"("requestObject":{"spec":{"containers":[{"image":"docker.io/nginx"}],)"
+		R"("volumes":[{"hostPath":{"path":"/var/lib/data"}}]}},"responseStatus":{"code":201}})");
+	std::list<json_event> evts;
+	falco_k8s_audit::parse_k8s_audit_json(j, evts);
+
+	json_event_filter_factory factory;
+	std::unique_ptr<gen_event_filter_check> chk(factory.new_filtercheck(cc.field));
+	chk->m_cmpop = cc.op;
+	for(auto &val : cc.values)
+	{
+		chk->add_filter_value(val.c_str(), val.size() + 1);
+	}
+
+	for(auto _ : state)
+	{
+		benchmark::DoNotOptimize(chk->compare(&evts.front()));
+	}
+
+	state.SetLabel(cc.label);
+}
+BENCHMARK(BM_k8s_audit_compare)->DenseRange(0, s_compare_cases.size() - 1);
+
+// Cost of building values from strings, as done for every value
+// extracted from an event.
+static void BM_json_event_value(benchmark::State &state)
+{
+	static const std::vector<std::string> strs = {"create", "system:serviceaccount:kube-system:default", "201", "200:299"};
+	const std::string &str = strs[state.range(0)];
+
+	for(auto _ : state)
+	{
+		json_event_value val(str);
+		benchmark::DoNotOptimize(val);
+	}
+
+	state.SetLabel(str);
+}
+BENCHMARK(BM_json_event_value)->DenseRange(0, 3);
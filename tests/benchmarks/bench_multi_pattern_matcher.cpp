@@ -0,0 +1,95 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "multi_pattern_matcher.h"
+
+// Finding state.range(0) patterns in command lines, with a
+// multi_pattern_matcher and with a search for each pattern, as
+// "proc.cmdline contains a or proc.cmdline contains b ..." does.
+
+static std::vector<std::string> make_patterns(int64_t n)
+{
+	std::vector<std::string> patterns;
+
+	for(int64_t i = 0; i < n; i++)
+	{
+		patterns.push_back("--option-" + std::to_string(i));
+	}
+
+	return patterns;
+}
+
+static const std::vector<std::string> s_cmdlines = {
+	"/usr/bin/python3 -m http.server --bind 127.0.0.1 --directory /var/www 8080",
+	"bash -c curl -s https://example.com/install.sh | sh",
+	"/usr/lib/jvm/java-11/bin/java -Xmx2g -jar /opt/app/app.jar --spring.profiles.active=prod",
+	"nginx: worker process",
+};
+
+static void BM_multi_pattern_matcher_scan(benchmark::State &state)
+{
+	multi_pattern_matcher m;
+	for(auto &p : make_patterns(state.range(0)))
+	{
+		m.add(p);
+	}
+
+	for(auto _ : state)
+	{
+		// Every command line differs from the previous one, so
+		// every scan is done
+		for(auto &cmdline : s_cmdlines)
+		{
+			m.scan(cmdline.c_str(), cmdline.size());
+			benchmark::DoNotOptimize(m.matches(0));
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * s_cmdlines.size());
+}
+BENCHMARK(BM_multi_pattern_matcher_scan)->RangeMultiplier(4)->Range(4, 1024);
+
+static void BM_multi_pattern_strstr(benchmark::State &state)
+{
+	std::vector<std::string> patterns = make_patterns(state.range(0));
+
+	for(auto _ : state)
+	{
+		for(auto &cmdline : s_cmdlines)
+		{
+			bool found = false;
+			for(auto &p : patterns)
+			{
+				if(strstr(cmdline.c_str(), p.c_str()) != NULL)
+				{
+					found = true;
+					break;
+				}
+			}
+			benchmark::DoNotOptimize(found);
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * s_cmdlines.size());
+}
+BENCHMARK(BM_multi_pattern_strstr)->RangeMultiplier(4)->Range(4, 1024);
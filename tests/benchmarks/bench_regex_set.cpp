@@ -0,0 +1,96 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <re2/re2.h>
+
+#include "regex_set.h"
+
+// Matching state.range(0) regexes with command lines, with a
+// regex_set and with each regex on its own.
+
+static std::vector<std::string> make_regexes(int64_t n)
+{
+	std::vector<std::string> regexes;
+
+	for(int64_t i = 0; i < n; i++)
+	{
+		regexes.push_back("--opt(ion)?-" + std::to_string(i) + "=[a-z]+");
+	}
+
+	return regexes;
+}
+
+static const std::vector<std::string> s_cmdlines = {
+	"/usr/bin/python3 -m http.server --bind 127.0.0.1 --directory /var/www 8080",
+	"bash -c curl -s https://example.com/install.sh | sh",
+	"/usr/lib/jvm/java-11/bin/java -Xmx2g -jar /opt/app/app.jar --spring.profiles.active=prod",
+	"nginx: worker process",
+};
+
+static void BM_regex_set_scan(benchmark::State &state)
+{
+	regex_set set;
+	for(auto &re : make_regexes(state.range(0)))
+	{
+		set.add(re);
+	}
+
+	for(auto _ : state)
+	{
+		for(auto &cmdline : s_cmdlines)
+		{
+			set.scan(cmdline.c_str(), cmdline.size());
+			benchmark::DoNotOptimize(set.matches(0));
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * s_cmdlines.size());
+}
+BENCHMARK(BM_regex_set_scan)->RangeMultiplier(4)->Range(4, 256);
+
+static void BM_regex_each(benchmark::State &state)
+{
+	std::vector<std::unique_ptr<RE2>> regexes;
+	for(auto &re : make_regexes(state.range(0)))
+	{
+		regexes.emplace_back(new RE2(re));
+	}
+
+	for(auto _ : state)
+	{
+		for(auto &cmdline : s_cmdlines)
+		{
+			bool found = false;
+			for(auto &re : regexes)
+			{
+				if(RE2::PartialMatch(cmdline, *re))
+				{
+					found = true;
+					break;
+				}
+			}
+			benchmark::DoNotOptimize(found);
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations() * s_cmdlines.size());
+}
+BENCHMARK(BM_regex_each)->RangeMultiplier(4)->Range(4, 256);
@@ -0,0 +1,143 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <benchmark/benchmark.h>
+
+#include "ruleset.h"
+
+// Cost of dispatching an event to the rules of a ruleset, with
+// filters that cost next to nothing and never match, so that every
+// candidate rule is evaluated.
+
+static const uint16_t s_num_evttypes = 9;
+static const uint16_t s_ruled_evttype = 1;
+static const uint16_t s_unruled_evttype = 100;
+
+class bench_event : public gen_event
+{
+public:
+	bench_event(uint16_t type):
+		m_type(type)
+	{
+	}
+
+	uint16_t get_source() const
+	{
+		return 0;
+	}
+
+	uint16_t get_type() const
+	{
+		return m_type;
+	}
+
+	uint64_t get_ts() const
+	{
+		return 0;
+	}
+
+private:
+	uint16_t m_type;
+};
+
+class bench_filter : public gen_event_filter
+{
+public:
+	bench_filter(std::set<uint16_t> evttypes):
+		m_evttypes(evttypes)
+	{
+	}
+
+	bool run(gen_event *evt)
+	{
+		benchmark::DoNotOptimize(evt);
+		return false;
+	}
+
+	std::set<uint16_t> evttypes()
+	{
+		return m_evttypes;
+	}
+
+private:
+	std::set<uint16_t> m_evttypes;
+};
+
+// One rule out of 10 applies to all event types, the others to one
+// of s_num_evttypes event types (from 1).
+static void add_rules(falco_ruleset &r, int64_t num_rules)
+{
+	std::string source = "syscall";
+	std::set<std::string> tags;
+
+	for(int64_t i = 0; i < num_rules; i++)
+	{
+		std::string name = "rule_" + std::to_string(i);
+		std::set<uint16_t> evttypes;
+		if(i % 10 != 9)
+		{
+			evttypes.insert(1 + (i % s_num_evttypes));
+		}
+
+		r.add(source, name, tags, std::make_shared<bench_filter>(evttypes));
+		r.enable(name, true, true);
+	}
+}
+
+// Args: number of rules, and whether the event type has rules of its
+// own (0) or only runs the rules for all event types (1).
+static void BM_ruleset_run(benchmark::State &state)
+{
+	falco_ruleset r;
+	add_rules(r, state.range(0));
+	bench_event evt(state.range(1) == 0 ? s_ruled_evttype : s_unruled_evttype);
+
+	for(auto _ : state)
+	{
+		benchmark::DoNotOptimize(r.run(&evt));
+	}
+
+	state.SetItemsProcessed(state.iterations());
+}
+
+// Same with per-rule profiling enabled
+static void BM_ruleset_run_profiled(benchmark::State &state)
+{
+	falco_ruleset r;
+	add_rules(r, state.range(0));
+	r.enable_profiling(true);
+	bench_event evt(state.range(1) == 0 ? s_ruled_evttype : s_unruled_evttype);
+
+	for(auto _ : state)
+	{
+		benchmark::DoNotOptimize(r.run(&evt));
+	}
+
+	state.SetItemsProcessed(state.iterations());
+}
+
+static void ruleset_args(benchmark::internal::Benchmark *b)
+{
+	for(int64_t num_rules : {10, 100, 1000})
+	{
+		for(int64_t evttype : {0, 1})
+		{
+			b->Args({num_rules, evttype});
+		}
+	}
+}
+BENCHMARK(BM_ruleset_run)->Apply(ruleset_args);
+BENCHMARK(BM_ruleset_run_profiled)->Apply(ruleset_args);
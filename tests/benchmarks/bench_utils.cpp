@@ -0,0 +1,68 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include <benchmark/benchmark.h>
+
+#include "bench_utils.h"
+
+const std::vector<std::string> &k8s_audit_trace_lines()
+{
+	static std::vector<std::string> lines;
+
+	if(lines.empty())
+	{
+		DIR *dir = opendir(FALCO_K8S_AUDIT_TRACE_DIR);
+		if(dir == NULL)
+		{
+			return lines;
+		}
+
+		std::vector<std::string> names;
+		struct dirent *ent;
+		while((ent = readdir(dir)) != NULL)
+		{
+			std::string name = ent->d_name;
+			if(name.size() >= 5 && name.compare(name.size() - 5, 5, ".json") == 0)
+			{
+				names.push_back(name);
+			}
+		}
+		closedir(dir);
+		std::sort(names.begin(), names.end());
+
+		for(auto &name : names)
+		{
+			std::ifstream ifs(std::string(FALCO_K8S_AUDIT_TRACE_DIR) + "/" + name);
+			std::string line;
+			while(std::getline(ifs, line))
+			{
+				if(!line.empty())
+				{
+					lines.push_back(line);
+				}
+			}
+		}
+	}
+
+	return lines;
+}
+
+BENCHMARK_MAIN();
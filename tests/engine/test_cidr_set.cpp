@@ -0,0 +1,99 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <arpa/inet.h>
+
+#include "cidr_set.h"
+#include <catch.hpp>
+
+TEST_CASE("Addresses are matched with the networks of a cidr_set", "[cidr_set]")
+{
+	cidr_set set;
+
+	REQUIRE(set.add("10.0.0.0/8"));
+	REQUIRE(set.add("192.168.1.0/24"));
+	REQUIRE(set.add("192.168.1.128/25"));
+	REQUIRE(set.add("8.8.8.8"));
+	REQUIRE(set.add("fd00::/8"));
+	REQUIRE(set.add("2001:db8::1/128"));
+	REQUIRE(set.size() == 6);
+
+	REQUIRE(set.match("10.1.2.3"));
+	REQUIRE(set.match("192.168.1.200"));
+	REQUIRE(set.match("8.8.8.8"));
+	REQUIRE_FALSE(set.match("8.8.8.9"));
+	REQUIRE_FALSE(set.match("192.168.2.1"));
+	REQUIRE_FALSE(set.match("11.0.0.1"));
+
+	REQUIRE(set.match("fd12:3456::1"));
+	REQUIRE(set.match("2001:db8::1"));
+	REQUIRE_FALSE(set.match("2001:db8::2"));
+	REQUIRE_FALSE(set.match("fe80::1"));
+
+	// IPv4-mapped addresses are matched with the IPv4 networks
+	REQUIRE(set.match("::ffff:10.0.0.1"));
+	REQUIRE_FALSE(set.match("::ffff:11.0.0.1"));
+
+	REQUIRE_FALSE(set.match("not an address"));
+	REQUIRE_FALSE(set.match(""));
+
+	// Binary addresses, as extracted by the syscall fields
+	uint8_t addr[16];
+	REQUIRE(inet_pton(AF_INET, "10.255.0.1", addr) == 1);
+	REQUIRE(set.match_ipv4(addr));
+	REQUIRE(inet_pton(AF_INET6, "fdff::1", addr) == 1);
+	REQUIRE(set.match_ipv6(addr));
+}
+
+TEST_CASE("The whole address space can be matched", "[cidr_set]")
+{
+	cidr_set set;
+
+	REQUIRE(set.add("0.0.0.0/0"));
+	REQUIRE(set.match("1.2.3.4"));
+	REQUIRE_FALSE(set.match("::1"));
+}
+
+TEST_CASE("Networks are validated", "[cidr_set]")
+{
+	cidr_set set;
+
+	REQUIRE_FALSE(set.add("10.0.0.0/33"));
+	REQUIRE_FALSE(set.add("10.0.0/8"));
+	REQUIRE_FALSE(set.add("fd00::/129"));
+	REQUIRE_FALSE(set.add("10.0.0.0/"));
+	REQUIRE_FALSE(set.add("10.0.0.0/-1"));
+	REQUIRE(set.size() == 0);
+
+	REQUIRE(cidr_set::is_cidr("10.0.0.0/8"));
+	REQUIRE(cidr_set::is_cidr("::/0"));
+	REQUIRE_FALSE(cidr_set::is_cidr("10.0.0.1"));
+	REQUIRE_FALSE(cidr_set::is_cidr("/usr/bin"));
+	REQUIRE_FALSE(cidr_set::is_cidr("a/b"));
+}
+
+TEST_CASE("cidr_sets with the same networks are shared", "[cidr_set]")
+{
+	cidr_set_cache cache;
+
+	auto a = cache.get({"10.0.0.0/8", "fd00::/8"});
+	auto b = cache.get({"10.0.0.0/8", "fd00::/8"});
+	auto c = cache.get({"10.0.0.0/8"});
+
+	REQUIRE(a == b);
+	REQUIRE(a != c);
+	REQUIRE(a->size() == 2);
+}
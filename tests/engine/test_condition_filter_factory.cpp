@@ -0,0 +1,183 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "condition_filter_factory.h"
+#include <catch.hpp>
+
+using namespace std;
+using namespace libsinsp::filter::ast;
+
+// A check accepting any field name, never extracting anything
+class any_field_check : public gen_event_filter_check
+{
+public:
+	int32_t parse_field_name(const char *str, bool alloc_state, bool needed_for_filtering)
+	{
+		return strlen(str);
+	}
+
+	void add_filter_value(const char *str, uint32_t len, uint32_t i = 0)
+	{
+	}
+
+	bool compare(gen_event *evt)
+	{
+		return false;
+	}
+
+	bool extract(gen_event *evt, std::vector<extract_value_t> &values, bool sanitize_strings = true)
+	{
+		return false;
+	}
+};
+
+// Lists a few fields of the syscall source, as sinsp_filter_factory
+// does
+class listed_fields_factory : public gen_event_filter_factory
+{
+public:
+	gen_event_filter *new_filter()
+	{
+		return NULL;
+	}
+
+	gen_event_filter_check *new_filtercheck(const char *fldname)
+	{
+		return new any_field_check();
+	}
+
+	std::list<gen_event_filter_factory::filter_fieldclass_info> get_fields()
+	{
+		gen_event_filter_factory::filter_fieldclass_info fd;
+		fd.name = "fd";
+		fd.fields.push_back({"fd.sip", "", "IPV4ADDR", {}});
+		fd.fields.push_back({"fd.snet", "", "IPNET", {}});
+		fd.fields.push_back({"fd.net", "", "IPNET", {"FILTER ONLY"}});
+		fd.fields.push_back({"fd.name", "", "CHARBUF", {}});
+		gen_event_filter_factory::filter_fieldclass_info proc;
+		proc.name = "proc";
+		proc.fields.push_back({"proc.name", "", "CHARBUF", {}});
+		proc.fields.push_back({"proc.aname", "", "CHARBUF", {}});
+		return {fd, proc};
+	}
+};
+
+TEST_CASE("Should only wrap the address fields with in_cidr", "[condition_filter_factory]")
+{
+	auto factory = std::make_shared<listed_fields_factory>();
+	auto types = condition_filter_factory::list_field_types(*factory);
+
+	REQUIRE(types["fd.sip"] == "IPV4ADDR");
+	REQUIRE(types["fd.name"] == "CHARBUF");
+
+	// Filter-only fields can't be extracted
+	REQUIRE(types["fd.net"] == "");
+
+	condition_filter_factory cfactory("syscall", factory,
+		[&types](const string &field)
+		{
+			return types[field];
+		},
+		{}, std::make_shared<cidr_set_cache>(),
+		std::make_shared<multi_pattern_index>(),
+		std::make_shared<regex_set_index>());
+
+	REQUIRE(cfactory.supports_cidr("fd.sip"));
+	REQUIRE(cfactory.supports_cidr("fd.snet"));
+	REQUIRE_FALSE(cfactory.supports_cidr("fd.net"));
+	REQUIRE_FALSE(cfactory.supports_cidr("fd.name"));
+	REQUIRE_FALSE(cfactory.supports_cidr("fd.unknown"));
+}
+
+TEST_CASE("Should only group the patterns of fields comparing their values", "[condition_filter_factory]")
+{
+	auto factory = std::make_shared<listed_fields_factory>();
+	auto types = condition_filter_factory::list_field_types(*factory);
+	condition_filter_factory cfactory("syscall", factory,
+		[&types](const string &field)
+		{
+			return types[field];
+		},
+		{}, std::make_shared<cidr_set_cache>(),
+		std::make_shared<multi_pattern_index>(),
+		std::make_shared<regex_set_index>());
+
+	REQUIRE(cfactory.supports_multi_pattern("proc.name"));
+	REQUIRE(cfactory.supports_multi_pattern("proc.aname[1]"));
+	REQUIRE_FALSE(cfactory.supports_multi_pattern("proc.aname"));
+	REQUIRE_FALSE(cfactory.supports_multi_pattern("fd.sip"));
+}
+
+TEST_CASE("Should only guard the rules with fields comparing their values", "[condition_filter_factory]")
+{
+	auto factory = std::make_shared<listed_fields_factory>();
+	auto types = condition_filter_factory::list_field_types(*factory);
+	condition_filter_factory cfactory("syscall", factory,
+		[&types](const string &field)
+		{
+			return types[field];
+		},
+		{}, std::make_shared<cidr_set_cache>(),
+		std::make_shared<multi_pattern_index>(),
+		std::make_shared<regex_set_index>());
+	auto new_guard_field = [&cfactory](const string &field, const vector<string> &values)
+	{
+		return cfactory.new_guard_field(field, values);
+	};
+
+	REQUIRE(cfactory.new_guard_field("proc.name", {"sshd"}));
+	REQUIRE(cfactory.new_guard_field("proc.aname[2]", {"sshd"}));
+
+	// proc.aname = sshd is true when any ancestor is sshd, while
+	// only the parent is extracted
+	REQUIRE_FALSE(cfactory.new_guard_field("proc.aname", {"sshd"}));
+
+	expr *filter = new and_expr({
+		new binary_check_expr("proc.aname", "", "=",
+			new value_expr("sshd")),
+		new binary_check_expr("proc.name", "", "in",
+			new list_expr({"bash", "sh"})),
+	});
+	auto guard = rule_guard::find(filter, new_guard_field);
+	REQUIRE(guard);
+	REQUIRE(guard->field() == "proc.name");
+	delete filter;
+
+	filter = new binary_check_expr("proc.aname", "", "=",
+		new value_expr("sshd"));
+	REQUIRE_FALSE(rule_guard::find(filter, new_guard_field));
+	delete filter;
+}
+
+TEST_CASE("Should only extract the string fields comparing their values", "[condition_filter_factory]")
+{
+	auto factory = std::make_shared<listed_fields_factory>();
+	auto types = condition_filter_factory::list_field_types(*factory);
+	condition_filter_factory cfactory("syscall", factory,
+		[&types](const string &field)
+		{
+			return types[field];
+		},
+		{}, std::make_shared<cidr_set_cache>(),
+		std::make_shared<multi_pattern_index>(),
+		std::make_shared<regex_set_index>());
+
+	REQUIRE(cfactory.new_string_field("proc.name"));
+	REQUIRE(cfactory.new_string_field("proc.aname[2]"));
+	REQUIRE_FALSE(cfactory.new_string_field("proc.aname"));
+	REQUIRE_FALSE(cfactory.new_string_field("fd.sip"));
+	REQUIRE_FALSE(cfactory.new_string_field("fd.unknown"));
+}
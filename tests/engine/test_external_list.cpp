@@ -0,0 +1,135 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <vector>
+
+#include "external_list.h"
+#include "falco_common.h"
+#include <catch.hpp>
+
+static std::string temp_path()
+{
+	char path[] = "/tmp/falco-test-list-XXXXXX";
+	int fd = mkstemp(path);
+	REQUIRE(fd >= 0);
+	close(fd);
+	return path;
+}
+
+static void write_file(const std::string &path, const std::string &content)
+{
+	std::ofstream out(path, std::ios::trunc);
+	out << content;
+}
+
+static bool contains(external_list &list, const std::string &value)
+{
+	return list.contains(value.c_str(), value.size());
+}
+
+TEST_CASE("External lists are read from text files", "[external_list]")
+{
+	std::string path = temp_path();
+	write_file(path, "# comment\n44d88612fea8a8f36de82e1278abb02f\n  evil.example.com \r\n\n10.0.0.1\n10.0.0.1\n");
+
+	external_list list("indicators", path);
+
+	REQUIRE(contains(list, "44d88612fea8a8f36de82e1278abb02f"));
+	REQUIRE(contains(list, "evil.example.com"));
+	REQUIRE(contains(list, "10.0.0.1"));
+	REQUIRE_FALSE(contains(list, "10.0.0.2"));
+	REQUIRE_FALSE(contains(list, "evil.example"));
+	REQUIRE_FALSE(contains(list, "# comment"));
+	REQUIRE_FALSE(contains(list, ""));
+
+	unlink(path.c_str());
+}
+
+TEST_CASE("External lists are reloaded when their file changes", "[external_list]")
+{
+	std::string path = temp_path();
+	write_file(path, "a\nb\n");
+
+	external_list list("indicators", path);
+
+	// Nothing to reload before the first lookup
+	REQUIRE_FALSE(list.update());
+	REQUIRE(contains(list, "a"));
+	REQUIRE_FALSE(list.update());
+
+	write_file(path, "b\nc\nd\n");
+	REQUIRE(list.update());
+	REQUIRE_FALSE(contains(list, "a"));
+	REQUIRE(contains(list, "c"));
+
+	// A file that can't be read keeps the values loaded before
+	unlink(path.c_str());
+	REQUIRE_THROWS_AS(list.update(), falco_exception);
+	REQUIRE(contains(list, "d"));
+}
+
+TEST_CASE("External lists can be loaded before the first lookup", "[external_list]")
+{
+	std::string path = temp_path();
+	write_file(path, "a\nb\n");
+
+	external_list list("indicators", path);
+	list.load();
+	REQUIRE(contains(list, "a"));
+
+	unlink(path.c_str());
+	external_list missing("missing", path);
+	REQUIRE_THROWS_AS(missing.load(), falco_exception);
+}
+
+TEST_CASE("External lists can be compiled in advance", "[external_list]")
+{
+	std::string text_path = temp_path();
+	std::string bin_path = temp_path();
+	write_file(text_path, "a\nb\n");
+
+	external_list::compile(text_path, bin_path);
+	external_list list("indicators", bin_path);
+	REQUIRE(contains(list, "a"));
+	REQUIRE(contains(list, "b"));
+	REQUIRE_FALSE(contains(list, "c"));
+
+	// Invalid binary files result in empty lists, and are reported
+	std::ofstream(bin_path, std::ios::app) << "trailing";
+	std::vector<std::string> errors;
+	external_list invalid("invalid", bin_path,
+		[&errors](falco_common::priority_type priority, const std::string &msg)
+		{
+			REQUIRE(priority == falco_common::PRIORITY_ERROR);
+			errors.push_back(msg);
+		});
+	REQUIRE_FALSE(contains(invalid, "a"));
+	REQUIRE(errors.size() == 1);
+	REQUIRE(errors[0].find(bin_path) != std::string::npos);
+	REQUIRE_FALSE(contains(invalid, "b"));
+	REQUIRE(errors.size() == 1);
+
+	// Unless loaded in advance, which fails
+	external_list invalid_loaded("invalid", bin_path);
+	REQUIRE_THROWS_AS(invalid_loaded.load(), falco_exception);
+
+	unlink(text_path.c_str());
+	unlink(bin_path.c_str());
+}
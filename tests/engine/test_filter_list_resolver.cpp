@@ -0,0 +1,213 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "filter_list_resolver.h"
+#include "falco_common.h"
+#include <catch.hpp>
+
+using namespace std;
+using namespace libsinsp::filter::ast;
+
+TEST_CASE("Should resolve lists on a filter AST", "[rule_loader]")
+{
+	string list_name = "test_list";
+	auto items = make_shared<vector<string>>(vector<string>{"a", "b c"});
+
+	SECTION("in the general case")
+	{
+		expr* filter = new and_expr({
+			new unary_check_expr("evt.name", "", "exists"),
+			new not_expr(
+				new binary_check_expr("proc.name", "", "in",
+					new list_expr({"x", list_name, "y"}))
+			),
+		});
+		expr* expected_filter = new and_expr({
+			new unary_check_expr("evt.name", "", "exists"),
+			new not_expr(
+				new binary_check_expr("proc.name", "", "in",
+					new list_expr({"x", "a", "b c", "y"}))
+			),
+		});
+
+		filter_list_resolver resolver;
+		resolver.set_list(list_name, items);
+
+		// first run
+		REQUIRE(resolver.run(filter) == true);
+		REQUIRE(resolver.get_resolved_lists().size() == 1);
+		REQUIRE(*resolver.get_resolved_lists().begin() == list_name);
+		REQUIRE(filter->is_equal(expected_filter));
+
+		// second run
+		REQUIRE(resolver.run(filter) == false);
+		REQUIRE(resolver.get_resolved_lists().empty());
+		REQUIRE(filter->is_equal(expected_filter));
+
+		delete filter;
+		delete expected_filter;
+	}
+
+	SECTION("with an empty list")
+	{
+		expr* filter = new binary_check_expr("proc.name", "", "in",
+			new list_expr({list_name}));
+		expr* expected_filter = new binary_check_expr("proc.name", "", "in",
+			new list_expr({}));
+
+		filter_list_resolver resolver;
+		resolver.set_list(list_name, make_shared<vector<string>>());
+
+		REQUIRE(resolver.run(filter) == true);
+		REQUIRE(filter->is_equal(expected_filter));
+
+		delete filter;
+		delete expected_filter;
+	}
+
+	SECTION("with values that are not list names")
+	{
+		expr* filter = new or_expr({
+			new binary_check_expr("proc.name", "", "=",
+				new value_expr(list_name)),
+			new binary_check_expr("proc.name", "", "in",
+				new list_expr({"x", "y"})),
+		});
+		expr* expected_filter = new or_expr({
+			new binary_check_expr("proc.name", "", "=",
+				new value_expr(list_name)),
+			new binary_check_expr("proc.name", "", "in",
+				new list_expr({"x", "y"})),
+		});
+
+		filter_list_resolver resolver;
+		resolver.set_list(list_name, items);
+
+		REQUIRE(resolver.run(filter) == false);
+		REQUIRE(resolver.get_resolved_lists().empty());
+		REQUIRE(filter->is_equal(expected_filter));
+
+		delete filter;
+		delete expected_filter;
+	}
+
+	SECTION("with external lists")
+	{
+		expr* filter = new not_expr(
+			new binary_check_expr("proc.aname", "2", "in",
+				new list_expr({"ext", "x", list_name})));
+		expr* expected_filter = new not_expr(
+			new or_expr({
+				new binary_check_expr("external_list", "proc.aname[2]", "in",
+					new list_expr({"ext"})),
+				new binary_check_expr("proc.aname", "2", "in",
+					new list_expr({"x", "a", "b c"})),
+			}));
+
+		filter_list_resolver resolver;
+		resolver.set_list(list_name, items);
+		resolver.set_external_list("ext");
+
+		REQUIRE(resolver.run(filter) == true);
+		REQUIRE(resolver.get_resolved_lists().size() == 2);
+		REQUIRE(filter->is_equal(expected_filter));
+		delete filter;
+		delete expected_filter;
+
+		// The root node can be replaced
+		filter = new binary_check_expr("proc.name", "", "in",
+			new list_expr({"ext"}));
+		expected_filter = new binary_check_expr("external_list", "proc.name", "in",
+			new list_expr({"ext"}));
+
+		REQUIRE(resolver.run(filter) == true);
+		REQUIRE(filter->is_equal(expected_filter));
+		delete filter;
+		delete expected_filter;
+
+		// Only the in operator is supported
+		filter = new binary_check_expr("proc.name", "", "pmatch",
+			new list_expr({"ext"}));
+		REQUIRE_THROWS_AS(resolver.run(filter), falco_exception);
+		delete filter;
+
+		// proc.aname in (...) compares all the ancestors, while
+		// the lists would only be looked up with the parent
+		filter = new binary_check_expr("proc.aname", "", "in",
+			new list_expr({"ext"}));
+		REQUIRE_THROWS_AS(resolver.run(filter), falco_exception);
+		delete filter;
+	}
+
+	SECTION("with networks")
+	{
+		expr* filter = new and_expr({
+			new binary_check_expr("fd.sip", "", "in",
+				new list_expr({list_name})),
+			new binary_check_expr("fd.snet", "", "in",
+				new list_expr({"10.0.0.0/8", "fd00::/8"})),
+			new binary_check_expr("fd.snet", "", "in",
+				new list_expr({"10.0.0.0/8", "localhost"})),
+			// Filter-only and string fields are left to their
+			// filterchecks
+			new binary_check_expr("fd.net", "", "in",
+				new list_expr({"127.0.0.1/24"})),
+			new binary_check_expr("jevt.value", "/net", "in",
+				new list_expr({"10.0.0.0/8"})),
+		});
+		expr* expected_filter = new and_expr({
+			new binary_check_expr("in_cidr", "fd.sip", "in",
+				new list_expr({"192.168.0.0/16", "172.16.0.0/12"})),
+			new binary_check_expr("in_cidr", "fd.snet", "in",
+				new list_expr({"10.0.0.0/8", "fd00::/8"})),
+			new binary_check_expr("fd.snet", "", "in",
+				new list_expr({"10.0.0.0/8", "localhost"})),
+			new binary_check_expr("fd.net", "", "in",
+				new list_expr({"127.0.0.1/24"})),
+			new binary_check_expr("jevt.value", "/net", "in",
+				new list_expr({"10.0.0.0/8"})),
+		});
+
+		filter_list_resolver resolver;
+		resolver.set_list(list_name, make_shared<vector<string>>(
+			vector<string>{"192.168.0.0/16", "172.16.0.0/12"}));
+		resolver.set_cidr_fields([](const string &field)
+		{
+			return field == "fd.sip" || field == "fd.snet";
+		});
+
+		REQUIRE(resolver.run(filter) == true);
+		REQUIRE(filter->is_equal(expected_filter));
+
+		delete filter;
+		delete expected_filter;
+	}
+
+	SECTION("without networks unless their fields are set")
+	{
+		expr* filter = new binary_check_expr("fd.sip", "", "in",
+			new list_expr({"10.0.0.0/8"}));
+		expr* expected_filter = new binary_check_expr("fd.sip", "", "in",
+			new list_expr({"10.0.0.0/8"}));
+
+		filter_list_resolver resolver;
+		REQUIRE(resolver.run(filter) == false);
+		REQUIRE(filter->is_equal(expected_filter));
+
+		delete filter;
+		delete expected_filter;
+	}
+}
@@ -0,0 +1,79 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "filter_multi_pattern_resolver.h"
+#include <catch.hpp>
+
+using namespace std;
+using namespace libsinsp::filter::ast;
+
+TEST_CASE("Should group pattern checks on the same field", "[rule_loader]")
+{
+	filter_multi_pattern_resolver resolver([](const string &field)
+	{
+		return field != "fd.num";
+	});
+
+	SECTION("in the general case")
+	{
+		expr* filter = new and_expr({
+			new unary_check_expr("evt.type", "", "exists"),
+			new or_expr({
+				new binary_check_expr("proc.cmdline", "", "contains", new value_expr("curl")),
+				new binary_check_expr("proc.name", "", "=", new value_expr("wget")),
+				new binary_check_expr("proc.cmdline", "", "startswith", new value_expr("nc ")),
+				new binary_check_expr("proc.aname", "2", "endswith", new value_expr("sh")),
+				new binary_check_expr("proc.cmdline", "", "endswith", new value_expr("| sh")),
+				new binary_check_expr("proc.aname", "2", "contains", new value_expr("python")),
+			}),
+		});
+		expr* expected_filter = new and_expr({
+			new unary_check_expr("evt.type", "", "exists"),
+			new or_expr({
+				new binary_check_expr("multi_pattern", "proc.cmdline", "in",
+					new list_expr({"contains:curl", "startswith:nc ", "endswith:| sh"})),
+				new binary_check_expr("proc.name", "", "=", new value_expr("wget")),
+				new binary_check_expr("multi_pattern", "proc.aname[2]", "in",
+					new list_expr({"endswith:sh", "contains:python"})),
+			}),
+		});
+
+		REQUIRE(resolver.run(filter) == true);
+		REQUIRE(filter->is_equal(expected_filter));
+
+		delete filter;
+		delete expected_filter;
+	}
+
+	SECTION("with single checks and unsupported fields")
+	{
+		expr* filter = new or_expr({
+			new binary_check_expr("proc.cmdline", "", "contains", new value_expr("curl")),
+			new binary_check_expr("proc.name", "", "contains", new value_expr("wget")),
+			new binary_check_expr("fd.num", "", "contains", new value_expr("1")),
+			new binary_check_expr("fd.num", "", "contains", new value_expr("2")),
+			new not_expr(new or_expr({
+				new binary_check_expr("proc.cmdline", "", "contains", new value_expr("a")),
+				new binary_check_expr("proc.cmdline", "", "=", new value_expr("b")),
+			})),
+		});
+
+		REQUIRE(resolver.run(filter) == false);
+		REQUIRE(dynamic_cast<or_expr*>(filter)->children.size() == 5);
+
+		delete filter;
+	}
+}
@@ -0,0 +1,212 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "filter_program.h"
+#include "falco_common.h"
+#include "test_utils.h"
+#include <catch.hpp>
+
+using namespace std;
+using namespace libsinsp::filter::ast;
+
+// Evaluates the condition by walking it
+static bool eval(expr *e, test_event &evt)
+{
+	if(auto a = dynamic_cast<and_expr *>(e))
+	{
+		for(auto c : a->children)
+		{
+			if(!eval(c, evt))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	if(auto o = dynamic_cast<or_expr *>(e))
+	{
+		for(auto c : o->children)
+		{
+			if(eval(c, evt))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+	if(auto n = dynamic_cast<not_expr *>(e))
+	{
+		return !eval(n->child, evt);
+	}
+	auto b = dynamic_cast<binary_check_expr *>(e);
+	return (evt.fields[b->field] == dynamic_cast<value_expr *>(b->value)->value);
+}
+
+static expr *check(const string &field)
+{
+	return new binary_check_expr(field, "", "=", new value_expr("1"));
+}
+
+TEST_CASE("Should run conditions as programs", "[filter_program]")
+{
+	auto factory = std::make_shared<test_filter_factory>();
+
+	SECTION("with the same results as the conditions")
+	{
+		std::vector<expr *> filters = {
+			check("a"),
+			new not_expr(check("a")),
+			new and_expr({check("a"), check("b"), check("c")}),
+			new or_expr({check("a"), check("b"), check("c")}),
+			new and_expr({
+				new or_expr({check("a"), new not_expr(check("b"))}),
+				new not_expr(new and_expr({check("c"), check("d")})),
+			}),
+			new or_expr({
+				new and_expr({check("a"), check("b")}),
+				new not_expr(new or_expr({check("c"), new not_expr(check("d"))})),
+				new and_expr({new not_expr(check("a")), check("d")}),
+			}),
+		};
+
+		for(auto f : filters)
+		{
+			filter_program program(f, factory, 12);
+
+			for(int bits = 0; bits < 16; bits++)
+			{
+				test_event evt;
+				evt.fields["a"] = (bits & 1) ? "1" : "0";
+				evt.fields["b"] = (bits & 2) ? "1" : "0";
+				evt.fields["c"] = (bits & 4) ? "1" : "0";
+				evt.fields["d"] = (bits & 8) ? "1" : "0";
+
+				bool expected = eval(f, evt);
+				REQUIRE(program.run(&evt) == expected);
+				REQUIRE(evt.get_check_id() == (expected ? 12 : 0));
+			}
+
+			delete f;
+		}
+	}
+
+	SECTION("evaluating the checks used several times once")
+	{
+		std::unique_ptr<expr> filter(new and_expr({
+			new or_expr({check("a"), check("b")}),
+			new or_expr({check("a"), check("c")}),
+			new not_expr(check("a")),
+		}));
+		filter_program program(filter.get(), factory, 1);
+		REQUIRE(program.num_checks() == 3);
+		REQUIRE(program.num_instructions() == 5);
+
+		test_event evt;
+		evt.fields["a"] = "0";
+		evt.fields["b"] = "1";
+		evt.fields["c"] = "1";
+
+		REQUIRE(program.run(&evt));
+		REQUIRE(evt.num_compares == 3);
+
+		// The results are only reused within a run
+		evt.fields["a"] = "1";
+		evt.num_compares = 0;
+		REQUIRE_FALSE(program.run(&evt));
+		REQUIRE(evt.num_compares == 1);
+	}
+
+	SECTION("with lists of values")
+	{
+		std::unique_ptr<expr> filter(new binary_check_expr("a", "", "in", new list_expr({"1", "2"})));
+		filter_program program(filter.get(), factory, 1);
+
+		test_event evt;
+		evt.fields["a"] = "2";
+		REQUIRE(program.run(&evt));
+		evt.fields["a"] = "3";
+		REQUIRE_FALSE(program.run(&evt));
+	}
+
+	SECTION("comparing the values of string fields extracted once per run")
+	{
+		// Only a is a string field
+		auto a = std::make_shared<test_string_field>("a");
+		auto new_field = [&a](const string &field)
+		{
+			return (field == "a" ? a : std::shared_ptr<test_string_field>());
+		};
+
+		std::unique_ptr<expr> filter(new or_expr({
+			new and_expr({check("a"), check("b")}),
+			new binary_check_expr("a", "", "in", new list_expr({"2", "3"})),
+			new and_expr({check("b"), new binary_check_expr("a", "", "=", new value_expr("4"))}),
+			new binary_check_expr("a", "", "startswith", new value_expr("5")),
+		}));
+		filter_program program(filter.get(), factory, 1, new_field);
+		REQUIRE(program.num_checks() == 5);
+		REQUIRE(program.num_string_matches() == 3);
+		REQUIRE(program.num_string_fields() == 1);
+
+		test_event evt;
+		evt.fields["b"] = "1";
+
+		// Only b and "a startswith 5" are compared by their checks
+		evt.fields["a"] = "4";
+		REQUIRE(program.run(&evt));
+		REQUIRE(a->num_extractions == 1);
+		REQUIRE(evt.num_compares == 1);
+
+		evt.fields["a"] = "3";
+		REQUIRE(program.run(&evt));
+		REQUIRE(a->num_extractions == 2);
+
+		evt.fields["a"] = "6";
+		evt.fields["b"] = "0";
+		evt.num_compares = 0;
+		REQUIRE_FALSE(program.run(&evt));
+		REQUIRE(a->num_extractions == 3);
+		REQUIRE(evt.num_compares == 2);
+
+		// Without a value, the checks compare the field
+		evt.fields.erase("a");
+		evt.fields["b"] = "1";
+		evt.num_compares = 0;
+		REQUIRE_FALSE(program.run(&evt));
+		REQUIRE(a->num_extractions == 4);
+		REQUIRE(evt.num_compares == 5);
+	}
+
+	SECTION("comparing the string fields of a single check with the check")
+	{
+		auto a = std::make_shared<test_string_field>("a");
+		auto new_field = [&a](const string &field)
+		{
+			return a;
+		};
+
+		std::unique_ptr<expr> filter(new or_expr({check("a"), check("a"), check("b")}));
+		filter_program program(filter.get(), factory, 1, new_field);
+		REQUIRE(program.num_string_matches() == 0);
+		REQUIRE(program.num_string_fields() == 0);
+	}
+
+	SECTION("except with unknown operators")
+	{
+		std::unique_ptr<expr> filter(new binary_check_expr("a", "", "~~", new value_expr("1")));
+		REQUIRE_THROWS_AS(filter_program(filter.get(), factory, 1), falco_exception);
+	}
+}
@@ -0,0 +1,292 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "json_evt.h"
+#include <catch.hpp>
+
+static const std::string s_event_a = R"({"kind":"Event","stageTimestamp":"2019-07-01T00:00:00.000000Z","verb":"a"})";
+static const std::string s_event_b = R"({"kind":"Event","stageTimestamp":"2019-07-01T00:00:01.000000Z","verb":"b"})";
+
+// Parse data in chunks of chunk_size bytes, collecting the verb of
+// each event passed to the callback.
+static bool stream_parse(falco_k8s_audit::event_stream_parser &parser,
+			 const std::string &data,
+			 size_t chunk_size,
+			 std::vector<std::string> &verbs,
+			 std::string &errstr)
+{
+	size_t pos = 0;
+
+	auto reader = [&](char *buf, size_t len) -> int64_t {
+		size_t n = std::min(std::min(len, chunk_size), data.size() - pos);
+		memcpy(buf, data.data() + pos, n);
+		pos += n;
+		return n;
+	};
+
+	auto cb = [&](json_event &evt, std::string &errstr) -> bool {
+		verbs.push_back(evt.jevt().value("verb", ""));
+		return true;
+	};
+
+	return parser.parse(reader, cb, errstr);
+}
+
+TEST_CASE("Stream parser should handle single events", "[json_evt][event_stream_parser]")
+{
+	falco_k8s_audit::event_stream_parser parser;
+	std::vector<std::string> verbs;
+	std::string errstr;
+
+	REQUIRE(stream_parse(parser, s_event_a, 7, verbs, errstr));
+	REQUIRE(verbs == std::vector<std::string>{"a"});
+	REQUIRE(parser.num_events() == 1);
+}
+
+TEST_CASE("Stream parser should split EventLists", "[json_evt][event_stream_parser]")
+{
+	falco_k8s_audit::event_stream_parser parser;
+	std::vector<std::string> verbs;
+	std::string errstr;
+
+	SECTION("kind before items")
+	{
+		std::string data = R"({"kind":"EventList","items":[)" + s_event_a + "," + s_event_b + "]}";
+		REQUIRE(stream_parse(parser, data, 16, verbs, errstr));
+	}
+
+	SECTION("kind after items")
+	{
+		std::string data = R"({"items":[)" + s_event_a + "," + s_event_b + R"(],"kind":"EventList"})";
+		REQUIRE(stream_parse(parser, data, 16, verbs, errstr));
+	}
+
+	SECTION("top level array")
+	{
+		std::string data = "[" + s_event_a + R"(,{"kind":"EventList","items":[)" + s_event_b + "]}]";
+		REQUIRE(stream_parse(parser, data, 16, verbs, errstr));
+	}
+
+	REQUIRE(verbs == std::vector<std::string>{"a", "b"});
+}
+
+TEST_CASE("Stream parser should reject invalid data", "[json_evt][event_stream_parser]")
+{
+	falco_k8s_audit::event_stream_parser parser;
+	std::vector<std::string> verbs;
+	std::string errstr;
+
+	REQUIRE_FALSE(stream_parse(parser, R"({"kind": 0})", 16, verbs, errstr));
+	REQUIRE(errstr == "Data not recognized as a k8s audit event");
+
+	REQUIRE_FALSE(stream_parse(parser, "[[" + s_event_a + "]]", 16, verbs, errstr));
+	REQUIRE(errstr == "Data not recognized as a k8s audit event");
+
+	REQUIRE_FALSE(stream_parse(parser, R"({"kind":"Event")", 16, verbs, errstr));
+	REQUIRE(errstr.find("Could not parse data") == 0);
+
+	REQUIRE_FALSE(parser.limit_exceeded());
+	REQUIRE(verbs.empty());
+}
+
+TEST_CASE("Stream parser should enforce size limits", "[json_evt][event_stream_parser]")
+{
+	std::string data = R"({"kind":"EventList","items":[)" + s_event_a + "," + s_event_b + "]}";
+	std::vector<std::string> verbs;
+	std::string errstr;
+
+	SECTION("input size")
+	{
+		falco_k8s_audit::event_stream_parser parser(data.size() - 1, 0);
+		REQUIRE_FALSE(stream_parse(parser, data, 16, verbs, errstr));
+		REQUIRE(parser.limit_exceeded());
+	}
+
+	SECTION("event size")
+	{
+		falco_k8s_audit::event_stream_parser parser(0, s_event_a.size() - 10);
+		REQUIRE_FALSE(stream_parse(parser, data, 16, verbs, errstr));
+		REQUIRE(parser.limit_exceeded());
+		REQUIRE(verbs.empty());
+	}
+
+	SECTION("within limits")
+	{
+		falco_k8s_audit::event_stream_parser parser(data.size(), s_event_a.size());
+		REQUIRE(stream_parse(parser, data, 16, verbs, errstr));
+		REQUIRE(verbs.size() == 2);
+	}
+}
+
+static std::string extract(json_event &evt, const std::string &field)
+{
+	json_event_filter_factory factory;
+	std::unique_ptr<json_event_filter_check> chk((json_event_filter_check *) factory.new_filtercheck(field.c_str()));
+	std::vector<extract_value_t> values;
+	std::string ret;
+
+	chk->extract(&evt, values);
+	for(auto &val : chk->extracted_values())
+	{
+		ret += val.as_string() + ";";
+	}
+
+	return ret;
+}
+
+TEST_CASE("Json paths should resolve escaped keys and array indexes", "[json_evt][json_path]")
+{
+	std::list<json_event> evts;
+	nlohmann::json j = nlohmann::json::parse(R"({"kind":"Event","stageTimestamp":"2019-07-01T00:00:00.000000Z",)"
+		R"("annotations":{"a/b":"slash","c~d":"tilde"},"items":["x","y"]})");
+	REQUIRE(falco_k8s_audit::parse_k8s_audit_json(j, evts));
+	REQUIRE(evts.size() == 1);
+
+	REQUIRE(extract(evts.front(), "jevt.value[/annotations/a~1b]") == "slash;");
+	REQUIRE(extract(evts.front(), "jevt.value[/annotations/c~0d]") == "tilde;");
+	REQUIRE(extract(evts.front(), "jevt.value[/items/1]") == "y;");
+	REQUIRE(extract(evts.front(), "jevt.value[/items/2]") == "<NA>;");
+	REQUIRE(extract(evts.front(), "jevt.value[/items/x]") == "<NA>;");
+	REQUIRE(extract(evts.front(), "jevt.value[/missing/key]") == "<NA>;");
+}
+
+TEST_CASE("Extracted values should be shared by checks on the same field", "[json_evt][json_path]")
+{
+	std::list<json_event> evts;
+	nlohmann::json j = nlohmann::json::parse(R"({"kind":"EventList","items":[)"
+		R"({"stageTimestamp":"2019-07-01T00:00:00.000000Z","verb":"a","user":{"groups":["g1","g2"]}},)"
+		R"({"stageTimestamp":"2019-07-01T00:00:01.000000Z","verb":"b"}]})");
+	REQUIRE(falco_k8s_audit::parse_k8s_audit_json(j, evts));
+	REQUIRE(evts.size() == 2);
+
+	json_event_filter_factory factory;
+	std::unique_ptr<json_event_filter_check> chk1((json_event_filter_check *) factory.new_filtercheck("ka.user.groups"));
+	std::unique_ptr<json_event_filter_check> chk2((json_event_filter_check *) factory.new_filtercheck("ka.user.groups"));
+	std::vector<extract_value_t> values1, values2;
+
+	REQUIRE(chk1->extract(&evts.front(), values1));
+	REQUIRE(chk2->extract(&evts.front(), values2));
+	REQUIRE(values1.size() == 1);
+	REQUIRE(values2.size() == 1);
+	REQUIRE(values1[0].ptr == values2[0].ptr);
+	REQUIRE(chk2->extracted_values().size() == 2);
+	REQUIRE(chk2->extracted_values()[1].as_string() == "g2");
+
+	// Values are memoized per event
+	REQUIRE(extract(evts.back(), "ka.user.groups") == "<NA>;");
+	REQUIRE(extract(evts.back(), "ka.verb") == "b;");
+	REQUIRE(extract(evts.front(), "ka.verb") == "a;");
+	REQUIRE(chk1->extracted_values().size() == 2);
+}
+
+static bool compare(json_event &evt, const std::string &field, cmpop op, const std::vector<std::string> &values)
+{
+	json_event_filter_factory factory;
+	std::unique_ptr<gen_event_filter_check> chk(factory.new_filtercheck(field.c_str()));
+
+	chk->m_cmpop = op;
+	for(auto &val : values)
+	{
+		chk->add_filter_value(val.c_str(), val.size() + 1);
+	}
+
+	return chk->compare(&evt);
+}
+
+TEST_CASE("Comparisons should work with small and large value lists", "[json_evt][compare]")
+{
+	std::list<json_event> evts;
+	nlohmann::json j = nlohmann::json::parse(R"({"kind":"Event","stageTimestamp":"2019-07-01T00:00:00.000000Z","verb":"create",)"
+		R"("user":{"groups":["b","a","b"]},"objectRef":{"namespace":"kube-system"},"responseStatus":{"code":201}})");
+	REQUIRE(falco_k8s_audit::parse_k8s_audit_json(j, evts));
+	json_event &evt = evts.front();
+
+	std::vector<std::string> many;
+	for(int i = 0; i < 100; i++)
+	{
+		many.push_back("v" + std::to_string(i));
+	}
+
+	REQUIRE(compare(evt, "ka.user.groups", CO_EQ, {"a", "b"}));
+	REQUIRE_FALSE(compare(evt, "ka.user.groups", CO_EQ, {"a"}));
+	REQUIRE(compare(evt, "ka.user.groups", CO_NE, {"a", "c"}));
+
+	REQUIRE(compare(evt, "ka.user.groups", CO_IN, {"a", "b", "c"}));
+	REQUIRE_FALSE(compare(evt, "ka.user.groups", CO_IN, {"a", "c"}));
+	REQUIRE_FALSE(compare(evt, "ka.user.groups", CO_INTERSECTS, {"c", "d"}));
+	REQUIRE(compare(evt, "ka.user.groups", CO_INTERSECTS, {"c", "b"}));
+
+	std::vector<std::string> large = many;
+	large.push_back("kube-system");
+	REQUIRE(compare(evt, "ka.target.namespace", CO_IN, large));
+	REQUIRE_FALSE(compare(evt, "ka.target.namespace", CO_IN, many));
+
+	large = many;
+	large.push_back("a");
+	REQUIRE(compare(evt, "ka.user.groups", CO_INTERSECTS, large));
+	REQUIRE_FALSE(compare(evt, "ka.user.groups", CO_INTERSECTS, many));
+
+	// Numbers and ranges, in small and large lists
+	REQUIRE(compare(evt, "ka.response.code", CO_IN, {"200:299"}));
+	REQUIRE(compare(evt, "ka.response.code", CO_IN, {"+201"}));
+	large = many;
+	large.push_back("201");
+	REQUIRE(compare(evt, "ka.response.code", CO_IN, large));
+	large.back() = "200:299";
+	REQUIRE(compare(evt, "ka.response.code", CO_IN, large));
+	large.back() = "300:399";
+	REQUIRE_FALSE(compare(evt, "ka.response.code", CO_IN, large));
+	REQUIRE(compare(evt, "ka.response.code", CO_LT, {"400"}));
+	REQUIRE_FALSE(compare(evt, "ka.response.code", CO_LT, {"201x"}));
+
+	REQUIRE(compare(evt, "ka.verb", CO_STARTSWITH, {"cre"}));
+	REQUIRE(compare(evt, "ka.verb", CO_CONTAINS, {"eat"}));
+	REQUIRE(compare(evt, "ka.verb", CO_EXISTS, {}));
+	REQUIRE_FALSE(compare(evt, "ka.target.name", CO_EXISTS, {}));
+}
+
+#ifdef HAS_SIMDJSON
+TEST_CASE("simdjson events should match nlohmann events", "[json_evt][simdjson]")
+{
+	std::string item = R"({"stageTimestamp":"2019-07-01T00:00:00.000000Z","verb":"create","user":{"username":"u","groups":["a","b"]},)"
+		R"("requestObject":{"spec":{"containers":[{"image":"nginx","securityContext":{"privileged":true}},{"image":"busybox"}]}},"code":201})";
+	std::string data = R"({"kind":"EventList","items":[)" + item + "]}";
+
+	simdjson::dom::parser parser;
+	std::list<json_event> simd_evts;
+	std::string errstr;
+	REQUIRE(falco_k8s_audit::parse_k8s_audit_data(parser, data.data(), data.size(), simd_evts, errstr));
+
+	std::list<json_event> evts;
+	nlohmann::json j = nlohmann::json::parse(data);
+	REQUIRE(falco_k8s_audit::parse_k8s_audit_json(j, evts));
+
+	REQUIRE(simd_evts.size() == 1);
+	REQUIRE(evts.size() == 1);
+
+	for(auto &field : {"ka.verb", "ka.user.groups", "ka.req.pod.containers.image",
+			   "ka.req.pod.containers.privileged", "ka.response.code",
+			   "jevt.value[/kind]", "jevt.value[/user]", "jevt.value[/missing]", "jevt.obj"})
+	{
+		REQUIRE(extract(simd_evts.front(), field) == extract(evts.front(), field));
+	}
+
+	REQUIRE(simd_evts.front().jevt() == evts.front().jevt());
+
+	REQUIRE_FALSE(falco_k8s_audit::parse_k8s_audit_data(parser, "{\"kind\": 0}", 11, simd_evts, errstr));
+	REQUIRE(errstr == "Data not recognized as a k8s audit event");
+}
+#endif
@@ -0,0 +1,102 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+
+#include "multi_pattern_matcher.h"
+#include <catch.hpp>
+
+static void scan(multi_pattern_matcher &m, const char *text)
+{
+	m.scan(text, strlen(text));
+}
+
+TEST_CASE("Patterns are found anywhere in the text", "[multi_pattern_matcher]")
+{
+	multi_pattern_matcher m;
+
+	uint32_t he = m.add("he");
+	uint32_t she = m.add("she");
+	uint32_t his = m.add("his");
+	uint32_t hers = m.add("hers");
+	REQUIRE(m.add("she") == she);
+	REQUIRE(m.size() == 4);
+
+	scan(m, "ushers");
+	REQUIRE(m.matches(he) == multi_pattern_matcher::MATCH_ANYWHERE);
+	REQUIRE(m.matches(she) == multi_pattern_matcher::MATCH_ANYWHERE);
+	REQUIRE(m.matches(hers) == (multi_pattern_matcher::MATCH_ANYWHERE | multi_pattern_matcher::MATCH_SUFFIX));
+	REQUIRE(m.matches(his) == 0);
+
+	scan(m, "his");
+	REQUIRE(m.matches(he) == 0);
+	REQUIRE(m.matches(she) == 0);
+	REQUIRE(m.matches(hers) == 0);
+	REQUIRE(m.matches(his) == (multi_pattern_matcher::MATCH_ANYWHERE |
+				   multi_pattern_matcher::MATCH_PREFIX |
+				   multi_pattern_matcher::MATCH_SUFFIX));
+
+	scan(m, "");
+	REQUIRE(m.matches(his) == 0);
+}
+
+TEST_CASE("Prefixes and suffixes are found", "[multi_pattern_matcher]")
+{
+	multi_pattern_matcher m;
+
+	uint32_t bash = m.add("bash");
+	uint32_t sh = m.add("sh");
+	uint32_t dash_c = m.add(" -c ");
+
+	scan(m, "bash -c 'ls | sh'");
+	REQUIRE(m.matches(bash) == (multi_pattern_matcher::MATCH_ANYWHERE | multi_pattern_matcher::MATCH_PREFIX));
+	REQUIRE(m.matches(sh) == multi_pattern_matcher::MATCH_ANYWHERE);
+	REQUIRE(m.matches(dash_c) == multi_pattern_matcher::MATCH_ANYWHERE);
+
+	scan(m, "/bin/sh");
+	REQUIRE(m.matches(bash) == 0);
+	REQUIRE(m.matches(sh) == (multi_pattern_matcher::MATCH_ANYWHERE | multi_pattern_matcher::MATCH_SUFFIX));
+	REQUIRE(m.matches(dash_c) == 0);
+}
+
+TEST_CASE("Patterns can be added after a scan", "[multi_pattern_matcher]")
+{
+	multi_pattern_matcher m;
+
+	uint32_t a = m.add("curl");
+	scan(m, "curl http://example.com | wget");
+	REQUIRE(m.matches(a) == (multi_pattern_matcher::MATCH_ANYWHERE | multi_pattern_matcher::MATCH_PREFIX));
+
+	// The same text is scanned again with the new automaton
+	uint32_t b = m.add("wget");
+	scan(m, "curl http://example.com | wget");
+	REQUIRE(m.matches(a) == (multi_pattern_matcher::MATCH_ANYWHERE | multi_pattern_matcher::MATCH_PREFIX));
+	REQUIRE(m.matches(b) == (multi_pattern_matcher::MATCH_ANYWHERE | multi_pattern_matcher::MATCH_SUFFIX));
+}
+
+TEST_CASE("Matchers of the same field are shared", "[multi_pattern_matcher]")
+{
+	multi_pattern_index index;
+
+	auto a = index.get("syscall", "proc.cmdline");
+	auto b = index.get("syscall", "proc.cmdline");
+	auto c = index.get("syscall", "proc.name");
+	auto d = index.get("k8s_audit", "proc.cmdline");
+
+	REQUIRE(a == b);
+	REQUIRE(a != c);
+	REQUIRE(a != d);
+}
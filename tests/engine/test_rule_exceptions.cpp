@@ -0,0 +1,103 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "rule_exceptions.h"
+#include "falco_common.h"
+#include "test_utils.h"
+#include <catch.hpp>
+
+static test_event make_event(const std::string &proc_name, const std::string &fd_name)
+{
+	test_event evt;
+	evt.fields["proc.name"] = proc_name;
+	evt.fields["fd.name"] = fd_name;
+	return evt;
+}
+
+TEST_CASE("Exception tuples compared with = are found by their values", "[rule_exceptions]")
+{
+	rule_exceptions exceptions(std::make_shared<test_filter_factory>());
+
+	exceptions.add_item({"proc.name", "fd.name"},
+			    {rule_exceptions::CMP_EQ, rule_exceptions::CMP_EQ},
+			    {{{"apk"}, {"/usr/lib/alpine"}},
+			     {{"npm"}, {"/usr/node/bin"}}});
+
+	auto evt = make_event("apk", "/usr/lib/alpine");
+	REQUIRE(exceptions.match(&evt));
+
+	evt = make_event("npm", "/usr/node/bin");
+	REQUIRE(exceptions.match(&evt));
+
+	// The values must belong to the same tuple
+	evt = make_event("apk", "/usr/node/bin");
+	REQUIRE_FALSE(exceptions.match(&evt));
+
+	// Fields without a value don't match
+	evt.fields.clear();
+	evt.fields["proc.name"] = "apk";
+	REQUIRE_FALSE(exceptions.match(&evt));
+}
+
+TEST_CASE("Exception fields compared with in and pmatch are checked on the tuples found", "[rule_exceptions]")
+{
+	rule_exceptions exceptions(std::make_shared<test_filter_factory>());
+
+	exceptions.add_item({"proc.name", "fd.name"},
+			    {rule_exceptions::CMP_EQ, rule_exceptions::CMP_PMATCH},
+			    {{{"apk"}, {"/usr/lib", "/var/cache//apk/"}}});
+	exceptions.add_item({"proc.name"},
+			    {rule_exceptions::CMP_IN},
+			    {{{"sh", "bash"}}});
+	REQUIRE(exceptions.num_items() == 2);
+
+	auto evt = make_event("apk", "/usr/lib/x");
+	REQUIRE(exceptions.match(&evt));
+
+	evt = make_event("apk", "/usr/lib");
+	REQUIRE(exceptions.match(&evt));
+
+	evt = make_event("apk", "/var/cache/apk/index");
+	REQUIRE(exceptions.match(&evt));
+
+	// Only whole path components are compared
+	evt = make_event("apk", "/usr/libexec/x");
+	REQUIRE_FALSE(exceptions.match(&evt));
+
+	evt = make_event("npm", "/usr/lib/x");
+	REQUIRE_FALSE(exceptions.match(&evt));
+
+	evt = make_event("bash", "/etc/passwd");
+	REQUIRE(exceptions.match(&evt));
+
+	evt = make_event("zsh", "/etc/passwd");
+	REQUIRE_FALSE(exceptions.match(&evt));
+}
+
+TEST_CASE("Exception items must have a value per field", "[rule_exceptions]")
+{
+	rule_exceptions exceptions(std::make_shared<test_filter_factory>());
+
+	REQUIRE_THROWS_AS(exceptions.add_item({"proc.name", "fd.name"},
+					      {rule_exceptions::CMP_EQ, rule_exceptions::CMP_EQ},
+					      {{{"apk"}}}),
+			  falco_exception);
+
+	REQUIRE_THROWS_AS(exceptions.add_item({"proc.name"},
+					      {rule_exceptions::CMP_EQ},
+					      {{{"apk", "npm"}}}),
+			  falco_exception);
+}
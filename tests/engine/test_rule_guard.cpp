@@ -0,0 +1,86 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "rule_guard.h"
+#include "test_utils.h"
+#include <catch.hpp>
+
+using namespace std;
+using namespace libsinsp::filter::ast;
+
+// Only the fields of the test are supported
+static std::shared_ptr<rule_guard_field> new_field(const string &field, const vector<string> &values)
+{
+	if(field == "fd.num")
+	{
+		return NULL;
+	}
+	return std::make_shared<test_guard_field>();
+}
+
+TEST_CASE("Should find the guard of a condition", "[rule_guard]")
+{
+	SECTION("in the general case")
+	{
+		expr* filter = new and_expr({
+			new binary_check_expr("evt.type", "", "=", new value_expr("execve")),
+			new and_expr({
+				new binary_check_expr("proc.name", "", "in", new list_expr({"a", "b", "c"})),
+				new binary_check_expr("proc.aname", "2", "in", new list_expr({"d", "e"})),
+			}),
+			new binary_check_expr("fd.num", "", "=", new value_expr("1")),
+			new binary_check_expr("proc.cmdline", "", "contains", new value_expr("x")),
+			new binary_check_expr("proc.pname", "", "in", new list_expr({"f", "g"})),
+		});
+
+		auto guard = rule_guard::find(filter, new_field);
+		REQUIRE(guard);
+		REQUIRE(guard->field() == "proc.aname[2]");
+		REQUIRE(guard->values() == vector<string>({"d", "e"}));
+
+		delete filter;
+	}
+
+	SECTION("with a single check")
+	{
+		expr* filter = new binary_check_expr("ka.verb", "", "=", new value_expr("create"));
+
+		auto guard = rule_guard::find(filter, new_field);
+		REQUIRE(guard);
+		REQUIRE(guard->field() == "ka.verb");
+		REQUIRE(guard->values() == vector<string>({"create"}));
+
+		delete filter;
+	}
+
+	SECTION("without required checks")
+	{
+		expr* filter = new and_expr({
+			new binary_check_expr("evt.type", "", "=", new value_expr("execve")),
+			new or_expr({
+				new binary_check_expr("proc.name", "", "=", new value_expr("a")),
+				new binary_check_expr("proc.pname", "", "=", new value_expr("b")),
+			}),
+			new not_expr(new binary_check_expr("proc.name", "", "=", new value_expr("c"))),
+			new binary_check_expr("fd.num", "", "=", new value_expr("1")),
+			new binary_check_expr("in_cidr", "fd.sip", "in", new list_expr({"10.0.0.0/8"})),
+		});
+
+		REQUIRE_FALSE(rule_guard::find(filter, new_field));
+
+		delete filter;
+	}
+}
@@ -0,0 +1,108 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "rule_scope.h"
+#include <catch.hpp>
+
+using namespace std;
+using namespace libsinsp::filter::ast;
+
+static rule_scope::scope field_scope(const string &field, const string &arg)
+{
+	if(field == "container.id")
+	{
+		return rule_scope::SCOPE_CONTAINER;
+	}
+	if(field == "proc.name" || field == "user.name")
+	{
+		return rule_scope::SCOPE_THREAD;
+	}
+	return rule_scope::SCOPE_EVENT;
+}
+
+TEST_CASE("Should split the checks that only depend on the thread", "[rule_scope]")
+{
+	std::unique_ptr<expr> scoped;
+	std::unique_ptr<expr> other;
+	rule_scope::scope scope;
+
+	SECTION("in the general case")
+	{
+		std::unique_ptr<expr> filter(new and_expr({
+			new binary_check_expr("evt.type", "", "=", new value_expr("execve")),
+			new and_expr({
+				new binary_check_expr("container.id", "", "!=", new value_expr("host")),
+				new not_expr(new binary_check_expr("proc.name", "", "in", new list_expr({"a", "b"}))),
+			}),
+			new or_expr({
+				new binary_check_expr("fd.name", "", "=", new value_expr("/etc/shadow")),
+				new binary_check_expr("user.name", "", "=", new value_expr("root")),
+			}),
+		}));
+
+		REQUIRE(rule_scope::split(filter.get(), field_scope, scoped, other, scope));
+		REQUIRE(scope == rule_scope::SCOPE_THREAD);
+
+		std::unique_ptr<expr> expected_scoped(new and_expr({
+			new binary_check_expr("container.id", "", "!=", new value_expr("host")),
+			new not_expr(new binary_check_expr("proc.name", "", "in", new list_expr({"a", "b"}))),
+		}));
+		REQUIRE(scoped->is_equal(expected_scoped.get()));
+
+		std::unique_ptr<expr> expected_other(new and_expr({
+			new binary_check_expr("evt.type", "", "=", new value_expr("execve")),
+			new or_expr({
+				new binary_check_expr("fd.name", "", "=", new value_expr("/etc/shadow")),
+				new binary_check_expr("user.name", "", "=", new value_expr("root")),
+			}),
+		}));
+		REQUIRE(other->is_equal(expected_other.get()));
+	}
+
+	SECTION("with container checks only")
+	{
+		std::unique_ptr<expr> filter(new and_expr({
+			new binary_check_expr("evt.type", "", "=", new value_expr("execve")),
+			new binary_check_expr("container.id", "", "!=", new value_expr("host")),
+		}));
+
+		REQUIRE(rule_scope::split(filter.get(), field_scope, scoped, other, scope));
+		REQUIRE(scope == rule_scope::SCOPE_CONTAINER);
+
+		std::unique_ptr<expr> expected_scoped(
+			new binary_check_expr("container.id", "", "!=", new value_expr("host")));
+		REQUIRE(scoped->is_equal(expected_scoped.get()));
+
+		std::unique_ptr<expr> expected_other(
+			new binary_check_expr("evt.type", "", "=", new value_expr("execve")));
+		REQUIRE(other->is_equal(expected_other.get()));
+	}
+
+	SECTION("without checks to split")
+	{
+		std::unique_ptr<expr> filter(new and_expr({
+			new binary_check_expr("proc.name", "", "=", new value_expr("a")),
+			new binary_check_expr("user.name", "", "=", new value_expr("root")),
+		}));
+		REQUIRE_FALSE(rule_scope::split(filter.get(), field_scope, scoped, other, scope));
+
+		filter.reset(new or_expr({
+			new binary_check_expr("evt.type", "", "=", new value_expr("execve")),
+			new binary_check_expr("container.id", "", "!=", new value_expr("host")),
+		}));
+		REQUIRE_FALSE(rule_scope::split(filter.get(), field_scope, scoped, other, scope));
+	}
+}
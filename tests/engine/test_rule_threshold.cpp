@@ -0,0 +1,240 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "rule_threshold.h"
+#include "falco_common.h"
+#include "falco_engine.h"
+#include "json_evt.h"
+#include "test_utils.h"
+#include <catch.hpp>
+
+using namespace std;
+
+static const uint64_t s_sec = 1000000000;
+
+// Extracts container.id, which has no value if empty
+class test_container_field : public rule_threshold_field
+{
+public:
+	bool extract_key(gen_event *evt, std::string &key)
+	{
+		key = ((test_event *) evt)->fields["container.id"];
+		return !key.empty();
+	}
+};
+
+// The number of events of container at the times in secs for which
+// threshold is reached
+static uint32_t add_events(rule_threshold &threshold, const std::vector<uint64_t> &secs,
+			   const std::string &container = "c1")
+{
+	uint32_t ret = 0;
+	for(auto sec : secs)
+	{
+		test_event evt;
+		evt.ts = sec * s_sec;
+		evt.fields["container.id"] = container;
+		if(threshold.add(&evt))
+		{
+			ret++;
+		}
+	}
+	return ret;
+}
+
+TEST_CASE("Should count the events of the rules with thresholds", "[rule_threshold]")
+{
+	std::vector<std::shared_ptr<rule_threshold_field>> group_by = {
+		std::make_shared<test_container_field>()};
+
+	SECTION("reaching the threshold once per count events")
+	{
+		rule_threshold threshold(3, 10 * s_sec, group_by);
+		REQUIRE(add_events(threshold, {100, 101}) == 0);
+		REQUIRE(add_events(threshold, {102}) == 1);
+
+		// The count starts over from 0
+		REQUIRE(add_events(threshold, {103, 104}) == 0);
+		REQUIRE(add_events(threshold, {105}) == 1);
+		REQUIRE(add_events(threshold, {106, 107, 108, 109, 110, 111}) == 2);
+	}
+
+	SECTION("within the window only")
+	{
+		rule_threshold threshold(3, 10 * s_sec, group_by);
+		REQUIRE(add_events(threshold, {100, 105, 111, 116, 122, 127}) == 0);
+		REQUIRE(add_events(threshold, {128}) == 1);
+
+		// Far after the last event
+		REQUIRE(add_events(threshold, {1000, 2000, 3000}) == 0);
+
+		// Events older than the window of the group
+		REQUIRE(add_events(threshold, {3001, 100, 200}) == 0);
+		REQUIRE(add_events(threshold, {3002}) == 1);
+	}
+
+	SECTION("for each group")
+	{
+		rule_threshold threshold(2, 10 * s_sec, group_by);
+		REQUIRE(add_events(threshold, {100}, "c1") == 0);
+		REQUIRE(add_events(threshold, {101}, "c2") == 0);
+		REQUIRE(add_events(threshold, {102}, "") == 0);
+		REQUIRE(add_events(threshold, {103}, "c1") == 1);
+		REQUIRE(add_events(threshold, {104}, "c2") == 1);
+		REQUIRE(add_events(threshold, {105}, "") == 1);
+		REQUIRE(threshold.num_groups() == 3);
+	}
+
+	SECTION("for the most recently seen groups only")
+	{
+		rule_threshold threshold(2, 10 * s_sec, group_by, 2);
+		REQUIRE(add_events(threshold, {100}, "c1") == 0);
+		REQUIRE(add_events(threshold, {101}, "c2") == 0);
+		REQUIRE(add_events(threshold, {102}, "c1") == 1);
+		REQUIRE(add_events(threshold, {103}, "c1") == 0);
+
+		// c2 is forgotten to count c3
+		REQUIRE(add_events(threshold, {104}, "c3") == 0);
+		REQUIRE(threshold.num_groups() == 2);
+		REQUIRE(add_events(threshold, {105}, "c2") == 0);
+		REQUIRE(add_events(threshold, {106}, "c2") == 1);
+	}
+
+	SECTION("without group")
+	{
+		rule_threshold threshold(2, 10 * s_sec, {});
+		REQUIRE(add_events(threshold, {100}, "c1") == 0);
+		REQUIRE(add_events(threshold, {101}, "c2") == 1);
+		REQUIRE(threshold.num_groups() == 1);
+	}
+
+	SECTION("in the groups shared with another threshold")
+	{
+		rule_threshold threshold(3, 10 * s_sec, group_by);
+		rule_threshold other(threshold, group_by);
+		REQUIRE(add_events(threshold, {100}) == 0);
+		REQUIRE(add_events(other, {101}) == 0);
+		REQUIRE(add_events(threshold, {102}) == 1);
+		REQUIRE(other.num_groups() == 1);
+		REQUIRE(other.count() == 3);
+	}
+
+	SECTION("except with invalid counts or windows")
+	{
+		REQUIRE_THROWS_AS(rule_threshold(0, 10 * s_sec, group_by), falco_exception);
+		REQUIRE_THROWS_AS(rule_threshold(3, 0, group_by), falco_exception);
+	}
+}
+
+TEST_CASE("Should share the thresholds of the same rules", "[rule_threshold]")
+{
+	std::vector<std::shared_ptr<rule_threshold_field>> group_by = {
+		std::make_shared<test_container_field>()};
+	std::vector<std::string> group_by_fields = {"container.id"};
+	rule_threshold_index index;
+
+	auto threshold = index.get("rule", 2, 10 * s_sec, group_by_fields, group_by);
+	auto same = index.get("rule", 2, 10 * s_sec, group_by_fields, group_by);
+	auto other_count = index.get("rule", 3, 10 * s_sec, group_by_fields, group_by);
+	auto other_rule = index.get("other_rule", 3, 10 * s_sec, group_by_fields, group_by);
+
+	REQUIRE(add_events(*threshold, {100}) == 0);
+	REQUIRE(add_events(*same, {101}) == 1);
+	REQUIRE(add_events(*other_count, {102, 103}) == 0);
+	REQUIRE(add_events(*other_rule, {104}) == 0);
+	REQUIRE(threshold.use_count() == 1);
+}
+
+static const std::string s_threshold_rules = R"(
+- rule: many_creates
+  desc: Many objects created by the same user
+  condition: ka.verb = create
+  output: Many objects created by %ka.user.name
+  priority: WARNING
+  source: k8s_audit
+  count: 3
+  window: 10s
+  group_by: [ka.user.name]
+)";
+
+// Process a create event of user at sec with engine, returning
+// whether a rule matched
+static bool process_create(falco_engine &engine, const std::string &user, uint64_t sec)
+{
+	std::string source = "k8s_audit";
+	nlohmann::json j = {{"kind", "Event"}, {"verb", "create"}, {"user", {{"username", user}}}};
+	json_event evt;
+	evt.set_jevt(j, sec * s_sec);
+
+	return (engine.process_event(source, &evt) != NULL);
+}
+
+static void add_k8s_audit_source(falco_engine &engine)
+{
+	std::shared_ptr<gen_event_filter_factory> filter_factory(new json_event_filter_factory());
+	std::shared_ptr<gen_event_formatter_factory> formatter_factory(new json_event_formatter_factory(filter_factory));
+	engine.add_source("k8s_audit", filter_factory, formatter_factory);
+}
+
+TEST_CASE("Should load the rules with thresholds", "[rule_threshold][falco_engine]")
+{
+	falco_engine engine(false);
+	add_k8s_audit_source(engine);
+
+	SECTION("matching every count events of the same group")
+	{
+		engine.load_rules(s_threshold_rules, false, false);
+
+		REQUIRE_FALSE(process_create(engine, "a", 100));
+		REQUIRE_FALSE(process_create(engine, "a", 101));
+		REQUIRE_FALSE(process_create(engine, "b", 102));
+		REQUIRE(process_create(engine, "a", 103));
+		REQUIRE_FALSE(process_create(engine, "a", 104));
+
+		// Out of the window of the first events of b
+		REQUIRE_FALSE(process_create(engine, "b", 120));
+		REQUIRE_FALSE(process_create(engine, "b", 121));
+		REQUIRE(process_create(engine, "b", 122));
+	}
+
+	SECTION("counting the events of the engines sharing them")
+	{
+		falco_engine replica(false);
+		add_k8s_audit_source(replica);
+		replica.set_rule_thresholds(engine.get_rule_thresholds());
+
+		engine.load_rules(s_threshold_rules, false, false);
+		replica.load_rules(s_threshold_rules, false, false);
+
+		REQUIRE_FALSE(process_create(engine, "a", 100));
+		REQUIRE_FALSE(process_create(replica, "a", 101));
+		REQUIRE(process_create(engine, "a", 102));
+	}
+
+	SECTION("rejecting invalid windows")
+	{
+		std::string rules = s_threshold_rules;
+		rules.replace(rules.find("10s"), 3, "10 seconds");
+		REQUIRE_THROWS_AS(engine.load_rules(rules, false, false), falco_exception);
+	}
+
+	SECTION("rejecting unknown group_by fields")
+	{
+		std::string rules = s_threshold_rules;
+		rules.replace(rules.find("ka.user.name]"), 12, "ka.unknown");
+		REQUIRE_THROWS_AS(engine.load_rules(rules, false, false), falco_exception);
+	}
+}
@@ -15,6 +15,7 @@ limitations under the License.
 */
 
 #include "ruleset.h"
+#include "test_utils.h"
 #include <catch.hpp>
 
 static bool exact_match = true;
@@ -283,3 +284,416 @@ TEST_CASE("Should enable/disable for incremental adding tags", "[rulesets]")
 	r.enable_tags(want_tags, disabled);
 	REQUIRE(r.num_rules_for_ruleset(default_ruleset) == 0);
 }
+
+// A filter that always returns the same result
+class fixed_filter : public gen_event_filter
+{
+public:
+	fixed_filter(bool match):
+		m_match(match)
+	{
+	}
+
+	bool run(gen_event *evt)
+	{
+		return m_match;
+	}
+
+private:
+	bool m_match;
+};
+
+TEST_CASE("Should profile rules only when enabled", "[rulesets]")
+{
+	string source = "some_plugin";
+	falco_ruleset r;
+	test_event evt;
+
+	string rule1_name = "one_rule";
+	r.add(source, rule1_name, tags, std::make_shared<fixed_filter>(false));
+	r.enable(rule1_name, exact_match, enabled, default_ruleset);
+
+	string rule2_name = "two_rule";
+	r.add(source, rule2_name, tags, std::make_shared<fixed_filter>(true));
+	r.enable(rule2_name, exact_match, enabled, non_default_ruleset);
+
+	std::list<falco_ruleset::rule_profile> profile;
+
+	REQUIRE_FALSE(r.run(&evt, default_ruleset));
+	r.get_profile(profile);
+	REQUIRE(profile.empty());
+
+	r.enable_profiling(true);
+
+	for(int i = 0; i < 3; i++)
+	{
+		REQUIRE_FALSE(r.run(&evt, default_ruleset));
+	}
+	REQUIRE(r.run(&evt, non_default_ruleset));
+
+	r.get_profile(profile);
+	REQUIRE(profile.size() == 2);
+
+	for(auto &rp : profile)
+	{
+		if(rp.name == rule1_name)
+		{
+			REQUIRE(rp.num_evals == 3);
+			REQUIRE(rp.num_matches == 0);
+		}
+		else
+		{
+			REQUIRE(rp.name == rule2_name);
+			REQUIRE(rp.num_evals == 1);
+			REQUIRE(rp.num_matches == 1);
+		}
+	}
+}
+
+TEST_CASE("Should list all rules with their priority and enabled status", "[rulesets]")
+{
+	falco_ruleset r;
+	std::shared_ptr<gen_event_filter> filter = create_filter();
+	string source = "syscall";
+
+	string rule1_name = "one_rule";
+	r.add(source, rule1_name, tags, filter, falco_common::PRIORITY_WARNING);
+	r.enable(rule1_name, exact_match, enabled, default_ruleset);
+
+	string rule2_name = "two_rule";
+	r.add(source, rule2_name, tags, filter);
+
+	std::list<falco_ruleset::rule_profile> profile;
+
+	r.get_profile(profile);
+	REQUIRE(profile.empty());
+
+	r.get_profile(profile, true, default_ruleset);
+	REQUIRE(profile.size() == 2);
+
+	for(auto &rp : profile)
+	{
+		REQUIRE(rp.source == source);
+		REQUIRE(rp.num_evals == 0);
+		if(rp.name == rule1_name)
+		{
+			REQUIRE(rp.priority == falco_common::PRIORITY_WARNING);
+			REQUIRE(rp.enabled);
+		}
+		else
+		{
+			REQUIRE(rp.name == rule2_name);
+			REQUIRE(rp.priority == falco_common::PRIORITY_DEBUG);
+			REQUIRE_FALSE(rp.enabled);
+		}
+	}
+}
+
+// A filter that never matches, taking ns of the time of a clock
+class slow_filter : public gen_event_filter
+{
+public:
+	slow_filter(uint64_t &clock, uint64_t ns):
+		m_clock(clock),
+		m_ns(ns)
+	{
+	}
+
+	bool run(gen_event *evt)
+	{
+		m_clock += m_ns;
+		return false;
+	}
+
+private:
+	uint64_t &m_clock;
+	uint64_t m_ns;
+};
+
+TEST_CASE("Should demote rules over their CPU budget", "[rulesets]")
+{
+	string source = "some_plugin";
+	falco_ruleset r;
+	test_event evt;
+
+	uint64_t clock = 0;
+	r.set_time_source([&clock]()
+	{
+		return clock;
+	});
+
+	string rule1_name = "cheap_rule";
+	r.add(source, rule1_name, tags, std::make_shared<fixed_filter>(false));
+	string rule2_name = "slow_rule";
+	r.add(source, rule2_name, tags, std::make_shared<slow_filter>(clock, 1000000));
+	r.enable("", substring_match, enabled, default_ruleset);
+
+	std::string demoted;
+	falco_ruleset::cpu_budget budget = {0, 0.5, 1, falco_ruleset::BUDGET_DISABLE, 1};
+	r.set_cpu_budget(budget, [&demoted](const std::string &source,
+					    const std::string &rule,
+					    uint64_t ns_per_sec,
+					    double share,
+					    falco_ruleset::budget_action action) {
+		REQUIRE(share > 0.5);
+		REQUIRE(action == falco_ruleset::BUDGET_DISABLE);
+		demoted = rule;
+	});
+
+	// The budget is checked every second, as measured every 1024
+	// runs. The slow rule takes 1ms per run.
+	for(int i = 0; i < 1023; i++)
+	{
+		REQUIRE_FALSE(r.run(&evt, default_ruleset));
+	}
+	REQUIRE(demoted.empty());
+	REQUIRE_FALSE(r.run(&evt, default_ruleset));
+	REQUIRE(demoted == rule2_name);
+
+	std::list<falco_ruleset::rule_profile> before, after;
+	r.get_profile(before);
+	for(int i = 0; i < 100; i++)
+	{
+		REQUIRE_FALSE(r.run(&evt, default_ruleset));
+	}
+	r.get_profile(after);
+
+	for(auto &rp : before)
+	{
+		for(auto &rp2 : after)
+		{
+			if(rp.name == rp2.name)
+			{
+				REQUIRE(rp2.num_evals == rp.num_evals + (rp.name == rule1_name ? 100 : 0));
+			}
+		}
+	}
+}
+
+TEST_CASE("Should only evaluate the rules whose guard holds", "[rulesets]")
+{
+	string source = "some_plugin";
+	falco_ruleset r;
+	test_event evt;
+	auto field = std::make_shared<test_guard_field>();
+
+	string rule1_name = "guarded_rule";
+	rule_options options1;
+	options1.guard = std::make_shared<rule_guard>("proc.name", std::vector<std::string>{"a", "b"}, field);
+	r.add(source, rule1_name, tags, std::make_shared<fixed_filter>(false),
+	      falco_common::PRIORITY_DEBUG, options1);
+	string rule2_name = "other_guarded_rule";
+	rule_options options2;
+	options2.guard = std::make_shared<rule_guard>("proc.name", std::vector<std::string>{"c"}, field);
+	r.add(source, rule2_name, tags, std::make_shared<fixed_filter>(false),
+	      falco_common::PRIORITY_DEBUG, options2);
+	string rule3_name = "unguarded_rule";
+	r.add(source, rule3_name, tags, std::make_shared<fixed_filter>(false));
+	r.enable("", substring_match, enabled, default_ruleset);
+	r.enable_profiling(true);
+
+	field->value = "a";
+	REQUIRE_FALSE(r.run(&evt, default_ruleset));
+	field->value = "c";
+	REQUIRE_FALSE(r.run(&evt, default_ruleset));
+	field->value = "d";
+	REQUIRE_FALSE(r.run(&evt, default_ruleset));
+
+	// Both guarded rules are evaluated when the value is unknown
+	field->has_value = false;
+	REQUIRE_FALSE(r.run(&evt, default_ruleset));
+
+	// The field is extracted once per event
+	REQUIRE(field->num_extractions == 4);
+
+	std::list<falco_ruleset::rule_profile> profile;
+	r.get_profile(profile);
+	for(auto &rp : profile)
+	{
+		if(rp.name == rule1_name)
+		{
+			REQUIRE(rp.num_evals == 2);
+		}
+		else if(rp.name == rule2_name)
+		{
+			REQUIRE(rp.num_evals == 2);
+		}
+		else
+		{
+			REQUIRE(rp.name == rule3_name);
+			REQUIRE(rp.num_evals == 4);
+		}
+	}
+}
+
+// The slots of two threads, the current one being the thread of the
+// events
+class test_scope_state : public rule_scope_state
+{
+public:
+	uint32_t reserve(uint32_t num)
+	{
+		for(auto &t : threads)
+		{
+			t.assign(num, DECISION_UNKNOWN);
+		}
+		return num;
+	}
+
+	uint8_t *slots(gen_event *evt)
+	{
+		return threads[thread].data();
+	}
+
+	rule_scope::scope changed_scope(gen_event *evt)
+	{
+		return changed;
+	}
+
+	std::vector<uint8_t> threads[2];
+	uint32_t thread = 0;
+	rule_scope::scope changed = rule_scope::SCOPE_EVENT;
+};
+
+TEST_CASE("Should cache the result of the scoped filters for each thread", "[rulesets]")
+{
+	string source = "some_plugin";
+	falco_ruleset r;
+	test_event evt;
+
+	auto thread_filter = std::make_shared<counting_filter>(true);
+	auto container_filter = std::make_shared<counting_filter>(false);
+
+	string rule1_name = "thread_rule";
+	rule_options options1;
+	options1.scope = std::make_shared<rule_scope>(thread_filter, rule_scope::SCOPE_THREAD);
+	r.add(source, rule1_name, tags, std::make_shared<fixed_filter>(false),
+	      falco_common::PRIORITY_DEBUG, options1);
+	string rule2_name = "container_rule";
+	rule_options options2;
+	options2.scope = std::make_shared<rule_scope>(container_filter, rule_scope::SCOPE_CONTAINER);
+	r.add(source, rule2_name, tags, std::make_shared<fixed_filter>(false),
+	      falco_common::PRIORITY_DEBUG, options2);
+	r.enable("", substring_match, enabled, default_ruleset);
+	r.enable_profiling(true);
+
+	SECTION("without state")
+	{
+		REQUIRE_FALSE(r.run(&evt, default_ruleset));
+		REQUIRE_FALSE(r.run(&evt, default_ruleset));
+		REQUIRE(thread_filter->num_runs == 2);
+		REQUIRE(container_filter->num_runs == 2);
+	}
+
+	SECTION("with a state")
+	{
+		auto state = std::make_shared<test_scope_state>();
+		r.set_scope_state(state);
+
+		for(int i = 0; i < 3; i++)
+		{
+			REQUIRE_FALSE(r.run(&evt, default_ruleset));
+		}
+		REQUIRE(thread_filter->num_runs == 1);
+		REQUIRE(container_filter->num_runs == 1);
+
+		state->thread = 1;
+		REQUIRE_FALSE(r.run(&evt, default_ruleset));
+		REQUIRE(thread_filter->num_runs == 2);
+		REQUIRE(container_filter->num_runs == 2);
+
+		// e.g. setuid
+		state->changed = rule_scope::SCOPE_THREAD;
+		REQUIRE_FALSE(r.run(&evt, default_ruleset));
+		REQUIRE(thread_filter->num_runs == 3);
+		REQUIRE(container_filter->num_runs == 2);
+
+		// e.g. execve, also seen when the event isn't matched
+		state->changed = rule_scope::SCOPE_CONTAINER;
+		r.skip(&evt);
+		state->changed = rule_scope::SCOPE_EVENT;
+		REQUIRE_FALSE(r.run(&evt, default_ruleset));
+		REQUIRE(thread_filter->num_runs == 4);
+		REQUIRE(container_filter->num_runs == 3);
+
+		// The rest of the condition is only evaluated when the
+		// scoped filter is true
+		std::list<falco_ruleset::rule_profile> profile;
+		r.get_profile(profile);
+		for(auto &rp : profile)
+		{
+			if(rp.name == rule1_name)
+			{
+				REQUIRE(rp.num_evals == 6);
+			}
+			else
+			{
+				REQUIRE(rp.name == rule2_name);
+				REQUIRE(rp.num_evals == 0);
+			}
+		}
+	}
+}
+
+TEST_CASE("Should only match the rules with a threshold when it's reached", "[rulesets]")
+{
+	string source = "some_plugin";
+	falco_ruleset r;
+	test_event evt;
+
+	auto other_filter = std::make_shared<counting_filter>(true);
+
+	string rule1_name = "threshold_rule";
+	rule_options options;
+	options.threshold = std::make_shared<rule_threshold>(3, 1000000000,
+							     std::vector<std::shared_ptr<rule_threshold_field>>());
+	r.add(source, rule1_name, tags, std::make_shared<fixed_filter>(true),
+	      falco_common::PRIORITY_DEBUG, options);
+	string rule2_name = "other_rule";
+	r.add(source, rule2_name, tags, other_filter);
+	r.enable(rule1_name, exact_match, enabled, default_ruleset);
+
+	REQUIRE_FALSE(r.run(&evt, default_ruleset));
+	REQUIRE_FALSE(r.run(&evt, default_ruleset));
+	REQUIRE(r.run(&evt, default_ruleset));
+	REQUIRE_FALSE(r.run(&evt, default_ruleset));
+
+	// The other rules are evaluated until the threshold is reached
+	r.enable(rule2_name, exact_match, enabled, default_ruleset);
+	REQUIRE(r.run(&evt, default_ruleset));
+	REQUIRE(r.run(&evt, default_ruleset));
+	REQUIRE(other_filter->num_runs == 1);
+}
+
+TEST_CASE("Should only keep the filters of the rules run as programs for their event types", "[rulesets]")
+{
+	using namespace libsinsp::filter::ast;
+
+	string source = "syscall";
+	falco_ruleset r;
+
+	std::unique_ptr<expr> cond(new binary_check_expr("a", "", "=", new value_expr("1")));
+	rule_options options;
+	options.program = std::make_shared<filter_program>(cond.get(), std::make_shared<test_filter_factory>(), 1);
+
+	auto filter = create_filter();
+	std::set<uint16_t> filter_evttypes = filter->evttypes();
+
+	string rule_name = "program_rule";
+	r.add(source, rule_name, tags, filter, falco_common::PRIORITY_DEBUG, options);
+	r.enable(rule_name, exact_match, enabled, default_ruleset);
+
+	// Only the program is kept
+	REQUIRE(filter.use_count() == 1);
+
+	std::set<uint16_t> evttypes;
+	r.evttypes_for_ruleset(evttypes, default_ruleset);
+	REQUIRE(evttypes == filter_evttypes);
+
+	test_event evt;
+	evt.type = ppm_event_type::PPME_SYSCALL_OPEN_E;
+	evt.fields["a"] = "1";
+	REQUIRE(r.run(&evt, default_ruleset));
+	evt.fields["a"] = "0";
+	REQUIRE_FALSE(r.run(&evt, default_ruleset));
+}
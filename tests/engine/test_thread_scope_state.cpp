@@ -0,0 +1,120 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "thread_scope_state.h"
+#include "ruleset.h"
+#include "test_utils.h"
+#include <catch.hpp>
+
+using namespace std;
+
+// Keeps the slots of a single thread instead of the private state of
+// the sinsp thread infos
+class single_thread_scope_state : public thread_scope_state
+{
+public:
+	single_thread_scope_state():
+		thread_scope_state(NULL)
+	{
+	}
+
+	uint32_t reserve(uint32_t num)
+	{
+		slots_of_thread.assign(num, DECISION_UNKNOWN);
+		return num;
+	}
+
+	uint8_t *slots(gen_event *evt)
+	{
+		return slots_of_thread.data();
+	}
+
+	std::vector<uint8_t> slots_of_thread;
+};
+
+static rule_scope::scope changed_scope(uint16_t type)
+{
+	single_thread_scope_state state;
+	test_event evt;
+	evt.type = type;
+	return state.changed_scope(&evt);
+}
+
+TEST_CASE("Should tell the scopes changed by the syscall events", "[thread_scope_state]")
+{
+	REQUIRE(changed_scope(PPME_SYSCALL_EXECVE_19_X) == rule_scope::SCOPE_CONTAINER);
+	REQUIRE(changed_scope(PPME_SYSCALL_EXECVEAT_X) == rule_scope::SCOPE_CONTAINER);
+	REQUIRE(changed_scope(PPME_SYSCALL_SETUID_X) == rule_scope::SCOPE_THREAD);
+	REQUIRE(changed_scope(PPME_SYSCALL_SETRESGID_X) == rule_scope::SCOPE_THREAD);
+
+	// The thread only changes once the syscall returns
+	REQUIRE(changed_scope(PPME_SYSCALL_EXECVEAT_E) == rule_scope::SCOPE_EVENT);
+	REQUIRE(changed_scope(PPME_SYSCALL_OPEN_E) == rule_scope::SCOPE_EVENT);
+}
+
+TEST_CASE("Should reset the scoped results of a thread when it execs", "[thread_scope_state]")
+{
+	string source = "some_plugin";
+	set<string> tags;
+	falco_ruleset r;
+	test_event evt;
+	test_event exec_evt;
+
+	auto thread_filter = std::make_shared<counting_filter>(false);
+	auto container_filter = std::make_shared<counting_filter>(false);
+
+	string rule1_name = "thread_rule";
+	rule_options options1;
+	options1.scope = std::make_shared<rule_scope>(thread_filter, rule_scope::SCOPE_THREAD);
+	r.add(source, rule1_name, tags, std::make_shared<counting_filter>(false),
+	      falco_common::PRIORITY_DEBUG, options1);
+	string rule2_name = "container_rule";
+	rule_options options2;
+	options2.scope = std::make_shared<rule_scope>(container_filter, rule_scope::SCOPE_CONTAINER);
+	r.add(source, rule2_name, tags, std::make_shared<counting_filter>(false),
+	      falco_common::PRIORITY_DEBUG, options2);
+	r.enable("", false, true);
+
+	auto state = std::make_shared<single_thread_scope_state>();
+	r.set_scope_state(state);
+
+	REQUIRE_FALSE(r.run(&evt));
+	REQUIRE_FALSE(r.run(&evt));
+	REQUIRE(thread_filter->num_runs == 1);
+	REQUIRE(container_filter->num_runs == 1);
+	REQUIRE(state->slots_of_thread[0] == rule_scope_state::DECISION_FALSE);
+	REQUIRE(state->slots_of_thread[1] == rule_scope_state::DECISION_FALSE);
+
+	SECTION("with execve")
+	{
+		exec_evt.type = PPME_SYSCALL_EXECVE_19_X;
+	}
+
+	SECTION("with execveat")
+	{
+		exec_evt.type = PPME_SYSCALL_EXECVEAT_X;
+	}
+
+	// No rule runs on the exec, but the thread forgets the
+	// results of its previous image
+	REQUIRE_FALSE(r.run(&exec_evt));
+	REQUIRE(state->slots_of_thread[0] == rule_scope_state::DECISION_UNKNOWN);
+	REQUIRE(state->slots_of_thread[1] == rule_scope_state::DECISION_UNKNOWN);
+
+	REQUIRE_FALSE(r.run(&evt));
+	REQUIRE(thread_filter->num_runs == 2);
+	REQUIRE(container_filter->num_runs == 2);
+}
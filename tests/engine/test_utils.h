@@ -0,0 +1,193 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <map>
+#include <set>
+#include <list>
+#include <vector>
+
+#include <sinsp.h>
+#include <filter.h>
+
+#include "gen_filter.h"
+#include "rule_guard.h"
+
+//
+// The events, filterchecks and factories shared by the tests and the
+// benchmarks of the engine.
+//
+
+// Events holding their fields in a map. They're plugin events by
+// default, which run the filters of any plugin source.
+class test_event : public gen_event
+{
+public:
+	uint16_t get_source() const
+	{
+		return 0;
+	}
+
+	uint16_t get_type() const
+	{
+		return type;
+	}
+
+	uint64_t get_ts() const
+	{
+		return ts;
+	}
+
+	uint16_t type = ppm_event_type::PPME_PLUGINEVENT_E;
+	uint64_t ts = 0;
+	std::map<std::string, std::string> fields;
+
+	// The comparisons made by the test_filter_checks
+	uint32_t num_compares = 0;
+};
+
+// Compares a field of test_events with = or in, or extracts it
+class test_filter_check : public gen_event_filter_check
+{
+public:
+	int32_t parse_field_name(const char *str, bool alloc_state, bool needed_for_filtering)
+	{
+		m_field = str;
+		return m_field.size();
+	}
+
+	void add_filter_value(const char *str, uint32_t len, uint32_t i = 0)
+	{
+		m_values.insert(std::string(str, len));
+	}
+
+	bool compare(gen_event *evt)
+	{
+		test_event *tevt = (test_event *) evt;
+		tevt->num_compares++;
+		auto it = tevt->fields.find(m_field);
+		return (it != tevt->fields.end() && m_values.find(it->second) != m_values.end());
+	}
+
+	bool extract(gen_event *evt, std::vector<extract_value_t> &values, bool sanitize_strings = true)
+	{
+		auto &fields = ((test_event *) evt)->fields;
+		auto it = fields.find(m_field);
+
+		values.clear();
+		if(it == fields.end())
+		{
+			return false;
+		}
+
+		extract_value_t val;
+		val.ptr = (uint8_t *) it->second.c_str();
+		val.len = it->second.size();
+		values.push_back(val);
+		return true;
+	}
+
+private:
+	std::string m_field;
+	std::set<std::string> m_values;
+};
+
+// Creates test_filter_checks for any field
+class test_filter_factory : public gen_event_filter_factory
+{
+public:
+	gen_event_filter *new_filter()
+	{
+		return new sinsp_filter(NULL);
+	}
+
+	gen_event_filter_check *new_filtercheck(const char *fldname)
+	{
+		return new test_filter_check();
+	}
+
+	std::list<gen_event_filter_factory::filter_fieldclass_info> get_fields()
+	{
+		return {};
+	}
+};
+
+// A filter that counts how many times it's evaluated
+class counting_filter : public gen_event_filter
+{
+public:
+	counting_filter(bool match):
+		m_match(match)
+	{
+	}
+
+	bool run(gen_event *evt)
+	{
+		num_runs++;
+		return m_match;
+	}
+
+	uint32_t num_runs = 0;
+
+private:
+	bool m_match;
+};
+
+// Extracts a fixed value, counting the extractions
+class test_guard_field : public rule_guard_field
+{
+public:
+	bool extract_key(gen_event *evt, std::string &key)
+	{
+		num_extractions++;
+		key = value;
+		return has_value;
+	}
+
+	std::string value;
+	bool has_value = true;
+	uint32_t num_extractions = 0;
+};
+
+// Extracts a field of test_events, counting the extractions
+class test_string_field : public rule_guard_field
+{
+public:
+	test_string_field(const std::string &field):
+		m_field(field)
+	{
+	}
+
+	bool extract_key(gen_event *evt, std::string &key)
+	{
+		num_extractions++;
+		auto &fields = ((test_event *) evt)->fields;
+		auto it = fields.find(m_field);
+		if(it == fields.end())
+		{
+			return false;
+		}
+		key = it->second;
+		return true;
+	}
+
+	uint32_t num_extractions = 0;
+
+private:
+	std::string m_field;
+};
@@ -0,0 +1,74 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "latency_stats.h"
+#include <catch.hpp>
+
+TEST_CASE("Latency histogram buckets should cover all values", "[latency]")
+{
+	for(uint64_t ns = 0; ns < 1000000; ns++)
+	{
+		uint32_t b = latency_histogram::bucket(ns);
+		REQUIRE(ns < latency_histogram::bucket_upper_bound(b));
+		if(b > 0)
+		{
+			REQUIRE(ns >= latency_histogram::bucket_upper_bound(b - 1));
+		}
+	}
+
+	REQUIRE(latency_histogram::bucket(UINT64_MAX) == latency_histogram::num_buckets - 1);
+}
+
+TEST_CASE("Latency histogram quantiles should be within the bucket precision", "[latency]")
+{
+	latency_stats stats;
+	latency_histogram *h = stats.stage(latency_stats::stage_read);
+	REQUIRE(stats.stage(latency_stats::stage_read) == h);
+
+	for(uint64_t i = 1; i <= 1000; i++)
+	{
+		h->record(i * 1000);
+	}
+
+	latency_histogram::snapshot s;
+	h->get_snapshot(s);
+	REQUIRE(s.count == 1000);
+	REQUIRE(s.sum == 500500000);
+	REQUIRE(s.quantile(0.5) >= 500000);
+	REQUIRE(s.quantile(0.5) <= 500000 * 1.07);
+	REQUIRE(s.quantile(0.99) >= 990000);
+	REQUIRE(s.quantile(0.99) <= 990000 * 1.07);
+	REQUIRE(s.quantile(1) >= 1000000);
+
+	latency_histogram::snapshot prev = s;
+	h->record(7);
+	h->get_snapshot(s);
+	latency_histogram::snapshot delta = s.delta(prev);
+	REQUIRE(delta.count == 1);
+	REQUIRE(delta.quantile(0.5) == 8);
+}
+
+TEST_CASE("Latency stats should be exported in the prometheus format", "[latency]")
+{
+	latency_stats stats;
+	stats.stage(latency_stats::stage_read)->record(2000000);
+	stats.stage(std::string(latency_stats::stage_output_prefix) + "stdout")->record(20000000);
+
+	std::string out = stats.to_prometheus();
+	REQUIRE(out.find("# TYPE falco_alert_latency_seconds histogram") != std::string::npos);
+	REQUIRE(out.find("falco_alert_latency_seconds_bucket{stage=\"read\",le=\"0.001\"} 0") != std::string::npos);
+	REQUIRE(out.find("falco_alert_latency_seconds_bucket{stage=\"read\",le=\"0.005\"} 1") != std::string::npos);
+	REQUIRE(out.find("falco_alert_latency_seconds_count{stage=\"output\",output=\"stdout\"} 1") != std::string::npos);
+}
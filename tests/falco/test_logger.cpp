@@ -0,0 +1,228 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "logger.h"
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <catch.hpp>
+
+// Redirects stderr to a pipe until stop(), which returns what was
+// written. Nothing is read from the pipe before start_reading(), so
+// that the writes to stderr block once the pipe is full.
+class captured_stderr
+{
+public:
+	captured_stderr()
+	{
+		fflush(stderr);
+		REQUIRE(pipe(m_pipe) == 0);
+		m_saved = dup(STDERR_FILENO);
+		dup2(m_pipe[1], STDERR_FILENO);
+		close(m_pipe[1]);
+
+		m_log_syslog = falco_logger::log_syslog;
+		falco_logger::log_syslog = false;
+	}
+
+	~captured_stderr()
+	{
+		stop();
+	}
+
+	void start_reading()
+	{
+		if(m_reader.joinable())
+		{
+			return;
+		}
+
+		m_reader = std::thread([this]()
+		{
+			char buf[4096];
+			ssize_t n;
+			while((n = read(m_pipe[0], buf, sizeof(buf))) > 0)
+			{
+				m_out.append(buf, n);
+			}
+		});
+	}
+
+	std::string stop()
+	{
+		if(m_saved >= 0)
+		{
+			fflush(stderr);
+			dup2(m_saved, STDERR_FILENO);
+			close(m_saved);
+			m_saved = -1;
+
+			start_reading();
+			m_reader.join();
+			close(m_pipe[0]);
+
+			falco_logger::log_syslog = m_log_syslog;
+		}
+		return m_out;
+	}
+
+private:
+	int m_pipe[2];
+	int m_saved;
+	bool m_log_syslog;
+	std::thread m_reader;
+	std::string m_out;
+};
+
+// The messages "<producer> <seq>" written, by producer, and the
+// number of messages reported as dropped
+struct logged_messages
+{
+	logged_messages(const std::string &out):
+		dropped(0)
+	{
+		std::istringstream lines(out);
+		std::string line;
+		while(std::getline(lines, line))
+		{
+			size_t pos = line.find("Dropped ");
+			if(pos != std::string::npos)
+			{
+				dropped += std::strtoull(line.c_str() + pos + 8, NULL, 10);
+				continue;
+			}
+
+			pos = line.find("msg ");
+			REQUIRE(pos != std::string::npos);
+			std::istringstream fields(line.substr(pos + 4));
+			size_t producer;
+			uint64_t seq;
+			fields >> producer >> seq;
+			if(seqs.size() <= producer)
+			{
+				seqs.resize(producer + 1);
+			}
+			seqs[producer].push_back(seq);
+		}
+	}
+
+	size_t count()
+	{
+		size_t ret = 0;
+		for(auto &s : seqs)
+		{
+			ret += s.size();
+		}
+		return ret;
+	}
+
+	std::vector<std::vector<uint64_t>> seqs;
+	uint64_t dropped;
+};
+
+static void log_messages(size_t producer, uint64_t num)
+{
+	for(uint64_t i = 0; i < num; i++)
+	{
+		falco_logger::log(LOG_ERR, "msg " + std::to_string(producer) + " " + std::to_string(i) + "\n");
+	}
+}
+
+TEST_CASE("Should write the messages of each thread in order", "[logger]")
+{
+	const size_t num_producers = 4;
+	const uint64_t num_messages = 200;
+
+	captured_stderr capture;
+	capture.start_reading();
+	falco_logger::start_async();
+
+	std::vector<std::thread> producers;
+	for(size_t p = 0; p < num_producers; p++)
+	{
+		producers.emplace_back(log_messages, p, num_messages);
+	}
+	for(auto &t : producers)
+	{
+		t.join();
+	}
+
+	falco_logger::stop_async();
+	logged_messages logged(capture.stop());
+
+	// The writer keeps up with this few messages
+	REQUIRE(logged.dropped == 0);
+	REQUIRE(logged.seqs.size() == num_producers);
+	for(auto &seqs : logged.seqs)
+	{
+		REQUIRE(seqs.size() == num_messages);
+		for(uint64_t i = 0; i < num_messages; i++)
+		{
+			REQUIRE(seqs[i] == i);
+		}
+	}
+}
+
+TEST_CASE("Should count the messages dropped when the queue is full", "[logger]")
+{
+	const uint64_t num_messages = 20000;
+
+	captured_stderr capture;
+	falco_logger::start_async();
+
+	// Nothing reads stderr, so the writer blocks once the pipe is
+	// full and the queue fills up
+	log_messages(0, num_messages);
+
+	capture.start_reading();
+	falco_logger::stop_async();
+	logged_messages logged(capture.stop());
+
+	REQUIRE(logged.dropped > 0);
+	REQUIRE(logged.count() + logged.dropped == num_messages);
+
+	// The messages written are still in order, with gaps
+	auto &seqs = logged.seqs[0];
+	for(size_t i = 1; i < seqs.size(); i++)
+	{
+		REQUIRE(seqs[i] > seqs[i - 1]);
+	}
+}
+
+TEST_CASE("Should write the queued messages when stopping", "[logger]")
+{
+	const uint64_t num_messages = 500;
+
+	captured_stderr capture;
+	falco_logger::start_async();
+	log_messages(0, num_messages);
+
+	// Nothing is read before stop_async() returns: the messages
+	// fit in the pipe
+	falco_logger::stop_async();
+	logged_messages logged(capture.stop());
+
+	REQUIRE(logged.dropped == 0);
+	REQUIRE(logged.count() == num_messages);
+
+	// The next messages are written directly
+	captured_stderr sync_capture;
+	falco_logger::log(LOG_ERR, "msg 0 0");
+	REQUIRE(logged_messages(sync_capture.stop()).count() == 1);
+}
@@ -14,15 +14,320 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 #include "webserver.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
 #include <catch.hpp>
 
-TEST_CASE("webserver must accept invalid data", "[!hide][webserver][k8s_audit_handler][accept_data]")
+static const std::string s_event = R"({"kind":"Event","stageTimestamp":"2019-07-01T00:00:00.000000Z","verb":"get"})";
+
+static std::string event_list(size_t num)
+{
+	std::string ret = R"({"kind":"EventList","items":[)";
+	for(size_t i = 0; i < num; i++)
+	{
+		ret += (i > 0 ? "," : "") + s_event;
+	}
+	return ret + "]}";
+}
+
+static std::list<std::shared_ptr<json_event>> new_events(size_t num)
+{
+	std::list<std::shared_ptr<json_event>> ret;
+	for(size_t i = 0; i < num; i++)
+	{
+		ret.push_back(std::make_shared<json_event>());
+	}
+	return ret;
+}
+
+// An engine without rules, so that the workers never need outputs
+static falco_engine *new_engine()
+{
+	falco_engine *engine = new falco_engine();
+	std::shared_ptr<gen_event_filter_factory> filter_factory(new json_event_filter_factory());
+	std::shared_ptr<gen_event_formatter_factory> formatter_factory(new json_event_formatter_factory(filter_factory));
+	engine->add_source(k8s_audit_handler::m_k8s_audit_event_source, filter_factory, formatter_factory);
+	return engine;
+}
+
+// Polls cond for up to 5 seconds
+template<typename F>
+static bool wait_for(F cond)
+{
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while(!cond())
+	{
+		if(std::chrono::steady_clock::now() > deadline)
+		{
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+// A socket connected to addr, giving up on reads after 5 seconds
+static int connect_to(int domain, const struct sockaddr *addr, socklen_t len)
+{
+	int fd = socket(domain, SOCK_STREAM, 0);
+	REQUIRE(fd >= 0);
+	struct timeval tv = {5, 0};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	REQUIRE(connect(fd, addr, len) == 0);
+	return fd;
+}
+
+static void write_all(int fd, const std::string &data)
+{
+	size_t pos = 0;
+	while(pos < data.size())
+	{
+		ssize_t n = write(fd, data.data() + pos, data.size() - pos);
+		REQUIRE(n > 0);
+		pos += n;
+	}
+}
+
+// Posts body to the k8s audit endpoint, returning the status of the
+// response
+static int post(int port, const std::string &body)
+{
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int fd = connect_to(AF_INET, (struct sockaddr *) &addr, sizeof(addr));
+
+	write_all(fd, "POST /k8s-audit HTTP/1.1\r\n"
+		      "Host: localhost\r\n"
+		      "Content-Type: application/json\r\n"
+		      "Content-Length: " + std::to_string(body.size()) + "\r\n"
+		      "Connection: close\r\n"
+		      "\r\n" + body);
+
+	std::string response;
+	char buf[1024];
+	ssize_t n;
+	while((n = read(fd, buf, sizeof(buf))) > 0)
+	{
+		response.append(buf, n);
+	}
+	close(fd);
+
+	// "HTTP/1.1 <status> <reason>"
+	size_t pos = response.find(' ');
+	REQUIRE(pos != std::string::npos);
+	return atoi(response.c_str() + pos + 1);
+}
+
+static int connect_unix(const std::string &path)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path.c_str(), path.size());
+	return connect_to(AF_UNIX, (struct sockaddr *) &addr, sizeof(addr));
+}
+
+static std::string length_framed(const std::string &msg)
+{
+	uint32_t len = htonl(msg.size());
+	return std::string((const char *) &len, sizeof(len)) + msg;
+}
+
+TEST_CASE("webserver must accept invalid data", "[webserver][k8s_audit_handler][accept_data]")
+{
+	std::unique_ptr<falco_engine> engine(new_engine());
+	std::string errstr;
+	std::string input("{\"kind\": 0}");
+
+	REQUIRE_FALSE(k8s_audit_handler::accept_data(engine.get(), NULL, input, errstr));
+	REQUIRE_FALSE(errstr.empty());
+}
+
+TEST_CASE("Worker pool should queue all the events of a request or none", "[webserver][k8s_audit_worker_pool]")
+{
+	k8s_audit_worker_pool pool(NULL, 4);
+	auto one = new_events(1);
+	auto two = new_events(2);
+	auto three = new_events(3);
+
+	REQUIRE_FALSE(pool.enqueue(one));
+
+	// Without workers, the events stay in the queue
+	pool.start(new_engine, 0);
+	REQUIRE(pool.running());
+	REQUIRE(pool.enqueue(three));
+	REQUIRE(pool.room() == 1);
+
+	REQUIRE_FALSE(pool.enqueue(two));
+	REQUIRE_FALSE(pool.enqueue(two, std::chrono::milliseconds(10)));
+	REQUIRE(pool.room() == 1);
+
+	REQUIRE(pool.enqueue(one));
+	REQUIRE(pool.full());
+	REQUIRE(pool.room() == 0);
+
+	pool.stop();
+}
+
+TEST_CASE("Worker pool should evaluate the queued events before stopping", "[webserver][k8s_audit_worker_pool]")
 {
-	// falco_engine* engine = new falco_engine();
-	// falco_outputs* outputs = new falco_outputs(engine);
-	// std::string errstr;
-	// std::string input("{\"kind\": 0}");
-	//k8s_audit_handler::accept_data(engine, outputs, input, errstr);
+	k8s_audit_worker_pool pool(NULL, 8);
+	pool.start(new_engine, 2);
+
+	for(int i = 0; i < 16; i++)
+	{
+		auto evts = new_events(8);
+		REQUIRE(pool.enqueue(evts, std::chrono::seconds(5)));
+	}
+
+	// The workers exit once they pop the events queued before
+	// their stop event
+	pool.stop();
+	REQUIRE_FALSE(pool.running());
+	REQUIRE(pool.room() == pool.queue_size());
+
+	auto evts = new_events(1);
+	REQUIRE_FALSE(pool.enqueue(evts));
+	REQUIRE_FALSE(pool.enqueue(evts, std::chrono::milliseconds(10)));
+
+	// Stopping again does nothing
+	pool.stop();
+}
+
+TEST_CASE("Worker pool should wake up the producers waiting for room when stopping", "[webserver][k8s_audit_worker_pool]")
+{
+	k8s_audit_worker_pool pool(NULL, 1);
+	pool.start(new_engine, 0);
+
+	auto one = new_events(1);
+	REQUIRE(pool.enqueue(one));
+
+	bool queued = true;
+	auto other = new_events(1);
+	std::thread producer([&pool, &other, &queued]()
+	{
+		queued = pool.enqueue(other, std::chrono::seconds(60));
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	auto start = std::chrono::steady_clock::now();
+	pool.stop();
+	producer.join();
+
+	REQUIRE_FALSE(queued);
+	REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(30));
+}
+
+TEST_CASE("k8s audit handler should tell the clients when to retry", "[webserver][k8s_audit_handler]")
+{
+	k8s_audit_worker_pool pool(NULL, 2);
+	k8s_audit_handler handler(NULL, NULL, &pool, 0, 0, 0, 1);
+
+	std::vector<std::string> options = {
+		"listening_ports", "127.0.0.1:0",
+		"num_threads", "1"};
+	CivetServer server(options);
+	server.addHandler("/k8s-audit", handler);
+	REQUIRE(server.getListeningPorts().size() == 1);
+	int port = server.getListeningPorts()[0];
+
+	// The pool isn't accepting events yet
+	REQUIRE(post(port, s_event) == 503);
+
+	pool.start(new_engine, 0);
+
+	// A request with more events than the queue can hold must
+	// not be retried
+	REQUIRE(post(port, event_list(3)) == 413);
+	REQUIRE(pool.room() == 2);
+
+	REQUIRE(post(port, s_event) == 202);
+	REQUIRE(pool.room() == 1);
+
+	// Retrying could succeed once the workers make room, and
+	// none of the events are queued meanwhile
+	REQUIRE(post(port, event_list(2)) == 429);
+	REQUIRE(pool.room() == 1);
+
+	REQUIRE(post(port, s_event) == 202);
+	REQUIRE(pool.full());
+	REQUIRE(post(port, s_event) == 429);
+
+	pool.stop();
+	REQUIRE(post(port, s_event) == 503);
+}
+
+TEST_CASE("k8s audit socket server should split the messages of its clients", "[webserver][k8s_audit_socket_server]")
+{
+	k8s_audit_worker_pool pool(NULL, 16);
+	pool.start(new_engine, 0);
+
+	std::string path = "/tmp/falco_test_k8s_audit_" + std::to_string(getpid()) + ".sock";
+
+	SECTION("with newlines")
+	{
+		k8s_audit_socket_server server(&pool, 0, k8s_audit_socket_server::FRAMING_NEWLINE);
+		server.start(path);
+
+		// The last message doesn't need a newline, and empty
+		// lines are skipped
+		int fd = connect_unix(path);
+		write_all(fd, s_event + "\n" + s_event + "\r\n\n" + event_list(2) + "\n" + s_event);
+		close(fd);
+
+		REQUIRE(wait_for([&pool]()
+		{
+			return pool.room() == 11;
+		}));
+		server.stop();
+	}
+
+	SECTION("with lengths")
+	{
+		k8s_audit_socket_server server(&pool, 0, k8s_audit_socket_server::FRAMING_LENGTH);
+		server.start(path);
+
+		// A message can be split across writes
+		int fd = connect_unix(path);
+		std::string data = length_framed(s_event) + length_framed(event_list(2));
+		write_all(fd, data.substr(0, 2));
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		write_all(fd, data.substr(2));
+
+		REQUIRE(wait_for([&pool]()
+		{
+			return pool.room() == 13;
+		}));
+		close(fd);
+		server.stop();
+	}
+
+	SECTION("closing the clients sending messages too large")
+	{
+		k8s_audit_socket_server server(&pool, 64, k8s_audit_socket_server::FRAMING_LENGTH);
+		server.start(path);
+
+		int fd = connect_unix(path);
+		write_all(fd, length_framed(s_event));
+
+		char c;
+		ssize_t n = read(fd, &c, 1);
+		REQUIRE((n == 0 || (n < 0 && errno == ECONNRESET)));
+		close(fd);
+		REQUIRE(pool.room() == 16);
+		server.stop();
+	}
 
-	REQUIRE(1 == 1);
-}
\ No newline at end of file
+	pool.stop();
+}
@@ -0,0 +1,208 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <arpa/inet.h>
+#include <string.h>
+
+#include "cidr_set.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+using namespace std;
+
+static const uint8_t s_ipv4_mapped_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+cidr_set::cidr_set():
+	m_ipv4(1),
+	m_ipv6(1),
+	m_size(0)
+{
+}
+
+cidr_set::~cidr_set()
+{
+}
+
+bool cidr_set::parse(const std::string &str, uint8_t *addr, bool &ipv6, uint32_t &prefix_len, bool &has_prefix)
+{
+	size_t slash = str.find('/');
+	string ip = str.substr(0, slash);
+
+	ipv6 = (ip.find(':') != string::npos);
+	if(inet_pton(ipv6 ? AF_INET6 : AF_INET, ip.c_str(), addr) != 1)
+	{
+		return false;
+	}
+
+	uint32_t max_len = (ipv6 ? 128 : 32);
+	has_prefix = (slash != string::npos);
+	if(!has_prefix)
+	{
+		prefix_len = max_len;
+		return true;
+	}
+
+	string len = str.substr(slash + 1);
+	if(len.empty() || len.size() > 3 ||
+	   len.find_first_not_of("0123456789") != string::npos)
+	{
+		return false;
+	}
+
+	prefix_len = stoul(len);
+	return (prefix_len <= max_len);
+}
+
+void cidr_set::insert(std::vector<node> &trie, const uint8_t *addr, uint32_t prefix_len)
+{
+	uint32_t n = 0;
+
+	for(uint32_t i = 0; i < prefix_len; i++)
+	{
+		// Already covered by a shorter network
+		if(trie[n].terminal)
+		{
+			return;
+		}
+
+		uint32_t bit = (addr[i / 8] >> (7 - (i % 8))) & 1;
+		if(trie[n].child[bit] == 0)
+		{
+			trie[n].child[bit] = trie.size();
+			trie.push_back(node());
+		}
+		n = trie[n].child[bit];
+	}
+
+	// The longer networks below are covered by this one
+	trie[n].terminal = true;
+	trie[n].child[0] = 0;
+	trie[n].child[1] = 0;
+}
+
+bool cidr_set::lookup(const std::vector<node> &trie, const uint8_t *addr, uint32_t bits)
+{
+	uint32_t n = 0;
+
+	for(uint32_t i = 0; i < bits; i++)
+	{
+		if(trie[n].terminal)
+		{
+			return true;
+		}
+
+		n = trie[n].child[(addr[i / 8] >> (7 - (i % 8))) & 1];
+		if(n == 0)
+		{
+			return false;
+		}
+	}
+
+	return trie[n].terminal;
+}
+
+bool cidr_set::add(const std::string &cidr)
+{
+	uint8_t addr[16];
+	bool ipv6;
+	uint32_t prefix_len;
+	bool has_prefix;
+
+	if(!parse(cidr, addr, ipv6, prefix_len, has_prefix))
+	{
+		return false;
+	}
+
+	insert(ipv6 ? m_ipv6 : m_ipv4, addr, prefix_len);
+	m_size++;
+
+	return true;
+}
+
+bool cidr_set::match_ipv4(const uint8_t *addr) const
+{
+	return lookup(m_ipv4, addr, 32);
+}
+
+bool cidr_set::match_ipv6(const uint8_t *addr) const
+{
+	if(memcmp(addr, s_ipv4_mapped_prefix, sizeof(s_ipv4_mapped_prefix)) == 0 &&
+	   lookup(m_ipv4, addr + sizeof(s_ipv4_mapped_prefix), 32))
+	{
+		return true;
+	}
+
+	return lookup(m_ipv6, addr, 128);
+}
+
+bool cidr_set::match(const char *addr) const
+{
+	uint8_t buf[16];
+
+	if(strchr(addr, ':') != NULL)
+	{
+		return (inet_pton(AF_INET6, addr, buf) == 1 && match_ipv6(buf));
+	}
+
+	return (inet_pton(AF_INET, addr, buf) == 1 && match_ipv4(buf));
+}
+
+bool cidr_set::is_cidr(const std::string &str)
+{
+	uint8_t addr[16];
+	bool ipv6;
+	uint32_t prefix_len;
+	bool has_prefix;
+
+	return (parse(str, addr, ipv6, prefix_len, has_prefix) && has_prefix);
+}
+
+size_t cidr_set::size() const
+{
+	return m_size;
+}
+
+std::shared_ptr<const cidr_set> cidr_set_cache::get(const std::vector<std::string> &cidrs)
+{
+	string key;
+	for(auto &cidr : cidrs)
+	{
+		key += cidr;
+		key.push_back('\n');
+	}
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+
+	auto it = m_sets.find(key);
+	if(it != m_sets.end())
+	{
+		return it->second;
+	}
+
+	std::shared_ptr<cidr_set> set = std::make_shared<cidr_set>();
+	for(auto &cidr : cidrs)
+	{
+		set->add(cidr);
+	}
+	m_sets[key] = set;
+
+	return set;
+}
+
+void cidr_set_cache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_sets.clear();
+}
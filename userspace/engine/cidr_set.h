@@ -0,0 +1,92 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+//
+// A set of IPv4 and IPv6 networks in CIDR notation (e.g. 10.0.0.0/8
+// or fd00::/8), kept in a binary trie per address family. Finding
+// whether an address is in any of the networks walks the bits of the
+// address until a network ends, so it costs at most the prefix length
+// of the longest network, whatever the number of networks.
+//
+class cidr_set
+{
+public:
+	cidr_set();
+	virtual ~cidr_set();
+
+	// Add a network, or a single address if there's no prefix
+	// length. Returns false if cidr isn't valid.
+	bool add(const std::string &cidr);
+
+	// Whether an address, in network byte order, is in one of
+	// the networks. IPv4-mapped IPv6 addresses are matched with
+	// the IPv4 networks.
+	bool match_ipv4(const uint8_t *addr) const;
+	bool match_ipv6(const uint8_t *addr) const;
+
+	// Same as above, for an address in text form
+	bool match(const char *addr) const;
+
+	// Whether str is a valid network with a prefix length, like
+	// 10.0.0.0/8
+	static bool is_cidr(const std::string &str);
+
+	size_t size() const;
+
+private:
+	struct node
+	{
+		// Indexes in the trie, 0 if there's no child, as the
+		// root is never a child
+		uint32_t child[2];
+		bool terminal;
+	};
+
+	static bool parse(const std::string &str, uint8_t *addr, bool &ipv6, uint32_t &prefix_len, bool &has_prefix);
+	static void insert(std::vector<node> &trie, const uint8_t *addr, uint32_t prefix_len);
+	static bool lookup(const std::vector<node> &trie, const uint8_t *addr, uint32_t bits);
+
+	std::vector<node> m_ipv4;
+	std::vector<node> m_ipv6;
+	size_t m_size;
+};
+
+//
+// The cidr_sets of the rules, built once for each distinct list of
+// networks and shared by all the checks using it.
+//
+class cidr_set_cache
+{
+public:
+	// The set of cidrs, which must be valid networks
+	std::shared_ptr<const cidr_set> get(const std::vector<std::string> &cidrs);
+
+	void clear();
+
+private:
+	std::mutex m_mtx;
+	std::unordered_map<std::string, std::shared_ptr<const cidr_set>> m_sets;
+};
@@ -0,0 +1,820 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <set>
+
+#include "condition_filter_factory.h"
+#include "json_evt.h"
+#include "falco_common.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+using namespace std;
+
+const std::string condition_filter_factory::external_list_field = "external_list";
+const std::string condition_filter_factory::cidr_field = "in_cidr";
+const std::string condition_filter_factory::multi_pattern_field = "multi_pattern";
+const std::string condition_filter_factory::regex_field = "regex";
+
+// How the values of a field are extracted
+enum value_kind
+{
+	// A json_extracted_values_t, for k8s audit fields
+	JSON_VALUES,
+	// 4 or 16 bytes in network byte order
+	IP_ADDRESS,
+	// NUL-terminated, as extracted by the syscall fields
+	C_STRING,
+	// len characters, as extracted by the plugin fields
+	STRING,
+	UNSUPPORTED
+};
+
+// Creates the check of field with the factory of the event source,
+// throwing falco_exception if it's not a field of the source
+static gen_event_filter_check *new_field_check(const std::string &field,
+					       std::shared_ptr<gen_event_filter_factory> factory)
+{
+	gen_event_filter_check *chk = factory->new_filtercheck(field.c_str());
+	if(chk == NULL ||
+	   chk->parse_field_name(field.c_str(), true, true) != (int32_t) field.size())
+	{
+		delete chk;
+		throw falco_exception("Field " + field + " is not a supported filter field");
+	}
+	return chk;
+}
+
+static value_kind field_value_kind(const std::string &source,
+				   const std::string &field,
+				   gen_event_filter_check *chk,
+				   condition_filter_factory::field_type_t &field_type)
+{
+	// Fields with an argument, like proc.aname[2], are listed
+	// without it
+	string type = field_type(field.substr(0, field.find('[')));
+	if(dynamic_cast<json_event_filter_check *>(chk) != NULL)
+	{
+		return JSON_VALUES;
+	}
+	if(type == "IPV4ADDR" || type == "IPV6ADDR" ||
+	   type == "IPADDR" || type == "IPNET")
+	{
+		return IP_ADDRESS;
+	}
+	if(type == "CHARBUF" || type == "FSPATH" || type == "FSRELPATH")
+	{
+		return (source == "syscall" ? C_STRING : STRING);
+	}
+	return UNSUPPORTED;
+}
+
+//
+// Base class of the pseudo-field checks, which compare the values of
+// the field they wrap, created by the factory of the event source.
+//
+class wrapping_filter_check : public gen_event_filter_check
+{
+public:
+	wrapping_filter_check(const std::string &source,
+			      const std::string &field,
+			      std::shared_ptr<gen_event_filter_factory> factory,
+			      condition_filter_factory::field_type_t &field_type)
+	{
+		m_field.reset(new_field_check(field, factory));
+		m_kind = field_value_kind(source, field, m_field.get(), field_type);
+	}
+
+	int32_t parse_field_name(const char *str, bool alloc_state, bool needed_for_filtering)
+	{
+		return strlen(str);
+	}
+
+	bool extract(gen_event *evt, std::vector<extract_value_t> &values, bool sanitize_strings = true)
+	{
+		return m_field->extract(evt, values, sanitize_strings);
+	}
+
+protected:
+	// Whether match returns true for the values of the field, as
+	// NUL-terminated strings. As for the "in" operator, all the
+	// values of k8s audit fields must match, and any value of the
+	// other fields. Fields without values never match.
+	template<typename Match>
+	bool match_strings(gen_event *evt, Match match)
+	{
+		if(!m_field->extract(evt, m_values, false) || m_values.empty())
+		{
+			return false;
+		}
+
+		if(m_kind == JSON_VALUES)
+		{
+			auto evalues = (const json_extracted_values_t *) m_values[0].ptr;
+			if(evalues->first.empty())
+			{
+				return false;
+			}
+			for(auto &val : evalues->first)
+			{
+				m_str = val.as_string();
+				if(!match(m_str))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		for(auto &val : m_values)
+		{
+			if(val.ptr != NULL && to_string(val) && match(m_str))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Sets m_str to a value of the field
+	bool to_string(const extract_value_t &val)
+	{
+		char buf[INET6_ADDRSTRLEN];
+
+		switch(m_kind)
+		{
+		case IP_ADDRESS:
+			if((val.len != 4 && val.len != 16) ||
+			   inet_ntop(val.len == 16 ? AF_INET6 : AF_INET, val.ptr, buf, sizeof(buf)) == NULL)
+			{
+				return false;
+			}
+			m_str = buf;
+			return true;
+		case C_STRING:
+			m_str = (const char *) val.ptr;
+			return true;
+		case STRING:
+			m_str.assign((const char *) val.ptr, strnlen((const char *) val.ptr, val.len));
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	std::unique_ptr<gen_event_filter_check> m_field;
+	value_kind m_kind;
+	std::vector<extract_value_t> m_values;
+	std::string m_str;
+};
+
+// Checks whether the values of a field are in the external lists
+// given as values
+class external_list_check : public wrapping_filter_check
+{
+public:
+	external_list_check(const std::string &source,
+			    const std::string &field,
+			    std::shared_ptr<gen_event_filter_factory> factory,
+			    condition_filter_factory::field_type_t &field_type,
+			    const std::map<std::string, std::shared_ptr<external_list>> &lists):
+		wrapping_filter_check(source, field, factory, field_type),
+		m_all_lists(lists)
+	{
+		if(m_kind == UNSUPPORTED)
+		{
+			throw falco_exception("Field " + field + " can't be compared with external lists, only string and address fields are supported");
+		}
+	}
+
+	// The values are the names of the lists
+	void add_filter_value(const char *str, uint32_t len, uint32_t i = 0)
+	{
+		string name(str, len);
+		auto it = m_all_lists.find(name);
+		if(it == m_all_lists.end())
+		{
+			throw falco_exception("Undefined external list " + name);
+		}
+		m_lists.push_back(it->second);
+	}
+
+	bool compare(gen_event *evt)
+	{
+		return match_strings(evt, [this](const std::string &val)
+		{
+			for(auto &list : m_lists)
+			{
+				if(list->contains(val.c_str(), val.size()))
+				{
+					return true;
+				}
+			}
+			return false;
+		});
+	}
+
+private:
+	std::map<std::string, std::shared_ptr<external_list>> m_all_lists;
+	std::vector<std::shared_ptr<external_list>> m_lists;
+};
+
+// Checks whether the addresses of a field are in the networks given
+// as values
+class cidr_check : public wrapping_filter_check
+{
+public:
+	cidr_check(const std::string &source,
+		   const std::string &field,
+		   std::shared_ptr<gen_event_filter_factory> factory,
+		   condition_filter_factory::field_type_t &field_type,
+		   std::shared_ptr<cidr_set_cache> cidr_sets):
+		wrapping_filter_check(source, field, factory, field_type),
+		m_cidr_sets(cidr_sets)
+	{
+		if(m_kind == UNSUPPORTED)
+		{
+			throw falco_exception("Field " + field + " can't be compared with networks, only string and address fields are supported");
+		}
+	}
+
+	void add_filter_value(const char *str, uint32_t len, uint32_t i = 0)
+	{
+		string cidr(str, len);
+		if(!cidr_set::is_cidr(cidr))
+		{
+			throw falco_exception("Invalid network " + cidr);
+		}
+		m_cidrs.push_back(cidr);
+	}
+
+	bool compare(gen_event *evt)
+	{
+		// Networks are only known once all the values are
+		// added. The set is shared with the other checks
+		// using the same networks.
+		if(!m_set)
+		{
+			m_set = m_cidr_sets->get(m_cidrs);
+		}
+
+		if(m_kind != IP_ADDRESS)
+		{
+			return match_strings(evt, [this](const std::string &val)
+			{
+				return m_set->match(val.c_str());
+			});
+		}
+
+		if(!m_field->extract(evt, m_values, false))
+		{
+			return false;
+		}
+
+		for(auto &val : m_values)
+		{
+			if(val.ptr == NULL)
+			{
+				continue;
+			}
+			if((val.len == 4 && m_set->match_ipv4(val.ptr)) ||
+			   (val.len == 16 && m_set->match_ipv6(val.ptr)))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	std::shared_ptr<cidr_set_cache> m_cidr_sets;
+	std::vector<std::string> m_cidrs;
+	std::shared_ptr<const cidr_set> m_set;
+};
+
+// Checks whether the values of a string field contain, start or end
+// with any of the patterns given as values, e.g. "contains:curl"
+class multi_pattern_check : public wrapping_filter_check
+{
+public:
+	multi_pattern_check(const std::string &source,
+			    const std::string &field,
+			    std::shared_ptr<gen_event_filter_factory> factory,
+			    condition_filter_factory::field_type_t &field_type,
+			    std::shared_ptr<multi_pattern_matcher> matcher):
+		wrapping_filter_check(source, field, factory, field_type),
+		m_matcher(matcher)
+	{
+		if(m_kind != C_STRING && m_kind != STRING)
+		{
+			throw falco_exception("Field " + field + " can't be compared with multiple patterns, only string fields are supported");
+		}
+	}
+
+	void add_filter_value(const char *str, uint32_t len, uint32_t i = 0)
+	{
+		string value(str, len);
+		size_t sep = value.find(':');
+		string op = value.substr(0, sep);
+		pattern p;
+
+		if(op == "contains")
+		{
+			p.flag = multi_pattern_matcher::MATCH_ANYWHERE;
+		}
+		else if(op == "startswith")
+		{
+			p.flag = multi_pattern_matcher::MATCH_PREFIX;
+		}
+		else if(op == "endswith")
+		{
+			p.flag = multi_pattern_matcher::MATCH_SUFFIX;
+		}
+		else
+		{
+			throw falco_exception("Invalid pattern " + value);
+		}
+
+		if(sep == string::npos || sep + 1 == value.size())
+		{
+			throw falco_exception("Invalid pattern " + value);
+		}
+
+		p.id = m_matcher->add(value.substr(sep + 1));
+		m_patterns.push_back(p);
+	}
+
+	bool compare(gen_event *evt)
+	{
+		if(!m_field->extract(evt, m_values, false))
+		{
+			return false;
+		}
+
+		for(auto &val : m_values)
+		{
+			if(val.ptr == NULL)
+			{
+				continue;
+			}
+
+			const char *str = (const char *) val.ptr;
+			m_matcher->scan(str, (m_kind == C_STRING ? strlen(str) : strnlen(str, val.len)));
+			for(auto &p : m_patterns)
+			{
+				if(m_matcher->matches(p.id) & p.flag)
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+private:
+	struct pattern
+	{
+		uint32_t id;
+		uint8_t flag;
+	};
+
+	std::shared_ptr<multi_pattern_matcher> m_matcher;
+	std::vector<pattern> m_patterns;
+};
+
+// Checks whether the values of a field match any of the regular
+// expressions given as values, as "regex[field] = pattern" or
+// "regex[field] in (pattern, ...)"
+class regex_check : public wrapping_filter_check
+{
+public:
+	regex_check(const std::string &source,
+		    const std::string &field,
+		    std::shared_ptr<gen_event_filter_factory> factory,
+		    condition_filter_factory::field_type_t &field_type,
+		    std::shared_ptr<regex_set> set):
+		wrapping_filter_check(source, field, factory, field_type),
+		m_set(set)
+	{
+		if(m_kind == UNSUPPORTED)
+		{
+			throw falco_exception("Field " + field + " can't be compared with regexes, only string and address fields are supported");
+		}
+	}
+
+	void add_filter_value(const char *str, uint32_t len, uint32_t i = 0)
+	{
+		if(m_cmpop != CO_EQ && m_cmpop != CO_IN)
+		{
+			throw falco_exception("Regexes can only be compared with the '=' and 'in' operators");
+		}
+
+		m_ids.push_back(m_set->add(string(str, len)));
+	}
+
+	bool compare(gen_event *evt)
+	{
+		return match_strings(evt, [this](const std::string &val)
+		{
+			m_set->scan(val.c_str(), val.size());
+			for(auto id : m_ids)
+			{
+				if(m_set->matches(id))
+				{
+					return true;
+				}
+			}
+			return false;
+		});
+	}
+
+private:
+	std::shared_ptr<regex_set> m_set;
+	std::vector<uint32_t> m_ids;
+};
+
+// Extracts the value of a string field for the rule guards
+class guard_field_check : public rule_guard_field
+{
+public:
+	guard_field_check(gen_event_filter_check *field, value_kind kind):
+		m_field(field),
+		m_kind(kind)
+	{
+	}
+
+	bool extract_key(gen_event *evt, std::string &key)
+	{
+		if(!m_field->extract(evt, m_values, false) ||
+		   m_values.size() != 1 ||
+		   m_values[0].ptr == NULL)
+		{
+			return false;
+		}
+
+		switch(m_kind)
+		{
+		case JSON_VALUES:
+		{
+			// Other types of values are compared as numbers
+			auto evalues = (const json_extracted_values_t *) m_values[0].ptr;
+			if(evalues->first.size() != 1 ||
+			   evalues->first[0].ptype() != json_event_value::JT_STRING)
+			{
+				return false;
+			}
+			key = evalues->first[0].as_string();
+			return true;
+		}
+		case C_STRING:
+			key = (const char *) m_values[0].ptr;
+			return true;
+		case STRING:
+			key.assign((const char *) m_values[0].ptr,
+				   strnlen((const char *) m_values[0].ptr, m_values[0].len));
+			return true;
+		default:
+			return false;
+		}
+	}
+
+private:
+	std::unique_ptr<gen_event_filter_check> m_field;
+	value_kind m_kind;
+	std::vector<extract_value_t> m_values;
+};
+
+// Extracts the value of a field of any type for the thresholds.
+// The values that aren't strings are kept as extracted.
+class threshold_field_check : public rule_threshold_field
+{
+public:
+	threshold_field_check(gen_event_filter_check *field, value_kind kind):
+		m_field(field),
+		m_kind(kind)
+	{
+	}
+
+	bool extract_key(gen_event *evt, std::string &key)
+	{
+		if(!m_field->extract(evt, m_values, false) || m_values.empty())
+		{
+			return false;
+		}
+
+		key.clear();
+		for(auto &v : m_values)
+		{
+			if(v.ptr == NULL)
+			{
+				continue;
+			}
+
+			switch(m_kind)
+			{
+			case JSON_VALUES:
+				for(auto &jv : ((const json_extracted_values_t *) v.ptr)->first)
+				{
+					key += jv.as_string();
+					key += '\0';
+				}
+				break;
+			case C_STRING:
+				key += (const char *) v.ptr;
+				key += '\0';
+				break;
+			case STRING:
+				key.append((const char *) v.ptr, strnlen((const char *) v.ptr, v.len));
+				key += '\0';
+				break;
+			default:
+				key.append((const char *) v.ptr, v.len);
+				break;
+			}
+		}
+		return true;
+	}
+
+private:
+	std::unique_ptr<gen_event_filter_check> m_field;
+	value_kind m_kind;
+	std::vector<extract_value_t> m_values;
+};
+
+condition_filter_factory::condition_filter_factory(const std::string &source,
+						   std::shared_ptr<gen_event_filter_factory> factory,
+						   field_type_t field_type,
+						   const std::map<std::string, std::shared_ptr<external_list>> &external_lists,
+						   std::shared_ptr<cidr_set_cache> cidr_sets,
+						   std::shared_ptr<multi_pattern_index> multi_patterns,
+						   std::shared_ptr<regex_set_index> regexes):
+	m_source(source),
+	m_factory(factory),
+	m_field_type(field_type),
+	m_external_lists(external_lists),
+	m_cidr_sets(cidr_sets),
+	m_multi_patterns(multi_patterns),
+	m_regexes(regexes)
+{
+}
+
+condition_filter_factory::~condition_filter_factory()
+{
+}
+
+gen_event_filter *condition_filter_factory::new_filter()
+{
+	return m_factory->new_filter();
+}
+
+// Returns the argument of fld if it's the pseudo-field name, e.g.
+// fd.sip for in_cidr[fd.sip]
+static bool pseudo_field_arg(const string &fld, const string &name, string &arg)
+{
+	if(fld.size() <= name.size() + 2 ||
+	   fld.compare(0, name.size(), name) != 0 ||
+	   fld[name.size()] != '[' ||
+	   fld.back() != ']')
+	{
+		return false;
+	}
+
+	arg = fld.substr(name.size() + 1, fld.size() - name.size() - 2);
+	return true;
+}
+
+gen_event_filter_check *condition_filter_factory::new_filtercheck(const char *fldname)
+{
+	string fld = fldname;
+	string arg;
+
+	if(pseudo_field_arg(fld, external_list_field, arg))
+	{
+		return new external_list_check(m_source, arg, m_factory, m_field_type, m_external_lists);
+	}
+
+	if(pseudo_field_arg(fld, cidr_field, arg))
+	{
+		return new cidr_check(m_source, arg, m_factory, m_field_type, m_cidr_sets);
+	}
+
+	if(pseudo_field_arg(fld, multi_pattern_field, arg))
+	{
+		return new multi_pattern_check(m_source, arg, m_factory, m_field_type,
+					       m_multi_patterns->get(m_source, arg));
+	}
+
+	if(pseudo_field_arg(fld, regex_field, arg))
+	{
+		return new regex_check(m_source, arg, m_factory, m_field_type,
+				       m_regexes->get(m_source, arg));
+	}
+
+	return m_factory->new_filtercheck(fldname);
+}
+
+bool condition_filter_factory::supports_multi_pattern(const std::string &field)
+{
+	if(!compares_extracted_values(field))
+	{
+		return false;
+	}
+
+	std::unique_ptr<gen_event_filter_check> chk;
+	try
+	{
+		chk.reset(new_field_check(field, m_factory));
+	}
+	catch(const std::exception &e)
+	{
+		return false;
+	}
+
+	value_kind kind = field_value_kind(m_source, field, chk.get(), m_field_type);
+	return (kind == C_STRING || kind == STRING);
+}
+
+bool condition_filter_factory::supports_cidr(const std::string &field)
+{
+	std::unique_ptr<gen_event_filter_check> chk;
+	try
+	{
+		chk.reset(new_field_check(field, m_factory));
+	}
+	catch(const std::exception &e)
+	{
+		return false;
+	}
+
+	return (field_value_kind(m_source, field, chk.get(), m_field_type) == IP_ADDRESS);
+}
+
+// The fields whose checks don't compare the values they extract,
+// when used without an argument
+static const std::set<std::string> s_any_ancestor_fields = {
+	"proc.aname", "proc.apid"
+};
+
+bool condition_filter_factory::compares_extracted_values(const std::string &field)
+{
+	return (s_any_ancestor_fields.find(field) == s_any_ancestor_fields.end());
+}
+
+std::map<std::string, std::string> condition_filter_factory::list_field_types(gen_event_filter_factory &factory)
+{
+	std::map<std::string, std::string> ret;
+	for(auto &fieldclass : factory.get_fields())
+	{
+		for(auto &field : fieldclass.fields)
+		{
+			// As tagged by sinsp_filter_factory
+			if(field.tags.find("FILTER ONLY") != field.tags.end())
+			{
+				ret[field.name] = "";
+			}
+			else
+			{
+				ret[field.name] = field.data_type;
+			}
+		}
+	}
+	return ret;
+}
+
+std::list<gen_event_filter_factory::filter_fieldclass_info> condition_filter_factory::get_fields()
+{
+	return m_factory->get_fields();
+}
+
+std::shared_ptr<rule_guard_field> condition_filter_factory::new_guard_field(const std::string &field,
+									    const std::vector<std::string> &values)
+{
+	if(!compares_extracted_values(field))
+	{
+		return NULL;
+	}
+
+	std::unique_ptr<gen_event_filter_check> chk;
+	try
+	{
+		chk.reset(new_field_check(field, m_factory));
+	}
+	catch(const std::exception &e)
+	{
+		return NULL;
+	}
+
+	value_kind kind = field_value_kind(m_source, field, chk.get(), m_field_type);
+	if(kind == JSON_VALUES)
+	{
+		for(auto &v : values)
+		{
+			if(json_event_value(v).ptype() != json_event_value::JT_STRING)
+			{
+				return NULL;
+			}
+		}
+	}
+	else if(kind != C_STRING && kind != STRING)
+	{
+		return NULL;
+	}
+
+	return std::make_shared<guard_field_check>(chk.release(), kind);
+}
+
+std::shared_ptr<rule_guard_field> condition_filter_factory::new_string_field(const std::string &field)
+{
+	if(!compares_extracted_values(field))
+	{
+		return NULL;
+	}
+
+	std::unique_ptr<gen_event_filter_check> chk;
+	try
+	{
+		chk.reset(new_field_check(field, m_factory));
+	}
+	catch(const std::exception &e)
+	{
+		return NULL;
+	}
+
+	value_kind kind = field_value_kind(m_source, field, chk.get(), m_field_type);
+	if(kind != C_STRING && kind != STRING)
+	{
+		return NULL;
+	}
+
+	return std::make_shared<guard_field_check>(chk.release(), kind);
+}
+
+// The syscall fields whose values only change when the thread execs
+// or changes its user or group. The fields of the parent and
+// ancestors aren't included, as they can exec or exit at any
+// time. Neither are the container fields other than the id, whose
+// values can be looked up after the first events of the container.
+static const std::set<std::string> s_thread_fields = {
+	"proc.pid", "proc.vpid", "proc.exe", "proc.exepath", "proc.name",
+	"proc.args", "proc.cmdline", "proc.exeline", "proc.env", "proc.tty",
+	"thread.tid", "thread.vtid",
+	"user.uid", "user.name", "group.gid", "group.name"
+};
+
+static const std::set<std::string> s_container_fields = {
+	"container.id"
+};
+
+rule_scope::scope condition_filter_factory::field_scope(const std::string &field,
+							const std::string &arg)
+{
+	if(m_source != "syscall")
+	{
+		return rule_scope::SCOPE_EVENT;
+	}
+
+	// The multi_pattern and regex checks only depend on the field
+	// they wrap. The external lists can be reloaded.
+	if(field == multi_pattern_field || field == regex_field)
+	{
+		return field_scope(arg, "");
+	}
+
+	if(!arg.empty())
+	{
+		return rule_scope::SCOPE_EVENT;
+	}
+
+	if(s_container_fields.find(field) != s_container_fields.end())
+	{
+		return rule_scope::SCOPE_CONTAINER;
+	}
+
+	if(s_thread_fields.find(field) != s_thread_fields.end())
+	{
+		return rule_scope::SCOPE_THREAD;
+	}
+
+	return rule_scope::SCOPE_EVENT;
+}
+
+std::shared_ptr<rule_threshold_field> condition_filter_factory::new_threshold_field(const std::string &field)
+{
+	std::unique_ptr<gen_event_filter_check> chk(new_field_check(field, m_factory));
+	value_kind kind = field_value_kind(m_source, field, chk.get(), m_field_type);
+	return std::make_shared<threshold_field_check>(chk.release(), kind);
+}
@@ -0,0 +1,138 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <map>
+#include <memory>
+#include <functional>
+
+#include "gen_filter.h"
+#include "external_list.h"
+#include "cidr_set.h"
+#include "multi_pattern_matcher.h"
+#include "regex_set.h"
+#include "rule_guard.h"
+#include "rule_scope.h"
+#include "rule_threshold.h"
+
+//
+// Filter factory used to compile the rule conditions. The list
+// resolver rewrites some checks into checks on pseudo-fields handled
+// by the engine instead of the factory of the event source, which
+// creates all the other fields:
+//
+// - "field in (list_name)" on an external list becomes
+//   "external_list[field] in (list_name)", looking up the values of
+//   field in the list.
+// - "field in (10.0.0.0/8, ...)" becomes
+//   "in_cidr[field] in (10.0.0.0/8, ...)", looking up the address
+//   values of field in a cidr_set.
+// - "field contains a or field startswith b" becomes
+//   "multi_pattern[field] in (contains:a, startswith:b)", finding all
+//   the patterns of field at once with a multi_pattern_matcher.
+//
+// Rules can also use the "regex[field] = pattern" and
+// "regex[field] in (pattern, ...)" checks, matching the values of
+// field with the regexes of a regex_set.
+//
+class condition_filter_factory : public gen_event_filter_factory
+{
+public:
+	// The names of the pseudo-fields
+	static const std::string external_list_field;
+	static const std::string cidr_field;
+	static const std::string multi_pattern_field;
+	static const std::string regex_field;
+
+	// Tells the data type of a field of the event source, as
+	// listed by get_fields()
+	typedef std::function<std::string(const std::string &)> field_type_t;
+
+	// Whether the checks of field compare the values it extracts,
+	// as assumed by the pseudo-fields, the guards and the
+	// exceptions checked by rule_exceptions. The checks of
+	// proc.aname and proc.apid without an index compare all the
+	// ancestors of the thread, while they only extract the
+	// parent.
+	static bool compares_extracted_values(const std::string &field);
+
+	// The data types of the fields of factory, by name, as
+	// expected by field_type_t. The filter-only fields, like
+	// fd.net, have an empty type, as their values can't be
+	// extracted.
+	static std::map<std::string, std::string> list_field_types(gen_event_filter_factory &factory);
+
+	condition_filter_factory(const std::string &source,
+				 std::shared_ptr<gen_event_filter_factory> factory,
+				 field_type_t field_type,
+				 const std::map<std::string, std::shared_ptr<external_list>> &external_lists,
+				 std::shared_ptr<cidr_set_cache> cidr_sets,
+				 std::shared_ptr<multi_pattern_index> multi_patterns,
+				 std::shared_ptr<regex_set_index> regexes);
+	virtual ~condition_filter_factory();
+
+	gen_event_filter *new_filter();
+
+	// Throws falco_exception if a pseudo-field wraps a field that
+	// isn't supported
+	gen_event_filter_check *new_filtercheck(const char *fldname);
+
+	std::list<gen_event_filter_factory::filter_fieldclass_info> get_fields();
+
+	// Whether field can be wrapped by the multi_pattern
+	// pseudo-field, i.e. whether it's a string field comparing
+	// the values it extracts
+	bool supports_multi_pattern(const std::string &field);
+
+	// Whether field can be wrapped by the in_cidr pseudo-field
+	// when compared with networks, i.e. whether it's an address
+	// field whose values can be extracted. The networks compared
+	// with other fields are left to their filtercheck, e.g. fd.net
+	// or the fields holding the networks as text.
+	bool supports_cidr(const std::string &field);
+
+	// The extractor of field for a rule_guard with values, or
+	// NULL if field isn't a string field or doesn't compare the
+	// values it extracts
+	std::shared_ptr<rule_guard_field> new_guard_field(const std::string &field,
+							  const std::vector<std::string> &values);
+
+	// The extractor of the string value of field, compared with
+	// "=" and "in" by a filter_program, or NULL if field isn't a
+	// string field of a syscall or plugin source, or doesn't
+	// compare the values it extracts. The json fields aren't
+	// included, as their "in" checks can compare paths by prefix.
+	std::shared_ptr<rule_guard_field> new_string_field(const std::string &field);
+
+	// The extractor of a group_by field of a rule_threshold.
+	// Throws falco_exception if field isn't a field of the source.
+	std::shared_ptr<rule_threshold_field> new_threshold_field(const std::string &field);
+
+	// The scope of field, given its argument if any. Only the
+	// syscall fields can have the thread or container scope.
+	rule_scope::scope field_scope(const std::string &field, const std::string &arg);
+
+private:
+	std::string m_source;
+	std::shared_ptr<gen_event_filter_factory> m_factory;
+	field_type_t m_field_type;
+	std::map<std::string, std::shared_ptr<external_list>> m_external_lists;
+	std::shared_ptr<cidr_set_cache> m_cidr_sets;
+	std::shared_ptr<multi_pattern_index> m_multi_patterns;
+	std::shared_ptr<regex_set_index> m_regexes;
+};
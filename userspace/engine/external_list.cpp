@@ -0,0 +1,490 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+#include "external_list.h"
+#include "falco_common.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+using namespace std;
+
+//
+// The binary format of the lists:
+//
+// list_header
+// uint64_t hashes[num_values]      sorted
+// uint64_t offsets[num_values + 1] of each value in strings
+// char strings[strings_size]       the values, in the order of hashes
+//
+static const char s_list_magic[8] = {'F', 'A', 'L', 'C', 'O', 'L', 'S', 'T'};
+static const uint32_t s_list_version = 1;
+
+struct list_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t num_values;
+	uint64_t strings_size;
+};
+
+// FNV-1a
+static uint64_t value_hash(const char *value, size_t len)
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	for(size_t i = 0; i < len; i++)
+	{
+		hash ^= (uint8_t) value[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+class external_list::table
+{
+public:
+	// An empty list
+	table();
+
+	// Maps the list in the file at path, compiling it first if
+	// it's a text file. Throws falco_exception on errors.
+	table(const std::string &path);
+
+	virtual ~table();
+
+	bool contains(const char *value, size_t len) const;
+
+private:
+	void map(const std::string &path);
+
+	void *m_addr;
+	size_t m_size;
+
+	uint64_t m_num_values;
+	const uint64_t *m_hashes;
+	const uint64_t *m_offsets;
+	const char *m_strings;
+};
+
+external_list::table::table():
+	m_addr(MAP_FAILED),
+	m_size(0),
+	m_num_values(0),
+	m_hashes(NULL),
+	m_offsets(NULL),
+	m_strings(NULL)
+{
+}
+
+external_list::table::table(const std::string &path):
+	table()
+{
+	char magic[sizeof(s_list_magic)] = {0};
+
+	ifstream in(path, ios::binary);
+	if(!in.is_open())
+	{
+		throw falco_exception("Could not open external list file " + path);
+	}
+	in.read(magic, sizeof(magic));
+	in.close();
+
+	if(memcmp(magic, s_list_magic, sizeof(magic)) == 0)
+	{
+		map(path);
+		return;
+	}
+
+	// A text file, compiled into a temporary file that is unlinked
+	// once mapped
+	const char *tmpdir = getenv("TMPDIR");
+	string tmp = string(tmpdir != NULL ? tmpdir : "/tmp") + "/falco-list-XXXXXX";
+	vector<char> tmp_path(tmp.begin(), tmp.end());
+	tmp_path.push_back('\0');
+
+	int fd = mkstemp(tmp_path.data());
+	if(fd < 0)
+	{
+		throw falco_exception("Could not create a temporary file to compile external list file " + path + ": " + strerror(errno));
+	}
+	close(fd);
+
+	try
+	{
+		compile(path, tmp_path.data());
+		map(tmp_path.data());
+	}
+	catch(falco_exception &e)
+	{
+		unlink(tmp_path.data());
+		throw;
+	}
+	unlink(tmp_path.data());
+}
+
+external_list::table::~table()
+{
+	if(m_addr != MAP_FAILED)
+	{
+		munmap(m_addr, m_size);
+	}
+}
+
+void external_list::table::map(const std::string &path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		throw falco_exception("Could not open external list file " + path + ": " + strerror(errno));
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+	{
+		string err = strerror(errno);
+		close(fd);
+		throw falco_exception("Could not stat external list file " + path + ": " + err);
+	}
+
+	m_size = st.st_size;
+	if(m_size < sizeof(list_header))
+	{
+		close(fd);
+		throw falco_exception("External list file " + path + " is truncated");
+	}
+
+	m_addr = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(m_addr == MAP_FAILED)
+	{
+		throw falco_exception("Could not map external list file " + path + ": " + strerror(errno));
+	}
+
+	const list_header *hdr = (const list_header *) m_addr;
+	size_t max_values = (m_size - sizeof(list_header)) / (2 * sizeof(uint64_t));
+
+	if(hdr->version != s_list_version ||
+	   hdr->num_values > max_values ||
+	   m_size != sizeof(list_header) + (2 * hdr->num_values + 1) * sizeof(uint64_t) + hdr->strings_size)
+	{
+		throw falco_exception("External list file " + path + " is invalid or has an unsupported version");
+	}
+
+	m_num_values = hdr->num_values;
+	m_hashes = (const uint64_t *) (hdr + 1);
+	m_offsets = m_hashes + m_num_values;
+	m_strings = (const char *) (m_offsets + m_num_values + 1);
+
+	// Checked once, so lookups can't read past the mapping
+	uint64_t prev = 0;
+	for(uint64_t i = 0; i <= m_num_values; i++)
+	{
+		if(m_offsets[i] < prev || m_offsets[i] > hdr->strings_size)
+		{
+			throw falco_exception("External list file " + path + " is invalid");
+		}
+		prev = m_offsets[i];
+	}
+}
+
+bool external_list::table::contains(const char *value, size_t len) const
+{
+	uint64_t hash = value_hash(value, len);
+
+	const uint64_t *end = m_hashes + m_num_values;
+	for(const uint64_t *it = lower_bound(m_hashes, end, hash); it != end && *it == hash; it++)
+	{
+		uint64_t i = it - m_hashes;
+		if(m_offsets[i + 1] - m_offsets[i] == len &&
+		   memcmp(m_strings + m_offsets[i], value, len) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool external_list::file_version::operator==(const file_version &other) const
+{
+	return dev == other.dev &&
+		ino == other.ino &&
+		size == other.size &&
+		mtime_ns == other.mtime_ns;
+}
+
+external_list::external_list(const std::string &name, const std::string &path,
+			     falco_common::log_callback_t log):
+	m_name(name),
+	m_path(path),
+	m_log(log),
+	m_pending(NULL),
+	m_version(),
+	m_loaded(false)
+{
+}
+
+external_list::~external_list()
+{
+	delete m_pending.exchange(NULL);
+}
+
+const std::string &external_list::name()
+{
+	return m_name;
+}
+
+const std::string &external_list::path()
+{
+	return m_path;
+}
+
+external_list::file_version external_list::stat_version(const std::string &path)
+{
+	struct stat st;
+	if(stat(path.c_str(), &st) != 0)
+	{
+		throw falco_exception("Could not stat external list file " + path + ": " + strerror(errno));
+	}
+
+	file_version version;
+	version.dev = st.st_dev;
+	version.ino = st.st_ino;
+	version.size = st.st_size;
+	version.mtime_ns = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	return version;
+}
+
+void external_list::load()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+
+	// On errors, update() only retries once the file changes
+	m_loaded = true;
+	m_version = stat_version(m_path);
+	m_table.reset(new table(m_path));
+}
+
+bool external_list::contains(const char *value, size_t len)
+{
+	if(m_pending.load(std::memory_order_relaxed) != NULL)
+	{
+		table *t = m_pending.exchange(NULL, std::memory_order_acquire);
+		if(t != NULL)
+		{
+			m_table.reset(t);
+		}
+	}
+
+	if(!m_table)
+	{
+		try
+		{
+			load();
+		}
+		catch(falco_exception &e)
+		{
+			if(m_log)
+			{
+				m_log(falco_common::PRIORITY_ERROR, "Could not load external list " + m_name +
+				      " from " + m_path + ", it matches nothing until the file changes: " + e.what());
+			}
+			m_table.reset(new table());
+		}
+	}
+
+	return m_table->contains(value, len);
+}
+
+bool external_list::update()
+{
+	if(!m_loaded)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+
+	file_version version = stat_version(m_path);
+	if(version == m_version)
+	{
+		return false;
+	}
+
+	// Not retried until the file changes again
+	m_version = version;
+
+	std::unique_ptr<table> t(new table(m_path));
+	delete m_pending.exchange(t.release(), std::memory_order_acq_rel);
+
+	return true;
+}
+
+void external_list::compile(const std::string &in_path, const std::string &out_path)
+{
+	ifstream in(in_path);
+	if(!in.is_open())
+	{
+		throw falco_exception("Could not open external list file " + in_path);
+	}
+
+	vector<pair<uint64_t, string>> values;
+	string line;
+	while(getline(in, line))
+	{
+		size_t start = line.find_first_not_of(" \t\r");
+		if(start == string::npos || line[start] == '#')
+		{
+			continue;
+		}
+		size_t end = line.find_last_not_of(" \t\r");
+		string value = line.substr(start, end - start + 1);
+		uint64_t hash = value_hash(value.c_str(), value.size());
+		values.push_back(make_pair(hash, std::move(value)));
+	}
+
+	if(in.bad())
+	{
+		throw falco_exception("Could not read external list file " + in_path);
+	}
+
+	sort(values.begin(), values.end());
+	values.erase(unique(values.begin(), values.end()), values.end());
+
+	list_header hdr;
+	memcpy(hdr.magic, s_list_magic, sizeof(hdr.magic));
+	hdr.version = s_list_version;
+	hdr.reserved = 0;
+	hdr.num_values = values.size();
+	hdr.strings_size = 0;
+	for(auto &v : values)
+	{
+		hdr.strings_size += v.second.size();
+	}
+
+	ofstream out(out_path, ios::binary | ios::trunc);
+	if(!out.is_open())
+	{
+		throw falco_exception("Could not open external list file " + out_path + " for writing");
+	}
+
+	out.write((const char *) &hdr, sizeof(hdr));
+	for(auto &v : values)
+	{
+		out.write((const char *) &v.first, sizeof(v.first));
+	}
+
+	uint64_t offset = 0;
+	out.write((const char *) &offset, sizeof(offset));
+	for(auto &v : values)
+	{
+		offset += v.second.size();
+		out.write((const char *) &offset, sizeof(offset));
+	}
+
+	for(auto &v : values)
+	{
+		out.write(v.second.c_str(), v.second.size());
+	}
+
+	out.close();
+	if(out.fail())
+	{
+		throw falco_exception("Could not write external list file " + out_path);
+	}
+}
+
+external_list_watcher::external_list_watcher(uint32_t interval_secs):
+	m_interval_secs(interval_secs),
+	m_stop(false)
+{
+}
+
+external_list_watcher::~external_list_watcher()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+
+	if(m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
+
+void external_list_watcher::add(std::shared_ptr<external_list> list)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+
+	m_lists.push_back(list);
+	if(!m_thread.joinable())
+	{
+		m_thread = std::thread(&external_list_watcher::watch, this);
+	}
+}
+
+void external_list_watcher::set_log_callback(falco_common::log_callback_t log)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+
+	m_log = log;
+}
+
+void external_list_watcher::watch()
+{
+	std::unique_lock<std::mutex> lock(m_mtx);
+
+	while(!m_cv.wait_for(lock, std::chrono::seconds(m_interval_secs), [this] { return m_stop; }))
+	{
+		std::vector<std::shared_ptr<external_list>> lists = m_lists;
+		falco_common::log_callback_t log = m_log;
+		lock.unlock();
+
+		for(auto &list : lists)
+		{
+			try
+			{
+				list->update();
+			}
+			catch(falco_exception &e)
+			{
+				// The list keeps its current values
+				if(log)
+				{
+					log(falco_common::PRIORITY_ERROR, "Could not reload external list " + list->name() +
+					    " from " + list->path() + ", keeping its current values: " + e.what());
+				}
+			}
+		}
+
+		lock.lock();
+	}
+}
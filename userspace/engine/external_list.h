@@ -0,0 +1,140 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "falco_common.h"
+
+//
+// A list whose values are read from a file instead of being written
+// in the rules files, for lists too large to be expanded in the
+// conditions, like threat intelligence feeds of hashes, IPs or
+// domains. Rules reference it as "field in (list_name)".
+//
+// The file either holds a value per line (empty lines and lines
+// beginning with # are skipped), or is already in the binary format
+// written by compile(). Text files are compiled into a temporary file
+// when loaded. The binary file is mapped in memory, and holds the
+// 64-bit hashes of the values sorted, so a lookup is a binary search
+// on the hashes and a comparison of the values with the same hash.
+//
+// The list is loaded by load() when the rules are loaded, or else on
+// the first lookup. Once loaded, update() reloads the file when it
+// changes, and the new version replaces the old one on the next
+// lookup, without recompiling the rules.
+//
+class external_list
+{
+public:
+	// log is called with the errors of the lookups, if set
+	external_list(const std::string &name, const std::string &path,
+		      falco_common::log_callback_t log = falco_common::log_callback_t());
+	virtual ~external_list();
+
+	const std::string &name();
+	const std::string &path();
+
+	// Load the file, throwing falco_exception if it can't be
+	// loaded. Called by the thread evaluating the rules, before
+	// the first lookup.
+	void load();
+
+	// Whether value is one of the values of the list. Only called
+	// by the thread evaluating the rules. If the file can't be
+	// loaded on the first lookup, the error is logged and the
+	// list is empty until update() succeeds.
+	bool contains(const char *value, size_t len);
+
+	// If the list was loaded and its file changed since then, load
+	// the new file and swap it in for the next lookup. Can be
+	// called from another thread. Returns true if the list was
+	// reloaded, and throws falco_exception if the file can't be
+	// loaded, keeping the current values.
+	bool update();
+
+	// Write the values of the text file in_path to out_path in the
+	// binary format of the lists. Throws falco_exception on errors.
+	static void compile(const std::string &in_path, const std::string &out_path);
+
+private:
+	class table;
+
+	// Identifies the contents of a file
+	struct file_version
+	{
+		dev_t dev;
+		ino_t ino;
+		off_t size;
+		int64_t mtime_ns;
+
+		bool operator==(const file_version &other) const;
+	};
+
+	static file_version stat_version(const std::string &path);
+
+	std::string m_name;
+	std::string m_path;
+	falco_common::log_callback_t m_log;
+
+	// The values being used, owned by the thread calling contains()
+	std::unique_ptr<table> m_table;
+
+	// A new version loaded by update(), taken by contains()
+	std::atomic<table *> m_pending;
+
+	// Protects m_version, written when loading the file
+	std::mutex m_mtx;
+	file_version m_version;
+	std::atomic<bool> m_loaded;
+};
+
+//
+// Periodically calls update() on external lists from a background
+// thread, started when the first list is added. The lists that can't
+// be reloaded are reported to the log callback, if set.
+//
+class external_list_watcher
+{
+public:
+	external_list_watcher(uint32_t interval_secs = 5);
+	virtual ~external_list_watcher();
+
+	void add(std::shared_ptr<external_list> list);
+
+	void set_log_callback(falco_common::log_callback_t log);
+
+private:
+	void watch();
+
+	uint32_t m_interval_secs;
+	std::vector<std::shared_ptr<external_list>> m_lists;
+	falco_common::log_callback_t m_log;
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	bool m_stop;
+	std::thread m_thread;
+};
@@ -19,6 +19,7 @@ limitations under the License.
 #include <string>
 #include <exception>
 #include <mutex>
+#include <functional>
 
 extern "C" {
 #include "lua.h"
@@ -87,6 +88,11 @@ public:
 		PRIORITY_DEBUG = 7
 	};
 
+	// Reports what can't be returned to the caller, e.g. the
+	// errors of a background thread. The priorities match the
+	// syslog levels.
+	typedef std::function<void(priority_type priority, const std::string &msg)> log_callback_t;
+
 protected:
 	lua_State *m_ls;
 
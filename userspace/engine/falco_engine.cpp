@@ -25,6 +25,7 @@ limitations under the License.
 #include "falco_engine.h"
 #include "falco_utils.h"
 #include "falco_engine_version.h"
+#include "falco_probes.h"
 
 #include "formats.h"
 
@@ -44,10 +45,14 @@ const std::string falco_engine::s_default_ruleset = "falco-default-ruleset";
 using namespace std;
 
 falco_engine::falco_engine(bool seed_rng)
-	: m_next_ruleset_id(0),
+	: m_compile_programs(true),
+	  m_rule_thresholds(new rule_threshold_index()),
+	  m_next_ruleset_id(0),
 	  m_min_priority(falco_common::PRIORITY_DEBUG),
 	  m_sampling_ratio(1), m_sampling_multiplier(0),
-	  m_replace_container_info(false)
+	  m_replace_container_info(false),
+	  m_rule_profiling(false),
+	  m_rule_cpu_budget({0, 0, 0, falco_ruleset::BUDGET_SAMPLE, 1})
 {
 	luaopen_yaml(m_ls);
 
@@ -172,6 +177,9 @@ void falco_engine::load_rules(const string &rules_content, bool verbose, bool al
 			m_rules->add_filter_factory(it.first, it.second);
 		}
 	}
+	m_rules->set_compile_programs(m_compile_programs);
+	m_rules->set_log_callback(m_log_cb);
+	m_rules->set_rule_thresholds(m_rule_thresholds);
 
 	m_rules->load_rules(rules_content, verbose, all_events, m_extra, m_replace_container_info, m_min_priority, required_engine_version, m_required_plugin_versions);
 }
@@ -223,6 +231,17 @@ void falco_engine::enable_rule_exact(const string &rule_name, bool enabled, cons
 	}
 }
 
+void falco_engine::enable_source_rule_exact(const string &source, const string &rule_name, bool enabled, const string &ruleset)
+{
+	auto it = m_rulesets.find(source);
+	if(it == m_rulesets.end())
+	{
+		return;
+	}
+
+	it->second->enable(rule_name, true, enabled, find_ruleset_id(ruleset));
+}
+
 void falco_engine::enable_rule_by_tag(const set<string> &tags, bool enabled, const string &ruleset)
 {
 	uint16_t ruleset_id = find_ruleset_id(ruleset);
@@ -296,10 +315,7 @@ std::shared_ptr<gen_event_formatter> falco_engine::create_formatter(const std::s
 
 unique_ptr<falco_engine::rule_result> falco_engine::process_event(std::string &source, gen_event *ev, uint16_t ruleset_id)
 {
-	if(should_drop_evt())
-	{
-		return unique_ptr<struct rule_result>();
-	}
+	FALCO_PROBE3(process_event_entry, source.c_str(), ev->get_ts(), ruleset_id);
 
 	auto it = m_rulesets.find(source);
 	if(it == m_rulesets.end())
@@ -308,8 +324,16 @@ unique_ptr<falco_engine::rule_result> falco_engine::process_event(std::string &s
 		throw falco_exception(err);
 	}
 
+	if(should_drop_evt())
+	{
+		it->second->skip(ev);
+		FALCO_PROBE4(process_event_return, source.c_str(), ev->get_ts(), -1, "");
+		return unique_ptr<struct rule_result>();
+	}
+
 	if (!it->second->run(ev, ruleset_id))
 	{
+		FALCO_PROBE4(process_event_return, source.c_str(), ev->get_ts(), -1, "");
 		return unique_ptr<struct rule_result>();
 	}
 
@@ -318,6 +342,8 @@ unique_ptr<falco_engine::rule_result> falco_engine::process_event(std::string &s
 
 	populate_rule_result(res, ev);
 
+	FALCO_PROBE4(process_event_return, source.c_str(), ev->get_ts(), (int) ev->get_check_id(), res->rule.c_str());
+
 	return res;
 }
 
@@ -334,6 +360,8 @@ void falco_engine::add_source(const std::string &source,
 	m_format_factories[source] = formatter_factory;
 
 	std::shared_ptr<falco_ruleset> ruleset(new falco_ruleset());
+	ruleset->enable_profiling(m_rule_profiling);
+	ruleset->set_cpu_budget(m_rule_cpu_budget, m_rule_cpu_budget_cb);
 	m_rulesets[source] = ruleset;
 }
 
@@ -416,7 +444,9 @@ void falco_engine::print_stats()
 void falco_engine::add_filter(std::shared_ptr<gen_event_filter> filter,
 			      std::string &rule,
 			      std::string &source,
-			      std::set<std::string> &tags)
+			      std::set<std::string> &tags,
+			      falco_common::priority_type priority,
+			      const rule_options &options)
 {
 	auto it = m_rulesets.find(source);
 	if(it == m_rulesets.end())
@@ -425,7 +455,7 @@ void falco_engine::add_filter(std::shared_ptr<gen_event_filter> filter,
 		throw falco_exception(err);
 	}
 
-	it->second->add(source, rule, tags, filter);
+	it->second->add(source, rule, tags, filter, priority, options);
 }
 
 bool falco_engine::is_source_valid(const std::string &source)
@@ -470,12 +500,77 @@ void falco_engine::clear_filters()
 	for(auto &it : m_filter_factories)
 	{
 		std::shared_ptr<falco_ruleset> ruleset(new falco_ruleset());
+		ruleset->enable_profiling(m_rule_profiling);
+		ruleset->set_cpu_budget(m_rule_cpu_budget, m_rule_cpu_budget_cb);
 		m_rulesets[it.first] = ruleset;
 	}
 
 	m_required_plugin_versions.clear();
 }
 
+void falco_engine::enable_rule_profiling(bool enabled)
+{
+	m_rule_profiling = enabled;
+
+	for(auto &it : m_rulesets)
+	{
+		it.second->enable_profiling(enabled);
+	}
+}
+
+void falco_engine::get_rule_profile(std::list<falco_ruleset::rule_profile> &profile, bool all)
+{
+	for(auto &it : m_rulesets)
+	{
+		it.second->get_profile(profile, all, m_default_ruleset_id);
+	}
+}
+
+void falco_engine::set_rule_cpu_budget(const falco_ruleset::cpu_budget &budget,
+				       falco_ruleset::budget_callback_t cb)
+{
+	m_rule_cpu_budget = budget;
+	m_rule_cpu_budget_cb = cb;
+
+	for(auto &it : m_rulesets)
+	{
+		it.second->set_cpu_budget(budget, cb);
+	}
+}
+
+void falco_engine::set_compile_programs(bool enabled)
+{
+	m_compile_programs = enabled;
+}
+
+void falco_engine::set_log_callback(falco_common::log_callback_t cb)
+{
+	m_log_cb = cb;
+}
+
+std::shared_ptr<rule_threshold_index> falco_engine::get_rule_thresholds()
+{
+	return m_rule_thresholds;
+}
+
+void falco_engine::set_rule_thresholds(std::shared_ptr<rule_threshold_index> thresholds)
+{
+	m_rule_thresholds = thresholds;
+}
+
+void falco_engine::set_rule_scope_state(const std::string &source,
+					std::shared_ptr<rule_scope_state> state)
+{
+	auto it = m_rulesets.find(source);
+	if(it == m_rulesets.end())
+	{
+		string err = "Unknown event source " + source;
+		throw falco_exception(err);
+	}
+
+	it->second->set_scope_state(state);
+}
+
 void falco_engine::set_sampling_ratio(uint32_t sampling_ratio)
 {
 	m_sampling_ratio = sampling_ratio;
@@ -83,6 +83,11 @@ public:
 	// Like enable_rule, but the rule name must be an exact match.
 	void enable_rule_exact(const std::string &rule_name, bool enabled, const std::string &ruleset = s_default_ruleset);
 
+	// Like enable_rule_exact, but only for the rules of a single
+	// event source. This leaves other sources alone, as they may
+	// be evaluated by other threads.
+	void enable_source_rule_exact(const std::string &source, const std::string &rule_name, bool enabled, const std::string &ruleset = s_default_ruleset);
+
 	//
 	// Enable/Disable any rules with any of the provided tags (set, exact matches only)
 	//
@@ -118,6 +123,61 @@ public:
 	// Clear all existing filters.
 	void clear_filters();
 
+	//
+	// Whether the rule conditions are compiled into a
+	// filter_program, run instead of their gen_event_filter. On by
+	// default, and only affects the rules loaded afterwards.
+	//
+	void set_compile_programs(bool enabled);
+
+	//
+	// Report the errors found outside of the calls to the engine,
+	// e.g. the external lists that can't be reloaded, to cb. Only
+	// affects the rules loaded afterwards.
+	//
+	void set_log_callback(falco_common::log_callback_t cb);
+
+	//
+	// The thresholds of the rules with count and window. An
+	// engine loading the same rules as another one and
+	// evaluating them on another thread can share its thresholds,
+	// so that each rule counts the events seen by both. Only
+	// affects the rules loaded afterwards.
+	//
+	std::shared_ptr<rule_threshold_index> get_rule_thresholds();
+	void set_rule_thresholds(std::shared_ptr<rule_threshold_index> thresholds);
+
+	//
+	// Measure the time spent evaluating each rule. This slows
+	// down rule evaluation, so it's mostly meant for offline
+	// analysis.
+	//
+	void enable_rule_profiling(bool enabled);
+
+	//
+	// Fill in the profile of the rules evaluated so far, for all
+	// sources, when rule profiling is enabled. If all is true,
+	// every loaded rule is included, e.g. to list them along
+	// with their priority.
+	//
+	void get_rule_profile(std::list<falco_ruleset::rule_profile> &profile, bool all = false);
+
+	//
+	// Demote the rules that use more CPU than budget, for all
+	// sources, calling cb for each of them. See
+	// falco_ruleset::set_cpu_budget().
+	//
+	void set_rule_cpu_budget(const falco_ruleset::cpu_budget &budget,
+				 falco_ruleset::budget_callback_t cb);
+
+	//
+	// Cache the results of the parts of the rules of source that
+	// only depend on the thread or container of the events in
+	// state. Must be called once all the rules are loaded.
+	//
+	void set_rule_scope_state(const std::string &source,
+				  std::shared_ptr<rule_scope_state> state);
+
 	//
 	// Set the sampling ratio, which can affect which events are
 	// matched against the set of rules.
@@ -183,12 +243,16 @@ public:
 	bool is_source_valid(const std::string &source);
 
 	//
-	// Add a filter for the provided event source to the engine
+	// Add a filter for the provided event source to the engine,
+	// with the options of the rule, e.g. its exceptions not
+	// expanded into the filter (see falco_ruleset::add)
 	//
 	void add_filter(std::shared_ptr<gen_event_filter> filter,
 			std::string &rule,
 			std::string &source,
-			std::set<std::string> &tags);
+			std::set<std::string> &tags,
+			falco_common::priority_type priority = falco_common::PRIORITY_DEBUG,
+			const rule_options &options = rule_options());
 
 	//
 	// Given an event source and ruleset, fill in a bitset
@@ -231,6 +295,9 @@ private:
 	std::map<std::string, std::shared_ptr<falco_ruleset>> m_rulesets;
 
 	std::unique_ptr<falco_rules> m_rules;
+	bool m_compile_programs;
+	falco_common::log_callback_t m_log_cb;
+	std::shared_ptr<rule_threshold_index> m_rule_thresholds;
 	uint16_t m_next_ruleset_id;
 	std::map<string, uint16_t> m_known_rulesets;
 	falco_common::priority_type m_min_priority;
@@ -269,5 +336,9 @@ private:
 
 	std::string m_extra;
 	bool m_replace_container_info;
+
+	bool m_rule_profiling;
+	falco_ruleset::cpu_budget m_rule_cpu_budget;
+	falco_ruleset::budget_callback_t m_rule_cpu_budget_cb;
 };
 
@@ -0,0 +1,41 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+//
+// USDT probes of the "falco" provider, which can be listed with
+// "bpftrace -l 'usdt:/usr/bin/falco:*'" (see scripts/bpftrace for
+// examples). A probe is a single nop until a tracer attaches to it,
+// but its arguments are always evaluated, so they should only be
+// values already at hand (no allocations nor lookups).
+//
+// Probes are compiled in when sys/sdt.h is available at build time
+// (see USE_USDT), and expand to nothing otherwise.
+//
+#ifdef HAS_USDT
+#include <sys/sdt.h>
+
+#define FALCO_PROBE1(name, a1) DTRACE_PROBE1(falco, name, a1)
+#define FALCO_PROBE2(name, a1, a2) DTRACE_PROBE2(falco, name, a1, a2)
+#define FALCO_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(falco, name, a1, a2, a3)
+#define FALCO_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(falco, name, a1, a2, a3, a4)
+#else
+#define FALCO_PROBE1(name, a1)
+#define FALCO_PROBE2(name, a1, a2)
+#define FALCO_PROBE3(name, a1, a2, a3)
+#define FALCO_PROBE4(name, a1, a2, a3, a4)
+#endif
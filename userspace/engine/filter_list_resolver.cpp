@@ -0,0 +1,270 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "filter_list_resolver.h"
+#include "condition_filter_factory.h"
+#include "cidr_set.h"
+#include "falco_common.h"
+
+using namespace std;
+using namespace libsinsp::filter;
+
+bool filter_list_resolver::run(libsinsp::filter::ast::expr*& filter)
+{
+	m_resolved_lists.clear();
+	m_last_node_changed = false;
+	m_last_node = filter;
+	filter->accept(this);
+	if (m_last_node_changed)
+	{
+		delete filter;
+		filter = m_last_node;
+	}
+	return !m_resolved_lists.empty();
+}
+
+void filter_list_resolver::set_list(
+		const string &name,
+		shared_ptr<const vector<string>> items)
+{
+	m_external_lists.erase(name);
+	m_lists[name] = items;
+}
+
+void filter_list_resolver::set_external_list(const string &name)
+{
+	m_lists.erase(name);
+	m_external_lists.insert(name);
+}
+
+void filter_list_resolver::set_cidr_fields(field_filter_t supported)
+{
+	m_cidr_fields = supported;
+}
+
+void filter_list_resolver::clear()
+{
+	m_lists.clear();
+	m_external_lists.clear();
+}
+
+set<string>& filter_list_resolver::get_resolved_lists()
+{
+	return m_resolved_lists;
+}
+
+void filter_list_resolver::visit(ast::and_expr* e)
+{
+	for (size_t i = 0; i < e->children.size(); i++)
+	{
+		e->children[i]->accept(this);
+		if (m_last_node_changed)
+		{
+			delete e->children[i];
+			e->children[i] = m_last_node;
+		}
+	}
+	m_last_node = e;
+	m_last_node_changed = false;
+}
+
+void filter_list_resolver::visit(ast::or_expr* e)
+{
+	for (size_t i = 0; i < e->children.size(); i++)
+	{
+		e->children[i]->accept(this);
+		if (m_last_node_changed)
+		{
+			delete e->children[i];
+			e->children[i] = m_last_node;
+		}
+	}
+	m_last_node = e;
+	m_last_node_changed = false;
+}
+
+void filter_list_resolver::visit(ast::not_expr* e)
+{
+	e->child->accept(this);
+	if (m_last_node_changed)
+	{
+		delete e->child;
+		e->child = m_last_node;
+	}
+	m_last_node = e;
+	m_last_node_changed = false;
+}
+
+void filter_list_resolver::visit(ast::list_expr* e)
+{
+	m_last_node = e;
+	m_last_node_changed = false;
+
+	// Most lists of values don't reference any list, and are
+	// left untouched
+	size_t i = 0;
+	for (; i < e->values.size(); i++)
+	{
+		if (m_lists.find(e->values[i]) != m_lists.end())
+		{
+			break;
+		}
+	}
+
+	if (i == e->values.size())
+	{
+		return;
+	}
+
+	vector<string> values(e->values.begin(), e->values.begin() + i);
+	for (; i < e->values.size(); i++)
+	{
+		auto list = m_lists.find(e->values[i]);
+		if (list == m_lists.end())
+		{
+			values.push_back(e->values[i]);
+		}
+		else
+		{
+			values.insert(values.end(), list->second->begin(), list->second->end());
+			m_resolved_lists.insert(e->values[i]);
+		}
+	}
+	e->values = std::move(values);
+}
+
+static string check_field(ast::binary_check_expr* e)
+{
+	return e->arg.empty() ? e->field : e->field + "[" + e->arg + "]";
+}
+
+// Whether e compares a field with networks, e.g.
+// "fd.sip in (10.0.0.0/8, 192.168.0.0/16)", and the field can be
+// wrapped by in_cidr
+bool filter_list_resolver::is_cidr_check(ast::binary_check_expr* e)
+{
+	auto list = dynamic_cast<ast::list_expr*>(e->value);
+	if (!m_cidr_fields || e->op != "in" || list == nullptr
+		|| list->values.empty()
+		|| e->field == condition_filter_factory::regex_field)
+	{
+		return false;
+	}
+
+	for (auto &v : list->values)
+	{
+		if (!cidr_set::is_cidr(v))
+		{
+			return false;
+		}
+	}
+	return m_cidr_fields(check_field(e));
+}
+
+void filter_list_resolver::visit(ast::binary_check_expr* e)
+{
+	e->value->accept(this);
+	m_last_node = e;
+	m_last_node_changed = false;
+
+	auto list = dynamic_cast<ast::list_expr*>(e->value);
+	if (list == nullptr)
+	{
+		return;
+	}
+
+	vector<string> externals;
+	vector<string> values;
+	for (auto &v : list->values)
+	{
+		if (m_external_lists.find(v) != m_external_lists.end())
+		{
+			externals.push_back(v);
+		}
+		else
+		{
+			values.push_back(v);
+		}
+	}
+
+	if (externals.empty())
+	{
+		// Networks are looked up in a trie instead of being
+		// compared one by one
+		if (is_cidr_check(e))
+		{
+			e->arg = check_field(e);
+			e->field = condition_filter_factory::cidr_field;
+		}
+		return;
+	}
+
+	if (e->op != "in")
+	{
+		throw falco_exception("External list " + externals[0]
+			+ " can only be used with the 'in' operator");
+	}
+
+	// The external lists are looked up with the extracted values,
+	// e.g. only the parent for proc.aname, which would change the
+	// meaning of the check
+	if (!condition_filter_factory::compares_extracted_values(check_field(e)))
+	{
+		throw falco_exception("External list " + externals[0]
+			+ " can't be used with field " + check_field(e)
+			+ ", whose checks don't compare the values it extracts");
+	}
+
+	// The external lists are looked up by their own check, and
+	// the other values remain in the original check
+	for (auto &name : externals)
+	{
+		m_resolved_lists.insert(name);
+	}
+	ast::expr* external_check = new ast::binary_check_expr(
+		condition_filter_factory::external_list_field, check_field(e),
+		"in", new ast::list_expr(externals));
+
+	if (values.empty())
+	{
+		m_last_node = external_check;
+	}
+	else
+	{
+		auto check = new ast::binary_check_expr(
+			e->field, e->arg, e->op, new ast::list_expr(values));
+		if (is_cidr_check(check))
+		{
+			check->arg = check_field(check);
+			check->field = condition_filter_factory::cidr_field;
+		}
+		m_last_node = new ast::or_expr({external_check, check});
+	}
+	m_last_node_changed = true;
+}
+
+void filter_list_resolver::visit(ast::unary_check_expr* e)
+{
+	m_last_node = e;
+	m_last_node_changed = false;
+}
+
+void filter_list_resolver::visit(ast::value_expr* e)
+{
+	// Either a macro reference or the single value of a check
+	m_last_node = e;
+	m_last_node_changed = false;
+}
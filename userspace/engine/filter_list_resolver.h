@@ -0,0 +1,123 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <filter/parser.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+
+/*!
+	\brief Helper class for substituting list references in parsed
+	filters with the items of the lists. Lists are defined once and
+	their items are inserted in the list values of the AST, so that
+	conditions don't need to be expanded as text and parsed again
+	for every rule using a list. Checks on external lists, whose
+	values are looked up in a file at runtime, and on networks are
+	rewritten into checks of the condition_filter_factory
+	pseudo-fields. Networks are only rewritten for the fields set
+	with set_cidr_fields(), as they depend on the event source.
+*/
+class filter_list_resolver: private libsinsp::filter::ast::expr_visitor
+{
+	public:
+		typedef std::function<bool(const std::string &)> field_filter_t;
+
+		/*!
+			\brief Visits a filter AST and substitutes the values of
+			list expressions (e.g. "(a, b)" in "proc.name in (a, b)")
+			that are the name of a list defined through set_list()
+			with the items of the list.
+			\param filter The filter AST to be processed. Note that the
+			pointer is passed by reference and may be modified, in
+			case the root node is a check on an external list.
+			\return true if at least one of the defined lists is resolved
+			\throws falco_exception if an external list is used with
+			an operator other than "in", or with a field whose checks
+			don't compare the values it extracts (e.g. proc.aname
+			without an index)
+		*/
+		bool run(libsinsp::filter::ast::expr*& filter);
+
+		/*!
+			\brief Defines a new list to be substituted in filters. If
+			called multiple times for the same list name, the previous
+			definition gets overridden. The items must not contain
+			references to other lists, and are used as they are, with
+			no quoting.
+			\param name The name of the list.
+			\param items The items of the list.
+		*/
+		void set_list(
+			const std::string &name,
+			std::shared_ptr<const std::vector<std::string>> items);
+
+		/*!
+			\brief Defines a new external list. A check like
+			"field in (name, a, b)" is rewritten into
+			"external_list[field] in (name) or field in (a, b)".
+			\param name The name of the list.
+		*/
+		void set_external_list(const std::string &name);
+
+		/*!
+			\brief Defines the fields whose checks on networks, like
+			"fd.sip in (10.0.0.0/8)", are rewritten into checks of
+			the in_cidr pseudo-field. No check is rewritten until
+			this is called.
+			\param supported Tells whether a field can be wrapped
+			by the in_cidr pseudo-field.
+		*/
+		void set_cidr_fields(field_filter_t supported);
+
+		/*!
+			\brief Removes all the lists defined with set_list()
+			and set_external_list().
+		*/
+		void clear();
+
+		/*!
+			\brief Returns a set containing the names of all the lists
+			substituted during the last invocation of run(). Should be
+			non-empty if the last invocation of run() returned true.
+		*/
+		std::set<std::string>& get_resolved_lists();
+
+	private:
+		void visit(libsinsp::filter::ast::and_expr* e) override;
+		void visit(libsinsp::filter::ast::or_expr* e) override;
+		void visit(libsinsp::filter::ast::not_expr* e) override;
+		void visit(libsinsp::filter::ast::value_expr* e) override;
+		void visit(libsinsp::filter::ast::list_expr* e) override;
+		void visit(libsinsp::filter::ast::unary_check_expr* e) override;
+		void visit(libsinsp::filter::ast::binary_check_expr* e) override;
+
+		bool is_cidr_check(libsinsp::filter::ast::binary_check_expr* e);
+
+		bool m_last_node_changed;
+		libsinsp::filter::ast::expr* m_last_node;
+		std::set<std::string> m_resolved_lists;
+		std::set<std::string> m_external_lists;
+		field_filter_t m_cidr_fields;
+		std::unordered_map<
+			std::string,
+			std::shared_ptr<const std::vector<std::string>>
+		> m_lists;
+};
@@ -0,0 +1,158 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "filter_multi_pattern_resolver.h"
+#include "condition_filter_factory.h"
+
+#include <map>
+
+using namespace std;
+using namespace libsinsp::filter;
+
+filter_multi_pattern_resolver::filter_multi_pattern_resolver(field_filter_t supported):
+	m_supported(supported),
+	m_resolved(false)
+{
+}
+
+bool filter_multi_pattern_resolver::run(libsinsp::filter::ast::expr* filter)
+{
+	m_resolved = false;
+	filter->accept(this);
+	return m_resolved;
+}
+
+void filter_multi_pattern_resolver::visit(ast::and_expr* e)
+{
+	for (auto &c : e->children)
+	{
+		c->accept(this);
+	}
+}
+
+// The pattern of a check on a field, e.g. "contains:curl" for
+// "proc.cmdline contains curl", or an empty string if it can't be
+// grouped
+static string check_pattern(ast::expr* e)
+{
+	auto check = dynamic_cast<ast::binary_check_expr*>(e);
+	if (check == nullptr)
+	{
+		return "";
+	}
+
+	auto value = dynamic_cast<ast::value_expr*>(check->value);
+	if (value == nullptr || value->value.empty())
+	{
+		return "";
+	}
+
+	if (check->op != "contains"
+		&& check->op != "startswith"
+		&& check->op != "endswith")
+	{
+		return "";
+	}
+
+	return check->op + ":" + value->value;
+}
+
+static string check_field(ast::expr* e)
+{
+	auto check = dynamic_cast<ast::binary_check_expr*>(e);
+	return check->arg.empty() ? check->field : check->field + "[" + check->arg + "]";
+}
+
+void filter_multi_pattern_resolver::visit(ast::or_expr* e)
+{
+	// The patterns of each field, in the order of the checks
+	map<string, vector<string>> patterns;
+	for (auto &c : e->children)
+	{
+		c->accept(this);
+		string pattern = check_pattern(c);
+		if (!pattern.empty())
+		{
+			patterns[check_field(c)].push_back(pattern);
+		}
+	}
+
+	for (auto it = patterns.begin(); it != patterns.end(); )
+	{
+		if (it->second.size() < 2 || !m_supported(it->first))
+		{
+			it = patterns.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	if (patterns.empty())
+	{
+		return;
+	}
+
+	// A group replaces its first check, and the others are removed
+	vector<ast::expr*> children;
+	for (auto &c : e->children)
+	{
+		auto group = patterns.end();
+		if (!check_pattern(c).empty())
+		{
+			group = patterns.find(check_field(c));
+		}
+
+		if (group == patterns.end())
+		{
+			children.push_back(c);
+			continue;
+		}
+
+		if (!group->second.empty())
+		{
+			children.push_back(new ast::binary_check_expr(
+				condition_filter_factory::multi_pattern_field, group->first,
+				"in", new ast::list_expr(group->second)));
+			group->second.clear();
+		}
+		delete c;
+	}
+	e->children = std::move(children);
+	m_resolved = true;
+}
+
+void filter_multi_pattern_resolver::visit(ast::not_expr* e)
+{
+	e->child->accept(this);
+}
+
+void filter_multi_pattern_resolver::visit(ast::list_expr* e)
+{
+}
+
+void filter_multi_pattern_resolver::visit(ast::binary_check_expr* e)
+{
+}
+
+void filter_multi_pattern_resolver::visit(ast::unary_check_expr* e)
+{
+}
+
+void filter_multi_pattern_resolver::visit(ast::value_expr* e)
+{
+}
@@ -0,0 +1,62 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <filter/parser.h>
+#include <string>
+#include <functional>
+
+/*!
+	\brief Helper class for grouping the "contains", "startswith" and
+	"endswith" checks on the same field in the alternatives of an "or",
+	e.g. "proc.cmdline contains a or proc.cmdline contains b". Each
+	group is rewritten into a single check of the multi_pattern
+	pseudo-field of the condition_filter_factory, which finds all the
+	patterns of the field at once.
+*/
+class filter_multi_pattern_resolver: private libsinsp::filter::ast::expr_visitor
+{
+	public:
+		typedef std::function<bool(const std::string &)> field_filter_t;
+
+		/*!
+			\param supported Tells whether the checks on a field,
+			like "proc.aname[2]", can be grouped.
+		*/
+		explicit filter_multi_pattern_resolver(field_filter_t supported);
+
+		/*!
+			\brief Visits a filter AST and rewrites the groups of at
+			least two checks on the same field. The root node is
+			never replaced.
+			\param filter The filter AST to be processed.
+			\return true if at least one group of checks is rewritten
+		*/
+		bool run(libsinsp::filter::ast::expr* filter);
+
+	private:
+		void visit(libsinsp::filter::ast::and_expr* e) override;
+		void visit(libsinsp::filter::ast::or_expr* e) override;
+		void visit(libsinsp::filter::ast::not_expr* e) override;
+		void visit(libsinsp::filter::ast::value_expr* e) override;
+		void visit(libsinsp::filter::ast::list_expr* e) override;
+		void visit(libsinsp::filter::ast::unary_check_expr* e) override;
+		void visit(libsinsp::filter::ast::binary_check_expr* e) override;
+
+		field_filter_t m_supported;
+		bool m_resolved;
+};
@@ -0,0 +1,457 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <map>
+
+#include "filter_program.h"
+#include "falco_common.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+using namespace std;
+using namespace libsinsp::filter;
+
+// The operators known by the program, as in sinsp_filter_compiler
+static const std::map<std::string, cmpop> s_operators = {
+	{"=", CO_EQ},
+	{"==", CO_EQ},
+	{"!=", CO_NE},
+	{"<", CO_LT},
+	{"<=", CO_LE},
+	{">", CO_GT},
+	{">=", CO_GE},
+	{"contains", CO_CONTAINS},
+	{"icontains", CO_ICONTAINS},
+	{"startswith", CO_STARTSWITH},
+	{"endswith", CO_ENDSWITH},
+	{"glob", CO_GLOB},
+	{"in", CO_IN},
+	{"intersects", CO_INTERSECTS},
+	{"pmatch", CO_PMATCH},
+	{"exists", CO_EXISTS}
+};
+
+//
+// Emits the instructions of the expressions. The jumps are first
+// made to labels, whose instruction is only known once the following
+// expressions are emitted.
+//
+class filter_program::compiler
+{
+public:
+	compiler(filter_program &program,
+		 std::shared_ptr<gen_event_filter_factory> factory,
+		 new_field_t new_field):
+		m_program(program),
+		m_factory(factory),
+		m_new_field(new_field)
+	{
+		m_labels.push_back(0); // ACCEPT
+		m_labels.push_back(0); // REJECT
+	}
+
+	void compile(ast::expr *filter)
+	{
+		emit(filter, ACCEPT, REJECT);
+
+		uint32_t size = (uint32_t) m_code.size();
+		m_labels[ACCEPT] = size;
+		m_labels[REJECT] = size + 1;
+
+		extract_fields();
+
+		// Only the checks used several times remember their
+		// result
+		std::vector<uint32_t> uses(m_program.m_checks.size(), 0);
+		for(auto &c : m_code)
+		{
+			uses[c.check]++;
+		}
+
+		std::vector<int32_t> results(m_program.m_checks.size(), -1);
+		for(size_t i = 0; i < uses.size(); i++)
+		{
+			if(uses[i] > 1)
+			{
+				results[i] = (int32_t) m_program.m_results.size();
+				m_program.m_results.push_back({0, false});
+			}
+		}
+
+		for(auto &c : m_code)
+		{
+			instruction in;
+			in.check = m_program.m_checks[c.check].get();
+			in.match = m_program.m_matches[c.check].get();
+			in.result = results[c.check];
+			in.on_true = m_labels[c.on_true];
+			in.on_false = m_labels[c.on_false];
+			m_program.m_code.push_back(in);
+		}
+	}
+
+private:
+	static const uint32_t ACCEPT = 0;
+	static const uint32_t REJECT = 1;
+
+	// An instruction with the index of its check in m_checks and
+	// labels as targets
+	struct pending_instruction
+	{
+		uint32_t check;
+		uint32_t on_true;
+		uint32_t on_false;
+	};
+
+	uint32_t new_label()
+	{
+		m_labels.push_back(0);
+		return (uint32_t) m_labels.size() - 1;
+	}
+
+	// The label is at the next instruction emitted
+	void bind(uint32_t label)
+	{
+		m_labels[label] = (uint32_t) m_code.size();
+	}
+
+	void emit(ast::expr *e, uint32_t on_true, uint32_t on_false)
+	{
+		auto and_e = dynamic_cast<ast::and_expr *>(e);
+		if(and_e != nullptr)
+		{
+			emit_children(and_e->children, true, on_true, on_false);
+			return;
+		}
+
+		auto or_e = dynamic_cast<ast::or_expr *>(e);
+		if(or_e != nullptr)
+		{
+			emit_children(or_e->children, false, on_true, on_false);
+			return;
+		}
+
+		auto not_e = dynamic_cast<ast::not_expr *>(e);
+		if(not_e != nullptr)
+		{
+			emit(not_e->child, on_false, on_true);
+			return;
+		}
+
+		auto binary_e = dynamic_cast<ast::binary_check_expr *>(e);
+		if(binary_e != nullptr)
+		{
+			std::vector<std::string> values;
+			auto value = dynamic_cast<ast::value_expr *>(binary_e->value);
+			auto list = dynamic_cast<ast::list_expr *>(binary_e->value);
+			if(value != nullptr)
+			{
+				values.push_back(value->value);
+			}
+			else if(list != nullptr)
+			{
+				values = list->values;
+			}
+			else
+			{
+				throw falco_exception("Unexpected value for field " + binary_e->field);
+			}
+
+			emit_check(binary_e->field, binary_e->arg, binary_e->op, values,
+				   list != nullptr, on_true, on_false);
+			return;
+		}
+
+		auto unary_e = dynamic_cast<ast::unary_check_expr *>(e);
+		if(unary_e != nullptr)
+		{
+			emit_check(unary_e->field, unary_e->arg, unary_e->op, {},
+				   false, on_true, on_false);
+			return;
+		}
+
+		throw falco_exception("Unexpected expression in condition");
+	}
+
+	// The children of an "and" stop at the first false one, and
+	// the ones of an "or" at the first true one
+	void emit_children(std::vector<ast::expr *> &children, bool is_and,
+			   uint32_t on_true, uint32_t on_false)
+	{
+		if(children.empty())
+		{
+			throw falco_exception("Unexpected empty expression in condition");
+		}
+
+		for(size_t i = 0; i + 1 < children.size(); i++)
+		{
+			uint32_t next = new_label();
+			if(is_and)
+			{
+				emit(children[i], next, on_false);
+			}
+			else
+			{
+				emit(children[i], on_true, next);
+			}
+			bind(next);
+		}
+		emit(children.back(), on_true, on_false);
+	}
+
+	void emit_check(const std::string &field, const std::string &arg,
+			const std::string &op, const std::vector<std::string> &values,
+			bool is_list, uint32_t on_true, uint32_t on_false)
+	{
+		std::string name = (arg.empty() ? field : field + "[" + arg + "]");
+
+		std::string key = name + '\0' + op + '\0' + (is_list ? "(" : "=");
+		for(auto &v : values)
+		{
+			key += v + '\0';
+		}
+
+		auto it = m_checks.find(key);
+		if(it == m_checks.end())
+		{
+			auto cmp = s_operators.find(op);
+			if(cmp == s_operators.end())
+			{
+				throw falco_exception("Unknown operator " + op);
+			}
+
+			std::unique_ptr<gen_event_filter_check> chk(m_factory->new_filtercheck(name.c_str()));
+			if(!chk)
+			{
+				throw falco_exception("Unknown field " + name);
+			}
+
+			// As done by sinsp_filter_compiler
+			chk->m_cmpop = cmp->second;
+			chk->m_boolop = BO_NONE;
+			chk->parse_field_name(name.c_str(), true, true);
+			for(size_t i = 0; i < values.size(); i++)
+			{
+				chk->add_filter_value(values[i].c_str(), values[i].size(), i);
+			}
+
+			it = m_checks.insert(make_pair(key, (uint32_t) m_program.m_checks.size())).first;
+			m_program.m_checks.push_back(std::move(chk));
+			m_program.m_matches.push_back(new_match(name, cmp->second, values, is_list));
+		}
+
+		m_code.push_back({it->second, on_true, on_false});
+	}
+
+	// The string_match of a check, or NULL if the check compares
+	// its field otherwise. Its field is the index of the field in
+	// m_field_names until the fields are extracted.
+	std::unique_ptr<string_match> new_match(const std::string &name, cmpop op,
+						const std::vector<std::string> &values,
+						bool is_list)
+	{
+		std::unique_ptr<string_match> ret;
+		if(!m_new_field ||
+		   !((op == CO_EQ && !is_list && values.size() == 1) ||
+		     (op == CO_IN && is_list && !values.empty())))
+		{
+			return ret;
+		}
+
+		auto it = m_fields.find(name);
+		if(it == m_fields.end())
+		{
+			it = m_fields.insert(make_pair(name, (uint32_t) m_field_names.size())).first;
+			m_field_names.push_back(name);
+		}
+
+		ret.reset(new string_match());
+		ret->field = it->second;
+		ret->is_list = is_list;
+		if(is_list)
+		{
+			ret->values.insert(values.begin(), values.end());
+		}
+		else
+		{
+			ret->value = values[0];
+		}
+		return ret;
+	}
+
+	// Only the fields compared by several checks are extracted
+	// by the program, as it saves extracting them again, while
+	// a single check compares its field as fast as the program
+	void extract_fields()
+	{
+		std::vector<uint32_t> uses(m_field_names.size(), 0);
+		for(auto &m : m_program.m_matches)
+		{
+			if(m)
+			{
+				uses[m->field]++;
+			}
+		}
+
+		std::vector<int32_t> fields(m_field_names.size(), -1);
+		for(size_t i = 0; i < uses.size(); i++)
+		{
+			if(uses[i] < 2)
+			{
+				continue;
+			}
+
+			std::shared_ptr<rule_guard_field> extractor = m_new_field(m_field_names[i]);
+			if(extractor)
+			{
+				fields[i] = (int32_t) m_program.m_fields.size();
+				m_program.m_fields.push_back({extractor, 0, false, ""});
+			}
+		}
+
+		for(auto &m : m_program.m_matches)
+		{
+			if(m && fields[m->field] < 0)
+			{
+				m.reset();
+			}
+			else if(m)
+			{
+				m->field = (uint32_t) fields[m->field];
+			}
+		}
+	}
+
+	filter_program &m_program;
+	std::shared_ptr<gen_event_filter_factory> m_factory;
+	new_field_t m_new_field;
+
+	std::vector<pending_instruction> m_code;
+
+	// The instruction of each label
+	std::vector<uint32_t> m_labels;
+
+	// The index of each distinct check in m_program.m_checks
+	std::map<std::string, uint32_t> m_checks;
+
+	// The string fields of the string_matches, and the index of
+	// each one in m_field_names
+	std::vector<std::string> m_field_names;
+	std::map<std::string, uint32_t> m_fields;
+};
+
+filter_program::filter_program(libsinsp::filter::ast::expr *filter,
+			       std::shared_ptr<gen_event_filter_factory> factory,
+			       int32_t check_id,
+			       new_field_t new_field):
+	m_run(0),
+	m_check_id(check_id)
+{
+	compiler c(*this, factory, new_field);
+	c.compile(filter);
+}
+
+filter_program::~filter_program()
+{
+}
+
+inline bool filter_program::compare(const instruction &in, gen_event *evt)
+{
+	if(in.match != NULL)
+	{
+		string_field &f = m_fields[in.match->field];
+		if(f.run != m_run)
+		{
+			f.run = m_run;
+			f.has_value = f.extractor->extract_key(evt, f.value);
+		}
+
+		// Otherwise, the check knows how to compare a
+		// missing value or several ones
+		if(f.has_value)
+		{
+			if(in.match->is_list)
+			{
+				return (in.match->values.find(f.value) != in.match->values.end());
+			}
+			return (f.value == in.match->value);
+		}
+	}
+
+	return in.check->compare(evt);
+}
+
+bool filter_program::run(gen_event *evt)
+{
+	m_run++;
+
+	const uint32_t accept = (uint32_t) m_code.size();
+	uint32_t pc = 0;
+	while(pc < accept)
+	{
+		const instruction &in = m_code[pc];
+		bool res;
+		if(in.result < 0)
+		{
+			res = compare(in, evt);
+		}
+		else
+		{
+			result &r = m_results[in.result];
+			if(r.run != m_run)
+			{
+				r.run = m_run;
+				r.value = compare(in, evt);
+			}
+			res = r.value;
+		}
+		pc = (res ? in.on_true : in.on_false);
+	}
+
+	if(pc == accept)
+	{
+		evt->set_check_id(m_check_id);
+		return true;
+	}
+	return false;
+}
+
+size_t filter_program::num_checks()
+{
+	return m_checks.size();
+}
+
+size_t filter_program::num_instructions()
+{
+	return m_code.size();
+}
+
+size_t filter_program::num_string_matches()
+{
+	size_t ret = 0;
+	for(auto &m : m_matches)
+	{
+		if(m)
+		{
+			ret++;
+		}
+	}
+	return ret;
+}
+
+size_t filter_program::num_string_fields()
+{
+	return m_fields.size();
+}
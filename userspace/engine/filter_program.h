@@ -0,0 +1,142 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_set>
+#include <functional>
+
+#include <filter/parser.h>
+
+#include "gen_filter.h"
+#include "rule_guard.h"
+
+//
+// A rule condition compiled into a flat array of checks, each one
+// telling which check comes next depending on its result. "and", "or"
+// and "not" are resolved when compiling into the jumps of the checks,
+// so running the program is a single loop calling compare() on the
+// checks actually needed, instead of walking the expression tree of
+// gen_event_filter and dispatching on the boolean operator of each
+// check.
+//
+// The same check used several times in a condition, which is common
+// once macros are expanded, is only created once and only evaluated
+// once per event.
+//
+// The "field = value" and "field in (values)" checks of a string
+// field compared by several checks, such as proc.name in the lists of
+// many macros, don't call compare() when the field has a single
+// value: the field is extracted once per run, and looked up in the
+// values of each check.
+//
+class filter_program
+{
+public:
+	// Creates the extractor of the string value of a field, or
+	// returns NULL if its checks must call compare()
+	typedef std::function<std::shared_ptr<rule_guard_field>(
+		const std::string &field)> new_field_t;
+
+	// Compile filter with the checks of factory. check_id is set
+	// on the events matching the program. new_field, if set,
+	// creates the extractors of the string fields compared with
+	// "=" and "in" by several checks. Throws falco_exception if the condition can't
+	// be compiled, e.g. for an unknown operator, in which case
+	// it's left to gen_event_filter.
+	filter_program(libsinsp::filter::ast::expr *filter,
+		       std::shared_ptr<gen_event_filter_factory> factory,
+		       int32_t check_id,
+		       new_field_t new_field = new_field_t());
+	virtual ~filter_program();
+
+	bool run(gen_event *evt);
+
+	// The number of checks, and of instructions referring to them
+	size_t num_checks();
+	size_t num_instructions();
+
+	// The number of checks comparing the values of extracted
+	// string fields, and of those fields
+	size_t num_string_matches();
+	size_t num_string_fields();
+
+private:
+	// The values of a "field = value" or "field in (values)" check
+	// of a string field
+	struct string_match
+	{
+		// The index of the field in m_fields
+		uint32_t field;
+
+		bool is_list;
+		std::string value;
+		std::unordered_set<std::string> values;
+	};
+
+	// A string field, extracted at most once per run
+	struct string_field
+	{
+		std::shared_ptr<rule_guard_field> extractor;
+		uint64_t run;
+		bool has_value;
+		std::string value;
+	};
+
+	struct instruction
+	{
+		gen_event_filter_check *check;
+
+		// The values compared with the field of check, used
+		// instead of check if the field has a single value, or
+		// NULL
+		const string_match *match;
+
+		// The index of the result of check in m_results if
+		// the check is used by other instructions, or -1
+		int32_t result;
+
+		// The next instruction, ACCEPT for m_code.size(), or
+		// REJECT for m_code.size() + 1
+		uint32_t on_true;
+		uint32_t on_false;
+	};
+
+	// The result of a check used by several instructions, valid
+	// for the run it was computed in
+	struct result
+	{
+		uint64_t run;
+		bool value;
+	};
+
+	class compiler;
+
+	inline bool compare(const instruction &in, gen_event *evt);
+
+	std::vector<instruction> m_code;
+	std::vector<std::unique_ptr<gen_event_filter_check>> m_checks;
+
+	// The string_match of each check, if any
+	std::vector<std::unique_ptr<string_match>> m_matches;
+	std::vector<string_field> m_fields;
+	std::vector<result> m_results;
+	uint64_t m_run;
+	int32_t m_check_id;
+};
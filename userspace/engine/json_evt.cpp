@@ -15,6 +15,9 @@ limitations under the License.
 */
 
 #include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <mutex>
 
 #include "uri.h"
 #include "utils.h"
@@ -38,10 +41,104 @@ void json_event::set_jevt(json &evt, uint64_t ts)
 {
 	m_jevt = evt;
 	m_event_ts = ts;
+	m_extracted.clear();
+
+#ifdef HAS_SIMDJSON
+	m_doc.reset();
+	m_jevt_valid = true;
+#endif
 }
 
+#ifdef HAS_SIMDJSON
+// Only call on elements known to be strings
+static inline std::string simd_string(simdjson::dom::element elem)
+{
+	std::string_view sv = elem.get_string().value_unsafe();
+	return std::string(sv.data(), sv.size());
+}
+
+// Convert a simdjson element into the equivalent nlohmann::json object
+static void simd_to_json(simdjson::dom::element elem, json &j)
+{
+	switch(elem.type())
+	{
+	case simdjson::dom::element_type::ARRAY:
+		j = json::array();
+		for(simdjson::dom::element item : simdjson::dom::array(elem))
+		{
+			j.emplace_back();
+			simd_to_json(item, j.back());
+		}
+		break;
+	case simdjson::dom::element_type::OBJECT:
+		j = json::object();
+		for(simdjson::dom::key_value_pair field : simdjson::dom::object(elem))
+		{
+			simd_to_json(field.value, j[std::string(field.key.data(), field.key.size())]);
+		}
+		break;
+	case simdjson::dom::element_type::INT64:
+		j = int64_t(elem);
+		break;
+	case simdjson::dom::element_type::UINT64:
+		j = uint64_t(elem);
+		break;
+	case simdjson::dom::element_type::DOUBLE:
+		j = double(elem);
+		break;
+	case simdjson::dom::element_type::STRING:
+		j = simd_string(elem);
+		break;
+	case simdjson::dom::element_type::BOOL:
+		j = bool(elem);
+		break;
+	case simdjson::dom::element_type::NULL_VALUE:
+		j = nullptr;
+		break;
+	}
+}
+
+void json_event::set_jevt(std::shared_ptr<simdjson::dom::document> doc,
+			  simdjson::dom::element elem,
+			  bool list_item,
+			  uint64_t ts)
+{
+	m_doc = doc;
+	m_elem = elem;
+	m_list_item = list_item;
+	m_jevt = json();
+	m_jevt_valid = false;
+	m_event_ts = ts;
+	m_extracted.clear();
+}
+
+bool json_event::simd_elem(simdjson::dom::element &elem, bool &list_item) const
+{
+	if(!m_doc)
+	{
+		return false;
+	}
+
+	elem = m_elem;
+	list_item = m_list_item;
+	return true;
+}
+#endif
+
 const json &json_event::jevt()
 {
+#ifdef HAS_SIMDJSON
+	if(!m_jevt_valid)
+	{
+		simd_to_json(m_elem, m_jevt);
+		if(m_list_item)
+		{
+			m_jevt["kind"] = "Event";
+		}
+		m_jevt_valid = true;
+	}
+#endif
+
 	return m_jevt;
 }
 
@@ -50,6 +147,33 @@ uint64_t json_event::get_ts() const
 	return m_event_ts;
 }
 
+const json_extracted_values_t *json_event::extracted_values(uint32_t field_id)
+{
+	if(field_id >= m_extracted.size())
+	{
+		return NULL;
+	}
+
+	return m_extracted[field_id].get();
+}
+
+const json_extracted_values_t *json_event::set_extracted_values(uint32_t field_id, json_extracted_values_t &&values)
+{
+	if(field_id >= m_extracted.size())
+	{
+		m_extracted.resize(field_id + 1);
+	}
+
+	m_extracted[field_id] = std::make_shared<json_extracted_values_t>(std::move(values));
+
+	return m_extracted[field_id].get();
+}
+
+void json_event::clear_extracted_values()
+{
+	m_extracted.clear();
+}
+
 static nlohmann::json::json_pointer k8s_audit_time = "/stageTimestamp"_json_pointer;
 
 bool falco_k8s_audit::parse_k8s_audit_json(nlohmann::json &j, std::list<json_event> &evts, bool top)
@@ -108,21 +232,543 @@ bool falco_k8s_audit::parse_k8s_audit_json(nlohmann::json &j, std::list<json_eve
 			uint64_t ns = 0;
 			if(!sinsp_utils::parse_iso_8601_utc_string(j.value(k8s_audit_time, "<NA>"), ns))
 			{
-				return false;
+				return false;
+			}
+
+			evts.back().set_jevt(j, ns);
+			return true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	catch(exception &e)
+	{
+		return false;
+	}
+}
+
+#ifdef HAS_SIMDJSON
+// Add the event represented by elem to evts, if it's valid.
+static bool add_simd_event(std::shared_ptr<simdjson::dom::document> &doc,
+			   simdjson::dom::element elem,
+			   bool list_item,
+			   std::list<json_event> &evts)
+{
+	std::string_view ts;
+	uint64_t ns = 0;
+
+	if(elem.at_pointer("/stageTimestamp").get_string().get(ts) != simdjson::SUCCESS ||
+	   !sinsp_utils::parse_iso_8601_utc_string(std::string(ts.data(), ts.size()), ns))
+	{
+		return false;
+	}
+
+	evts.emplace_back();
+	evts.back().set_jevt(doc, elem, list_item, ns);
+
+	return true;
+}
+
+// Mirrors parse_k8s_audit_json above.
+static bool parse_simd_events(std::shared_ptr<simdjson::dom::document> &doc,
+			      simdjson::dom::element elem,
+			      std::list<json_event> &evts,
+			      bool top)
+{
+	if(elem.is_array())
+	{
+		if(!top)
+		{
+			return false;
+		}
+
+		// Note we only handle a single top level array, to
+		// avoid excessive recursion.
+		for(simdjson::dom::element item : simdjson::dom::array(elem))
+		{
+			if(!parse_simd_events(doc, item, evts, false))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	std::string_view kind;
+	if(elem["kind"].get_string().get(kind) != simdjson::SUCCESS)
+	{
+		return false;
+	}
+
+	if(kind == "EventList")
+	{
+		simdjson::dom::element items;
+		auto err = elem["items"].get(items);
+
+		if(err == simdjson::NO_SUCH_FIELD)
+		{
+			return true;
+		}
+
+		if(err != simdjson::SUCCESS || !items.is_array())
+		{
+			return false;
+		}
+
+		for(simdjson::dom::element item : simdjson::dom::array(items))
+		{
+			if(!add_simd_event(doc, item, true, evts))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+	else if(kind == "Event")
+	{
+		return add_simd_event(doc, elem, false, evts);
+	}
+
+	return false;
+}
+
+bool falco_k8s_audit::parse_k8s_audit_data(simdjson::dom::parser &parser,
+					   const char *data, size_t len,
+					   std::list<json_event> &evts,
+					   std::string &errstr)
+{
+	std::shared_ptr<simdjson::dom::document> doc = std::make_shared<simdjson::dom::document>();
+	simdjson::dom::element root;
+
+	auto err = parser.parse_into_document(*doc, (const uint8_t *) data, len).get(root);
+	if(err != simdjson::SUCCESS)
+	{
+		errstr = std::string("Could not parse data: ") + simdjson::error_message(err);
+		return false;
+	}
+
+	if(!parse_simd_events(doc, root, evts, true))
+	{
+		errstr = std::string("Data not recognized as a k8s audit event");
+		return false;
+	}
+
+	return true;
+}
+#endif
+
+// A streambuf that pulls its data from a reader function, keeping
+// track of how many bytes have been consumed so far and stopping
+// once the maximum input size has been exceeded.
+class falco_k8s_audit::event_stream_parser::input_buffer : public std::streambuf
+{
+public:
+	input_buffer(reader_t &reader, uint64_t max_size):
+		m_reader(reader),
+		m_max_size(max_size),
+		m_filled(0),
+		m_limit_exceeded(false),
+		m_read_error(false)
+	{
+	}
+
+	// The number of bytes consumed by the parser so far
+	uint64_t offset() const
+	{
+		return m_filled - (egptr() - gptr());
+	}
+
+	bool limit_exceeded() const
+	{
+		return m_limit_exceeded;
+	}
+
+	bool read_error() const
+	{
+		return m_read_error;
+	}
+
+protected:
+	int_type underflow() override
+	{
+		if(gptr() < egptr())
+		{
+			return traits_type::to_int_type(*gptr());
+		}
+
+		size_t len = sizeof(m_buf);
+
+		// Read at most one byte past the limit, which is
+		// enough to tell whether the limit was exceeded.
+		if(m_max_size > 0 && (m_max_size + 1 - m_filled) < len)
+		{
+			len = m_max_size + 1 - m_filled;
+		}
+
+		int64_t r = m_reader(m_buf, len);
+		if(r < 0)
+		{
+			m_read_error = true;
+			return traits_type::eof();
+		}
+		if(r == 0)
+		{
+			return traits_type::eof();
+		}
+
+		m_filled += r;
+		if(m_max_size > 0 && m_filled > m_max_size)
+		{
+			m_limit_exceeded = true;
+			return traits_type::eof();
+		}
+
+		setg(m_buf, m_buf, m_buf + r);
+		return traits_type::to_int_type(*gptr());
+	}
+
+private:
+	reader_t &m_reader;
+	uint64_t m_max_size;
+	uint64_t m_filled;
+	bool m_limit_exceeded;
+	bool m_read_error;
+	char m_buf[4096];
+};
+
+// A SAX handler for nlohmann::json::sax_parse that builds a json
+// object for each top level object (or object within a top level
+// array). When such an object is an EventList, each of its items is
+// built and handed to the callback on its own instead of being
+// added to the list.
+//
+// Streaming items requires the "kind" property to precede "items",
+// which is what the API server does. Otherwise, the whole object is
+// built and passed to parse_k8s_audit_json() once complete.
+class falco_k8s_audit::event_stream_parser::sax_handler
+{
+public:
+	sax_handler(event_stream_parser &parser, input_buffer &input, callback_t &cb):
+		m_parser(parser),
+		m_input(input),
+		m_cb(cb),
+		m_items(NULL),
+		m_depth(0),
+		m_event_start(0)
+	{
+	}
+
+	bool null()
+	{
+		return add_value(json(nullptr));
+	}
+
+	bool boolean(bool val)
+	{
+		return add_value(json(val));
+	}
+
+	bool number_integer(json::number_integer_t val)
+	{
+		return add_value(json(val));
+	}
+
+	bool number_unsigned(json::number_unsigned_t val)
+	{
+		return add_value(json(val));
+	}
+
+	bool number_float(json::number_float_t val, const std::string &s)
+	{
+		return add_value(json(val));
+	}
+
+	bool string(std::string &val)
+	{
+		return add_value(json(std::move(val)));
+	}
+
+	bool start_object(std::size_t elements)
+	{
+		return open(json::value_t::object);
+	}
+
+	bool key(std::string &val)
+	{
+		m_key = val;
+		return check_event_size();
+	}
+
+	bool end_object()
+	{
+		return close();
+	}
+
+	bool start_array(std::size_t elements)
+	{
+		return open(json::value_t::array);
+	}
+
+	bool end_array()
+	{
+		return close();
+	}
+
+	bool parse_error(std::size_t position, const std::string &last_token, const json::exception &ex)
+	{
+		m_errstr = std::string("Could not parse data: ") + ex.what();
+		return false;
+	}
+
+	std::string m_errstr;
+
+private:
+	bool not_recognized()
+	{
+		m_errstr = std::string("Data not recognized as a k8s audit event");
+		return false;
+	}
+
+	bool check_event_size()
+	{
+		if(m_parser.m_max_event_size > 0 &&
+		   m_input.offset() - m_event_start > m_parser.m_max_event_size)
+		{
+			m_parser.m_limit_exceeded = true;
+			m_errstr = std::string("Audit event exceeds the maximum size of ") + to_string(m_parser.m_max_event_size) + " bytes";
+			return false;
+		}
+
+		return true;
+	}
+
+	json &append(json *parent, json &&val)
+	{
+		if(parent->is_object())
+		{
+			json &ref = (*parent)[m_key];
+			ref = std::move(val);
+			return ref;
+		}
+
+		parent->push_back(std::move(val));
+		return parent->back();
+	}
+
+	bool add_value(json &&val)
+	{
+		// Scalars are only meaningful within an event
+		if(m_stack.empty() || m_stack.back() == m_items)
+		{
+			return not_recognized();
+		}
+
+		append(m_stack.back(), std::move(val));
+
+		return check_event_size();
+	}
+
+	bool open(json::value_t type)
+	{
+		json *val;
+
+		if(m_stack.empty())
+		{
+			// Only a single top level array is handled, to
+			// match parse_k8s_audit_json().
+			if(m_depth == 0 && type == json::value_t::array)
+			{
+				m_depth++;
+				return true;
+			}
+
+			if(type != json::value_t::object)
+			{
+				return not_recognized();
+			}
+
+			m_container = json(json::value_t::object);
+			m_items = NULL;
+			m_event_start = m_input.offset();
+			val = &m_container;
+		}
+		else if(m_stack.back() == m_items)
+		{
+			if(type != json::value_t::object)
+			{
+				return not_recognized();
+			}
+
+			m_item = json(json::value_t::object);
+			m_event_start = m_input.offset();
+			val = &m_item;
+		}
+		else
+		{
+			json *parent = m_stack.back();
+			val = &append(parent, json(type));
+
+			if(type == json::value_t::array &&
+			   parent == &m_container &&
+			   m_key == "items")
+			{
+				auto it = m_container.find("kind");
+				if(it != m_container.end() && *it == "EventList")
+				{
+					m_items = val;
+				}
+			}
+		}
+
+		m_stack.push_back(val);
+		m_depth++;
+
+		return check_event_size();
+	}
+
+	bool close()
+	{
+		m_depth--;
+
+		// The end of the top level array
+		if(m_stack.empty())
+		{
+			return true;
+		}
+
+		json *val = m_stack.back();
+		m_stack.pop_back();
+
+		std::list<json_event> evts;
+
+		if(val == &m_item)
+		{
+			m_item["kind"] = "Event";
+			if(!parse_k8s_audit_json(m_item, evts))
+			{
+				return not_recognized();
+			}
+			m_item = json();
+
+			// The remainder of the EventList counts as a
+			// new event for the purpose of size limits.
+			m_event_start = m_input.offset();
+		}
+		else if(val == &m_container)
+		{
+			// If the items were streamed, they've all
+			// been handled already.
+			if(m_items == NULL &&
+			   !parse_k8s_audit_json(m_container, evts))
+			{
+				return not_recognized();
 			}
-
-			evts.back().set_jevt(j, ns);
-			return true;
+			m_container = json();
+			m_items = NULL;
 		}
-		else
+
+		for(auto &evt : evts)
 		{
-			return false;
+			m_parser.m_num_events++;
+			if(!m_cb(evt, m_errstr))
+			{
+				return false;
+			}
 		}
+
+		return true;
+	}
+
+	event_stream_parser &m_parser;
+	input_buffer &m_input;
+	callback_t &m_cb;
+
+	// The values currently being built, innermost last
+	std::vector<json *> m_stack;
+
+	// The current top level object
+	json m_container;
+
+	// The current EventList item, when streaming items
+	json m_item;
+
+	// Points to the items array within m_container when its
+	// items are streamed, NULL otherwise.
+	json *m_items;
+
+	std::string m_key;
+	uint64_t m_depth;
+
+	// Input offset at which the current event started
+	uint64_t m_event_start;
+};
+
+falco_k8s_audit::event_stream_parser::event_stream_parser(uint64_t max_input_size, uint64_t max_event_size):
+	m_max_input_size(max_input_size),
+	m_max_event_size(max_event_size),
+	m_limit_exceeded(false),
+	m_num_events(0)
+{
+}
+
+falco_k8s_audit::event_stream_parser::~event_stream_parser()
+{
+}
+
+bool falco_k8s_audit::event_stream_parser::parse(reader_t reader, callback_t cb, std::string &errstr)
+{
+	m_limit_exceeded = false;
+	m_num_events = 0;
+
+	input_buffer input(reader, m_max_input_size);
+	std::istream is(&input);
+	sax_handler handler(*this, input, cb);
+
+	bool ok;
+	try
+	{
+		ok = json::sax_parse(is, &handler);
 	}
 	catch(exception &e)
 	{
+		handler.m_errstr = std::string("Could not parse data: ") + e.what();
+		ok = false;
+	}
+
+	if(input.limit_exceeded())
+	{
+		m_limit_exceeded = true;
+		errstr = string("Data exceeds the maximum size of ") + to_string(m_max_input_size) + " bytes";
+		return false;
+	}
+
+	if(input.read_error())
+	{
+		errstr = string("Could not read data");
+		return false;
+	}
+
+	if(!ok)
+	{
+		errstr = handler.m_errstr;
 		return false;
 	}
+
+	return true;
+}
+
+bool falco_k8s_audit::event_stream_parser::limit_exceeded()
+{
+	return m_limit_exceeded;
+}
+
+uint64_t falco_k8s_audit::event_stream_parser::num_events()
+{
+	return m_num_events;
 }
 
 json_event_value::json_event_value()
@@ -139,7 +785,7 @@ json_event_value::json_event_value(const std::string &val)
 	{
 		m_type = JT_INT64_PAIR;
 	}
-	else if (parse_as_int64(m_intval, val))
+	else if (parse_as_int64(m_intval, val.c_str(), val.c_str() + val.size()))
 	{
 		m_type = JT_INT64;
 	}
@@ -317,6 +963,11 @@ bool json_event_value::operator>(const json_event_value &val) const
 
 bool json_event_value::startswith(const json_event_value &val) const
 {
+	if(m_type == JT_STRING && val.m_type == JT_STRING)
+	{
+		return (m_stringval.compare(0, val.m_stringval.size(), val.m_stringval) == 0);
+	}
+
 	std::string str = as_string();
 	std::string valstr = val.as_string();
 
@@ -325,18 +976,39 @@ bool json_event_value::startswith(const json_event_value &val) const
 
 bool json_event_value::contains(const json_event_value &val) const
 {
+	if(m_type == JT_STRING && val.m_type == JT_STRING)
+	{
+		return (m_stringval.find(val.m_stringval) != string::npos);
+	}
+
 	std::string str = as_string();
 	std::string valstr = val.as_string();
 
 	return (str.find(valstr) != string::npos);
 }
 
+size_t json_event_value::hash::operator()(const json_event_value &val) const
+{
+	switch(val.m_type)
+	{
+	case JT_STRING:
+		return std::hash<std::string>()(val.m_stringval);
+	case JT_INT64:
+		return std::hash<int64_t>()(val.m_intval);
+	case JT_INT64_PAIR:
+		return std::hash<int64_t>()(val.m_pairval.first) ^ std::hash<int64_t>()(val.m_pairval.second);
+	default:
+		return 0;
+	}
+}
+
 bool json_event_value::parse_as_pair_int64(std::pair<int64_t,int64_t> &pairval, const std::string &val)
 {
+	const char *str = val.c_str();
 	size_t pos = val.find_first_of(':');
 	if(pos != std::string::npos &&
-	   json_event_value::parse_as_int64(pairval.first, val.substr(0, pos)) &&
-	   json_event_value::parse_as_int64(pairval.second, val.substr(pos+1)))
+	   json_event_value::parse_as_int64(pairval.first, str, str + pos) &&
+	   json_event_value::parse_as_int64(pairval.second, str + pos + 1, str + val.size()))
 	{
 		return true;
 	}
@@ -344,27 +1016,22 @@ bool json_event_value::parse_as_pair_int64(std::pair<int64_t,int64_t> &pairval,
 	return false;
 }
 
-bool json_event_value::parse_as_int64(int64_t &intval, const std::string &val)
+// Same rules as std::stoll, but without exceptions. Every extracted
+// string goes through here, and most of them aren't numbers.
+bool json_event_value::parse_as_int64(int64_t &intval, const char *str, const char *end)
 {
-	try {
-		std::string::size_type ptr;
+	char *ptr;
 
-		intval = std::stoll(val, &ptr);
+	errno = 0;
+	long long val = strtoll(str, &ptr, 10);
 
-		if(ptr != val.length())
-		{
-			return false;
-		}
-	}
-	catch(std::out_of_range &)
-	{
-		return false;
-	}
-	catch (std::invalid_argument &)
+	if(ptr == str || ptr != end || errno == ERANGE)
 	{
 		return false;
 	}
 
+	intval = val;
+
 	return true;
 }
 
@@ -372,43 +1039,154 @@ std::string json_event_filter_check::no_value = "<NA>";
 std::vector<std::string> json_event_filter_check::s_index_mode_strs = {"IDX_REQUIRED", "IDX_ALLOWED", "IDX_NONE"};
 std::vector<std::string> json_event_filter_check::s_index_type_strs = {"IDX_KEY", "IDX_NUMERIC"};
 
-bool json_event_filter_check::def_extract(const nlohmann::json &root,
-					  const std::list<nlohmann::json::json_pointer> &ptrs,
-					  std::list<nlohmann::json::json_pointer>::iterator it)
+json_path::json_path(const json::json_pointer &ptr):
+	m_str(ptr.to_string())
 {
-	if(it == ptrs.end())
+	// Split the pointer into its reference tokens, unescaping
+	// them as described in RFC 6901.
+	size_t pos = 0;
+	while(pos < m_str.size())
 	{
-		add_extracted_value(json_as_string(root));
-		return true;
+		size_t end = m_str.find('/', pos + 1);
+		if(end == std::string::npos)
+		{
+			end = m_str.size();
+		}
+
+		token tok;
+		tok.key = m_str.substr(pos + 1, end - pos - 1);
+
+		size_t esc = 0;
+		while((esc = tok.key.find("~1", esc)) != std::string::npos)
+		{
+			tok.key.replace(esc, 2, "/");
+			esc++;
+		}
+
+		esc = 0;
+		while((esc = tok.key.find("~0", esc)) != std::string::npos)
+		{
+			tok.key.replace(esc, 2, "~");
+			esc++;
+		}
+
+		// Array indexes are digits without leading zeros
+		tok.is_idx = (!tok.key.empty() &&
+			      tok.key.size() <= 18 &&
+			      std::all_of(tok.key.begin(), tok.key.end(), ::isdigit) &&
+			      (tok.key[0] != '0' || tok.key.size() == 1));
+		tok.idx = (tok.is_idx ? std::stoull(tok.key) : 0);
+
+		m_tokens.push_back(tok);
+		pos = end;
 	}
+}
 
-	try {
-		const json &j = root.at(*it);
+json_path::~json_path()
+{
+}
 
-		if(j.is_array())
+const json *json_path::resolve(const json &j) const
+{
+	const json *cur = &j;
+
+	for(auto &tok : m_tokens)
+	{
+		if(cur->is_object())
 		{
-			for(auto &item : j)
+			auto it = cur->find(tok.key);
+			if(it == cur->end())
 			{
-				if(!def_extract(item, ptrs, std::next(it, 1)))
-				{
-					add_extracted_value(no_value);
-				}
+				return NULL;
+			}
+			cur = &(*it);
+		}
+		else if(cur->is_array())
+		{
+			if(!tok.is_idx || tok.idx >= cur->size())
+			{
+				return NULL;
 			}
+			cur = &((*cur)[tok.idx]);
 		}
 		else
 		{
-			add_extracted_value(json_as_string(j));
+			return NULL;
 		}
 	}
-	catch(json::out_of_range &e)
+
+	return cur;
+}
+
+#ifdef HAS_SIMDJSON
+bool json_path::resolve(simdjson::dom::element elem, simdjson::dom::element &val) const
+{
+	val = elem;
+
+	for(auto &tok : m_tokens)
 	{
-		return false;
+		simdjson::dom::object obj;
+		simdjson::dom::array arr;
+
+		if(val.get(obj) == simdjson::SUCCESS)
+		{
+			if(obj.at_key(tok.key).get(val) != simdjson::SUCCESS)
+			{
+				return false;
+			}
+		}
+		else if(val.get(arr) == simdjson::SUCCESS)
+		{
+			if(!tok.is_idx || arr.at(tok.idx).get(val) != simdjson::SUCCESS)
+			{
+				return false;
+			}
+		}
+		else
+		{
+			return false;
+		}
 	}
-	catch(json::type_error &e)
+
+	return true;
+}
+#endif
+
+const std::string &json_path::str() const
+{
+	return m_str;
+}
+
+bool json_event_filter_check::def_extract(const nlohmann::json &root,
+					  std::vector<json_path>::const_iterator it)
+{
+	if(it == m_paths.end())
+	{
+		add_extracted_value(json_as_string(root));
+		return true;
+	}
+
+	const json *j = it->resolve(root);
+	if(j == NULL)
 	{
 		return false;
 	}
 
+	if(j->is_array())
+	{
+		for(auto &item : *j)
+		{
+			if(!def_extract(item, std::next(it, 1)))
+			{
+				add_extracted_value(no_value);
+			}
+		}
+	}
+	else
+	{
+		add_extracted_value(json_as_string(*j));
+	}
+
 	return true;
 }
 
@@ -424,6 +1202,73 @@ std::string json_event_filter_check::json_as_string(const json &j)
 	}
 }
 
+#ifdef HAS_SIMDJSON
+bool json_event_filter_check::def_extract_simd(simdjson::dom::element root, bool list_item,
+					       std::vector<json_path>::const_iterator it)
+{
+	if(it == m_paths.end())
+	{
+		add_extracted_value(json_as_string(root));
+		return true;
+	}
+
+	// The kind of the items of an EventList was overwritten
+	// with "Event" when they were split.
+	if(list_item && it == m_paths.begin() && it->str() == "/kind")
+	{
+		add_extracted_value("Event");
+		return true;
+	}
+
+	simdjson::dom::element j;
+	if(!it->resolve(root, j))
+	{
+		return false;
+	}
+
+	if(j.is_array())
+	{
+		for(simdjson::dom::element item : simdjson::dom::array(j))
+		{
+			if(!def_extract_simd(item, false, std::next(it, 1)))
+			{
+				add_extracted_value(no_value);
+			}
+		}
+	}
+	else
+	{
+		add_extracted_value(json_as_string(j));
+	}
+
+	return true;
+}
+
+std::string json_event_filter_check::json_as_string(simdjson::dom::element elem)
+{
+	switch(elem.type())
+	{
+	case simdjson::dom::element_type::STRING:
+		return simd_string(elem);
+	case simdjson::dom::element_type::INT64:
+		return to_string(int64_t(elem));
+	case simdjson::dom::element_type::UINT64:
+		return to_string(uint64_t(elem));
+	case simdjson::dom::element_type::BOOL:
+		return (bool(elem) ? "true" : "false");
+	case simdjson::dom::element_type::NULL_VALUE:
+		return "null";
+	default:
+		// Objects, arrays and floating point numbers are
+		// rare, and converted to keep the exact same
+		// formatting (e.g. sorted keys) as nlohmann::json.
+		json j;
+		simd_to_json(elem, j);
+		return j.dump();
+	}
+}
+#endif
+
 json_event_filter_check::field_info::field_info():
 	m_idx_mode(IDX_NONE),
 	m_idx_type(IDX_NUMERIC),
@@ -532,7 +1377,7 @@ int32_t json_event_filter_check::parse_field_name(const char *str, bool alloc_st
 		   str[info.m_name.size()] != '.' &&
 		   info.m_name.size() > match_len)
 		{
-			m_jptrs = al.m_jptrs;
+			m_paths.assign(al.m_jptrs.begin(), al.m_jptrs.end());
 			m_field = info.m_name;
 
 			if(al.m_extract)
@@ -581,12 +1426,29 @@ int32_t json_event_filter_check::parse_field_name(const char *str, bool alloc_st
 
 void json_event_filter_check::add_filter_value(const char *str, uint32_t len, uint32_t i)
 {
-	m_values.insert(string(str));
+	json_event_value val(str);
+
+	m_values.insert(val);
+
+	if(val.ptype() == json_event_value::JT_INT64_PAIR)
+	{
+		m_hash_values = false;
+		m_values_hash.clear();
+	}
+	else if(m_hash_values)
+	{
+		m_values_hash.insert(val);
+	}
+
+	if(m_uses_paths)
+	{
+		m_prefix_search.add_search_path(str);
+	}
 }
 
 const json_event_filter_check::values_t &json_event_filter_check::extracted_values()
 {
-	return m_evalues.first;
+	return m_cur_evalues->first;
 }
 
 bool json_event_filter_check::compare(gen_event *evt)
@@ -599,13 +1461,19 @@ bool json_event_filter_check::compare(gen_event *evt)
 	}
 	auto evalues = (const extracted_values_t *) values[0].ptr;
 
-	values_set_t setvals;
+	// The extracted values, sorted and without duplicates
+	auto &sorted = (evalues->first.size() > 1 ? evalues->second : evalues->first);
+
+	static const json_event_value no_value_val(no_value);
+
 	switch(m_cmpop)
 	{
 	case CO_EQ:
-		return evalues->second == m_values;
+		return (sorted.size() == m_values.size() &&
+			std::equal(sorted.begin(), sorted.end(), m_values.begin()));
 	case CO_NE:
-		return evalues->second != m_values;
+		return !(sorted.size() == m_values.size() &&
+			 std::equal(sorted.begin(), sorted.end(), m_values.begin()));
 	case CO_STARTSWITH:
 		return (evalues->first.size() == 1 &&
 			m_values.size() == 1 &&
@@ -615,18 +1483,18 @@ bool json_event_filter_check::compare(gen_event *evt)
 			m_values.size() == 1 &&
 			evalues->first.at(0).contains(*(m_values.begin())));
 	case CO_IN:
-		for(auto &item : evalues->second)
+		for(auto &item : sorted)
 		{
-			if(m_values.find(item) == m_values.end())
+			if(!find_value(item))
 			{
 				return false;
 			}
 		}
 		return true;
 	case CO_PMATCH:
-		for(auto &item : evalues->second)
+		for(auto &item : sorted)
 		{
-			if(item.as_string() != no_value)
+			if(item != no_value_val)
 			{
 				if(!m_prefix_search.match(item.as_string().c_str()))
 				{
@@ -636,10 +1504,14 @@ bool json_event_filter_check::compare(gen_event *evt)
 		}
 		return true;
 	case CO_INTERSECTS:
-		std::set_intersection(evalues->second.begin(), evalues->second.end(),
-				      m_values.begin(), m_values.end(),
-				      std::inserter(setvals, setvals.begin()));
-		return (!setvals.empty());
+		for(auto &item : sorted)
+		{
+			if(find_value(item))
+			{
+				return true;
+			}
+		}
+		return false;
 	case CO_LT:
 		return (evalues->first.size() == 1 &&
 			m_values.size() == 1 &&
@@ -664,12 +1536,25 @@ bool json_event_filter_check::compare(gen_event *evt)
 			 evalues->first.at(0) == *(m_values.begin())));
 	case CO_EXISTS:
 		return (evalues->first.size() == 1 &&
-			(evalues->first.at(0) != json_event_filter_check::no_value));
+			(evalues->first.at(0) != no_value_val));
 	default:
 		throw falco_exception("filter error: unsupported comparison operator");
 	}
 }
 
+bool json_event_filter_check::find_value(const json_event_value &val) const
+{
+	// A range can be equal to values with a different hash
+	if(m_hash_values &&
+	   m_values.size() > s_max_set_lookup_values &&
+	   val.ptype() != json_event_value::JT_INT64_PAIR)
+	{
+		return (m_values_hash.find(val) != m_values_hash.end());
+	}
+
+	return (m_values.find(val) != m_values.end());
+}
+
 const std::string &json_event_filter_check::field()
 {
 	return m_field;
@@ -699,36 +1584,77 @@ json_event_filter_check::check_info &json_event_filter_check::get_info()
 
 void json_event_filter_check::add_extracted_value(const std::string &str)
 {
-	m_evalues.first.emplace_back(json_event_value(str));
-	m_evalues.second.emplace(json_event_value(str));
-
-	if(m_uses_paths)
-	{
-		m_prefix_search.add_search_path(str);
-	}
+	m_evalues.first.emplace_back(str);
 }
 
 void json_event_filter_check::add_extracted_value_num(int64_t val)
 {
-	m_evalues.first.emplace_back(json_event_value(val));
-	m_evalues.second.emplace(json_event_value(val));
+	m_evalues.first.emplace_back(val);
 }
 
 bool json_event_filter_check::extract(gen_event *evt, std::vector<extract_value_t>& values, bool sanitize_strings)
 {
-	m_evalues.first.clear();
-	m_evalues.second.clear();
+	json_event *jevt = (json_event *) evt;
 
-	if (!extract_values((json_event *) evt))
+	if(m_field_id < 0)
+	{
+		m_field_id = field_id(m_idx.empty() ? m_field : m_field + "[" + m_idx + "]");
+	}
+
+	// Another check on the same field might have already
+	// extracted the values from this event
+	m_cur_evalues = jevt->extracted_values(m_field_id);
+
+	if(m_cur_evalues == NULL)
 	{
 		m_evalues.first.clear();
 		m_evalues.second.clear();
-		add_extracted_value(no_value);
+
+		if (!extract_values(jevt))
+		{
+			m_evalues.first.clear();
+			m_evalues.second.clear();
+			add_extracted_value(no_value);
+		}
+
+		if(m_evalues.first.size() > 1)
+		{
+			// Same ordering and duplicates as a std::set
+			m_evalues.second = m_evalues.first;
+			std::sort(m_evalues.second.begin(), m_evalues.second.end());
+			m_evalues.second.erase(std::unique(m_evalues.second.begin(), m_evalues.second.end(),
+							   [](const json_event_value &a, const json_event_value &b) {
+								   return !(a < b) && !(b < a);
+							   }),
+					       m_evalues.second.end());
+		}
+
+		m_cur_evalues = jevt->set_extracted_values(m_field_id, std::move(m_evalues));
 	}
-	values.push_back({(uint8_t *)&m_evalues, sizeof(m_evalues)});
+
+	values.push_back({(uint8_t *)m_cur_evalues, sizeof(*m_cur_evalues)});
 	return true;
 }
 
+uint32_t json_event_filter_check::field_id(const std::string &name)
+{
+	static std::mutex s_mtx;
+	static std::map<std::string, uint32_t> s_ids;
+
+	std::lock_guard<std::mutex> lock(s_mtx);
+
+	auto it = s_ids.find(name);
+	if(it != s_ids.end())
+	{
+		return it->second;
+	}
+
+	uint32_t id = s_ids.size();
+	s_ids[name] = id;
+
+	return id;
+}
+
 bool json_event_filter_check::extract_values(json_event *jevt)
 {
 	try
@@ -742,7 +1668,20 @@ bool json_event_filter_check::extract_values(json_event *jevt)
 		}
 		else
 		{
-			if (!def_extract(jevt->jevt(), m_jptrs, m_jptrs.begin()))
+#ifdef HAS_SIMDJSON
+			simdjson::dom::element elem;
+			bool list_item;
+
+			if(jevt->simd_elem(elem, list_item))
+			{
+				if(!def_extract_simd(elem, list_item, m_paths.begin()))
+				{
+					return false;
+				}
+			}
+			else
+#endif
+			if (!def_extract(jevt->jevt(), m_paths.begin()))
 			{
 				return false;
 			}
@@ -850,7 +1789,7 @@ int32_t jevt_filter_check::parse_field_name(const char *str, bool alloc_state, b
 		try
 		{
 			m_idx = string(str + (s_jevt_value_field.size() + 1), (end - str - (s_jevt_value_field.size() + 1)));
-			m_idx_ptr = json::json_pointer(m_idx);
+			m_idx_path.reset(new json_path(json::json_pointer(m_idx)));
 		}
 		catch(json::parse_error &e)
 		{
@@ -888,18 +1827,32 @@ bool jevt_filter_check::extract_values(json_event *jevt)
 	}
 	else if (m_field == s_jevt_value_field)
 	{
-		try {
-			const json &j = jevt->jevt().at(m_idx_ptr);
-			tstr = json_as_string(j);
-		}
-		catch(json::out_of_range &e)
+#ifdef HAS_SIMDJSON
+		simdjson::dom::element elem;
+		bool list_item;
+
+		// The kind of EventList items is handled by jevt()
+		if(jevt->simd_elem(elem, list_item) &&
+		   !(list_item && m_idx_path->str() == "/kind"))
 		{
-			return false;
+			simdjson::dom::element j;
+			if(!m_idx_path->resolve(elem, j))
+			{
+				return false;
+			}
+
+			add_extracted_value(json_as_string(j));
+			return true;
 		}
-		catch(json::type_error &e)
+#endif
+
+		const json *j = m_idx_path->resolve(jevt->jevt());
+		if(j == NULL)
 		{
 			return false;
 		}
+
+		tstr = json_as_string(*j);
 	}
 	else
 	{
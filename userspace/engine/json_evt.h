@@ -17,18 +17,31 @@ limitations under the License.
 #pragma once
 
 #include <memory>
+#include <functional>
 #include <list>
 #include <map>
 #include <string>
 #include <vector>
 #include <set>
+#include <unordered_set>
 #include <utility>
 
 #include <nlohmann/json.hpp>
 
+#ifdef HAS_SIMDJSON
+#include <simdjson.h>
+#endif
+
 #include "prefix_search.h"
 #include <sinsp.h>
 
+class json_event_value;
+
+// The values extracted from an event by a field, both in order and
+// sorted without duplicates. The sorted values are only filled in when
+// there's more than one value, as a single value is already sorted.
+typedef std::pair<std::vector<json_event_value>, std::vector<json_event_value>> json_extracted_values_t;
+
 class json_event : public gen_event
 {
 public:
@@ -36,10 +49,44 @@ public:
 	virtual ~json_event();
 
 	void set_jevt(nlohmann::json &evt, uint64_t ts);
+
+#ifdef HAS_SIMDJSON
+	// Back the event by elem, an element of the simdjson
+	// document doc. Several events (e.g. the items of an
+	// EventList) can share the same document. The
+	// nlohmann::json object returned by jevt() is only built the
+	// first time it's needed.
+	//
+	// list_item means that the event came from the items of an
+	// EventList, and its kind should be considered "Event".
+	void set_jevt(std::shared_ptr<simdjson::dom::document> doc,
+		      simdjson::dom::element elem,
+		      bool list_item,
+		      uint64_t ts);
+
+	// Returns true and fills in elem if the event is backed by
+	// a simdjson document.
+	bool simd_elem(simdjson::dom::element &elem, bool &list_item) const;
+#endif
+
 	const nlohmann::json &jevt();
 
 	uint64_t get_ts() const;
 
+	// Values already extracted from this event by the field with
+	// the provided id (see json_event_filter_check::field_id()),
+	// or NULL. This lets all the filter checks on the same field
+	// (e.g. across rules) share a single extraction.
+	const json_extracted_values_t *extracted_values(uint32_t field_id);
+
+	// Remember the values extracted by a field, returning the
+	// stored copy.
+	const json_extracted_values_t *set_extracted_values(uint32_t field_id, json_extracted_values_t &&values);
+
+	// Forget all the values extracted so far, so they're
+	// extracted again from the event on their next use.
+	void clear_extracted_values();
+
 	inline uint16_t get_source() const
 	{
 		return ESRC_K8S_AUDIT;
@@ -55,6 +102,19 @@ protected:
 	nlohmann::json m_jevt;
 
 	uint64_t m_event_ts;
+
+	// Indexed by field id. Copies of an event share the values,
+	// which never change once extracted.
+	std::vector<std::shared_ptr<json_extracted_values_t>> m_extracted;
+
+#ifdef HAS_SIMDJSON
+	std::shared_ptr<simdjson::dom::document> m_doc;
+	simdjson::dom::element m_elem;
+	bool m_list_item = false;
+
+	// False until m_jevt has been built from m_elem
+	bool m_jevt_valid = true;
+#endif
 };
 
 namespace falco_k8s_audit {
@@ -68,6 +128,106 @@ namespace falco_k8s_audit {
 	// audit event(s), false otherwise.
 	//
 	bool parse_k8s_audit_json(nlohmann::json &j, std::list<json_event> &evts, bool top=true);
+
+#ifdef HAS_SIMDJSON
+	//
+	// Like the above, but parses the raw data using
+	// simdjson. The returned events share the parsed document
+	// and are only converted to nlohmann::json objects when
+	// needed.
+	//
+	// Returns false and fills in errstr if the data couldn't be
+	// parsed or wasn't recognized as k8s audit event(s).
+	//
+	bool parse_k8s_audit_data(simdjson::dom::parser &parser,
+				  const char *data, size_t len,
+				  std::list<json_event> &evts,
+				  std::string &errstr);
+#endif
+
+	//
+	// Incrementally parses a json document containing k8s audit
+	// events (a single Event, an EventList, or a top level array
+	// of those) as it is read. Each event is passed to a callback
+	// as soon as it has been completely read, so the items of an
+	// EventList are never all held in memory at once.
+	//
+	class event_stream_parser
+	{
+	public:
+		// Fill buf with up to len bytes of input. Returns the
+		// number of bytes read, 0 at the end of the input, or
+		// a negative value on error.
+		typedef std::function<int64_t (char *buf, size_t len)> reader_t;
+
+		// Called for each parsed event. Returning false stops
+		// parsing, in which case errstr should be filled in.
+		typedef std::function<bool (json_event &evt, std::string &errstr)> callback_t;
+
+		// max_input_size bounds the total number of bytes
+		// read from the reader, and max_event_size the number
+		// of bytes making up a single event. 0 means no limit.
+		event_stream_parser(uint64_t max_input_size = 0, uint64_t max_event_size = 0);
+		virtual ~event_stream_parser();
+
+		// Returns true if the whole input was read and
+		// recognized as k8s audit event(s). Otherwise, fills
+		// in errstr. Note that events preceding an error in the
+		// input have already been passed to the callback.
+		bool parse(reader_t reader, callback_t cb, std::string &errstr);
+
+		// Returns true if the last call to parse() failed
+		// because the input or an event was too large.
+		bool limit_exceeded();
+
+		// Returns the number of events passed to the
+		// callback by the last call to parse().
+		uint64_t num_events();
+
+	private:
+		class input_buffer;
+		class sax_handler;
+
+		uint64_t m_max_input_size;
+		uint64_t m_max_event_size;
+		bool m_limit_exceeded;
+		uint64_t m_num_events;
+	};
+};
+
+// A json pointer split into its reference tokens, so that it can be
+// resolved against many objects without parsing it again, and without
+// using exceptions to report values that don't exist.
+class json_path
+{
+public:
+	json_path(const nlohmann::json::json_pointer &ptr);
+	virtual ~json_path();
+
+	// Returns the referenced value, or NULL if it doesn't exist.
+	const nlohmann::json *resolve(const nlohmann::json &j) const;
+
+#ifdef HAS_SIMDJSON
+	// Fills in val and returns true if the referenced value exists.
+	bool resolve(simdjson::dom::element elem, simdjson::dom::element &val) const;
+#endif
+
+	// The pointer in its string form e.g. "/user/username"
+	const std::string &str() const;
+
+private:
+	struct token
+	{
+		std::string key;
+
+		// Only meaningful when the token is a valid array
+		// index.
+		bool is_idx;
+		size_t idx;
+	};
+
+	std::vector<token> m_tokens;
+	std::string m_str;
 };
 
 // A class representing an extracted value or a value on the rhs of a
@@ -103,11 +263,22 @@ public:
 	bool startswith(const json_event_value &val) const;
 	bool contains(const json_event_value &val) const;
 
+	// Hashes values consistently with operator==, except for
+	// JT_INT64_PAIR values, which can be equal to values with a
+	// different hash and shouldn't be put in hash containers.
+	struct hash
+	{
+		size_t operator()(const json_event_value &val) const;
+	};
+
 private:
 	param_type m_type;
 
 	static bool parse_as_pair_int64(std::pair<int64_t,int64_t> &pairval, const std::string &val);
-	static bool parse_as_int64(int64_t &intval, const std::string &val);
+
+	// Parses the characters from str up to end, which must be
+	// followed by a non-digit character.
+	static bool parse_as_int64(int64_t &intval, const char *str, const char *end);
 
 	// The number of possible types is small so far, so sticking
 	// with separate vars
@@ -199,6 +370,11 @@ public:
 
 	check_info &get_info();
 
+	// Returns a small integer identifying a field name,
+	// including its index if any (e.g. ka.req.pod.containers.image[0]).
+	// The same name always gets the same id.
+	static uint32_t field_id(const std::string &name);
+
 	//
 	// Allocate a new check of the same type. Must be overridden.
 	//
@@ -220,6 +396,12 @@ protected:
 
 	static std::string json_as_string(const nlohmann::json &j);
 
+#ifdef HAS_SIMDJSON
+	// Returns the same string json_as_string would return for the
+	// equivalent nlohmann::json object.
+	static std::string json_as_string(simdjson::dom::element elem);
+#endif
+
 	// Subclasses can define field names that act as aliases for
 	// specific json pointer expressions e.g. ka.user ==
 	// jevt.value[/user/username]. This struct represents one of
@@ -273,18 +455,42 @@ protected:
 
 private:
 	typedef std::set<json_event_value> values_set_t;
-	typedef std::pair<values_t, values_set_t> extracted_values_t;
+	typedef std::unordered_set<json_event_value, json_event_value::hash> values_hash_t;
+	typedef json_extracted_values_t extracted_values_t;
+
+	// Above this many values on the right hand side of the
+	// operator, m_values_hash is used to look up values instead
+	// of m_values.
+	static const size_t s_max_set_lookup_values = 8;
 
-	// The default extraction function uses the list of pointers
-	// in m_jptrs. Iterates over array elements between pointers if
+	// Returns whether val is one of the values in m_values.
+	bool find_value(const json_event_value &val) const;
+
+	// The default extraction function uses the list of paths
+	// in m_paths. Iterates over array elements between paths if
 	// found.
 	bool def_extract(const nlohmann::json &j,
-			 const std::list<nlohmann::json::json_pointer> &ptrs,
-			 std::list<nlohmann::json::json_pointer>::iterator it);
+			 std::vector<json_path>::const_iterator it);
+
+#ifdef HAS_SIMDJSON
+	// Like def_extract, but works directly on the simdjson
+	// element backing an event.
+	bool def_extract_simd(simdjson::dom::element elem, bool list_item,
+			      std::vector<json_path>::const_iterator it);
+#endif
+
+	// The json pointers of the alias used to extract from
+	// events, compiled once when parsing the field name. See
+	// alias struct for usage.
+	std::vector<json_path> m_paths;
 
-	// The actual json pointer value to use to extract from
-	// events. See alias struct for usage.
-	std::list<nlohmann::json::json_pointer> m_jptrs;
+	// Identifies m_field/m_idx in json_event's cache of
+	// extracted values. Assigned on first use.
+	int64_t m_field_id = -1;
+
+	// The values returned by the last call to extract(). Either
+	// m_evalues or values cached in the event.
+	const extracted_values_t *m_cur_evalues = &m_evalues;
 
 	// The extraction function to use. May not be defined, in which
 	// case the default function is used.
@@ -295,6 +501,12 @@ private:
 	// "two", "three")
 	values_set_t m_values;
 
+	// The same values as m_values, for faster lookups in large
+	// lists. Only used when none of the values is a range
+	// (m_hash_values is true).
+	values_hash_t m_values_hash;
+	bool m_hash_values = true;
+
 	// All values extracted from the object by the field e.g. for
 	// a field ka.req.container.image returns all container images
 	// for all pods within a request.
@@ -325,7 +537,7 @@ private:
 
 	// When the field is jevt_value, a json pointer representing
 	// the index in m_idx
-	nlohmann::json::json_pointer m_idx_ptr;
+	std::unique_ptr<json_path> m_idx_path;
 
 	static std::string s_jevt_time_field;
 	static std::string s_jevt_time_iso_8601_field;
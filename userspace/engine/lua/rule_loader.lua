@@ -31,62 +31,25 @@ function trim(s)
 end
 
 
-function expand_list(source, list_defs)
-   for name, def in pairs(list_defs) do
-      local bpos = string.find(source, name, 1, true)
-      while bpos ~= nil do
-	      def.used = true
-	      local epos = bpos + string.len(name)
-
-         -- The characters surrounding the name must be delimiters of beginning/end of string
-         if (bpos == 1 or string.match(string.sub(source, bpos-1, bpos-1), "[%s(),=]"))
-               and (epos > string.len(source) or string.match(string.sub(source, epos, epos), "[%s(),=]")) then
-            -- Shift pointers to consume all whitespaces
-            while (bpos > 1 and string.match(string.sub(source, bpos-1, bpos-1), "[%s]")) do
-               bpos = bpos - 1
-            end
-            while (epos < string.len(source) and string.match(string.sub(source, epos, epos), "[%s]")) do
-               epos = epos + 1
-            end
-
-            -- Create substitution string by concatenating all values
-            local sub = table.concat(def.items, ", ")
-
-            -- If substituted list is empty, we need to remove a comma from the left or the right
-            if string.len(sub) == 0 then
-               if (bpos > 1 and string.sub(source, bpos-1, bpos-1) == ",") then
-                  bpos = bpos - 1
-               elseif (epos < string.len(source) and string.sub(source, epos, epos) == ",") then
-                  epos = epos + 1
-               end
-               -- If no comma is removed, this means that the list is only surrounded by parenthesis
-               -- or other characters
-            end
-
-            -- Compose new string with substitution
-            local new_source = ""
-            if bpos > 1 then
-               new_source = new_source..string.sub(source, 1, bpos-1).." "
-            end
-            new_source = new_source..sub.." "
-            if epos <= string.len(source) then
-               new_source = new_source..string.sub(source, epos, string.len(source))
-            end
-            
-            -- Iterate to the next match
-            source = new_source
-            bpos = bpos + (string.len(sub)-string.len(name))
-         end
-	      bpos = string.find(source, name, bpos+1, true)
+-- Substitutes the list names found in the list values of the filter
+-- (e.g. "proc.name in (shell_binaries)") with the items of the lists,
+-- marking them as used. The lists are defined once in the resolver,
+-- so that they don't need to be expanded and parsed again as text for
+-- every rule or macro referencing them. Returns the resulting filter,
+-- or an error if an external list can't be used in it.
+local list_resolver = nil
+
+local function resolve_lists(filter, list_defs)
+   local ok, filter_or_err, resolved = filter_helper.resolve_lists(list_resolver, filter)
+   if ok then
+      for _, name in ipairs(resolved) do
+	 list_defs[name].used = true
       end
    end
-   return source
+   return ok, filter_or_err
 end
 
 function parse_macro(line, macro_defs, list_defs)
-   -- Substitute list in macro filter string
-   line = expand_list(line, list_defs)
-
    -- Parse the macro to an AST
    local ok, filter_or_error = filter_helper.parse_filter(line)
    if (ok == false) then
@@ -96,8 +59,17 @@ function parse_macro(line, macro_defs, list_defs)
    end
    local filter = filter_or_error
 
-   -- Validate the macro
+   -- Validate the macro. Lists are resolved in the rules using the
+   -- macro, after the macros get expanded.
    local filter_copy = filter_helper.clone_ast(filter)
+   local ok, filter_copy_or_err = resolve_lists(filter_copy, list_defs)
+   if (ok == false) then
+      filter_helper.delete_ast(filter_copy)
+      filter_helper.delete_ast(filter)
+      local msg = "Compilation error when compiling \""..line.."\": ".. filter_copy_or_err
+      return false, msg
+   end
+   filter_copy = filter_copy_or_err
    local expand_macros = true
    while (expand_macros) do
       expand_macros = false
@@ -126,11 +98,6 @@ end
    Parses a single filter, then expands macros using passed-in table of definitions. Returns resulting AST.
 --]]
 function parse_rule(name, source, macro_defs, list_defs)
-   -- Substitute list in rule filter string
-   -- todo(jasondellaluce): we are supposed to do better than text-substitution, this is what
-   -- breaks escaping in lists and exceptions of Falco rulesets
-   source = expand_list(source, list_defs)
-
    -- Parse the rule filter to an AST
    local ok, filter_or_err = filter_helper.parse_filter(source)
    if (ok == false) then
@@ -161,7 +128,14 @@ function parse_rule(name, source, macro_defs, list_defs)
       return false, msg
    end
 
-   return true, filter
+   -- Substitute the lists in the rule and in the expanded macros
+   local ok, filter_or_err = resolve_lists(filter, list_defs)
+   if (ok == false) then
+      filter_helper.delete_ast(filter)
+      return false, filter_or_err
+   end
+
+   return true, filter_or_err
 end
 
 -- Permissive for case and for common abbreviations.
@@ -211,6 +185,11 @@ local function reset_rules(rules_mgr)
    state.rules_by_idx = {}
    state.macros = {}
    state.lists = {}
+
+   if list_resolver ~= nil then
+      filter_helper.delete_list_resolver(list_resolver)
+   end
+   list_resolver = filter_helper.new_list_resolver()
 end
 
 -- From http://lua-users.org/wiki/TableUtils
@@ -338,6 +317,22 @@ function quote_item(item)
    return item
 end
 
+-- The values of the items once parsed in a filter, without the
+-- quotes surrounding them
+function list_values(items)
+   local values = {}
+
+   for i, item in ipairs(items) do
+      local q = string.sub(item, 1, 1)
+      if string.len(item) > 1 and (q == "'" or q == '"') and string.sub(item, -1) == q then
+	 item = string.sub(item, 2, -2)
+      end
+      values[i] = item
+   end
+
+   return values
+end
+
 function paren_item(item)
    if string.sub(item, 1, 1) ~= "(" then
       item = "("..item..")"
@@ -410,6 +405,57 @@ function validate_exception_item_single_field(rules_mgr, source, eitem, context)
    end
 end
 
+-- The duration units of the window of a rule, in ns
+local window_units = {
+   ["ms"] = 1000000,
+   ["s"] = 1000000000,
+   ["m"] = 60 * 1000000000,
+   ["h"] = 3600 * 1000000000
+}
+
+-- Validate the count, window and group_by properties of a rule,
+-- setting its window_ns property and turning group_by into a list.
+-- As an event only matches the first rule matching it, the rule only
+-- counts the events not matched by the rules evaluated before it.
+function validate_rule_threshold(rules_mgr, v)
+
+   local count = v['count']
+   if type(count) ~= "number" or count < 1 or math.floor(count) ~= count then
+      return false, build_error_with_context(v['context'], "Rule "..v['rule']..": count must be a positive integer")
+   end
+
+   -- A number of seconds, or a number followed by a unit
+   local window = v['window']
+   local num, unit
+   if type(window) == "number" then
+      num, unit = window, "s"
+   elseif type(window) == "string" then
+      num, unit = string.match(window, "^(%d+)(%a+)$")
+      num = tonumber(num)
+   end
+
+   if num == nil or num <= 0 or window_units[unit] == nil then
+      return false, build_error_with_context(v['context'], "Rule "..v['rule']..": window must be a positive duration like 500ms, 10s, 5m or 1h")
+   end
+   v['window_ns'] = num * window_units[unit]
+
+   if v['group_by'] == nil then
+      v['group_by'] = {}
+   elseif type(v['group_by']) == "string" then
+      v['group_by'] = {v['group_by']}
+   elseif type(v['group_by']) ~= "table" then
+      return false, build_error_with_context(v['context'], "Rule "..v['rule']..": group_by must be a field or a list of fields")
+   end
+
+   for _, field in ipairs(v['group_by']) do
+      if not falco_rules.is_defined_field(rules_mgr, v['source'], field) then
+	 return false, build_error_with_context(v['context'], "Rule "..v['rule']..": group_by field "..field.." is not a supported filter field")
+      end
+   end
+
+   return true
+end
+
 function load_rules_doc(rules_mgr, doc, load_state)
 
    local warnings = {}
@@ -524,9 +570,17 @@ function load_rules_doc(rules_mgr, doc, load_state)
 	    state.ordered_list_names[#state.ordered_list_names+1] = v['list']
 	 end
 
-	 for j, field in ipairs({'items'}) do
-	    if (v[field] == nil) then
-	       return false, build_error_with_context(v['context'], "List must have property "..field), warnings
+	 -- The values of external lists are read from a file, with
+	 -- a value per line
+	 if v['file'] ~= nil then
+	    if type(v['file']) ~= "string" or v['items'] ~= nil then
+	       return false, build_error_with_context(v['context'], "List property file must be a path, and can't be used with items"), warnings
+	    end
+	 else
+	    for j, field in ipairs({'items'}) do
+	       if (v[field] == nil) then
+		  return false, build_error_with_context(v['context'], "List must have property "..field), warnings
+	       end
 	    end
 	 end
 
@@ -542,6 +596,10 @@ function load_rules_doc(rules_mgr, doc, load_state)
 	       return false, build_error_with_context(v['context'], "List " ..v['list'].. " has 'append' key but no list by that name already exists"), warnings
 	    end
 
+	    if v['file'] ~= nil or state.lists_by_name[v['list']]['file'] ~= nil then
+	       return false, build_error_with_context(v['context'], "List " ..v['list'].. " has 'append' key, which is not supported by external lists"), warnings
+	    end
+
 	    for j, elem in ipairs(v['items']) do
 	       table.insert(state.lists_by_name[v['list']]['items'], elem)
 	    end
@@ -621,6 +679,18 @@ function load_rules_doc(rules_mgr, doc, load_state)
 	    end
 	 end
 
+	 -- Validate the threshold of the rule, if any
+	 if v['count'] ~= nil or v['window'] ~= nil or v['group_by'] ~= nil then
+	    if append then
+	       return false, build_error_with_context(v['context'], "Can not append count, window or group_by to existing rule"), warnings
+	    end
+
+	    local valid, err = validate_rule_threshold(rules_mgr, v)
+	    if valid == false then
+	       return false, err, warnings
+	    end
+	 end
+
 	 if append then
 
 	    if state.rules_by_name[v['rule']] == nil then
@@ -872,6 +942,145 @@ function build_exception_condition_string_single_field(eitem, exfields)
 
 end
 
+-- Whether value means the same as a literal and as a value in a
+-- condition string, so that it can be used in native exceptions
+local function is_native_exception_value(value, comp)
+   if value == "" or string.find(value, "^[\"']") or string.find(value, "[(),]") then
+      return false
+   end
+
+   -- pmatch only compares whole path components
+   if comp == "pmatch" and string.find(value, "*", 1, true) then
+      return false
+   end
+
+   return true
+end
+
+-- Append value to items, or the items of the list named value. Returns
+-- false if a value can't be used in native exceptions.
+local function add_native_exception_values(value, comp, items)
+   value = tostring(value)
+
+   local list = state.lists[value]
+   if list ~= nil then
+      -- External lists are checked in the condition
+      if list.external then
+	 return false
+      end
+      list.used = true
+      for _, item in ipairs(list.items) do
+	 if not is_native_exception_value(item, comp) then
+	    return false
+	 end
+	 items[#items+1] = item
+      end
+      return true
+   end
+
+   if not is_native_exception_value(value, comp) then
+      return false
+   end
+
+   items[#items+1] = value
+   return true
+end
+
+-- Returns the exception item in the form expected by
+-- falco_rules.add_filter, when all its fields and comparisons can be
+-- checked natively (see rule_exceptions.h), or nil if it must be
+-- added to the condition instead. Errors in the values are left to
+-- build_exception_condition_string_*().
+-- Populates exfields with all fields used
+function native_exception_item(rules_mgr, source, eitem, exfields)
+
+   local fields = eitem['fields']
+   local comps = eitem['comps']
+   local tuples = {}
+
+   -- (field comp (v1, v2, ...))
+   if type(fields) ~= "table" then
+      if (comps ~= "in" and comps ~= "pmatch") or
+	 not falco_rules.is_native_exception_field(rules_mgr, source, fields) then
+	 return nil
+      end
+
+      local items = {}
+      for _, value in ipairs(eitem['values']) do
+	 if type(value) ~= "string" or not add_native_exception_values(value, comps, items) then
+	    return nil
+	 end
+      end
+
+      if #items == 0 then
+	 return nil
+      end
+
+      exfields[fields] = true
+
+      -- Each value of an in is an = tuple, found with a single lookup
+      if comps == "in" then
+	 for i, item in ipairs(items) do
+	    tuples[i] = {{item}}
+	 end
+	 return {fields={fields}, comps={"="}, values=tuples}
+      end
+
+      return {fields={fields}, comps={comps}, values={{items}}}
+   end
+
+   -- ((f1 c1 v1 and f2 c2 v2) or ...)
+   for k = 1, #fields do
+      if (comps[k] ~= "=" and comps[k] ~= "==" and comps[k] ~= "in" and comps[k] ~= "pmatch") or
+	 not falco_rules.is_native_exception_field(rules_mgr, source, fields[k]) then
+	 return nil
+      end
+   end
+
+   for _, values in ipairs(eitem['values']) do
+      if #fields ~= #values then
+	 return nil
+      end
+
+      local tuple = {}
+      for k = 1, #fields do
+	 local ival = values[k]
+	 local items = {}
+
+	 if comps[k] == "=" or comps[k] == "==" then
+	    -- A list name would be expanded in the condition
+	    if type(ival) == "table" or state.lists[tostring(ival)] ~= nil or
+	       not is_native_exception_value(tostring(ival), comps[k]) then
+	       return nil
+	    end
+	    items[1] = tostring(ival)
+	 elseif type(ival) == "table" then
+	    for _, item in ipairs(ival) do
+	       if not add_native_exception_values(item, comps[k], items) then
+		  return nil
+	       end
+	    end
+	 elseif not add_native_exception_values(ival, comps[k], items) then
+	    return nil
+	 end
+
+	 tuple[k] = items
+      end
+
+      tuples[#tuples+1] = tuple
+   end
+
+   if #tuples == 0 then
+      return nil
+   end
+
+   for k = 1, #fields do
+      exfields[fields[k]] = true
+   end
+
+   return {fields=fields, comps=comps, values=tuples}
+end
+
 -- Returns:
 -- - Load Result: bool
 -- - required engine version. will be nil when load result is false
@@ -958,15 +1167,28 @@ function load_rules(rules_content,
 
       local v = state.lists_by_name[name]
 
+      if v['file'] ~= nil then
+	 local err = falco_rules.add_external_list(rules_mgr, v['list'], v['file'])
+	 if err ~= nil then
+	    return false, nil, nil, build_error_with_context(v['context'], err), warnings
+	 end
+	 filter_helper.set_external_list(list_resolver, v['list'])
+	 state.lists[v['list']] = {["items"] = {}, ["external"] = true, ["used"] = false}
+	 goto next_list
+      end
+
       -- list items are represented in yaml as a native list, so no
-      -- parsing necessary
+      -- parsing necessary. The items are kept as written, and
+      -- substituted in the filters by the list resolver.
       local items = {}
 
       -- List items may be references to other lists, so go through
       -- the items and expand any references to the items in the list
       for i, item in ipairs(v['items']) do
 	 if (state.lists[item] == nil) then
-	    items[#items+1] = quote_item(item)
+	    items[#items+1] = tostring(item)
+	 elseif state.lists[item].external then
+	    return false, nil, nil, build_error_with_context(v['context'], "List "..v['list'].." can't include the external list "..item), warnings
 	 else
 	    state.lists[item].used = true
 	    for i, exp_item in ipairs(state.lists[item].items) do
@@ -976,6 +1198,9 @@ function load_rules(rules_content,
       end
 
       state.lists[v['list']] = {["items"] = items, ["used"] = false}
+      filter_helper.set_list(list_resolver, v['list'], list_values(items))
+
+      ::next_list::
    end
 
    for _, name in ipairs(state.ordered_macro_names) do
@@ -999,12 +1224,19 @@ function load_rules(rules_content,
 
       local exfields = {}
 
-      -- Turn exceptions into condition strings and add them to each
-      -- rule's condition
+      -- Exceptions checked natively by the engine, passed to add_filter
+      local native_exceptions = {}
+
+      -- Turn the other exceptions into condition strings and add
+      -- them to each rule's condition
       for _, eitem in ipairs(v['exceptions']) do
 
 	 local icond, err
-	 if type(eitem['fields']) == "table" then
+	 local nitem = native_exception_item(rules_mgr, v['source'], eitem, exfields)
+	 if nitem ~= nil then
+	    native_exceptions[#native_exceptions+1] = nitem
+	    icond = ""
+	 elseif type(eitem['fields']) == "table" then
 	    icond, err = build_exception_condition_string_multi_fields(eitem, exfields)
 	 else
 	    icond, err = build_exception_condition_string_single_field(eitem, exfields)
@@ -1069,7 +1301,10 @@ function load_rules(rules_content,
 	    end
 	 else
        local compiled_filter = compiled_filter_or_err
-	    local num_evttypes = falco_rules.add_filter(rules_mgr, compiled_filter, v['rule'], v['source'], v['tags'])
+	    if v['window_ns'] ~= nil then
+	       falco_rules.set_rule_threshold(rules_mgr, compiled_filter, v['rule'], v['source'], v['count'], v['window_ns'], v['group_by'])
+	    end
+	    local num_evttypes = falco_rules.add_filter(rules_mgr, compiled_filter, v['rule'], v['source'], v['tags'], v['priority_num'], native_exceptions)
 	    if v['source'] == "syscall" and (num_evttypes == 0 or num_evttypes > 100) then
 	       if warn_evttypes == true then
             local msg = "Rule "..v['rule']..": warning (no-evttype):\n".."         matches too many evt.type values.\n".."         This has a significant performance penalty."
@@ -17,6 +17,9 @@ limitations under the License.
 #include <sinsp.h>
 #include "lua_filter_helper.h"
 #include "filter_macro_resolver.h"
+#include "filter_list_resolver.h"
+#include "filter_multi_pattern_resolver.h"
+#include "condition_filter_factory.h"
 #include "rules.h"
 
 using namespace std;
@@ -38,6 +41,11 @@ const static struct luaL_Reg ll_filter_helper[] =
 	{"find_unknown_macro", &lua_filter_helper::find_unknown_macro},
 	{"clone_ast", &lua_filter_helper::clone_ast},
 	{"delete_ast", &lua_filter_helper::delete_ast},
+	{"new_list_resolver", &lua_filter_helper::new_list_resolver},
+	{"delete_list_resolver", &lua_filter_helper::delete_list_resolver},
+	{"set_list", &lua_filter_helper::set_list},
+	{"set_external_list", &lua_filter_helper::set_external_list},
+	{"resolve_lists", &lua_filter_helper::resolve_lists},
 	{NULL, NULL}
 };
 
@@ -73,6 +81,34 @@ int lua_filter_helper::parse_filter(lua_State *ls)
 	return 2;
 }
 
+// The program of a condition, or NULL if it's left to the filter
+// compiled by sinsp_filter_compiler
+static std::shared_ptr<filter_program> compile_program(falco_rules *rules,
+						       ast::expr *filter,
+						       std::shared_ptr<condition_filter_factory> factory,
+						       int32_t check_id)
+{
+	if(!rules->compile_programs())
+	{
+		return NULL;
+	}
+
+	try
+	{
+		return std::make_shared<filter_program>(filter, factory, check_id,
+			[factory](const string &field)
+			{
+				return factory->new_string_field(field);
+			});
+	}
+	catch(const std::exception &e)
+	{
+		rules->log(falco_common::PRIORITY_DEBUG,
+			   string("Could not compile a condition into a program, evaluating its filter instead: ") + e.what());
+		return NULL;
+	}
+}
+
 int lua_filter_helper::compile_filter(lua_State *ls)
 {
 	if (! lua_islightuserdata(ls, -4) ||
@@ -91,9 +127,63 @@ int lua_filter_helper::compile_filter(lua_State *ls)
 
 	try
 	{
-		sinsp_filter_compiler compiler(rules->get_filter_factory(source), ast);
+		auto factory = rules->get_condition_filter_factory(source);
+
+		// The checks of a field on many patterns are grouped.
+		// The caller deletes the AST once compiled, so it can
+		// be modified in place.
+		filter_multi_pattern_resolver resolver([&factory](const string &field)
+		{
+			return factory->supports_multi_pattern(field);
+		});
+		resolver.run(ast);
+
+		// The networks compared with the address fields are
+		// looked up in a trie instead of being compared one by
+		// one
+		filter_list_resolver cidr_resolver;
+		cidr_resolver.set_cidr_fields([&factory](const string &field)
+		{
+			return factory->supports_cidr(field);
+		});
+		cidr_resolver.run(ast);
+
+		// The checks that only depend on the thread or the
+		// container are compiled apart, as their result is
+		// cached by the ruleset
+		rule_options options;
+		std::unique_ptr<ast::expr> scoped;
+		std::unique_ptr<ast::expr> other;
+		rule_scope::scope scope;
+		if(rule_scope::split(ast, [&factory](const string &field, const string &arg)
+			{
+				return factory->field_scope(field, arg);
+			}, scoped, other, scope))
+		{
+			sinsp_filter_compiler scope_compiler(factory, scoped.get());
+			scope_compiler.set_check_id(check_id);
+			std::shared_ptr<gen_event_filter> scope_filter(scope_compiler.compile());
+			options.scope = std::make_shared<rule_scope>(scope_filter, scope);
+			options.scope->set_program(compile_program(rules, scoped.get(), factory, check_id));
+		}
+
+		ast::expr *rest = (options.scope ? other.get() : ast);
+		sinsp_filter_compiler compiler(factory, rest);
 		compiler.set_check_id(check_id);
 		gen_event_filter* filter = compiler.compile();
+
+		// The filter is kept for its event types, and the
+		// program is run instead
+		options.program = compile_program(rules, rest, factory, check_id);
+
+		// The ruleset only evaluates the rule for the events
+		// matching its guard
+		options.guard = rule_guard::find(ast,
+			[&factory](const string &field, const vector<string> &values)
+			{
+				return factory->new_guard_field(field, values);
+			});
+		rules->set_filter_options(filter, options);
 		lua_pushboolean(ls, true);
 		lua_pushlightuserdata(ls, filter);
 	}
@@ -187,4 +277,105 @@ int lua_filter_helper::delete_ast(lua_State *ls)
 
 	delete (ast::expr*) lua_topointer(ls, -1);
 	return 0;
-}
\ No newline at end of file
+}
+int lua_filter_helper::new_list_resolver(lua_State *ls)
+{
+	lua_pushlightuserdata(ls, new filter_list_resolver());
+	return 1;
+}
+
+int lua_filter_helper::delete_list_resolver(lua_State *ls)
+{
+	if (! lua_islightuserdata(ls, -1))  // resolver
+	{
+		lua_pushstring(ls, "Invalid arguments passed to delete_list_resolver()");
+		lua_error(ls);
+	}
+
+	delete (filter_list_resolver*) lua_topointer(ls, -1);
+	return 0;
+}
+
+int lua_filter_helper::set_list(lua_State *ls)
+{
+	if (! lua_islightuserdata(ls, -3) ||	// resolver
+		! lua_isstring(ls, -2) ||		   // name
+		! lua_istable(ls, -1))			  // items
+	{
+		lua_pushstring(ls, "Invalid arguments passed to set_list()");
+		lua_error(ls);
+	}
+
+	filter_list_resolver* resolver = (filter_list_resolver*) lua_topointer(ls, -3);
+	std::string name = lua_tostring(ls, -2);
+
+	// The items are converted once, and shared by all the filters
+	// referencing the list
+	auto items = make_shared<vector<string>>();
+	size_t num_items = lua_objlen(ls, -1);
+	for (size_t i = 1; i <= num_items; i++)
+	{
+		lua_rawgeti(ls, -1, i);
+		if (! lua_isstring(ls, -1))
+		{
+			lua_pushstring(ls, "Invalid item passed to set_list()");
+			lua_error(ls);
+		}
+		items->push_back(lua_tostring(ls, -1));
+		lua_pop(ls, 1);
+	}
+
+	resolver->set_list(name, items);
+	return 0;
+}
+
+int lua_filter_helper::set_external_list(lua_State *ls)
+{
+	if (! lua_islightuserdata(ls, -2) ||	// resolver
+		! lua_isstring(ls, -1))			  // name
+	{
+		lua_pushstring(ls, "Invalid arguments passed to set_external_list()");
+		lua_error(ls);
+	}
+
+	filter_list_resolver* resolver = (filter_list_resolver*) lua_topointer(ls, -2);
+	resolver->set_external_list(lua_tostring(ls, -1));
+	return 0;
+}
+
+int lua_filter_helper::resolve_lists(lua_State *ls)
+{
+	if (! lua_islightuserdata(ls, -2) ||	// resolver
+		! lua_islightuserdata(ls, -1))	  // ast
+	{
+		lua_pushstring(ls, "Invalid arguments passed to resolve_lists()");
+		lua_error(ls);
+	}
+
+	filter_list_resolver* resolver = (filter_list_resolver*) lua_topointer(ls, -2);
+	ast::expr* ast = (ast::expr*) lua_topointer(ls, -1);
+
+	// Returns the new AST and the names of the lists found in it
+	try
+	{
+		resolver->run(ast);
+	}
+	catch (const falco_exception& e)
+	{
+		lua_pushboolean(ls, false);
+		lua_pushstring(ls, e.what());
+		lua_pushnil(ls);
+		return 3;
+	}
+
+	lua_pushboolean(ls, true);
+	lua_pushlightuserdata(ls, ast);
+	lua_newtable(ls);
+	int i = 1;
+	for (auto &name : resolver->get_resolved_lists())
+	{
+		lua_pushstring(ls, name.c_str());
+		lua_rawseti(ls, -2, i++);
+	}
+	return 3;
+}
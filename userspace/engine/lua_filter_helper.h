@@ -33,4 +33,9 @@ public:
 	static int find_unknown_macro(lua_State *ls);
 	static int clone_ast(lua_State *ls);
 	static int delete_ast(lua_State *ls);
+	static int new_list_resolver(lua_State *ls);
+	static int delete_list_resolver(lua_State *ls);
+	static int set_list(lua_State *ls);
+	static int set_external_list(lua_State *ls);
+	static int resolve_lists(lua_State *ls);
 };
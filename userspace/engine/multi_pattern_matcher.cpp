@@ -0,0 +1,242 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+
+#include <queue>
+
+#include "multi_pattern_matcher.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+using namespace std;
+
+multi_pattern_matcher::multi_pattern_matcher():
+	m_trie(1),
+	m_trie_patterns(1, -1),
+	m_built(false),
+	m_scanned(false)
+{
+}
+
+multi_pattern_matcher::~multi_pattern_matcher()
+{
+}
+
+uint32_t multi_pattern_matcher::add(const std::string &pattern)
+{
+	auto it = m_ids.find(pattern);
+	if(it != m_ids.end())
+	{
+		return it->second;
+	}
+
+	uint32_t s = 0;
+	for(auto c : pattern)
+	{
+		auto next = m_trie[s].find((uint8_t) c);
+		if(next != m_trie[s].end())
+		{
+			s = next->second;
+			continue;
+		}
+
+		uint32_t n = m_trie.size();
+		m_trie[s][(uint8_t) c] = n;
+		m_trie.push_back(map<uint8_t, uint32_t>());
+		m_trie_patterns.push_back(-1);
+		s = n;
+	}
+
+	uint32_t id = m_lengths.size();
+	m_trie_patterns[s] = id;
+	m_lengths.push_back(pattern.size());
+	m_ids[pattern] = id;
+
+	m_built = false;
+	return id;
+}
+
+void multi_pattern_matcher::build()
+{
+	m_states.assign(m_trie.size(), state());
+	m_edges.clear();
+
+	for(uint32_t s = 0; s < m_trie.size(); s++)
+	{
+		m_states[s].first_edge = m_edges.size();
+		m_states[s].num_edges = m_trie[s].size();
+		m_states[s].pattern = m_trie_patterns[s];
+		for(auto &e : m_trie[s])
+		{
+			m_edges.push_back({e.first, e.second});
+		}
+	}
+
+	for(uint32_t c = 0; c < 256; c++)
+	{
+		auto next = m_trie[0].find((uint8_t) c);
+		m_root[c] = (next != m_trie[0].end() ? next->second : 0);
+	}
+
+	// Breadth-first, so that the fail state of a state, which is
+	// shallower, is complete when the state is visited
+	queue<uint32_t> states;
+	for(auto &e : m_trie[0])
+	{
+		m_states[e.second].fail = 0;
+		m_states[e.second].output = 0;
+		states.push(e.second);
+	}
+
+	while(!states.empty())
+	{
+		uint32_t s = states.front();
+		states.pop();
+
+		for(auto &e : m_trie[s])
+		{
+			uint32_t fail = next_state(m_states[s].fail, e.first);
+			m_states[e.second].fail = fail;
+			m_states[e.second].output = (m_states[fail].pattern >= 0 ? fail : m_states[fail].output);
+			states.push(e.second);
+		}
+	}
+
+	m_matches.assign(m_lengths.size(), 0);
+	m_found.clear();
+	m_scanned = false;
+	m_built = true;
+}
+
+uint32_t multi_pattern_matcher::next_state(uint32_t s, uint8_t c) const
+{
+	while(s != 0)
+	{
+		const state &st = m_states[s];
+		const edge *begin = &m_edges[st.first_edge];
+		const edge *end = begin + st.num_edges;
+
+		// The edges are sorted by character
+		while(begin < end)
+		{
+			const edge *mid = begin + (end - begin) / 2;
+			if(mid->c == c)
+			{
+				return mid->next;
+			}
+			if(mid->c < c)
+			{
+				begin = mid + 1;
+			}
+			else
+			{
+				end = mid;
+			}
+		}
+
+		s = st.fail;
+	}
+
+	return m_root[c];
+}
+
+void multi_pattern_matcher::found(uint32_t s, size_t end, size_t len)
+{
+	for(; s != 0; s = m_states[s].output)
+	{
+		uint32_t id = m_states[s].pattern;
+		if(m_matches[id] == 0)
+		{
+			m_found.push_back(id);
+		}
+
+		uint8_t flags = MATCH_ANYWHERE;
+		if(end + 1 == m_lengths[id])
+		{
+			flags |= MATCH_PREFIX;
+		}
+		if(end + 1 == len)
+		{
+			flags |= MATCH_SUFFIX;
+		}
+		m_matches[id] |= flags;
+	}
+}
+
+void multi_pattern_matcher::scan(const char *text, size_t len)
+{
+	if(!m_built)
+	{
+		build();
+	}
+
+	if(m_scanned && len == m_text.size() && memcmp(text, m_text.data(), len) == 0)
+	{
+		return;
+	}
+
+	for(auto id : m_found)
+	{
+		m_matches[id] = 0;
+	}
+	m_found.clear();
+
+	uint32_t s = 0;
+	for(size_t i = 0; i < len; i++)
+	{
+		s = next_state(s, (uint8_t) text[i]);
+		if(m_states[s].pattern >= 0)
+		{
+			found(s, i, len);
+		}
+		else if(m_states[s].output != 0)
+		{
+			found(m_states[s].output, i, len);
+		}
+	}
+
+	m_text.assign(text, len);
+	m_scanned = true;
+}
+
+uint8_t multi_pattern_matcher::matches(uint32_t id) const
+{
+	return m_matches[id];
+}
+
+size_t multi_pattern_matcher::size() const
+{
+	return m_lengths.size();
+}
+
+std::shared_ptr<multi_pattern_matcher> multi_pattern_index::get(const std::string &source, const std::string &field)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+
+	auto &matcher = m_matchers[make_pair(source, field)];
+	if(!matcher)
+	{
+		matcher = std::make_shared<multi_pattern_matcher>();
+	}
+
+	return matcher;
+}
+
+void multi_pattern_index::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_matchers.clear();
+}
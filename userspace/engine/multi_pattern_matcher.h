@@ -0,0 +1,128 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+//
+// Finds many patterns at once in a string, with an Aho-Corasick
+// automaton, for the "contains", "startswith" and "endswith" checks
+// comparing the same field with different strings. A scan of the
+// string reports all the patterns found in it, and whether they were
+// found at its beginning or end, so the checks then only look up the
+// result for their own patterns.
+//
+// The matcher of a field is shared by all the checks on the field,
+// and the result of the last scan is kept, so that the field is only
+// scanned once per event however many rules compare it. It must only
+// be used by the thread evaluating the events of its source.
+//
+class multi_pattern_matcher
+{
+public:
+	// Where a pattern was found
+	enum match_flags
+	{
+		MATCH_ANYWHERE = 1,
+		MATCH_PREFIX = 2,
+		MATCH_SUFFIX = 4
+	};
+
+	multi_pattern_matcher();
+	virtual ~multi_pattern_matcher();
+
+	// Add a non-empty pattern, returning its id. Adding a pattern
+	// again returns the same id. The automaton is rebuilt on the
+	// next scan.
+	uint32_t add(const std::string &pattern);
+
+	// Find the patterns in text. Scanning the same text as the
+	// previous scan does nothing.
+	void scan(const char *text, size_t len);
+
+	// The match_flags of a pattern in the text of the last scan
+	uint8_t matches(uint32_t id) const;
+
+	size_t size() const;
+
+private:
+	struct state
+	{
+		// The edges of the state, in m_edges
+		uint32_t first_edge;
+		uint32_t num_edges;
+		// The state of the longest proper suffix in the trie
+		uint32_t fail;
+		// The closest state through the fail links ending a
+		// pattern, 0 if none
+		uint32_t output;
+		// The pattern ending in this state, or -1
+		int32_t pattern;
+	};
+
+	struct edge
+	{
+		uint8_t c;
+		uint32_t next;
+	};
+
+	void build();
+	uint32_t next_state(uint32_t s, uint8_t c) const;
+	void found(uint32_t s, size_t end, size_t len);
+
+	// The trie of the patterns, before build()
+	std::vector<std::map<uint8_t, uint32_t>> m_trie;
+	std::vector<int32_t> m_trie_patterns;
+
+	std::unordered_map<std::string, uint32_t> m_ids;
+	std::vector<uint32_t> m_lengths;
+
+	// The automaton
+	bool m_built;
+	std::vector<state> m_states;
+	std::vector<edge> m_edges;
+	uint32_t m_root[256];
+
+	// The result of the last scan
+	bool m_scanned;
+	std::string m_text;
+	std::vector<uint8_t> m_matches;
+	std::vector<uint32_t> m_found;
+};
+
+//
+// The matchers of the fields compared in the rules, shared by all the
+// checks on the same field.
+//
+class multi_pattern_index
+{
+public:
+	std::shared_ptr<multi_pattern_matcher> get(const std::string &source, const std::string &field);
+
+	void clear();
+
+private:
+	std::mutex m_mtx;
+	std::map<std::pair<std::string, std::string>, std::shared_ptr<multi_pattern_matcher>> m_matchers;
+};
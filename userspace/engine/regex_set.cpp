@@ -0,0 +1,165 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+
+#include "regex_set.h"
+#include "falco_common.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+using namespace std;
+
+regex_set::regex_set():
+	m_compiled(false),
+	m_scanned(false)
+{
+	m_options.set_log_errors(false);
+}
+
+regex_set::~regex_set()
+{
+}
+
+uint32_t regex_set::add(const std::string &pattern)
+{
+	auto it = m_ids.find(pattern);
+	if(it != m_ids.end())
+	{
+		return it->second;
+	}
+
+	if(pattern.size() > max_pattern_len)
+	{
+		throw falco_exception("Regex " + pattern.substr(0, 32) + "... is longer than "
+				      + to_string(max_pattern_len) + " characters");
+	}
+
+	std::unique_ptr<RE2> re(new RE2(pattern, m_options));
+	if(!re->ok())
+	{
+		throw falco_exception("Invalid regex " + pattern + ": " + re->error());
+	}
+
+	if(re->ProgramSize() > max_program_size)
+	{
+		throw falco_exception("Regex " + pattern + " is too complex");
+	}
+
+	uint32_t id = m_regexes.size();
+	m_regexes.push_back(std::move(re));
+	m_ids[pattern] = id;
+
+	m_compiled = false;
+	return id;
+}
+
+void regex_set::compile()
+{
+	m_set.reset(new RE2::Set(m_options, RE2::UNANCHORED));
+
+	for(auto &re : m_regexes)
+	{
+		if(m_set->Add(re->pattern(), NULL) < 0)
+		{
+			m_set.reset();
+			break;
+		}
+	}
+
+	// If the set is over the memory limit, the patterns are
+	// matched one by one
+	if(m_set && !m_set->Compile())
+	{
+		m_set.reset();
+	}
+
+	m_matches.assign(m_regexes.size(), 0);
+	m_found.clear();
+	m_scanned = false;
+	m_compiled = true;
+}
+
+void regex_set::scan(const char *text, size_t len)
+{
+	if(!m_compiled)
+	{
+		compile();
+	}
+
+	if(m_scanned && len == m_text.size() && memcmp(text, m_text.data(), len) == 0)
+	{
+		return;
+	}
+
+	for(auto id : m_found)
+	{
+		m_matches[id] = 0;
+	}
+	m_found.clear();
+
+	re2::StringPiece str(text, len);
+	RE2::Set::ErrorInfo err;
+	if(!m_set || (!m_set->Match(str, &m_found, &err) && err.kind != RE2::Set::kNoError))
+	{
+		// The set ran out of memory, so each pattern is matched
+		// on its own
+		m_found.clear();
+		for(uint32_t id = 0; id < m_regexes.size(); id++)
+		{
+			if(RE2::PartialMatch(str, *m_regexes[id]))
+			{
+				m_found.push_back(id);
+			}
+		}
+	}
+
+	for(auto id : m_found)
+	{
+		m_matches[id] = 1;
+	}
+
+	m_text.assign(text, len);
+	m_scanned = true;
+}
+
+bool regex_set::matches(uint32_t id) const
+{
+	return m_matches[id] != 0;
+}
+
+size_t regex_set::size() const
+{
+	return m_regexes.size();
+}
+
+std::shared_ptr<regex_set> regex_set_index::get(const std::string &source, const std::string &field)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+
+	auto &set = m_sets[make_pair(source, field)];
+	if(!set)
+	{
+		set = std::make_shared<regex_set>();
+	}
+
+	return set;
+}
+
+void regex_set_index::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_sets.clear();
+}
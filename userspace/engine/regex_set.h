@@ -0,0 +1,103 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include <re2/re2.h>
+#include <re2/set.h>
+
+//
+// The regular expressions compared with a field, matched with RE2,
+// whose time is linear in the length of the text. All the patterns
+// are compiled into one RE2::Set, so that a single scan of the text
+// tells which patterns match. A pattern matches anywhere in the text,
+// unless anchored with ^ or $.
+//
+// As the multi_pattern_matcher, the set of a field is shared by all
+// the checks on the field, and keeps the result of the last scan. It
+// must only be used by the thread evaluating the events of its
+// source.
+//
+class regex_set
+{
+public:
+	// Limits on each pattern, so that a pattern can't make the
+	// rules slow or large
+	static const size_t max_pattern_len = 4096;
+	static const int max_program_size = 10000;
+
+	regex_set();
+	virtual ~regex_set();
+
+	// Add a pattern, returning its id. Adding a pattern again
+	// returns the same id. Throws falco_exception if the pattern
+	// isn't valid or exceeds the limits. The set is compiled again
+	// on the next scan.
+	uint32_t add(const std::string &pattern);
+
+	// Match the patterns with text. Scanning the same text as the
+	// previous scan does nothing.
+	void scan(const char *text, size_t len);
+
+	// Whether a pattern matched the text of the last scan
+	bool matches(uint32_t id) const;
+
+	size_t size() const;
+
+private:
+	void compile();
+
+	RE2::Options m_options;
+
+	// The patterns, compiled on their own to check them, and used
+	// if the set can't be compiled or matched in the memory limit
+	std::vector<std::unique_ptr<RE2>> m_regexes;
+	std::unordered_map<std::string, uint32_t> m_ids;
+
+	bool m_compiled;
+	std::unique_ptr<RE2::Set> m_set;
+
+	// The result of the last scan
+	bool m_scanned;
+	std::string m_text;
+	std::vector<int> m_found;
+	std::vector<uint8_t> m_matches;
+};
+
+//
+// The regex_sets of the fields compared in the rules, shared by all
+// the checks on the same field.
+//
+class regex_set_index
+{
+public:
+	std::shared_ptr<regex_set> get(const std::string &source, const std::string &field);
+
+	void clear();
+
+private:
+	std::mutex m_mtx;
+	std::map<std::pair<std::string, std::string>, std::shared_ptr<regex_set>> m_sets;
+};
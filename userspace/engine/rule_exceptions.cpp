@@ -0,0 +1,279 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "rule_exceptions.h"
+#include "falco_common.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+using namespace std;
+
+// Split a path into its components, ignoring empty ones, as pmatch
+// does
+static std::vector<std::string> path_components(const std::string &path)
+{
+	std::vector<std::string> ret;
+	size_t start = 0;
+
+	while(start < path.size())
+	{
+		size_t end = path.find('/', start);
+		if(end == string::npos)
+		{
+			end = path.size();
+		}
+		if(end > start)
+		{
+			ret.push_back(path.substr(start, end - start));
+		}
+		start = end + 1;
+	}
+
+	return ret;
+}
+
+// Whether the components of path begin with prefix
+static bool path_has_prefix(const char *path, const std::vector<std::string> &prefix)
+{
+	const char *p = path;
+
+	for(auto &component : prefix)
+	{
+		while(*p == '/')
+		{
+			p++;
+		}
+
+		size_t len = strcspn(p, "/");
+		if(len != component.size() ||
+		   component.compare(0, len, p, len) != 0)
+		{
+			return false;
+		}
+		p += len;
+	}
+
+	return true;
+}
+
+bool rule_exceptions::value_set::match(const char *value) const
+{
+	if(comp == CMP_PMATCH)
+	{
+		for(auto &prefix : prefixes)
+		{
+			if(path_has_prefix(value, prefix))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	return (values.find(value) != values.end());
+}
+
+rule_exceptions::rule_exceptions(std::shared_ptr<gen_event_filter_factory> factory):
+	m_factory(factory)
+{
+}
+
+rule_exceptions::~rule_exceptions()
+{
+}
+
+uint32_t rule_exceptions::field_index(const std::string &name)
+{
+	for(uint32_t i = 0; i < m_field_names.size(); i++)
+	{
+		if(m_field_names[i] == name)
+		{
+			return i;
+		}
+	}
+
+	std::unique_ptr<gen_event_filter_check> check(m_factory->new_filtercheck(name.c_str()));
+	if(!check ||
+	   check->parse_field_name(name.c_str(), true, true) != (int32_t) name.size())
+	{
+		throw falco_exception("Exception field " + name + " is not a supported filter field");
+	}
+
+	m_field_names.push_back(name);
+	m_checks.push_back(std::move(check));
+	m_states.push_back(NOT_EXTRACTED);
+	m_values.push_back(NULL);
+
+	return m_field_names.size() - 1;
+}
+
+void rule_exceptions::add_item(const std::vector<std::string> &fields,
+			       const std::vector<comparison> &comps,
+			       const std::vector<values_tuple> &tuples)
+{
+	if(fields.size() != comps.size())
+	{
+		throw falco_exception("Exception fields and comps lists must have equal length");
+	}
+
+	item it;
+
+	for(size_t i = 0; i < fields.size(); i++)
+	{
+		if(comps[i] == CMP_EQ)
+		{
+			it.key_fields.push_back(field_index(fields[i]));
+		}
+		else
+		{
+			it.other_fields.push_back(field_index(fields[i]));
+		}
+	}
+
+	for(auto &tuple : tuples)
+	{
+		if(tuple.size() != fields.size())
+		{
+			throw falco_exception("Exception fields and values lists must have equal length");
+		}
+
+		std::string key;
+		std::vector<value_set> others;
+
+		for(size_t i = 0; i < fields.size(); i++)
+		{
+			if(comps[i] == CMP_EQ)
+			{
+				if(tuple[i].size() != 1)
+				{
+					throw falco_exception("Exception field " + fields[i] + " must be compared with a single value");
+				}
+				key += tuple[i][0];
+				key.push_back('\0');
+				continue;
+			}
+
+			value_set vs;
+			vs.comp = comps[i];
+			for(auto &val : tuple[i])
+			{
+				if(comps[i] == CMP_PMATCH)
+				{
+					vs.prefixes.push_back(path_components(val));
+				}
+				else
+				{
+					vs.values.insert(val);
+				}
+			}
+			others.push_back(std::move(vs));
+		}
+
+		it.tuples[key].push_back(std::move(others));
+	}
+
+	m_items.push_back(std::move(it));
+}
+
+const char *rule_exceptions::field_value(uint32_t idx, gen_event *evt)
+{
+	if(m_states[idx] == NOT_EXTRACTED)
+	{
+		// As when comparing the field in a condition, a field
+		// without a value doesn't match
+		if(m_checks[idx]->extract(evt, m_extracted, false) &&
+		   m_extracted.size() == 1 &&
+		   m_extracted[0].ptr != NULL)
+		{
+			m_values[idx] = (const char *) m_extracted[0].ptr;
+			m_states[idx] = EXTRACTED;
+		}
+		else
+		{
+			m_states[idx] = NO_VALUE;
+		}
+	}
+
+	return (m_states[idx] == EXTRACTED ? m_values[idx] : NULL);
+}
+
+bool rule_exceptions::match(gen_event *evt)
+{
+	bool ret = false;
+
+	for(auto &it : m_items)
+	{
+		m_key.clear();
+
+		bool has_values = true;
+		for(auto idx : it.key_fields)
+		{
+			const char *val = field_value(idx, evt);
+			if(val == NULL)
+			{
+				has_values = false;
+				break;
+			}
+			m_key.append(val);
+			m_key.push_back('\0');
+		}
+
+		if(!has_values)
+		{
+			continue;
+		}
+
+		auto found = it.tuples.find(m_key);
+		if(found == it.tuples.end())
+		{
+			continue;
+		}
+
+		for(auto &others : found->second)
+		{
+			bool tuple_match = true;
+			for(size_t i = 0; tuple_match && i < others.size(); i++)
+			{
+				const char *val = field_value(it.other_fields[i], evt);
+				tuple_match = (val != NULL && others[i].match(val));
+			}
+
+			if(tuple_match)
+			{
+				ret = true;
+				break;
+			}
+		}
+
+		if(ret)
+		{
+			break;
+		}
+	}
+
+	// The values are only valid for this event
+	std::fill(m_states.begin(), m_states.end(), NOT_EXTRACTED);
+
+	return ret;
+}
+
+uint32_t rule_exceptions::num_items()
+{
+	return m_items.size();
+}
@@ -0,0 +1,117 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "gen_filter.h"
+
+//
+// The exceptions of a rule, checked natively instead of being
+// expanded into "and not ((f1=v1 and f2=v2) or ...)" in the rule
+// condition. The values of the fields compared with = are the key
+// of a hash table, so an item with thousands of values costs one
+// extraction per field and one lookup. The fields compared with in
+// and pmatch are checked on the values found with that key.
+//
+// Only string fields are supported, as the extracted values are
+// compared as C strings. The rule loader keeps expanding the other
+// exceptions into the condition.
+//
+// Like filters, this isn't thread safe.
+//
+class rule_exceptions
+{
+public:
+	enum comparison
+	{
+		CMP_EQ,
+		CMP_IN,
+		CMP_PMATCH
+	};
+
+	// A list of values for each field. Lists for CMP_EQ fields
+	// hold a single value.
+	typedef std::vector<std::vector<std::string>> values_tuple;
+
+	rule_exceptions(std::shared_ptr<gen_event_filter_factory> factory);
+	virtual ~rule_exceptions();
+
+	// Add an exception item. An event matches it when the
+	// values of fields match all the values of a tuple. Throws
+	// falco_exception if a field isn't supported.
+	void add_item(const std::vector<std::string> &fields,
+		      const std::vector<comparison> &comps,
+		      const std::vector<values_tuple> &tuples);
+
+	// Whether evt matches any exception item.
+	bool match(gen_event *evt);
+
+	uint32_t num_items();
+
+private:
+	struct value_set
+	{
+		comparison comp;
+
+		// For CMP_IN
+		std::unordered_set<std::string> values;
+
+		// For CMP_PMATCH, the components of each path
+		std::vector<std::vector<std::string>> prefixes;
+
+		bool match(const char *value) const;
+	};
+
+	struct item
+	{
+		// Indexes in m_fields
+		std::vector<uint32_t> key_fields;
+		std::vector<uint32_t> other_fields;
+
+		// From the values of the key fields, separated by
+		// '\0', to the values of the other fields of each
+		// tuple
+		std::unordered_map<std::string, std::vector<std::vector<value_set>>> tuples;
+	};
+
+	// The fields of all the items, each extracted once per event
+	uint32_t field_index(const std::string &name);
+	const char *field_value(uint32_t idx, gen_event *evt);
+
+	std::shared_ptr<gen_event_filter_factory> m_factory;
+
+	std::vector<std::string> m_field_names;
+	std::vector<std::unique_ptr<gen_event_filter_check>> m_checks;
+	std::vector<item> m_items;
+
+	// Reused by match()
+	enum extract_state
+	{
+		NOT_EXTRACTED,
+		EXTRACTED,
+		NO_VALUE
+	};
+	std::vector<extract_state> m_states;
+	std::vector<const char *> m_values;
+	std::vector<extract_value_t> m_extracted;
+	std::string m_key;
+};
@@ -0,0 +1,137 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "rule_guard.h"
+#include "condition_filter_factory.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+using namespace std;
+using namespace libsinsp::filter;
+
+rule_guard::rule_guard(const std::string &field,
+		       const std::vector<std::string> &values,
+		       std::shared_ptr<rule_guard_field> extractor):
+	m_field(field),
+	m_values(values),
+	m_extractor(extractor)
+{
+}
+
+rule_guard::~rule_guard()
+{
+}
+
+// The checks that must all be true for filter to be true, i.e. the
+// children of the "and" expressions at the root
+static void required_checks(ast::expr *filter, std::vector<ast::binary_check_expr *> &checks)
+{
+	auto and_e = dynamic_cast<ast::and_expr *>(filter);
+	if(and_e != nullptr)
+	{
+		for(auto &c : and_e->children)
+		{
+			required_checks(c, checks);
+		}
+		return;
+	}
+
+	auto or_e = dynamic_cast<ast::or_expr *>(filter);
+	if(or_e != nullptr && or_e->children.size() == 1)
+	{
+		required_checks(or_e->children[0], checks);
+		return;
+	}
+
+	auto check = dynamic_cast<ast::binary_check_expr *>(filter);
+	if(check != nullptr)
+	{
+		checks.push_back(check);
+	}
+}
+
+// The event type and direction are already indexed, or have too few
+// values to be selective. The pseudo-fields of the
+// condition_filter_factory don't compare values for equality.
+static bool guard_field(const std::string &field)
+{
+	return (field != "evt.type" &&
+		field != "evt.dir" &&
+		field != condition_filter_factory::external_list_field &&
+		field != condition_filter_factory::cidr_field &&
+		field != condition_filter_factory::multi_pattern_field &&
+		field != condition_filter_factory::regex_field);
+}
+
+std::shared_ptr<rule_guard> rule_guard::find(libsinsp::filter::ast::expr *filter,
+					     new_field_t new_field)
+{
+	std::vector<ast::binary_check_expr *> checks;
+	required_checks(filter, checks);
+
+	std::shared_ptr<rule_guard> ret;
+	for(auto check : checks)
+	{
+		if(!guard_field(check->field))
+		{
+			continue;
+		}
+
+		std::vector<std::string> values;
+		auto value = dynamic_cast<ast::value_expr *>(check->value);
+		auto list = dynamic_cast<ast::list_expr *>(check->value);
+		if((check->op == "=" || check->op == "==") && value != nullptr)
+		{
+			values.push_back(value->value);
+		}
+		else if(check->op == "in" && list != nullptr && !list->values.empty())
+		{
+			values = list->values;
+		}
+		else
+		{
+			continue;
+		}
+
+		if(ret && ret->values().size() <= values.size())
+		{
+			continue;
+		}
+
+		std::string field = (check->arg.empty() ? check->field : check->field + "[" + check->arg + "]");
+		std::shared_ptr<rule_guard_field> extractor = new_field(field, values);
+		if(extractor)
+		{
+			ret = std::make_shared<rule_guard>(field, values, extractor);
+		}
+	}
+
+	return ret;
+}
+
+const std::string &rule_guard::field()
+{
+	return m_field;
+}
+
+const std::vector<std::string> &rule_guard::values()
+{
+	return m_values;
+}
+
+std::shared_ptr<rule_guard_field> rule_guard::extractor()
+{
+	return m_extractor;
+}
@@ -0,0 +1,80 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include <filter/parser.h>
+
+#include "gen_filter.h"
+
+//
+// Extracts the value of a field from events, as the string compared
+// with the values of a rule_guard.
+//
+class rule_guard_field
+{
+public:
+	virtual ~rule_guard_field() {}
+
+	// Returns false if the value can't be compared with the
+	// values of the guards, e.g. when the field has no value or
+	// several ones. Then, all the rules guarded by the field must
+	// be evaluated.
+	virtual bool extract_key(gen_event *evt, std::string &key) = 0;
+};
+
+//
+// A check that must be true for a rule to match, such as
+// "proc.name in (a, b)" in "proc.name in (a, b) and ...": the rule can
+// only match the events where field has one of values. The ruleset
+// indexes the rules by the values of their guard, and only evaluates
+// the rules whose guard holds for the value of the field.
+//
+class rule_guard
+{
+public:
+	typedef std::function<std::shared_ptr<rule_guard_field>(
+		const std::string &field,
+		const std::vector<std::string> &values)> new_field_t;
+
+	rule_guard(const std::string &field,
+		   const std::vector<std::string> &values,
+		   std::shared_ptr<rule_guard_field> extractor);
+	virtual ~rule_guard();
+
+	// Find the guard of a condition, among its "field = value" and
+	// "field in (values)" checks required for the whole condition
+	// to match. The one with the fewest values is picked.
+	// new_field creates the extractor of a field, or returns NULL
+	// if the field or the values can't be used as a guard. Returns
+	// NULL if there's no guard.
+	static std::shared_ptr<rule_guard> find(libsinsp::filter::ast::expr *filter,
+						new_field_t new_field);
+
+	const std::string &field();
+	const std::vector<std::string> &values();
+	std::shared_ptr<rule_guard_field> extractor();
+
+private:
+	std::string m_field;
+	std::vector<std::string> m_values;
+	std::shared_ptr<rule_guard_field> m_extractor;
+};
@@ -0,0 +1,157 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+
+#include "rule_scope.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+using namespace std;
+using namespace libsinsp::filter;
+
+rule_scope::rule_scope(std::shared_ptr<gen_event_filter> filter, scope scope):
+	m_filter(filter),
+	m_scope(scope)
+{
+}
+
+rule_scope::~rule_scope()
+{
+}
+
+// The checks that must all be true for filter to be true, i.e. the
+// children of the "and" expressions at the root
+static void required_exprs(ast::expr *filter, std::vector<ast::expr *> &exprs)
+{
+	auto and_e = dynamic_cast<ast::and_expr *>(filter);
+	if(and_e != nullptr)
+	{
+		for(auto &c : and_e->children)
+		{
+			required_exprs(c, exprs);
+		}
+		return;
+	}
+
+	exprs.push_back(filter);
+}
+
+// The scope of an expression is the highest one of its fields
+static rule_scope::scope expr_scope(ast::expr *e, rule_scope::field_scope_t &field_scope)
+{
+	auto and_e = dynamic_cast<ast::and_expr *>(e);
+	auto or_e = dynamic_cast<ast::or_expr *>(e);
+	if(and_e != nullptr || or_e != nullptr)
+	{
+		rule_scope::scope ret = rule_scope::SCOPE_CONTAINER;
+		for(auto &c : (and_e != nullptr ? and_e->children : or_e->children))
+		{
+			ret = std::max(ret, expr_scope(c, field_scope));
+		}
+		return ret;
+	}
+
+	auto not_e = dynamic_cast<ast::not_expr *>(e);
+	if(not_e != nullptr)
+	{
+		return expr_scope(not_e->child, field_scope);
+	}
+
+	auto binary_e = dynamic_cast<ast::binary_check_expr *>(e);
+	if(binary_e != nullptr)
+	{
+		return field_scope(binary_e->field, binary_e->arg);
+	}
+
+	auto unary_e = dynamic_cast<ast::unary_check_expr *>(e);
+	if(unary_e != nullptr)
+	{
+		return field_scope(unary_e->field, unary_e->arg);
+	}
+
+	return rule_scope::SCOPE_EVENT;
+}
+
+static ast::expr *clone_and(std::vector<ast::expr *> &exprs)
+{
+	if(exprs.size() == 1)
+	{
+		return ast::clone(exprs[0]);
+	}
+
+	std::vector<ast::expr *> children;
+	for(auto e : exprs)
+	{
+		children.push_back(ast::clone(e));
+	}
+	return new ast::and_expr(children);
+}
+
+bool rule_scope::split(libsinsp::filter::ast::expr *filter,
+		       field_scope_t field_scope,
+		       std::unique_ptr<libsinsp::filter::ast::expr> &scoped,
+		       std::unique_ptr<libsinsp::filter::ast::expr> &other,
+		       scope &scope)
+{
+	std::vector<ast::expr *> exprs;
+	required_exprs(filter, exprs);
+
+	std::vector<ast::expr *> scoped_exprs;
+	std::vector<ast::expr *> other_exprs;
+	scope = SCOPE_CONTAINER;
+	for(auto e : exprs)
+	{
+		rule_scope::scope s = expr_scope(e, field_scope);
+		if(s == SCOPE_EVENT)
+		{
+			other_exprs.push_back(e);
+		}
+		else
+		{
+			scoped_exprs.push_back(e);
+			scope = std::max(scope, s);
+		}
+	}
+
+	if(scoped_exprs.empty() || other_exprs.empty())
+	{
+		return false;
+	}
+
+	scoped.reset(clone_and(scoped_exprs));
+	other.reset(clone_and(other_exprs));
+	return true;
+}
+
+std::shared_ptr<gen_event_filter> rule_scope::filter()
+{
+	return m_filter;
+}
+
+void rule_scope::set_program(std::shared_ptr<filter_program> program)
+{
+	m_program = program;
+}
+
+std::shared_ptr<filter_program> rule_scope::program()
+{
+	return m_program;
+}
+
+rule_scope::scope rule_scope::get_scope()
+{
+	return m_scope;
+}
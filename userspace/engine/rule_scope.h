@@ -0,0 +1,120 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <functional>
+
+#include <filter/parser.h>
+
+#include "gen_filter.h"
+#include "filter_program.h"
+
+//
+// The part of a rule condition that only depends on the state of the
+// thread of the event, or of its container, such as
+// "container.id != host and proc.name = nginx". It gives the same
+// result for all the events of a thread until that state changes, so
+// the ruleset caches its result for each thread in a
+// rule_scope_state, and only evaluates the rest of the condition for
+// each event.
+//
+class rule_scope
+{
+public:
+	// What a check depends on, from the least to the most often
+	// changing
+	enum scope
+	{
+		// Changes when the thread execs
+		SCOPE_CONTAINER = 0,
+
+		// Changes when the thread execs or changes its user or
+		// group
+		SCOPE_THREAD = 1,
+
+		// Changes for each event
+		SCOPE_EVENT = 2
+	};
+
+	// The scope of a field, given its argument if any
+	typedef std::function<scope(const std::string &field,
+				    const std::string &arg)> field_scope_t;
+
+	rule_scope(std::shared_ptr<gen_event_filter> filter, scope scope);
+	virtual ~rule_scope();
+
+	// Split the checks that must all be true for filter to match
+	// into the ones that don't depend on the event, returned in
+	// scoped, and the others, returned in other. The scope of
+	// scoped is returned in scope. filter is left untouched.
+	// Returns false if there's nothing to split, i.e. if either
+	// part would be empty.
+	static bool split(libsinsp::filter::ast::expr *filter,
+			  field_scope_t field_scope,
+			  std::unique_ptr<libsinsp::filter::ast::expr> &scoped,
+			  std::unique_ptr<libsinsp::filter::ast::expr> &other,
+			  scope &scope);
+
+	// The filter of the scoped checks
+	std::shared_ptr<gen_event_filter> filter();
+
+	// The program compiled from the scoped checks, run instead
+	// of the filter if set
+	void set_program(std::shared_ptr<filter_program> program);
+	std::shared_ptr<filter_program> program();
+
+	scope get_scope();
+
+private:
+	std::shared_ptr<gen_event_filter> m_filter;
+	std::shared_ptr<filter_program> m_program;
+	scope m_scope;
+};
+
+//
+// Where the ruleset caches the results of the scoped filters, for the
+// thread of each event.
+//
+class rule_scope_state
+{
+public:
+	// The cached results, as stored in the slots
+	enum decision
+	{
+		DECISION_UNKNOWN = 0,
+		DECISION_FALSE = 1,
+		DECISION_TRUE = 2
+	};
+
+	virtual ~rule_scope_state() {}
+
+	// Reserve num slots for each thread, all initially
+	// DECISION_UNKNOWN. Called once, before any event. Returns the
+	// number of slots actually reserved.
+	virtual uint32_t reserve(uint32_t num) = 0;
+
+	// The slots of the thread of evt, or NULL if evt has no
+	// thread
+	virtual uint8_t *slots(gen_event *evt) = 0;
+
+	// The lowest scope that evt changes for its thread, the
+	// higher ones changing too, or SCOPE_EVENT if it changes
+	// none. Called for all the events, before slots().
+	virtual rule_scope::scope changed_scope(gen_event *evt) = 0;
+};
@@ -0,0 +1,192 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "rule_threshold.h"
+#include "falco_common.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+using namespace std;
+
+rule_threshold::rule_threshold(uint64_t count, uint64_t window_ns,
+			       const std::vector<std::shared_ptr<rule_threshold_field>> &group_by,
+			       uint32_t max_groups):
+	m_counts(new counts()),
+	m_group_by(group_by)
+{
+	if(count == 0 || window_ns == 0 || max_groups == 0)
+	{
+		throw falco_exception("The count, window and maximum number of groups of a threshold must be positive");
+	}
+
+	m_counts->count = count;
+	m_counts->window = window_ns;
+	m_counts->bucket_ns = (window_ns + num_buckets - 1) / num_buckets;
+	m_counts->max_groups = max_groups;
+}
+
+rule_threshold::rule_threshold(const rule_threshold &other,
+			       const std::vector<std::shared_ptr<rule_threshold_field>> &group_by):
+	m_counts(other.m_counts),
+	m_group_by(group_by)
+{
+}
+
+rule_threshold::~rule_threshold()
+{
+}
+
+void rule_threshold::slide(group &g, uint64_t bucket)
+{
+	if(bucket - g.last >= num_buckets)
+	{
+		for(uint32_t i = 0; i < num_buckets; i++)
+		{
+			g.buckets[i] = 0;
+		}
+		g.total = 0;
+	}
+	else
+	{
+		for(uint64_t b = g.last + 1; b <= bucket; b++)
+		{
+			uint32_t &n = g.buckets[b % num_buckets];
+			g.total -= n;
+			n = 0;
+		}
+	}
+	g.last = bucket;
+}
+
+bool rule_threshold::add(gen_event *evt)
+{
+	// The values of the fields, prefixed by their size as they
+	// may contain anything
+	m_key.clear();
+	for(auto &field : m_group_by)
+	{
+		if(field->extract_key(evt, m_value))
+		{
+			m_key += to_string(m_value.size());
+			m_key += ':';
+			m_key += m_value;
+		}
+		else
+		{
+			m_key += '-';
+		}
+	}
+
+	counts &c = *m_counts;
+	uint64_t bucket = evt->get_ts() / c.bucket_ns;
+
+	std::lock_guard<std::mutex> lock(c.mtx);
+
+	group_list::iterator it;
+	auto found = c.groups_by_key.find(m_key);
+	if(found != c.groups_by_key.end())
+	{
+		it = found->second;
+		c.groups.splice(c.groups.begin(), c.groups, it);
+	}
+	else
+	{
+		if(c.groups.size() >= c.max_groups)
+		{
+			c.groups_by_key.erase(c.groups.back().key);
+			c.groups.pop_back();
+		}
+
+		c.groups.emplace_front();
+		it = c.groups.begin();
+		it->key = m_key;
+		for(uint32_t i = 0; i < num_buckets; i++)
+		{
+			it->buckets[i] = 0;
+		}
+		it->last = bucket;
+		it->total = 0;
+		c.groups_by_key[m_key] = it;
+	}
+
+	group &g = *it;
+	if(bucket > g.last)
+	{
+		slide(g, bucket);
+	}
+	else if(g.last - bucket >= num_buckets)
+	{
+		// Older than the window of the group
+		return false;
+	}
+
+	g.buckets[bucket % num_buckets]++;
+	g.total++;
+
+	if(g.total < c.count)
+	{
+		return false;
+	}
+
+	for(uint32_t i = 0; i < num_buckets; i++)
+	{
+		g.buckets[i] = 0;
+	}
+	g.total = 0;
+
+	return true;
+}
+
+uint64_t rule_threshold::count()
+{
+	return m_counts->count;
+}
+
+uint64_t rule_threshold::window()
+{
+	return m_counts->window;
+}
+
+size_t rule_threshold::num_groups()
+{
+	std::lock_guard<std::mutex> lock(m_counts->mtx);
+	return m_counts->groups.size();
+}
+
+std::shared_ptr<rule_threshold> rule_threshold_index::get(const std::string &rule,
+							  uint64_t count, uint64_t window_ns,
+							  const std::vector<std::string> &group_by_fields,
+							  const std::vector<std::shared_ptr<rule_threshold_field>> &group_by)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+
+	std::shared_ptr<rule_threshold> ret;
+	entry &e = m_entries[rule];
+	std::shared_ptr<rule_threshold> last = e.threshold.lock();
+	if(last && e.count == count && e.window == window_ns && e.group_by_fields == group_by_fields)
+	{
+		ret = std::make_shared<rule_threshold>(*last, group_by);
+	}
+	else
+	{
+		ret = std::make_shared<rule_threshold>(count, window_ns, group_by);
+		e.count = count;
+		e.window = window_ns;
+		e.group_by_fields = group_by_fields;
+	}
+
+	e.threshold = ret;
+	return ret;
+}
@@ -0,0 +1,158 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include "gen_filter.h"
+
+//
+// Extracts the value of a group_by field from events, as a string
+// identifying the group of the event.
+//
+class rule_threshold_field
+{
+public:
+	virtual ~rule_threshold_field() {}
+
+	// Returns false if the field has no value
+	virtual bool extract_key(gen_event *evt, std::string &key) = 0;
+};
+
+//
+// The threshold of a rule with count, window and group_by: the rule
+// only matches once count events matching its condition, with the
+// same values of the group_by fields, were seen within window.
+//
+// The window slides by buckets of 1/num_buckets of its duration, so
+// the events of a group are counted in num_buckets counters. At most
+// max_groups groups are counted, the least recently seen one being
+// forgotten to count a new one, which bounds the memory used whatever
+// the values of the fields.
+//
+// The ruleset stops at the first rule matching an event, so only the
+// events not matched by the rules evaluated before are counted.
+//
+// Like filters, a threshold is used by a single thread, but the
+// groups it counts can be shared with the thresholds of the same rule
+// in other engines, in which case they're locked.
+//
+class rule_threshold
+{
+public:
+	static const uint32_t num_buckets = 10;
+	static const uint32_t default_max_groups = 10000;
+
+	rule_threshold(uint64_t count, uint64_t window_ns,
+		       const std::vector<std::shared_ptr<rule_threshold_field>> &group_by,
+		       uint32_t max_groups = default_max_groups);
+
+	// A threshold counting the events in the groups of other,
+	// extracting the same group_by fields with its own extractors
+	rule_threshold(const rule_threshold &other,
+		       const std::vector<std::shared_ptr<rule_threshold_field>> &group_by);
+	virtual ~rule_threshold();
+
+	// Count evt, which matched the condition of the rule, in its
+	// group. Returns true if the group reached count events in
+	// the window, in which case its count starts over from 0.
+	bool add(gen_event *evt);
+
+	uint64_t count();
+	uint64_t window();
+
+	// The number of groups being counted
+	size_t num_groups();
+
+private:
+	struct group
+	{
+		std::string key;
+
+		// The events in the buckets of the window, the last
+		// one being buckets[last % num_buckets]
+		uint32_t buckets[num_buckets];
+		uint64_t last;
+		uint64_t total;
+	};
+
+	typedef std::list<group> group_list;
+
+	// The groups and what's needed to count their events
+	struct counts
+	{
+		uint64_t count;
+		uint64_t window;
+		uint64_t bucket_ns;
+		uint32_t max_groups;
+
+		std::mutex mtx;
+
+		// Most recently seen first
+		group_list groups;
+		std::unordered_map<std::string, group_list::iterator> groups_by_key;
+	};
+
+	// Forget the events of g older than the window ending in
+	// bucket
+	static void slide(group &g, uint64_t bucket);
+
+	std::shared_ptr<counts> m_counts;
+	std::vector<std::shared_ptr<rule_threshold_field>> m_group_by;
+
+	// Reused by add()
+	std::string m_key;
+	std::string m_value;
+};
+
+//
+// The thresholds of the rules by name, shared by the engines loading
+// the same rules and evaluating them on different threads, e.g. the
+// k8s audit workers, so that a rule counts the events seen by all of
+// them.
+//
+class rule_threshold_index
+{
+public:
+	// A threshold for rule, counting the events in the groups of
+	// the last one returned for rule if it had the same count,
+	// window and group_by fields, or in new groups otherwise.
+	// group_by are the extractors of group_by_fields, used by the
+	// thread of the caller only.
+	std::shared_ptr<rule_threshold> get(const std::string &rule,
+					    uint64_t count, uint64_t window_ns,
+					    const std::vector<std::string> &group_by_fields,
+					    const std::vector<std::shared_ptr<rule_threshold_field>> &group_by);
+
+private:
+	struct entry
+	{
+		uint64_t count;
+		uint64_t window;
+		std::vector<std::string> group_by_fields;
+		std::weak_ptr<rule_threshold> threshold;
+	};
+
+	std::mutex m_mtx;
+	std::map<std::string, entry> m_entries;
+};
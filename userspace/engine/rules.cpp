@@ -25,6 +25,7 @@ extern "C" {
 }
 
 #include "falco_engine.h"
+#include "condition_filter_factory.h"
 #include "banned.h" // This raises a compilation error when certain functions are used
 
 const static struct luaL_Reg ll_falco_rules[] =
@@ -36,12 +37,18 @@ const static struct luaL_Reg ll_falco_rules[] =
 		{"is_source_valid", &falco_rules::is_source_valid},
 		{"is_format_valid", &falco_rules::is_format_valid},
 		{"is_defined_field", &falco_rules::is_defined_field},
+		{"is_native_exception_field", &falco_rules::is_native_exception_field},
+		{"add_external_list", &falco_rules::add_external_list},
+		{"set_rule_threshold", &falco_rules::set_rule_threshold},
 		{NULL, NULL}};
 
 falco_rules::falco_rules(falco_engine *engine,
 			 lua_State *ls)
 	: m_engine(engine),
-	  m_ls(ls)
+	  m_ls(ls),
+	  m_cidr_sets(std::make_shared<cidr_set_cache>()),
+	  m_multi_patterns(std::make_shared<multi_pattern_index>()),
+	  m_regexes(std::make_shared<regex_set_index>())
 {
 }
 
@@ -73,6 +80,12 @@ int falco_rules::clear_filters(lua_State *ls)
 void falco_rules::clear_filters()
 {
 	m_engine->clear_filters();
+
+	// The sets and matchers are kept by the filters using them
+	m_cidr_sets->clear();
+	m_multi_patterns->clear();
+	m_regexes->clear();
+	m_filter_options.clear();
 }
 
 std::shared_ptr<gen_event_filter_factory> falco_rules::get_filter_factory(const std::string &source)
@@ -85,27 +98,147 @@ std::shared_ptr<gen_event_filter_factory> falco_rules::get_filter_factory(const
 	return it->second;
 }
 
+std::shared_ptr<condition_filter_factory> falco_rules::get_condition_filter_factory(const std::string &source)
+{
+	auto field_type = [this, source](const std::string &field)
+	{
+		return get_field_type(source, field);
+	};
+
+	return std::make_shared<condition_filter_factory>(source, get_filter_factory(source),
+							  field_type, m_external_lists, m_cidr_sets,
+							  m_multi_patterns, m_regexes);
+}
+
+// Absolute stack index of idx, so that it remains valid when
+// pushing values
+static int lua_abs_index(lua_State *ls, int idx)
+{
+	return (idx < 0 ? lua_gettop(ls) + idx + 1 : idx);
+}
+
+static std::vector<std::string> get_lua_string_array(lua_State *ls, int idx)
+{
+	std::vector<std::string> ret;
+
+	idx = lua_abs_index(ls, idx);
+	int len = lua_objlen(ls, idx);
+	for(int i = 1; i <= len; i++)
+	{
+		lua_rawgeti(ls, idx, i);
+		if(! lua_isstring(ls, -1))
+		{
+			lua_pop(ls, 1);
+			throw falco_exception("Non-string value in table of strings");
+		}
+		ret.push_back(lua_tostring(ls, -1));
+		lua_pop(ls, 1);
+	}
+
+	return ret;
+}
+
+// Read the exceptions passed to add_filter, as an array of
+// {fields={f1, ...}, comps={c1, ...}, values={{{v1, ...}, ...}, ...}}
+// tables. Returns NULL if there are none.
+static std::shared_ptr<rule_exceptions> get_lua_exceptions(lua_State *ls, int idx,
+							   std::shared_ptr<gen_event_filter_factory> factory)
+{
+	std::shared_ptr<rule_exceptions> ret;
+
+	idx = lua_abs_index(ls, idx);
+	int num_items = lua_objlen(ls, idx);
+	for(int i = 1; i <= num_items; i++)
+	{
+		std::vector<rule_exceptions::comparison> comps;
+		std::vector<rule_exceptions::values_tuple> tuples;
+
+		lua_rawgeti(ls, idx, i);
+		int item = lua_gettop(ls);
+
+		lua_getfield(ls, item, "fields");
+		std::vector<std::string> fields = get_lua_string_array(ls, -1);
+		lua_pop(ls, 1);
+
+		lua_getfield(ls, item, "comps");
+		for(auto &comp : get_lua_string_array(ls, -1))
+		{
+			if(comp == "=" || comp == "==")
+			{
+				comps.push_back(rule_exceptions::CMP_EQ);
+			}
+			else if(comp == "in")
+			{
+				comps.push_back(rule_exceptions::CMP_IN);
+			}
+			else if(comp == "pmatch")
+			{
+				comps.push_back(rule_exceptions::CMP_PMATCH);
+			}
+			else
+			{
+				throw falco_exception("Comparison operator " + comp + " not supported in native exceptions");
+			}
+		}
+		lua_pop(ls, 1);
+
+		lua_getfield(ls, item, "values");
+		int values = lua_gettop(ls);
+		int num_tuples = lua_objlen(ls, values);
+		for(int t = 1; t <= num_tuples; t++)
+		{
+			rule_exceptions::values_tuple tuple;
+
+			lua_rawgeti(ls, values, t);
+			int num_values = lua_objlen(ls, -1);
+			for(int v = 1; v <= num_values; v++)
+			{
+				lua_rawgeti(ls, -1, v);
+				tuple.push_back(get_lua_string_array(ls, -1));
+				lua_pop(ls, 1);
+			}
+			lua_pop(ls, 1);
+
+			tuples.push_back(tuple);
+		}
+
+		// values and item
+		lua_pop(ls, 2);
+
+		if(!ret)
+		{
+			ret = std::make_shared<rule_exceptions>(factory);
+		}
+		ret->add_item(fields, comps, tuples);
+	}
+
+	return ret;
+}
+
 int falco_rules::add_filter(lua_State *ls)
 {
-	if (! lua_islightuserdata(ls, -5) ||
-	    ! lua_islightuserdata(ls, -4) ||
-	    ! lua_isstring(ls, -3) ||
-	    ! lua_isstring(ls, -2) ||
+	if (! lua_islightuserdata(ls, -7) ||
+	    ! lua_islightuserdata(ls, -6) ||
+	    ! lua_isstring(ls, -5) ||
+	    ! lua_isstring(ls, -4) ||
+	    ! lua_istable(ls, -3) ||
+	    ! lua_isnumber(ls, -2) ||
 	    ! lua_istable(ls, -1))
 	{
 		lua_pushstring(ls, "Invalid arguments passed to add_filter()");
 		lua_error(ls);
 	}
 
-	falco_rules *rules = (falco_rules *) lua_topointer(ls, -5);
-	gen_event_filter *filter = (gen_event_filter*) lua_topointer(ls, -4);
-	std::string rule = lua_tostring(ls, -3);
-	std::string source = lua_tostring(ls, -2);
+	falco_rules *rules = (falco_rules *) lua_topointer(ls, -7);
+	gen_event_filter *filter = (gen_event_filter*) lua_topointer(ls, -6);
+	std::string rule = lua_tostring(ls, -5);
+	std::string source = lua_tostring(ls, -4);
+	falco_common::priority_type priority = (falco_common::priority_type) lua_tonumber(ls, -2);
 
 	set<string> tags;
 
 	lua_pushnil(ls);  /* first key */
-	while (lua_next(ls, -2) != 0) {
+	while (lua_next(ls, -4) != 0) {
                 // key is at index -2, value is at index
                 // -1. We want the values.
 		tags.insert(lua_tostring(ls, -1));
@@ -124,7 +257,17 @@ int falco_rules::add_filter(lua_State *ls)
 	try
 	{
 		std::shared_ptr<gen_event_filter> filter_ptr(filter);
-		rules->add_filter(filter_ptr, rule, source, tags);
+
+		rule_options options;
+		auto it = rules->m_filter_options.find(filter);
+		if(it != rules->m_filter_options.end())
+		{
+			options = it->second;
+			rules->m_filter_options.erase(it);
+		}
+		options.exceptions = get_lua_exceptions(ls, -1, rules->get_filter_factory(source));
+
+		rules->add_filter(filter_ptr, rule, source, tags, priority, options);
 	}
 	catch (exception &e)
 	{
@@ -137,9 +280,45 @@ int falco_rules::add_filter(lua_State *ls)
 	return 1;
 }
 
-void falco_rules::add_filter(std::shared_ptr<gen_event_filter> filter, string &rule, string &source, set<string> &tags)
+void falco_rules::add_filter(std::shared_ptr<gen_event_filter> filter, string &rule, string &source, set<string> &tags, falco_common::priority_type priority, const rule_options &options)
 {
-	m_engine->add_filter(filter, rule, source, tags);
+	m_engine->add_filter(filter, rule, source, tags, priority, options);
+}
+
+// A filter compiled but never added may have the address of a later
+// one, so its options are always replaced
+void falco_rules::set_filter_options(gen_event_filter *filter, const rule_options &options)
+{
+	m_filter_options[filter] = options;
+}
+
+void falco_rules::set_compile_programs(bool enabled)
+{
+	m_compile_programs = enabled;
+}
+
+bool falco_rules::compile_programs()
+{
+	return m_compile_programs;
+}
+
+void falco_rules::set_log_callback(falco_common::log_callback_t cb)
+{
+	m_log_cb = cb;
+	m_external_list_watcher.set_log_callback(cb);
+}
+
+void falco_rules::log(falco_common::priority_type priority, const std::string &msg)
+{
+	if(m_log_cb)
+	{
+		m_log_cb(priority, msg);
+	}
+}
+
+void falco_rules::set_rule_thresholds(std::shared_ptr<rule_threshold_index> thresholds)
+{
+	m_rule_thresholds = thresholds;
 }
 
 int falco_rules::enable_rule(lua_State *ls)
@@ -304,6 +483,161 @@ bool falco_rules::is_defined_field(const std::string &source, const std::string
 	return true;
 }
 
+int falco_rules::is_native_exception_field(lua_State *ls)
+{
+	if (! lua_islightuserdata(ls, -3) ||
+	    ! lua_isstring(ls, -2) ||
+	    ! lua_isstring(ls, -1))
+	{
+		lua_pushstring(ls, "Invalid arguments passed to is_native_exception_field");
+		lua_error(ls);
+	}
+
+	falco_rules *rules = (falco_rules *) lua_topointer(ls, -3);
+	string source = luaL_checkstring(ls, -2);
+	string fldname = luaL_checkstring(ls, -1);
+
+	bool ret = rules->is_native_exception_field(source, fldname);
+
+	lua_pushboolean(ls, (ret ? 1 : 0));
+
+	return 1;
+}
+
+bool falco_rules::is_native_exception_field(const std::string &source, const std::string &fldname)
+{
+	// The values extracted by the k8s audit and plugin fields
+	// aren't C strings
+	if(source != "syscall" || !is_defined_field(source, fldname))
+	{
+		return false;
+	}
+
+	// rule_exceptions compares the extracted values, which is
+	// not what the conditions on proc.aname do
+	if(!condition_filter_factory::compares_extracted_values(fldname))
+	{
+		return false;
+	}
+
+	string type = get_field_type(source, fldname);
+	return (type == "CHARBUF" || type == "FSPATH" || type == "FSRELPATH");
+}
+
+std::string falco_rules::get_field_type(const std::string &source, const std::string &fldname)
+{
+	auto it = m_field_types.find(source);
+	if(it == m_field_types.end())
+	{
+		it = m_field_types.insert(make_pair(source,
+			condition_filter_factory::list_field_types(*get_filter_factory(source)))).first;
+	}
+
+	// Fields with an argument, like proc.aname[2], are listed
+	// without it
+	auto type = it->second.find(fldname.substr(0, fldname.find('[')));
+	return (type != it->second.end() ? type->second : "");
+}
+
+int falco_rules::add_external_list(lua_State *ls)
+{
+	if (! lua_islightuserdata(ls, -3) ||
+	    ! lua_isstring(ls, -2) ||
+	    ! lua_isstring(ls, -1))
+	{
+		lua_pushstring(ls, "Invalid arguments passed to add_external_list");
+		lua_error(ls);
+	}
+
+	falco_rules *rules = (falco_rules *) lua_topointer(ls, -3);
+	string name = luaL_checkstring(ls, -2);
+	string path = luaL_checkstring(ls, -1);
+	string errstr;
+
+	if(!rules->add_external_list(name, path, errstr))
+	{
+		lua_pushstring(ls, errstr.c_str());
+	}
+	else
+	{
+		lua_pushnil(ls);
+	}
+
+	return 1;
+}
+
+bool falco_rules::add_external_list(const std::string &name, const std::string &path, std::string &errstr)
+{
+	// Loading the same rules again keeps the values already loaded
+	auto it = m_external_lists.find(name);
+	if(it != m_external_lists.end() && it->second->path() == path)
+	{
+		return true;
+	}
+
+	// Loaded now rather than on the first lookup, so that the
+	// rules aren't loaded with a list that can't be
+	std::shared_ptr<external_list> list = std::make_shared<external_list>(name, path, m_log_cb);
+	try
+	{
+		list->load();
+	}
+	catch(falco_exception &e)
+	{
+		errstr = "Could not load external list " + name + " from " + path + ": " + e.what();
+		return false;
+	}
+
+	m_external_lists[name] = list;
+	m_external_list_watcher.add(list);
+
+	return true;
+}
+
+int falco_rules::set_rule_threshold(lua_State *ls)
+{
+	if (! lua_islightuserdata(ls, -7) ||
+	    ! lua_islightuserdata(ls, -6) ||
+	    ! lua_isstring(ls, -5) ||
+	    ! lua_isstring(ls, -4) ||
+	    ! lua_isnumber(ls, -3) ||
+	    ! lua_isnumber(ls, -2) ||
+	    ! lua_istable(ls, -1))
+	{
+		lua_pushstring(ls, "Invalid arguments passed to set_rule_threshold()");
+		lua_error(ls);
+	}
+
+	falco_rules *rules = (falco_rules *) lua_topointer(ls, -7);
+	gen_event_filter *filter = (gen_event_filter*) lua_topointer(ls, -6);
+	std::string rule = lua_tostring(ls, -5);
+	std::string source = lua_tostring(ls, -4);
+	uint64_t count = (uint64_t) lua_tonumber(ls, -3);
+	uint64_t window_ns = (uint64_t) lua_tonumber(ls, -2);
+
+	try
+	{
+		std::vector<std::string> group_by = get_lua_string_array(ls, -1);
+		auto factory = rules->get_condition_filter_factory(source);
+
+		std::vector<std::shared_ptr<rule_threshold_field>> fields;
+		for(auto &field : group_by)
+		{
+			fields.push_back(factory->new_threshold_field(field));
+		}
+
+		rules->m_filter_options[filter].threshold = rules->m_rule_thresholds->get(rule, count, window_ns, group_by, fields);
+	}
+	catch (exception &e)
+	{
+		std::string errstr = string("Could not set threshold of rule ") + rule + ": " + e.what();
+		lua_pushstring(ls, errstr.c_str());
+		lua_error(ls);
+	}
+
+	return 0;
+}
+
 static std::list<std::string> get_lua_table_values(lua_State *ls, int idx)
 {
 	std::list<std::string> ret;
@@ -24,10 +24,16 @@ limitations under the License.
 
 #include "json_evt.h"
 #include "falco_common.h"
+#include "ruleset.h"
+#include "external_list.h"
+#include "cidr_set.h"
+#include "multi_pattern_matcher.h"
+#include "regex_set.h"
 
 typedef struct lua_State lua_State;
 
 class falco_engine;
+class condition_filter_factory;
 
 class falco_rules
 {
@@ -41,6 +47,11 @@ class falco_rules
 
 	std::shared_ptr<gen_event_filter_factory> get_filter_factory(const std::string &source);
 
+	// The factory used to compile rule conditions, which also
+	// creates the checks of the external lists, networks, multiple
+	// patterns and regexes
+	std::shared_ptr<condition_filter_factory> get_condition_filter_factory(const std::string &source);
+
 	void load_rules(const string &rules_content, bool verbose, bool all_events,
 			std::string &extra, bool replace_container_info,
 			falco_common::priority_type min_priority,
@@ -54,6 +65,39 @@ class falco_rules
 
 	bool is_defined_field(const std::string &source, const std::string &field);
 
+	// Whether exceptions on field can be checked with a
+	// rule_exceptions instead of being added to the condition,
+	// i.e. whether field is a string field of the syscall source
+	// whose checks compare the values it extracts
+	bool is_native_exception_field(const std::string &source, const std::string &field);
+
+	// The data type of a field, as listed by the filter factory
+	// (e.g. CHARBUF), or an empty string if it's not listed or
+	// can only be used in filters
+	std::string get_field_type(const std::string &source, const std::string &field);
+
+	// Define a list whose values are read from the file at
+	// path, loading it. Returns false if the file can't be loaded.
+	bool add_external_list(const std::string &name, const std::string &path, std::string &errstr);
+
+	// Remember the options of a compiled filter, e.g. its guard,
+	// until the filter is added
+	void set_filter_options(gen_event_filter *filter, const rule_options &options);
+
+	// Whether the conditions are also compiled into programs,
+	// true by default
+	void set_compile_programs(bool enabled);
+	bool compile_programs();
+
+	// Report the errors of the external lists to cb
+	void set_log_callback(falco_common::log_callback_t cb);
+
+	// Report msg to the log callback, if any
+	void log(falco_common::priority_type priority, const std::string &msg);
+
+	// Get the thresholds of the rules from thresholds
+	void set_rule_thresholds(std::shared_ptr<rule_threshold_index> thresholds);
+
 	static void init(lua_State *ls);
 	static int clear_filters(lua_State *ls);
 	static int add_filter(lua_State *ls);
@@ -68,9 +112,19 @@ class falco_rules
 	// err = falco_rules.is_defined_field(source, field)
 	static int is_defined_field(lua_State *ls);
 
+	// native = falco_rules.is_native_exception_field(source, field)
+	static int is_native_exception_field(lua_State *ls);
+
+	// err = falco_rules.add_external_list(name, path)
+	static int add_external_list(lua_State *ls);
+
+	// falco_rules.set_rule_threshold(filter, rule, source, count, window_ns, group_by)
+	// Called before adding the compiled filter of the rule
+	static int set_rule_threshold(lua_State *ls);
+
  private:
 	void clear_filters();
-	void add_filter(std::shared_ptr<gen_event_filter> filter, string &rule, string &source, std::set<string> &tags);
+	void add_filter(std::shared_ptr<gen_event_filter> filter, string &rule, string &source, std::set<string> &tags, falco_common::priority_type priority, const rule_options &options);
 	void enable_rule(string &rule, bool enabled);
 
 	falco_engine *m_engine;
@@ -80,6 +134,31 @@ class falco_rules
 	// for that event source.
 	std::map<std::string, std::shared_ptr<gen_event_filter_factory>> m_filter_factories;
 
+	// The data types of the fields of each event source, filled
+	// in when first needed
+	std::map<std::string, std::map<std::string, std::string>> m_field_types;
+
+	// The external lists by name, reloaded by the watcher when
+	// their files change
+	std::map<std::string, std::shared_ptr<external_list>> m_external_lists;
+	external_list_watcher m_external_list_watcher;
+	falco_common::log_callback_t m_log_cb;
+
+	// The networks compared with in, shared by the conditions
+	std::shared_ptr<cidr_set_cache> m_cidr_sets;
+
+	// The patterns of the fields compared with contains,
+	// startswith and endswith, shared by the conditions
+	std::shared_ptr<multi_pattern_index> m_multi_patterns;
+
+	// The regexes of the fields, shared by the conditions
+	std::shared_ptr<regex_set_index> m_regexes;
+
+	// The options of the filters compiled and not added yet
+	std::map<gen_event_filter *, rule_options> m_filter_options;
+	bool m_compile_programs = true;
+	std::shared_ptr<rule_threshold_index> m_rule_thresholds = std::make_shared<rule_threshold_index>();
+
 	string m_lua_load_rules = "load_rules";
 	string m_lua_describe_rule = "describe_rule";
 };
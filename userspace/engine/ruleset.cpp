@@ -18,10 +18,20 @@ limitations under the License.
 #include "banned.h" // This raises a compilation error when certain functions are used
 
 #include <algorithm>
+#include <chrono>
 
 using namespace std;
 
-falco_ruleset::falco_ruleset()
+// The clock is only read every this many calls to run()
+static const uint64_t s_budget_check_runs = 1024;
+static const uint64_t s_budget_period_ns = 1000000000;
+
+falco_ruleset::falco_ruleset():
+	m_now([]()
+	{
+		return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	})
 {
 }
 
@@ -66,7 +76,7 @@ void falco_ruleset::ruleset_filters::remove_wrapper_from_list(filter_wrapper_lis
 
 void falco_ruleset::ruleset_filters::add_filter(std::shared_ptr<filter_wrapper> wrap)
 {
-	std::set<uint16_t> fevttypes = wrap->evttypes();
+	const std::set<uint16_t> &fevttypes = wrap->evttypes;
 
 	if(fevttypes.empty())
 	{
@@ -91,7 +101,7 @@ void falco_ruleset::ruleset_filters::add_filter(std::shared_ptr<filter_wrapper>
 
 void falco_ruleset::ruleset_filters::remove_filter(std::shared_ptr<filter_wrapper> wrap)
 {
-	std::set<uint16_t> fevttypes = wrap->evttypes();
+	const std::set<uint16_t> &fevttypes = wrap->evttypes;
 
 	if(fevttypes.empty())
 	{
@@ -116,13 +126,55 @@ uint64_t falco_ruleset::ruleset_filters::num_filters()
 	return m_filters.size();
 }
 
-bool falco_ruleset::ruleset_filters::run(gen_event *evt)
+bool falco_ruleset::ruleset_filters::has_filter(std::shared_ptr<filter_wrapper> wrap)
+{
+	return (m_filters.find(wrap) != m_filters.end());
+}
+
+void falco_ruleset::ruleset_filters::move_last(std::shared_ptr<filter_wrapper> wrap)
+{
+	if(has_filter(wrap))
+	{
+		remove_filter(wrap);
+		add_filter(wrap);
+	}
+}
+
+bool falco_ruleset::ruleset_filters::run_wrapper(filter_wrapper &wrap, gen_event *evt, const time_source_t *now)
+{
+	if(wrap.demoted)
+	{
+		if(wrap.demotion == BUDGET_DISABLE ||
+		   (wrap.demotion == BUDGET_SAMPLE && (wrap.num_sampled++ % wrap.sample_ratio) != 0))
+		{
+			return false;
+		}
+	}
+
+	if(!now)
+	{
+		return wrap.run(evt);
+	}
+
+	uint64_t start = (*now)();
+	bool match = wrap.run(evt);
+	uint64_t end = (*now)();
+
+	wrap.num_evals++;
+	wrap.num_matches += match;
+	wrap.eval_ns += end - start;
+
+	return match;
+}
+
+bool falco_ruleset::ruleset_filters::run(gen_event *evt, const time_source_t *now, guards &guards, scopes &scopes)
 {
     if(evt->get_type() < m_filter_by_event_type.size())
     {
         for(auto &wrap : m_filter_by_event_type[evt->get_type()])
         {
-            if(wrap->filter->run(evt))
+            if(guards.candidate(*wrap, evt) && scopes.holds(*wrap, evt) &&
+               run_wrapper(*wrap, evt, now))
             {
                 return true;
             }
@@ -132,7 +184,8 @@ bool falco_ruleset::ruleset_filters::run(gen_event *evt)
 	// Finally, try filters that are not specific to an event type.
 	for(auto &wrap : m_filter_all_event_types)
 	{
-		if(wrap->filter->run(evt))
+		if(guards.candidate(*wrap, evt) && scopes.holds(*wrap, evt) &&
+		   run_wrapper(*wrap, evt, now))
 		{
 			return true;
 		}
@@ -147,21 +200,147 @@ void falco_ruleset::ruleset_filters::evttypes_for_ruleset(std::set<uint16_t> &ev
 
 	for(auto &wrap : m_filters)
 	{
-		auto fevttypes = wrap->evttypes();
+		const auto &fevttypes = wrap->evttypes;
 		evttypes.insert(fevttypes.begin(), fevttypes.end());
 	}
 }
 
+void falco_ruleset::guards::add(filter_wrapper &wrap, std::shared_ptr<rule_guard> guard)
+{
+	auto it = m_fields.find(guard->field());
+	if(it == m_fields.end())
+	{
+		// The first extractor of a field is used for all the
+		// rules guarded by the field
+		it = m_fields.insert(make_pair(guard->field(), (int32_t) m_indexes.size())).first;
+		m_indexes.push_back(guard_index());
+		m_indexes.back().field = guard->extractor();
+	}
+
+	guard_index &index = m_indexes[it->second];
+	for(auto &val : guard->values())
+	{
+		index.wrappers[val].push_back(&wrap);
+	}
+	index.all.push_back(&wrap);
+
+	wrap.guard = it->second;
+}
+
+void falco_ruleset::guards::mark(guard_index &index, gen_event *evt)
+{
+	if(!index.field->extract_key(evt, m_key))
+	{
+		for(auto wrap : index.all)
+		{
+			wrap->guard_run = m_run;
+		}
+		return;
+	}
+
+	auto it = index.wrappers.find(m_key);
+	if(it != index.wrappers.end())
+	{
+		for(auto wrap : it->second)
+		{
+			wrap->guard_run = m_run;
+		}
+	}
+}
+
+void falco_ruleset::scopes::add(filter_wrapper &wrap, std::shared_ptr<rule_scope> scope)
+{
+	wrap.scope_program = scope->program();
+	if(!wrap.scope_program)
+	{
+		wrap.scope_filter = scope->filter();
+	}
+	wrap.scope_slot = (int32_t) m_scopes.size();
+	m_scopes.push_back(scope->get_scope());
+}
+
+void falco_ruleset::scopes::set_state(std::shared_ptr<rule_scope_state> state)
+{
+	m_state = state;
+	m_num_reserved = (int32_t) m_state->reserve((uint32_t) m_scopes.size());
+}
+
+void falco_ruleset::scopes::next_run(gen_event *evt)
+{
+	m_slots_found = false;
+	m_slots = NULL;
+
+	if(m_num_reserved == 0)
+	{
+		return;
+	}
+
+	rule_scope::scope changed = m_state->changed_scope(evt);
+	if(changed == rule_scope::SCOPE_EVENT)
+	{
+		return;
+	}
+
+	m_slots = m_state->slots(evt);
+	m_slots_found = true;
+	if(m_slots == NULL)
+	{
+		return;
+	}
+
+	for(int32_t i = 0; i < m_num_reserved; i++)
+	{
+		if(m_scopes[i] >= changed)
+		{
+			m_slots[i] = rule_scope_state::DECISION_UNKNOWN;
+		}
+	}
+}
+
 void falco_ruleset::add(string &source,
 			string &name,
 			set<string> &tags,
-			std::shared_ptr<gen_event_filter> filter)
+			std::shared_ptr<gen_event_filter> filter,
+			falco_common::priority_type priority,
+			const rule_options &options)
 {
 	std::shared_ptr<filter_wrapper> wrap(new filter_wrapper());
 	wrap->source = source;
 	wrap->name = name;
 	wrap->tags = tags;
-	wrap->filter = filter;
+	wrap->priority = priority;
+	wrap->exceptions = options.exceptions;
+	wrap->threshold = options.threshold;
+
+	// todo(jasondellaluce,leogr): temp workaround, remove when fixed in libs
+	if(source == "syscall" || source == "k8s_audit")
+	{
+		wrap->evttypes = filter->evttypes();
+	}
+	else
+	{
+		// assume plugins
+		wrap->evttypes = {ppm_event_type::PPME_PLUGINEVENT_E};
+	}
+	// workaround end
+
+	// The filter is freed once its event types are known if the
+	// program is run instead
+	wrap->program = options.program;
+	if(!wrap->program)
+	{
+		wrap->filter = filter;
+	}
+
+	if(options.guard)
+	{
+		m_guards.add(*wrap, options.guard);
+	}
+
+	if(options.scope)
+	{
+		m_scopes.add(*wrap, options.scope);
+	}
 
 	m_filters.insert(wrap);
 }
@@ -242,14 +421,34 @@ uint64_t falco_ruleset::num_rules_for_ruleset(uint16_t ruleset)
 	return m_rulesets[ruleset]->num_filters();
 }
 
+void falco_ruleset::set_scope_state(std::shared_ptr<rule_scope_state> state)
+{
+	m_scopes.set_state(state);
+}
+
 bool falco_ruleset::run(gen_event *evt, uint16_t ruleset)
 {
+	m_scopes.next_run(evt);
+
 	if(m_rulesets.size() < (size_t)ruleset + 1)
 	{
 		return false;
 	}
 
-	return m_rulesets[ruleset]->run(evt);
+	m_guards.next_run();
+	bool match = m_rulesets[ruleset]->run(evt, (m_profile ? &m_now : NULL), m_guards, m_scopes);
+
+	if(m_budget_enabled && (++m_budget_runs % s_budget_check_runs) == 0)
+	{
+		check_cpu_budget();
+	}
+
+	return match;
+}
+
+void falco_ruleset::skip(gen_event *evt)
+{
+	m_scopes.next_run(evt);
 }
 
 void falco_ruleset::evttypes_for_ruleset(set<uint16_t> &evttypes, uint16_t ruleset)
@@ -261,3 +460,109 @@ void falco_ruleset::evttypes_for_ruleset(set<uint16_t> &evttypes, uint16_t rules
 
 	return m_rulesets[ruleset]->evttypes_for_ruleset(evttypes);
 }
+
+void falco_ruleset::enable_profiling(bool enabled)
+{
+	m_profile_requested = enabled;
+	m_profile = (m_profile_requested || m_budget_enabled);
+}
+
+void falco_ruleset::get_profile(std::list<rule_profile> &profile, bool all, uint16_t ruleset)
+{
+	for(auto &wrap : m_filters)
+	{
+		if(all || wrap->num_evals > 0)
+		{
+			bool enabled = (m_rulesets.size() > ruleset && m_rulesets[ruleset]->has_filter(wrap));
+
+			profile.push_back({wrap->name, wrap->num_evals, wrap->num_matches, wrap->eval_ns,
+					   wrap->source, wrap->priority, enabled});
+		}
+	}
+}
+
+void falco_ruleset::set_cpu_budget(const cpu_budget &budget, budget_callback_t cb)
+{
+	m_budget = budget;
+	m_budget_cb = cb;
+	m_budget_enabled = (budget.max_ns_per_sec > 0 || budget.max_share > 0);
+	m_budget_period_start = m_now();
+	m_profile = (m_profile_requested || m_budget_enabled);
+
+	for(auto &wrap : m_filters)
+	{
+		wrap->budget_eval_ns = wrap->eval_ns;
+		wrap->budget_periods = 0;
+	}
+}
+
+void falco_ruleset::set_time_source(time_source_t now)
+{
+	m_now = now;
+	m_budget_period_start = m_now();
+}
+
+void falco_ruleset::check_cpu_budget()
+{
+	uint64_t now = m_now();
+	uint64_t period_ns = now - m_budget_period_start;
+
+	if(period_ns < s_budget_period_ns)
+	{
+		return;
+	}
+
+	m_budget_period_start = now;
+
+	uint64_t total_ns = 0;
+	for(auto &wrap : m_filters)
+	{
+		total_ns += wrap->eval_ns - wrap->budget_eval_ns;
+	}
+
+	for(auto &wrap : m_filters)
+	{
+		uint64_t ns = wrap->eval_ns - wrap->budget_eval_ns;
+		wrap->budget_eval_ns = wrap->eval_ns;
+
+		if(wrap->demoted)
+		{
+			continue;
+		}
+
+		uint64_t ns_per_sec = (uint64_t) (ns * ((double) s_budget_period_ns / period_ns));
+		double share = (total_ns > 0 ? (double) ns / total_ns : 0);
+
+		if((m_budget.max_ns_per_sec == 0 || ns_per_sec <= m_budget.max_ns_per_sec) &&
+		   (m_budget.max_share <= 0 || share <= m_budget.max_share))
+		{
+			wrap->budget_periods = 0;
+			continue;
+		}
+
+		if(++wrap->budget_periods >= m_budget.max_periods)
+		{
+			demote(wrap);
+
+			if(m_budget_cb)
+			{
+				m_budget_cb(wrap->source, wrap->name, ns_per_sec, share, m_budget.action);
+			}
+		}
+	}
+}
+
+void falco_ruleset::demote(std::shared_ptr<filter_wrapper> wrap)
+{
+	wrap->demoted = true;
+	wrap->demotion = m_budget.action;
+	wrap->sample_ratio = std::max<uint32_t>(m_budget.sample_ratio, 1);
+
+	if(m_budget.action == BUDGET_MOVE_LAST)
+	{
+		for(auto &rs : m_rulesets)
+		{
+			rs->move_last(wrap);
+		}
+	}
+}
@@ -18,15 +18,49 @@ limitations under the License.
 
 #include <string>
 #include <set>
+#include <chrono>
+#include <functional>
 #include <vector>
 #include <list>
 #include <map>
+#include <unordered_map>
 
 #include "sinsp.h"
 #include "filter.h"
 #include "event.h"
 
 #include "gen_filter.h"
+#include "falco_common.h"
+#include "rule_exceptions.h"
+#include "rule_guard.h"
+#include "rule_scope.h"
+#include "rule_threshold.h"
+
+// What the ruleset uses to evaluate a rule besides its filter, all
+// optional
+struct rule_options
+{
+	// An event matching exceptions doesn't match the rule, even
+	// if it matches the filter
+	std::shared_ptr<rule_exceptions> exceptions;
+
+	// The rule is only evaluated for the events matching guard
+	std::shared_ptr<rule_guard> guard;
+
+	// The rule only matches the events matching both the filter
+	// of scope and the filter
+	std::shared_ptr<rule_scope> scope;
+
+	// Run instead of the filter, which is still used for its
+	// event types
+	std::shared_ptr<filter_program> program;
+
+	// The rule only matches the events for which threshold is
+	// reached. run() stops at the first rule matching an event,
+	// so the events matching a rule evaluated before aren't
+	// counted.
+	std::shared_ptr<rule_threshold> threshold;
+};
 
 class falco_ruleset
 {
@@ -37,7 +71,14 @@ public:
 	void add(string &source,
 		 std::string &name,
 		 std::set<std::string> &tags,
-		 std::shared_ptr<gen_event_filter> filter);
+		 std::shared_ptr<gen_event_filter> filter,
+		 falco_common::priority_type priority = falco_common::PRIORITY_DEBUG,
+		 const rule_options &options = rule_options());
+
+	// Cache the results of the scoped filters of the rules
+	// added so far in state. Without a state, they're evaluated
+	// for every event.
+	void set_scope_state(std::shared_ptr<rule_scope_state> state);
 
 	// rulesets are arbitrary numbers and should be managed by the caller.
         // Note that rulesets are used to index into a std::vector so
@@ -67,9 +108,83 @@ public:
 	// Match all filters against the provided event.
 	bool run(gen_event *evt, uint16_t ruleset = 0);
 
+	// Called instead of run() for the events that are not
+	// matched, so that the changes of their thread are still seen.
+	void skip(gen_event *evt);
+
 	// Populate the provided set of event types used by this ruleset.
 	void evttypes_for_ruleset(std::set<uint16_t> &evttypes, uint16_t ruleset);
 
+	// How often a rule was evaluated and how long it took, in
+	// all rulesets.
+	struct rule_profile
+	{
+		std::string name;
+		uint64_t num_evals;
+		uint64_t num_matches;
+		uint64_t eval_ns;
+		std::string source;
+		falco_common::priority_type priority;
+
+		// Whether the rule is enabled in the ruleset passed
+		// to get_profile()
+		bool enabled;
+	};
+
+	// When enabled, run() measures the time spent evaluating
+	// each rule. This has a cost, so it's disabled by default.
+	void enable_profiling(bool enabled);
+
+	// Add the profile of every rule evaluated at least once to
+	// profile. If all is true, also add the rules never evaluated.
+	void get_profile(std::list<rule_profile> &profile, bool all = false, uint16_t ruleset = 0);
+
+	// What happens to a rule that stays over its CPU budget
+	enum budget_action
+	{
+		// Only evaluate it for 1 event out of sample_ratio
+		BUDGET_SAMPLE,
+		// Evaluate it after all the other rules, so that it's
+		// skipped when another rule matches
+		BUDGET_MOVE_LAST,
+		// Stop evaluating it
+		BUDGET_DISABLE
+	};
+
+	// A rule is over budget for a second when its evaluation
+	// took more than max_ns_per_sec ns, or more than max_share
+	// (in [0, 1]) of the time spent evaluating all the rules of
+	// this object. A limit of 0 is ignored. A rule over budget
+	// for max_periods consecutive seconds is demoted.
+	struct cpu_budget
+	{
+		uint64_t max_ns_per_sec;
+		double max_share;
+		uint32_t max_periods;
+		budget_action action;
+		uint32_t sample_ratio;
+	};
+
+	// Called from run() when a rule is demoted, with its cost in
+	// the last second.
+	typedef std::function<void (const std::string &source,
+				    const std::string &rule,
+				    uint64_t ns_per_sec,
+				    double share,
+				    budget_action action)> budget_callback_t;
+
+	// Enforce budget on every rule, measuring rules as with
+	// enable_profiling(true).
+	void set_cpu_budget(const cpu_budget &budget, budget_callback_t cb);
+
+	// Returns the current time in ns, from a monotonic clock
+	typedef std::function<uint64_t ()> time_source_t;
+
+	// Measure the rules and the budget periods with now instead
+	// of std::chrono::steady_clock, e.g. to control the time in
+	// tests
+	void set_time_source(time_source_t now);
+
 private:
 
 	class filter_wrapper {
@@ -77,21 +192,177 @@ private:
 		std::string source;
 		std::string name;
 		std::set<std::string> tags;
+		falco_common::priority_type priority;
+
+		// The filter is only kept if there's no program to run
+		// instead
 		std::shared_ptr<gen_event_filter> filter;
-		std::set<uint16_t> evttypes()
+		std::shared_ptr<filter_program> program;
+
+		// The exceptions not already in the filter, if any
+		std::shared_ptr<rule_exceptions> exceptions;
+
+		// Counts the events matching the filter, if any
+		std::shared_ptr<rule_threshold> threshold;
+
+		// The index of the guard field in m_guards, or -1, and
+		// the last run for which the guard held
+		int32_t guard = -1;
+		uint64_t guard_run = 0;
+
+		// The filter of the scope, if any, or its program, and
+		// the slot caching its result in m_scopes
+		std::shared_ptr<gen_event_filter> scope_filter;
+		std::shared_ptr<filter_program> scope_program;
+		int32_t scope_slot = -1;
+
+		inline bool run(gen_event *evt)
+		{
+			return ((program ? program->run(evt) : filter->run(evt)) &&
+				!(exceptions && exceptions->match(evt)) &&
+				(!threshold || threshold->add(evt)));
+		}
+
+		inline bool run_scope(gen_event *evt)
+		{
+			return (scope_program ? scope_program->run(evt) : scope_filter->run(evt));
+		}
+
+		// Only updated when profiling is enabled
+		uint64_t num_evals = 0;
+		uint64_t num_matches = 0;
+		uint64_t eval_ns = 0;
+
+		// eval_ns at the start of the current budget period,
+		// and the number of consecutive periods over budget
+		uint64_t budget_eval_ns = 0;
+		uint32_t budget_periods = 0;
+
+		// Set once the rule went over budget
+		bool demoted = false;
+		budget_action demotion = BUDGET_SAMPLE;
+		uint32_t sample_ratio = 1;
+		uint64_t num_sampled = 0;
+
+		// Computed from the filter when the rule is added
+		std::set<uint16_t> evttypes;
+	};
+
+	typedef std::list<std::shared_ptr<filter_wrapper>> filter_wrapper_list;
+
+	// The rules guarded by a field, by value of the field
+	struct guard_index
+	{
+		std::shared_ptr<rule_guard_field> field;
+		std::unordered_map<std::string, std::vector<filter_wrapper *>> wrappers;
+		std::vector<filter_wrapper *> all;
+
+		// The last run for which the field was extracted
+		uint64_t run = 0;
+	};
+
+	// The guards of all the rules. The field of a guard is only
+	// extracted when a rule it guards could be evaluated, and
+	// then marks the rules for which the guard holds.
+	class guards
+	{
+	public:
+		void add(filter_wrapper &wrap, std::shared_ptr<rule_guard> guard);
+
+		// Called once per event, before candidate()
+		inline void next_run()
+		{
+			m_run++;
+		}
+
+		// Whether the rule of wrap can match evt
+		inline bool candidate(filter_wrapper &wrap, gen_event *evt)
 		{
-			// todo(jasondellaluce,leogr): temp workaround, remove when fixed in libs
-			if(source == "syscall" || source == "k8s_audit")
+			if(wrap.guard < 0)
+			{
+				return true;
+			}
+
+			guard_index &index = m_indexes[wrap.guard];
+			if(index.run != m_run)
 			{
-				return filter->evttypes();
+				index.run = m_run;
+				mark(index, evt);
 			}
-			// else assume plugins
-			return {ppm_event_type::PPME_PLUGINEVENT_E};
-			// workaround end
+
+			return (wrap.guard_run == m_run);
 		}
+
+	private:
+		void mark(guard_index &index, gen_event *evt);
+
+		std::vector<guard_index> m_indexes;
+		std::map<std::string, int32_t> m_fields;
+		uint64_t m_run = 0;
+		std::string m_key;
 	};
 
-	typedef std::list<std::shared_ptr<filter_wrapper>> filter_wrapper_list;
+	// The scoped filters of all the rules. Their results are
+	// cached in the slots of the thread of the events, if there's
+	// a state.
+	class scopes
+	{
+	public:
+		void add(filter_wrapper &wrap, std::shared_ptr<rule_scope> scope);
+
+		void set_state(std::shared_ptr<rule_scope_state> state);
+
+		// Called once per event, before holds()
+		void next_run(gen_event *evt);
+
+		// Whether the scoped filter of wrap is true for evt
+		inline bool holds(filter_wrapper &wrap, gen_event *evt)
+		{
+			if(wrap.scope_slot < 0)
+			{
+				return true;
+			}
+
+			if(wrap.scope_slot >= m_num_reserved)
+			{
+				return wrap.run_scope(evt);
+			}
+
+			if(!m_slots_found)
+			{
+				m_slots = m_state->slots(evt);
+				m_slots_found = true;
+			}
+
+			if(m_slots == NULL)
+			{
+				return wrap.run_scope(evt);
+			}
+
+			uint8_t &slot = m_slots[wrap.scope_slot];
+			if(slot == rule_scope_state::DECISION_UNKNOWN)
+			{
+				slot = (wrap.run_scope(evt) ?
+					rule_scope_state::DECISION_TRUE :
+					rule_scope_state::DECISION_FALSE);
+			}
+
+			return (slot == rule_scope_state::DECISION_TRUE);
+		}
+
+	private:
+		std::shared_ptr<rule_scope_state> m_state;
+
+		// The scope of each slot, the first m_num_reserved
+		// ones being in the state
+		std::vector<rule_scope::scope> m_scopes;
+		int32_t m_num_reserved = 0;
+
+		// The slots of the thread of the current event, once
+		// found
+		bool m_slots_found = false;
+		uint8_t *m_slots = NULL;
+	};
 
 	// A group of filters all having the same ruleset
 	class ruleset_filters {
@@ -105,11 +376,19 @@ private:
 
 		uint64_t num_filters();
 
-		bool run(gen_event *evt);
+		bool has_filter(std::shared_ptr<filter_wrapper> wrap);
+
+		// Move the filter after all the others, if present
+		void move_last(std::shared_ptr<filter_wrapper> wrap);
+
+		// The rules are measured with now if it's set
+		bool run(gen_event *evt, const time_source_t *now, guards &guards, scopes &scopes);
 
 		void evttypes_for_ruleset(std::set<uint16_t> &evttypes);
 
 	private:
+		static bool run_wrapper(filter_wrapper &wrap, gen_event *evt, const time_source_t *now);
+
 		void add_wrapper_to_list(filter_wrapper_list &wrappers, std::shared_ptr<filter_wrapper> wrap);
 		void remove_wrapper_from_list(filter_wrapper_list &wrappers, std::shared_ptr<filter_wrapper> wrap);
 
@@ -129,4 +408,24 @@ private:
 
 	// All filters added. The set of enabled filters is held in m_rulesets
 	std::set<std::shared_ptr<filter_wrapper>> m_filters;
+
+	guards m_guards;
+
+	scopes m_scopes;
+
+	// Check the rules against the budget once per period
+	void check_cpu_budget();
+
+	void demote(std::shared_ptr<filter_wrapper> wrap);
+
+	// m_profile is also set while enforcing a budget
+	bool m_profile = false;
+	bool m_profile_requested = false;
+
+	bool m_budget_enabled = false;
+	cpu_budget m_budget;
+	budget_callback_t m_budget_cb;
+	time_source_t m_now;
+	uint64_t m_budget_period_start = 0;
+	uint64_t m_budget_runs = 0;
 };
@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "thread_scope_state.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+thread_scope_state::thread_scope_state(sinsp *inspector):
+	m_inspector(inspector),
+	m_reserved(false),
+	m_id(0)
+{
+}
+
+thread_scope_state::~thread_scope_state()
+{
+}
+
+uint32_t thread_scope_state::reserve(uint32_t num)
+{
+	if(num == 0)
+	{
+		return 0;
+	}
+
+	// sinsp zeroes the private state of new threads, i.e. all
+	// their slots are DECISION_UNKNOWN
+	m_id = m_inspector->reserve_thread_memory(num);
+	m_reserved = true;
+	return num;
+}
+
+uint8_t *thread_scope_state::slots(gen_event *evt)
+{
+	if(!m_reserved)
+	{
+		return NULL;
+	}
+
+	sinsp_threadinfo *tinfo = static_cast<sinsp_evt *>(evt)->get_thread_info();
+	if(tinfo == NULL)
+	{
+		return NULL;
+	}
+
+	return (uint8_t *) tinfo->get_private_state(m_id);
+}
+
+rule_scope::scope thread_scope_state::changed_scope(gen_event *evt)
+{
+	switch(evt->get_type())
+	{
+	case PPME_SYSCALL_EXECVE_8_X:
+	case PPME_SYSCALL_EXECVE_13_X:
+	case PPME_SYSCALL_EXECVE_14_X:
+	case PPME_SYSCALL_EXECVE_15_X:
+	case PPME_SYSCALL_EXECVE_16_X:
+	case PPME_SYSCALL_EXECVE_17_X:
+	case PPME_SYSCALL_EXECVE_18_X:
+	case PPME_SYSCALL_EXECVE_19_X:
+	case PPME_SYSCALL_EXECVEAT_X:
+		return rule_scope::SCOPE_CONTAINER;
+	case PPME_SYSCALL_SETUID_X:
+	case PPME_SYSCALL_SETGID_X:
+	case PPME_SYSCALL_SETRESUID_X:
+	case PPME_SYSCALL_SETRESGID_X:
+		return rule_scope::SCOPE_THREAD;
+	default:
+		return rule_scope::SCOPE_EVENT;
+	}
+}
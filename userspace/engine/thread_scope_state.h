@@ -0,0 +1,50 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "sinsp.h"
+
+#include "rule_scope.h"
+
+//
+// Caches the results of the scoped filters of the syscall rules in
+// the private state of the sinsp thread infos, which is allocated
+// with each thread and freed with it.
+//
+class thread_scope_state : public rule_scope_state
+{
+public:
+	// The inspector must not be opened yet, as the private state
+	// of the threads can only be reserved before
+	thread_scope_state(sinsp *inspector);
+	virtual ~thread_scope_state();
+
+	uint32_t reserve(uint32_t num);
+
+	uint8_t *slots(gen_event *evt);
+
+	// Execs, with execve or execveat, change the container scope,
+	// as sinsp looks up the container of the thread again, and
+	// setuid/setgid and friends the thread scope. The libs have
+	// no setreuid/setregid events yet.
+	rule_scope::scope changed_scope(gen_event *evt);
+
+private:
+	sinsp *m_inspector;
+	bool m_reserved;
+	uint32_t m_id;
+};
@@ -37,6 +37,8 @@ public:
 	std::string conf_filename;
 	bool all_events;
 	sinsp_evt::param_fmt event_buffer_format;
+	uint32_t bench_loops;
+	std::string bench_report_filename;
 	std::vector<std::string> cri_socket_paths;
 	bool daemon;
 	bool disable_cri_async;
@@ -46,6 +48,7 @@ public:
 	std::string k8s_api;
 	std::string k8s_api_cert;
 	std::string k8s_node_name;
+	std::vector<std::string> k8s_audit_replay_filenames;
 	bool describe_all_rules;
 	std::string describe_rule;
 	bool print_ignored_events;
@@ -38,7 +38,17 @@ falco_configuration::falco_configuration():
 	m_webserver_listen_port(8765),
 	m_webserver_k8s_audit_endpoint("/k8s-audit"),
 	m_webserver_k8s_healthz_endpoint("/healthz"),
+	m_webserver_metrics_endpoint("/metrics"),
+	m_webserver_k8s_audit_max_request_size(67108864),
+	m_webserver_k8s_audit_max_event_size(4194304),
+	m_webserver_k8s_audit_max_pending_size(16777216),
+	m_webserver_k8s_audit_workers(1),
+	m_webserver_k8s_audit_queue_size(10000),
+	m_webserver_k8s_audit_retry_after(1),
+	m_webserver_k8s_audit_unix_socket_framing("newline"),
 	m_webserver_ssl_enabled(false),
+	m_rule_cpu_budget({0, 0, 10, falco_ruleset::BUDGET_SAMPLE, 10}),
+	m_alert_latency_enabled(false),
 	m_config(NULL)
 {
 }
@@ -212,6 +222,24 @@ void falco_configuration::init(string conf_filename, const vector<string> &cmdli
 	m_webserver_listen_port = m_config->get_scalar<uint32_t>("webserver.listen_port", 8765);
 	m_webserver_k8s_audit_endpoint = m_config->get_scalar<string>("webserver.k8s_audit_endpoint", "/k8s-audit");
 	m_webserver_k8s_healthz_endpoint = m_config->get_scalar<string>("webserver.k8s_healthz_endpoint", "/healthz");
+	m_webserver_metrics_endpoint = m_config->get_scalar<string>("webserver.metrics_endpoint", "/metrics");
+	m_webserver_k8s_audit_max_request_size = m_config->get_scalar<uint64_t>("webserver.k8s_audit_max_request_size", 67108864);
+	m_webserver_k8s_audit_max_event_size = m_config->get_scalar<uint64_t>("webserver.k8s_audit_max_event_size", 4194304);
+	m_webserver_k8s_audit_max_pending_size = m_config->get_scalar<uint64_t>("webserver.k8s_audit_max_pending_size", 16777216);
+	m_webserver_k8s_audit_workers = m_config->get_scalar<uint32_t>("webserver.k8s_audit_workers", 1);
+	m_webserver_k8s_audit_queue_size = m_config->get_scalar<uint64_t>("webserver.k8s_audit_queue_size", 10000);
+	m_webserver_k8s_audit_retry_after = m_config->get_scalar<uint32_t>("webserver.k8s_audit_retry_after", 1);
+	m_webserver_k8s_audit_unix_socket = m_config->get_scalar<string>("webserver.k8s_audit_unix_socket", "");
+	m_webserver_k8s_audit_unix_socket_framing = m_config->get_scalar<string>("webserver.k8s_audit_unix_socket_framing", "newline");
+	if(m_webserver_k8s_audit_unix_socket_framing != "newline" &&
+	   m_webserver_k8s_audit_unix_socket_framing != "length")
+	{
+		throw logic_error("Error reading config file (" + m_config_file + "): webserver.k8s_audit_unix_socket_framing must be one of newline, length");
+	}
+	if(!m_webserver_k8s_audit_unix_socket.empty() && m_webserver_k8s_audit_workers == 0)
+	{
+		throw logic_error("Error reading config file (" + m_config_file + "): webserver.k8s_audit_unix_socket requires webserver.k8s_audit_workers to be greater than 0");
+	}
 	m_webserver_ssl_enabled = m_config->get_scalar<bool>("webserver.ssl_enabled", false);
 	m_webserver_ssl_certificate = m_config->get_scalar<string>("webserver.ssl_certificate", "/etc/falco/falco.pem");
 
@@ -244,9 +272,17 @@ void falco_configuration::init(string conf_filename, const vector<string> &cmdli
 		{
 			m_syscall_evt_drop_actions.insert(syscall_evt_drop_action::EXIT);
 		}
+		else if(act == "shed")
+		{
+			if(m_syscall_evt_drop_actions.count(syscall_evt_drop_action::IGNORE))
+			{
+				throw logic_error("Error reading config file (" + m_config_file + "): syscall event drop action \"" + act + "\" does not make sense with the \"ignore\" action");
+			}
+			m_syscall_evt_drop_actions.insert(syscall_evt_drop_action::SHED);
+		}
 		else
 		{
-			throw logic_error("Error reading config file (" + m_config_file + "): available actions for syscall event drops are \"ignore\", \"log\", \"alert\", and \"exit\"");
+			throw logic_error("Error reading config file (" + m_config_file + "): available actions for syscall event drops are \"ignore\", \"log\", \"alert\", \"exit\", and \"shed\"");
 		}
 	}
 
@@ -264,12 +300,71 @@ void falco_configuration::init(string conf_filename, const vector<string> &cmdli
 	m_syscall_evt_drop_max_burst = m_config->get_scalar<double>("syscall_event_drops.max_burst", 1);
 	m_syscall_evt_simulate_drops = m_config->get_scalar<bool>("syscall_event_drops.simulate_drops", false);
 
+	string shed_priority = m_config->get_scalar<string>("syscall_event_drops.shed_priority", "warning");
+	auto shed_comp = [shed_priority](string &s) {
+		return (strcasecmp(s.c_str(), shed_priority.c_str()) == 0);
+	};
+	if((it = std::find_if(falco_common::priority_names.begin(), falco_common::priority_names.end(), shed_comp)) == falco_common::priority_names.end())
+	{
+		throw logic_error("Error reading config file (" + m_config_file + "): unknown syscall event drops shed_priority \"" + shed_priority + "\"--must be one of emergency, alert, critical, error, warning, notice, informational, debug");
+	}
+	m_syscall_evt_drop_shed_priority = (falco_common::priority_type)(it - falco_common::priority_names.begin());
+
+	string shed_by = m_config->get_scalar<string>("syscall_event_drops.shed_by", "priority");
+	if(shed_by != "priority" && shed_by != "cpu")
+	{
+		throw logic_error("Error reading config file (" + m_config_file + "): syscall event drops shed_by must be one of priority, cpu");
+	}
+	m_syscall_evt_drop_shed_by_cpu = (shed_by == "cpu");
+
+	m_syscall_evt_drop_shed_recovery_secs = m_config->get_scalar<uint32_t>("syscall_event_drops.shed_recovery_secs", 10);
+	if(m_syscall_evt_drop_shed_recovery_secs == 0)
+	{
+		throw logic_error("Error reading config file (" + m_config_file + "): syscall event drops shed_recovery_secs must be an unsigned integer > 0");
+	}
+
 	m_syscall_evt_timeout_max_consecutives = m_config->get_scalar<uint32_t>("syscall_event_timeouts.max_consecutives", 1000);
 	if(m_syscall_evt_timeout_max_consecutives == 0)
 	{
 		throw logic_error("Error reading config file(" + m_config_file + "): the maximum consecutive timeouts without an event must be an unsigned integer > 0");
 	}
 
+	m_rule_cpu_budget.max_ns_per_sec = m_config->get_scalar<uint64_t>("rule_cpu_budget.max_ns_per_sec", 0);
+	m_rule_cpu_budget.max_share = m_config->get_scalar<double>("rule_cpu_budget.max_share", 0);
+	if(m_rule_cpu_budget.max_share < 0 || m_rule_cpu_budget.max_share > 1)
+	{
+		throw logic_error("Error reading config file (" + m_config_file + "): rule_cpu_budget.max_share must be a double in the range [0, 1]");
+	}
+	m_rule_cpu_budget.max_periods = m_config->get_scalar<uint32_t>("rule_cpu_budget.periods", 10);
+	if(m_rule_cpu_budget.max_periods == 0)
+	{
+		throw logic_error("Error reading config file (" + m_config_file + "): rule_cpu_budget.periods must be an unsigned integer > 0");
+	}
+	string budget_action = m_config->get_scalar<string>("rule_cpu_budget.action", "sample");
+	if(budget_action == "sample")
+	{
+		m_rule_cpu_budget.action = falco_ruleset::BUDGET_SAMPLE;
+	}
+	else if(budget_action == "move_last")
+	{
+		m_rule_cpu_budget.action = falco_ruleset::BUDGET_MOVE_LAST;
+	}
+	else if(budget_action == "disable")
+	{
+		m_rule_cpu_budget.action = falco_ruleset::BUDGET_DISABLE;
+	}
+	else
+	{
+		throw logic_error("Error reading config file (" + m_config_file + "): rule_cpu_budget.action must be one of sample, move_last, disable");
+	}
+	m_rule_cpu_budget.sample_ratio = m_config->get_scalar<uint32_t>("rule_cpu_budget.sample_ratio", 10);
+	if(m_rule_cpu_budget.sample_ratio == 0)
+	{
+		throw logic_error("Error reading config file (" + m_config_file + "): rule_cpu_budget.sample_ratio must be an unsigned integer > 0");
+	}
+
+	m_alert_latency_enabled = m_config->get_scalar<bool>("alert_latency.enabled", false);
+
 	m_metadata_download_max_mb = m_config->get_scalar<uint32_t>("metadata_download.max_mb", 100);
 	if(m_metadata_download_max_mb > 1024)
 	{
@@ -247,6 +247,15 @@ public:
 	uint32_t m_webserver_listen_port;
 	std::string m_webserver_k8s_audit_endpoint;
 	std::string m_webserver_k8s_healthz_endpoint;
+	std::string m_webserver_metrics_endpoint;
+	uint64_t m_webserver_k8s_audit_max_request_size;
+	uint64_t m_webserver_k8s_audit_max_event_size;
+	uint64_t m_webserver_k8s_audit_max_pending_size;
+	uint32_t m_webserver_k8s_audit_workers;
+	uint64_t m_webserver_k8s_audit_queue_size;
+	uint32_t m_webserver_k8s_audit_retry_after;
+	std::string m_webserver_k8s_audit_unix_socket;
+	std::string m_webserver_k8s_audit_unix_socket_framing;
 	bool m_webserver_ssl_enabled;
 	std::string m_webserver_ssl_certificate;
 
@@ -254,11 +263,19 @@ public:
 	double m_syscall_evt_drop_threshold;
 	double m_syscall_evt_drop_rate;
 	double m_syscall_evt_drop_max_burst;
+	falco_common::priority_type m_syscall_evt_drop_shed_priority;
+	bool m_syscall_evt_drop_shed_by_cpu;
+	uint32_t m_syscall_evt_drop_shed_recovery_secs;
 	// Only used for testing
 	bool m_syscall_evt_simulate_drops;
 
 	uint32_t m_syscall_evt_timeout_max_consecutives;
 
+	// Disabled when both limits are 0
+	falco_ruleset::cpu_budget m_rule_cpu_budget;
+
+	bool m_alert_latency_enabled;
+
 	uint32_t m_metadata_download_max_mb;
 	uint32_t m_metadata_download_chunk_wait_us;
 	uint32_t m_metadata_download_watch_freq_sec;
@@ -14,6 +14,8 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <algorithm>
+
 #include "event_drops.h"
 #include "falco_common.h"
 #include "banned.h" // This raises a compilation error when certain functions are used
@@ -24,7 +26,13 @@ syscall_evt_drop_mgr::syscall_evt_drop_mgr():
 	m_inspector(NULL),
 	m_outputs(NULL),
 	m_next_check_ts(0),
-	m_simulate_drops(false)
+	m_simulate_drops(false),
+	m_engine(NULL),
+	m_shed_max_priority(falco_common::PRIORITY_WARNING),
+	m_shed_by_cpu(false),
+	m_shed_recovery_secs(10),
+	m_secs_without_drops(0),
+	m_num_shed_escalations(0)
 {
 }
 
@@ -55,6 +63,24 @@ void syscall_evt_drop_mgr::init(sinsp *inspector,
 	}
 }
 
+void syscall_evt_drop_mgr::init_shedding(falco_engine *engine,
+					 const std::string &source,
+					 falco_common::priority_type max_priority,
+					 bool by_cpu,
+					 uint32_t recovery_secs)
+{
+	m_engine = engine;
+	m_shed_source = source;
+	m_shed_max_priority = max_priority;
+	m_shed_by_cpu = by_cpu;
+	m_shed_recovery_secs = recovery_secs;
+
+	if(m_shed_by_cpu)
+	{
+		m_engine->enable_rule_profiling(true);
+	}
+}
+
 bool syscall_evt_drop_mgr::process_event(sinsp *inspector, sinsp_evt *evt)
 {
 	if(m_next_check_ts == 0)
@@ -88,6 +114,7 @@ bool syscall_evt_drop_mgr::process_event(sinsp *inspector, sinsp_evt *evt)
 			delta.n_drops++;
 		}
 
+		bool dropping = false;
 		if(delta.n_drops > 0)
 		{
 			double ratio = delta.n_drops;
@@ -95,22 +122,31 @@ bool syscall_evt_drop_mgr::process_event(sinsp *inspector, sinsp_evt *evt)
 			ratio /= delta.n_drops + delta.n_evts;
 
 			// When simulating drops the threshold is always zero
-			if(ratio > m_threshold)
+			dropping = (ratio > m_threshold);
+		}
+
+		// Shedding isn't subject to the token bucket, as it
+		// must react to every second with or without drops.
+		if(m_actions.count(syscall_evt_drop_action::SHED))
+		{
+			update_shedding(evt->get_ts(), dropping);
+		}
+
+		if(dropping)
+		{
+			m_num_syscall_evt_drops++;
+
+			// There were new drops in the last second.
+			// If the token bucket allows, perform actions.
+			if(m_bucket.claim(1, evt->get_ts()))
+			{
+				m_num_actions++;
+
+				return perform_actions(evt->get_ts(), delta, inspector->is_bpf_enabled());
+			}
+			else
 			{
-				m_num_syscall_evt_drops++;
-
-				// There were new drops in the last second.
-				// If the token bucket allows, perform actions.
-				if(m_bucket.claim(1, evt->get_ts()))
-				{
-					m_num_actions++;
-
-					return perform_actions(evt->get_ts(), delta, inspector->is_bpf_enabled());
-				}
-				else
-				{
-					falco_logger::log(LOG_DEBUG, "Syscall event drop but token bucket depleted, skipping actions");
-				}
+				falco_logger::log(LOG_DEBUG, "Syscall event drop but token bucket depleted, skipping actions");
 			}
 		}
 	}
@@ -123,6 +159,11 @@ void syscall_evt_drop_mgr::print_stats()
 	fprintf(stderr, "Syscall event drop monitoring:\n");
 	fprintf(stderr, "   - event drop detected: %lu occurrences\n", m_num_syscall_evt_drops);
 	fprintf(stderr, "   - num times actions taken: %lu\n", m_num_actions);
+	if(m_actions.count(syscall_evt_drop_action::SHED))
+	{
+		fprintf(stderr, "   - num times rules shed: %lu\n", m_num_shed_escalations);
+		fprintf(stderr, "   - rules currently shed: %lu\n", m_shed_rules.size());
+	}
 }
 
 bool syscall_evt_drop_mgr::perform_actions(uint64_t now, scap_stats &delta, bool bpf_enabled)
@@ -153,6 +194,10 @@ bool syscall_evt_drop_mgr::perform_actions(uint64_t now, scap_stats &delta, bool
 			output_fields["n_drops_pf"] = std::to_string(delta.n_drops_pf);
 			output_fields["n_drops_bug"] = std::to_string(delta.n_drops_bug);
 			output_fields["ebpf_enabled"] = std::to_string(bpf_enabled);
+			if(!m_shed_rules.empty())
+			{
+				output_fields["n_shed_rules"] = std::to_string(m_shed_rules.size());
+			}
 			m_outputs->handle_msg(now, falco_common::PRIORITY_DEBUG, msg, rule, output_fields);
 			break;
 		}
@@ -160,6 +205,10 @@ bool syscall_evt_drop_mgr::perform_actions(uint64_t now, scap_stats &delta, bool
 			should_exit = true;
 			break;
 
+		case syscall_evt_drop_action::SHED:
+			// Done every second by update_shedding()
+			break;
+
 		default:
 			falco_logger::log(LOG_ERR, "Ignoring unknown action " + std::to_string(int(act)));
 			break;
@@ -175,3 +224,131 @@ bool syscall_evt_drop_mgr::perform_actions(uint64_t now, scap_stats &delta, bool
 
 	return true;
 }
+
+void syscall_evt_drop_mgr::update_shedding(uint64_t now, bool dropping)
+{
+	if(!m_engine)
+	{
+		return;
+	}
+
+	if(dropping)
+	{
+		m_secs_without_drops = 0;
+		shed_rules(now);
+	}
+	else if(!m_shed_rules.empty() &&
+		++m_secs_without_drops >= m_shed_recovery_secs)
+	{
+		m_secs_without_drops = 0;
+		restore_rules(now);
+	}
+}
+
+void syscall_evt_drop_mgr::shed_rules(uint64_t now)
+{
+	std::list<falco_ruleset::rule_profile> rules;
+	std::vector<falco_ruleset::rule_profile> candidates;
+
+	// Rules already disabled, either by shedding or by the
+	// user, are never candidates, so that restoring the shed
+	// rules can't enable a rule the user disabled.
+	m_engine->get_rule_profile(rules, true);
+	for(auto &rule : rules)
+	{
+		if(rule.enabled &&
+		   rule.source == m_shed_source &&
+		   rule.priority > m_shed_max_priority)
+		{
+			candidates.push_back(rule);
+		}
+	}
+
+	if(candidates.empty())
+	{
+		return;
+	}
+
+	// Larger priority values are less severe
+	auto by_priority = [](const falco_ruleset::rule_profile &a, const falco_ruleset::rule_profile &b) {
+		if(a.priority != b.priority)
+		{
+			return a.priority > b.priority;
+		}
+		return a.eval_ns > b.eval_ns;
+	};
+	auto by_cpu = [](const falco_ruleset::rule_profile &a, const falco_ruleset::rule_profile &b) {
+		if(a.eval_ns != b.eval_ns)
+		{
+			return a.eval_ns > b.eval_ns;
+		}
+		return a.priority > b.priority;
+	};
+
+	if(m_shed_by_cpu)
+	{
+		std::stable_sort(candidates.begin(), candidates.end(), by_cpu);
+	}
+	else
+	{
+		std::stable_sort(candidates.begin(), candidates.end(), by_priority);
+	}
+
+	// Double the number of disabled rules at each step
+	size_t num = std::min(std::max<size_t>(m_shed_rules.size(), 1), candidates.size());
+	std::string names;
+
+	for(size_t i = 0; i < num; i++)
+	{
+		m_engine->enable_source_rule_exact(m_shed_source, candidates[i].name, false);
+		m_shed_rules.push_back(candidates[i].name);
+		names += (i > 0 ? ", " : "") + candidates[i].name;
+	}
+
+	m_num_shed_escalations++;
+
+	report_shedding(now, "Falco internal: syscall event drop load shedding. Disabled " +
+			std::to_string(num) + " rules: " + names);
+}
+
+void syscall_evt_drop_mgr::restore_rules(uint64_t now)
+{
+	// Re-enable the most recently disabled half, i.e. the most
+	// important ones
+	size_t num = (m_shed_rules.size() + 1) / 2;
+	std::string names;
+
+	for(size_t i = 0; i < num; i++)
+	{
+		std::string &name = m_shed_rules.back();
+		m_engine->enable_source_rule_exact(m_shed_source, name, true);
+		names += (i > 0 ? ", " : "") + name;
+		m_shed_rules.pop_back();
+	}
+
+	report_shedding(now, "Falco internal: syscall event drop load shedding. Re-enabled " +
+			std::to_string(num) + " rules: " + names);
+}
+
+void syscall_evt_drop_mgr::report_shedding(uint64_t now, const std::string &msg)
+{
+	falco_logger::log(LOG_WARNING, msg);
+
+	if(!m_actions.count(syscall_evt_drop_action::ALERT))
+	{
+		return;
+	}
+
+	std::string rule = "Falco internal: syscall event drop load shedding";
+	std::string output = msg;
+	std::string shed_rules;
+	for(auto &name : m_shed_rules)
+	{
+		shed_rules += (shed_rules.empty() ? "" : ",") + name;
+	}
+
+	std::map<std::string, std::string> output_fields;
+	output_fields["n_shed_rules"] = std::to_string(m_shed_rules.size());
+	output_fields["shed_rules"] = shed_rules;
+	m_outputs->handle_msg(now, falco_common::PRIORITY_WARNING, output, rule, output_fields);
+}
@@ -16,11 +16,14 @@ limitations under the License.
 #pragma once
 
 #include <set>
+#include <string>
+#include <vector>
 
 #include <sinsp.h>
 #include <token_bucket.h>
 
 #include "logger.h"
+#include "falco_engine.h"
 #include "falco_outputs.h"
 
 // The possible actions that this class can take upon
@@ -30,7 +33,8 @@ enum class syscall_evt_drop_action : uint8_t
 	IGNORE = 0,
 	LOG,
 	ALERT,
-	EXIT
+	EXIT,
+	SHED
 };
 
 using syscall_evt_drop_actions = std::set<syscall_evt_drop_action>;
@@ -49,6 +53,20 @@ public:
 		  double max_tokens,
 		  bool simulate_drops);
 
+	// Configure the "shed" action, which disables rules of the
+	// given source while events are being dropped. Only rules
+	// with priority less severe than max_priority are disabled,
+	// the least severe first, or the most expensive first when
+	// by_cpu is true (this turns on rule profiling in the
+	// engine). Each second with drops doubles the number of
+	// disabled rules, and each recovery_secs seconds without
+	// drops re-enables the most recently disabled half.
+	void init_shedding(falco_engine *engine,
+			   const std::string &source,
+			   falco_common::priority_type max_priority,
+			   bool by_cpu,
+			   uint32_t recovery_secs);
+
 	// Call this for every event. The class will take care of
 	// periodically measuring the scap stats, looking for syscall
 	// event drops, and performing any actions.
@@ -62,6 +80,14 @@ protected:
 	// Perform all configured actions.
 	bool perform_actions(uint64_t now, scap_stats &delta, bool bpf_enabled);
 
+	// Disable more rules, or re-enable some of them, and
+	// report it. Called once per second with the drop status of
+	// the last second.
+	void update_shedding(uint64_t now, bool dropping);
+	void shed_rules(uint64_t now);
+	void restore_rules(uint64_t now);
+	void report_shedding(uint64_t now, const std::string &msg);
+
 	uint64_t m_num_syscall_evt_drops;
 	uint64_t m_num_actions;
 	sinsp *m_inspector;
@@ -72,4 +98,15 @@ protected:
 	scap_stats m_last_stats;
 	bool m_simulate_drops;
 	double m_threshold;
+
+	falco_engine *m_engine;
+	std::string m_shed_source;
+	falco_common::priority_type m_shed_max_priority;
+	bool m_shed_by_cpu;
+	uint32_t m_shed_recovery_secs;
+	uint32_t m_secs_without_drops;
+	uint64_t m_num_shed_escalations;
+
+	// Rules currently disabled, in the order they were disabled
+	std::vector<std::string> m_shed_rules;
 };
@@ -46,11 +46,16 @@ limitations under the License.
 #include "configuration.h"
 #include "falco_engine.h"
 #include "falco_engine_version.h"
+#include "thread_scope_state.h"
 #include "config_falco.h"
 #include "statsfilewriter.h"
+#include "latency_stats.h"
+#include "falco_probes.h"
+#include "replay_bench.h"
 #ifndef MINIMAL_BUILD
 #include "webserver.h"
 #include "grpc_server.h"
+#include "k8s_audit_replay.h"
 #endif
 #include "banned.h" // This raises a compilation error when certain functions are used
 
@@ -125,7 +130,122 @@ void read_k8s_audit_trace_file(falco_engine *engine,
 		}
 	}
 }
+
+// Evaluate the k8s audit events in each of the files as fast as
+// possible, then print how long it took.
+static int replay_k8s_audit_files(falco_engine *engine,
+				  falco_outputs *outputs,
+				  const std::vector<std::string> &filenames)
+{
+	k8s_audit_replay replay(engine, outputs);
+
+	engine->enable_rule_profiling(true);
+
+	for(auto &filename : filenames)
+	{
+		string errstr;
+
+		falco_logger::log(LOG_INFO, "Replaying k8s audit events from file: " + filename + "\n");
+
+		if(!replay.replay(filename, errstr))
+		{
+			display_fatal_err("Could not replay k8s audit events from file " + filename + ": " + errstr + "\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	replay.print_stats();
+
+	return EXIT_SUCCESS;
+}
+#endif
+
+// Replay the events of -e or --k8s-audit-replay through the rules
+// and the output formats as many times as requested with --bench,
+// then write the report.
+static int run_bench(falco_engine *engine,
+		     falco_outputs *outputs,
+		     sinsp *inspector,
+		     falco::app::cmdline_options &opts)
+{
+	replay_bench bench(engine, outputs);
+	std::vector<std::string> filenames = opts.k8s_audit_replay_filenames;
+
+	// Whether each file is a capture, the files of
+	// --k8s-audit-replay always holding k8s audit events
+	std::vector<bool> is_scap(filenames.size(), false);
+	string errstr;
+	bool ok = true;
+
+	if(!opts.trace_filename.empty())
+	{
+		filenames.push_back(opts.trace_filename);
+		is_scap.push_back(false);
+
+		// As without --bench, files that can't be opened as
+		// captures are read as k8s audit events.
+		try {
+			inspector->open(opts.trace_filename);
+			inspector->close();
+			is_scap.back() = true;
+		}
+		catch(sinsp_exception &e)
+		{
+			falco_logger::log(LOG_DEBUG, "Could not read trace file \"" + opts.trace_filename + "\": " + string(e.what()));
+		}
+	}
+
+#ifdef MINIMAL_BUILD
+	if(std::find(is_scap.begin(), is_scap.end(), false) != is_scap.end())
+	{
+		display_fatal_err("Cannot use k8s audit events trace file with a minimal Falco build\n");
+		return EXIT_FAILURE;
+	}
+#else
+	k8s_audit_replay replay(engine, outputs);
+	replay.set_bench(&bench);
+#endif
+
+	falco_logger::log(LOG_INFO, "Replaying events " + to_string(opts.bench_loops) + " times\n");
+
+	bench.start();
+	for(uint32_t i = 0; ok && i < opts.bench_loops && !g_terminate; i++)
+	{
+		for(size_t j = 0; ok && j < filenames.size(); j++)
+		{
+			const std::string &filename = filenames[j];
+
+			if(is_scap[j])
+			{
+				ok = bench.replay_scap(inspector, filename, syscall_source, opts.all_events, errstr);
+			}
+#ifndef MINIMAL_BUILD
+			else
+			{
+				ok = replay.replay(filename, errstr);
+			}
 #endif
+			if(!ok)
+			{
+				display_fatal_err("Could not replay events from file " + filename + ": " + errstr + "\n");
+			}
+		}
+	}
+	bench.stop();
+
+	if(!ok)
+	{
+		return EXIT_FAILURE;
+	}
+
+	if(!bench.write_report(opts.bench_report_filename, filenames, opts.bench_loops, errstr))
+	{
+		display_fatal_err(errstr + "\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
 
 static std::string read_file(std::string filename)
 {
@@ -149,6 +269,7 @@ uint64_t do_inspect(falco_engine *engine,
 			string &stats_filename,
 			uint64_t stats_interval,
 			bool all_events,
+			latency_stats *latency,
 			int &result)
 {
 	uint64_t num_evts = 0;
@@ -157,6 +278,7 @@ uint64_t do_inspect(falco_engine *engine,
 	StatsFileWriter writer;
 	uint64_t duration_start = 0;
 	uint32_t timeouts_since_last_success_or_msg = 0;
+	latency_histogram *read_latency = (latency ? latency->stage(latency_stats::stage_read) : NULL);
 
 	sdropmgr.init(inspector,
 		      outputs,
@@ -166,11 +288,20 @@ uint64_t do_inspect(falco_engine *engine,
 		      config.m_syscall_evt_drop_max_burst,
 		      config.m_syscall_evt_simulate_drops);
 
+	if(config.m_syscall_evt_drop_actions.count(syscall_evt_drop_action::SHED))
+	{
+		sdropmgr.init_shedding(engine,
+				       event_source,
+				       config.m_syscall_evt_drop_shed_priority,
+				       config.m_syscall_evt_drop_shed_by_cpu,
+				       config.m_syscall_evt_drop_shed_recovery_secs);
+	}
+
 	if (stats_filename != "")
 	{
 		string errstr;
 
-		if (!writer.init(inspector, stats_filename, stats_interval, errstr))
+		if (!writer.init(inspector, stats_filename, stats_interval, errstr, latency))
 		{
 			throw falco_exception(errstr);
 		}
@@ -244,6 +375,11 @@ uint64_t do_inspect(falco_engine *engine,
 
 		// Reset the timeouts counter, Falco successfully got an event to process
 		timeouts_since_last_success_or_msg = 0;
+		FALCO_PROBE2(event_read, ev->get_ts(), ev->get_type());
+		if(read_latency)
+		{
+			read_latency->record_since(ev->get_ts());
+		}
 		if(duration_start == 0)
 		{
 			duration_start = ev->get_ts();
@@ -383,6 +519,73 @@ static void list_source_fields(falco_engine *engine, bool verbose, bool names_on
 	engine->list_fields(source, verbose, names_only, markdown);
 }
 
+// Log what the engine reports outside of its calls, e.g. the external
+// lists that can't be reloaded
+static void log_engine_message(falco_common::priority_type priority, const std::string &msg)
+{
+	falco_logger::log(priority, msg + "\n");
+}
+
+// Demote the rules going over the configured CPU budget, reporting
+// each of them with an internal alert.
+static void configure_rule_cpu_budget(falco_configuration &config, falco_engine *engine, falco_outputs *outputs)
+{
+	if(config.m_rule_cpu_budget.max_ns_per_sec == 0 &&
+	   config.m_rule_cpu_budget.max_share <= 0)
+	{
+		return;
+	}
+
+	auto cb = [outputs](const std::string &source,
+			    const std::string &rule_name,
+			    uint64_t ns_per_sec,
+			    double share,
+			    falco_ruleset::budget_action action) {
+		static const std::vector<std::string> action_names = {"sampled", "moved last", "disabled"};
+
+		std::string rule = "Falco internal: rule over CPU budget";
+		std::string msg = rule + ". Rule \"" + rule_name + "\" " + action_names[action] + ".";
+		std::map<std::string, std::string> o = {
+			{"rule", rule_name},
+			{"source", source},
+			{"ns_per_sec", std::to_string(ns_per_sec)},
+			{"share", std::to_string(share)},
+			{"action", action_names[action]},
+		};
+
+		falco_logger::log(LOG_WARNING, msg + " Cost: " + std::to_string(ns_per_sec) + " ns/s\n");
+
+		auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		outputs->handle_msg(now, falco_common::PRIORITY_WARNING, msg, rule, o);
+	};
+
+	engine->set_rule_cpu_budget(config.m_rule_cpu_budget, cb);
+}
+
+// Enable/disable rules according to the -D/-T/-t command line options.
+static void select_rules(falco::app::application &app, falco_engine *engine)
+{
+	string all_rules;
+
+	for (auto substring : app.options().disabled_rule_substrings)
+	{
+		engine->enable_rule(substring, false);
+	}
+
+	if(app.options().disabled_rule_tags.size() > 0)
+	{
+		engine->enable_rule_by_tag(app.options().disabled_rule_tags, false);
+	}
+
+	if(app.options().enabled_rule_tags.size() > 0)
+	{
+		// Since we only want to enable specific
+		// rules, first disable all rules.
+		engine->enable_rule(all_rules, false);
+		engine->enable_rule_by_tag(app.options().enabled_rule_tags, true);
+	}
+}
+
 static void configure_output_format(falco::app::application &app, falco_engine *engine)
 {
 	std::string output_format;
@@ -426,6 +629,7 @@ int falco_init(int argc, char **argv)
 	sinsp* inspector = NULL;
 	falco_engine *engine = NULL;
 	falco_outputs *outputs = NULL;
+	latency_stats *latency = NULL;
 	syscall_evt_drop_mgr sdropmgr;
 	bool trace_is_scap = true;
 	string outfile;
@@ -460,8 +664,6 @@ int falco_init(int argc, char **argv)
 
 	try
 	{
-		string all_rules;
-
 		if(app.options().help)
 		{
 			printf("%s", app.options().usage().c_str());
@@ -508,6 +710,7 @@ int falco_init(int argc, char **argv)
 		engine = new falco_engine(true);
 
 		configure_output_format(app, engine);
+		engine->set_log_callback(log_engine_message);
 
 		// Create "factories" that can create filters/formatters for
 		// syscalls and k8s audit events.
@@ -763,31 +966,20 @@ int falco_init(int argc, char **argv)
 		for (auto substring : app.options().disabled_rule_substrings)
 		{
 			falco_logger::log(LOG_INFO, "Disabling rules matching substring: " + substring + "\n");
-			engine->enable_rule(substring, false);
 		}
 
-		if(app.options().disabled_rule_tags.size() > 0)
+		for(auto &tag : app.options().disabled_rule_tags)
 		{
-			for(auto &tag : app.options().disabled_rule_tags)
-			{
-				falco_logger::log(LOG_INFO, "Disabling rules with tag: " + tag + "\n");
-			}
-			engine->enable_rule_by_tag(app.options().disabled_rule_tags, false);
+			falco_logger::log(LOG_INFO, "Disabling rules with tag: " + tag + "\n");
 		}
 
-		if(app.options().enabled_rule_tags.size() > 0)
+		for(auto &tag : app.options().enabled_rule_tags)
 		{
-
-			// Since we only want to enable specific
-			// rules, first disable all rules.
-			engine->enable_rule(all_rules, false);
-			for(auto &tag : app.options().enabled_rule_tags)
-			{
-				falco_logger::log(LOG_INFO, "Enabling rules with tag: " + tag + "\n");
-			}
-			engine->enable_rule_by_tag(app.options().enabled_rule_tags, true);
+			falco_logger::log(LOG_INFO, "Enabling rules with tag: " + tag + "\n");
 		}
 
+		select_rules(app, engine);
+
 		if(app.options().print_support)
 		{
 			nlohmann::json support;
@@ -962,23 +1154,64 @@ int falco_init(int argc, char **argv)
 			g_daemonized = true;
 		}
 
+		// From now on, log messages are written by a background
+		// thread. This must happen after forking.
+		falco_logger::start_async();
+
+		bool bench = (app.options().bench_loops > 0);
+
 		outputs = new falco_outputs();
 
+		// With --bench, alerts are formatted as usual but not
+		// rate-limited nor sent anywhere.
 		outputs->init(engine,
 			      config.m_json_output,
 			      config.m_json_include_output_property,
 			      config.m_json_include_tags_property,
 			      config.m_output_timeout,
-			      config.m_notifications_rate, config.m_notifications_max_burst,
+			      (bench ? UINT32_MAX : config.m_notifications_rate),
+			      (bench ? UINT32_MAX : config.m_notifications_max_burst),
 			      config.m_buffered_outputs,
 			      config.m_time_format_iso_8601,
 			      hostname);
 
-		for(auto output : config.m_outputs)
+		if(!bench)
+		{
+			for(auto output : config.m_outputs)
+			{
+				outputs->add_output(output);
+			}
+		}
+
+		if(config.m_alert_latency_enabled)
 		{
-			outputs->add_output(output);
+			latency = new latency_stats();
+			outputs->set_latency_stats(latency);
 		}
 
+		configure_rule_cpu_budget(config, engine, outputs);
+
+		// The results of the parts of the syscall rules that only
+		// depend on the thread or container are cached in the
+		// thread table, whose private state must be reserved
+		// before opening the inspector
+		engine->set_rule_scope_state(syscall_source, std::make_shared<thread_scope_state>(inspector));
+
+		if(bench)
+		{
+			result = run_bench(engine, outputs, inspector, app.options());
+			goto exit;
+		}
+
+#ifndef MINIMAL_BUILD
+		if(!app.options().k8s_audit_replay_filenames.empty())
+		{
+			result = replay_k8s_audit_files(engine, outputs, app.options().k8s_audit_replay_filenames);
+			engine->print_stats();
+			goto exit;
+		}
+#endif
+
 		if(app.options().trace_filename.size())
 		{
 			// Try to open the trace file as a
@@ -1151,7 +1384,48 @@ int falco_init(int argc, char **argv)
 		{
 			std::string ssl_option = (config.m_webserver_ssl_enabled ? " (SSL)" : "");
 			falco_logger::log(LOG_INFO, "Starting internal webserver, listening on port " + to_string(config.m_webserver_listen_port) + ssl_option + "\n");
-			webserver.init(&config, engine, outputs);
+
+			// Each k8s audit worker gets its own copy of
+			// the main engine, configured the same way.
+			auto engine_factory = [&]() -> falco_engine * {
+				std::unique_ptr<falco_engine> replica(new falco_engine(true));
+
+				configure_output_format(app, replica.get());
+				replica->set_log_callback(log_engine_message);
+
+				// The rules with count and window count
+				// the events of all the workers
+				replica->set_rule_thresholds(engine->get_rule_thresholds());
+
+				replica->add_source(syscall_source, syscall_filter_factory, syscall_formatter_factory);
+				replica->add_source(k8s_audit_source, k8s_audit_filter_factory, k8s_audit_formatter_factory);
+				if(input_plugin)
+				{
+					replica->add_source(event_source, plugin_filter_factory, plugin_formatter_factory);
+				}
+
+				replica->set_min_priority(config.m_min_priority);
+
+				for (auto filename : config.m_rules_filenames)
+				{
+					try {
+						replica->load_rules_file(filename, false, app.options().all_events);
+					}
+					catch(falco_exception &e)
+					{
+						std::string prefix = "Could not load rules file " + filename + ": ";
+
+						throw falco_exception(prefix + e.what());
+					}
+				}
+
+				select_rules(app, replica.get());
+				configure_rule_cpu_budget(config, replica.get(), outputs);
+
+				return replica.release();
+			};
+
+			webserver.init(&config, engine, outputs, engine_factory, latency);
 			webserver.start();
 		}
 
@@ -1197,6 +1471,7 @@ int falco_init(int argc, char **argv)
 					      app.options().stats_filename,
 					      app.options().stats_interval,
 					      app.options().all_events,
+					      latency,
 					      result);
 
 			duration = ((double)clock()) / CLOCKS_PER_SEC - duration;
@@ -1255,9 +1530,12 @@ int falco_init(int argc, char **argv)
 
 exit:
 
+	falco_logger::stop_async();
+
 	delete inspector;
 	delete engine;
 	delete outputs;
+	delete latency;
 
 	return result;
 }
@@ -25,6 +25,7 @@ limitations under the License.
 #include "formats.h"
 #include "logger.h"
 #include "watchdog.h"
+#include "falco_probes.h"
 
 #include "outputs_file.h"
 #include "outputs_program.h"
@@ -41,6 +42,10 @@ using namespace std;
 
 falco_outputs::falco_outputs():
 	m_initialized(false),
+	m_latency(NULL),
+	m_latency_match(NULL),
+	m_latency_format(NULL),
+	m_latency_queue(NULL),
 	m_buffered(true),
 	m_json_output(false),
 	m_time_format_iso_8601(false),
@@ -137,11 +142,40 @@ void falco_outputs::add_output(falco::outputs::config oc)
 
 	oo->init(oc, m_buffered, m_hostname, m_json_output);
 	m_outputs.push_back(oo);
+	if(m_latency)
+	{
+		add_output_latency(oo);
+	}
+}
+
+void falco_outputs::set_latency_stats(latency_stats *latency)
+{
+	m_latency = latency;
+	m_latency_match = latency->stage(latency_stats::stage_match);
+	m_latency_format = latency->stage(latency_stats::stage_format);
+	m_latency_queue = latency->stage(latency_stats::stage_queue);
+	m_latency_outputs.clear();
+	for(auto o : m_outputs)
+	{
+		add_output_latency(o);
+	}
+}
+
+void falco_outputs::add_output_latency(falco::outputs::abstract_output *o)
+{
+	m_latency_outputs.push_back(m_latency->stage(latency_stats::stage_output_prefix + o->get_name()));
 }
 
 void falco_outputs::handle_event(gen_event *evt, string &rule, string &source,
 				 falco_common::priority_type priority, string &format, std::set<std::string> &tags)
 {
+	FALCO_PROBE4(handle_event, rule.c_str(), source.c_str(), (int) priority, evt->get_ts());
+
+	if(m_latency)
+	{
+		m_latency_match->record_since(evt->get_ts());
+	}
+
 	if(!m_notifications_tb.claim())
 	{
 		falco_logger::log(LOG_DEBUG, "Skipping rate-limited notification for rule " + rule + "\n");
@@ -192,6 +226,12 @@ void falco_outputs::handle_event(gen_event *evt, string &rule, string &source,
 	cmsg.fields = m_formats->get_field_values(evt, source, sformat);
 	cmsg.tags.insert(tags.begin(), tags.end());
 
+	if(m_latency)
+	{
+		m_latency_format->record_since(cmsg.ts);
+		cmsg.track_latency = true;
+	}
+
 	cmsg.type = ctrl_msg_type::CTRL_MSG_OUTPUT;
 	m_queue.push(cmsg);
 }
@@ -297,9 +337,9 @@ inline void falco_outputs::push(ctrl_msg_type cmt)
 // we still need to improve the error reporting since some inner functions can throw exceptions.
 void falco_outputs::worker() noexcept
 {
-	watchdog<std::string> wd;
-	wd.start([&](std::string payload) -> void {
-		falco_logger::log(LOG_CRIT, "\"" + payload + "\" output timeout, all output channels are blocked\n");
+	watchdog<falco::outputs::abstract_output *> wd;
+	wd.start([&](falco::outputs::abstract_output *o) -> void {
+		falco_logger::log(LOG_CRIT, "\"" + o->get_name() + "\" output timeout, all output channels are blocked\n");
 	});
 
 	auto timeout = m_timeout;
@@ -310,15 +350,29 @@ void falco_outputs::worker() noexcept
 		// Block until a message becomes available.
 		m_queue.pop(cmsg);
 
-		for(const auto o : m_outputs)
+		if(cmsg.type == ctrl_msg_type::CTRL_MSG_OUTPUT)
+		{
+			FALCO_PROBE2(output_dequeue, cmsg.rule.c_str(), cmsg.ts);
+		}
+
+		bool track_latency = (cmsg.track_latency && cmsg.type == ctrl_msg_type::CTRL_MSG_OUTPUT);
+		if(track_latency)
 		{
-			wd.set_timeout(timeout, o->get_name());
+			m_latency_queue->record_since(cmsg.ts);
+		}
+
+		for(size_t i = 0; i < m_outputs.size(); i++)
+		{
+			const auto o = m_outputs[i];
+			wd.set_timeout(timeout, o);
 			try
 			{
 				switch(cmsg.type)
 				{
 					case ctrl_msg_type::CTRL_MSG_OUTPUT:
+						FALCO_PROBE3(output_send_entry, o->get_name().c_str(), cmsg.rule.c_str(), cmsg.ts);
 						o->output(&cmsg);
+						FALCO_PROBE3(output_send_return, o->get_name().c_str(), cmsg.rule.c_str(), cmsg.ts);
 						break;
 					case ctrl_msg_type::CTRL_MSG_CLEANUP:
 					case ctrl_msg_type::CTRL_MSG_STOP:
@@ -335,6 +389,11 @@ void falco_outputs::worker() noexcept
 			{
 				falco_logger::log(LOG_ERR, o->get_name() + ": " + string(e.what()) + "\n");
 			}
+
+			if(track_latency)
+			{
+				m_latency_outputs[i]->record_since(cmsg.ts);
+			}
 		}
 		wd.cancel_timeout();
 	} while(cmsg.type != ctrl_msg_type::CTRL_MSG_STOP);
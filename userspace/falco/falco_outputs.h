@@ -26,6 +26,7 @@ limitations under the License.
 #include "falco_engine.h"
 #include "outputs.h"
 #include "formats.h"
+#include "latency_stats.h"
 #include "tbb/concurrent_queue.h"
 
 //
@@ -49,6 +50,11 @@ public:
 
 	void add_output(falco::outputs::config oc);
 
+	// Record the match, format, queue and output stages of each
+	// alert in latency. Like add_output(), this must be called
+	// before any message has been enqueued.
+	void set_latency_stats(latency_stats *latency);
+
 	// Format then send the event to all configured outputs (`evt` is an event that has matched some rule).
 	void handle_event(gen_event *evt, std::string &rule, std::string &source,
 			  falco_common::priority_type priority, std::string &format, std::set<std::string> &tags);
@@ -70,6 +76,14 @@ private:
 
 	std::vector<falco::outputs::abstract_output *> m_outputs;
 
+	// NULL unless set_latency_stats() was called. Output stages
+	// are in the same order as m_outputs.
+	latency_stats *m_latency;
+	latency_histogram *m_latency_match;
+	latency_histogram *m_latency_format;
+	latency_histogram *m_latency_queue;
+	std::vector<latency_histogram *> m_latency_outputs;
+
 	// Rate limits notifications
 	token_bucket m_notifications_tb;
 
@@ -90,6 +104,9 @@ private:
 	struct ctrl_msg : falco::outputs::message
 	{
 		ctrl_msg_type type;
+
+		// False for messages not associated with an event
+		bool track_latency;
 	};
 
 	typedef tbb::concurrent_bounded_queue<ctrl_msg> falco_outputs_cbq;
@@ -98,6 +115,7 @@ private:
 
 	std::thread m_worker_thread;
 	inline void push(ctrl_msg_type cmt);
+	void add_output_latency(falco::outputs::abstract_output *o);
 	void worker() noexcept;
 	void stop_worker();
 };
@@ -0,0 +1,287 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <zlib.h>
+
+#include "k8s_audit_replay.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+using namespace std;
+
+static std::string s_k8s_audit_source = "k8s_audit";
+
+// Size of each read from the file
+static const size_t s_read_size = 1024 * 1024;
+
+k8s_audit_replay::k8s_audit_replay(falco_engine *engine, falco_outputs *outputs):
+	m_engine(engine),
+	m_outputs(outputs),
+	m_bench(NULL),
+	m_num_bytes(0),
+	m_num_events(0),
+	m_num_alerts(0),
+	m_duration_ns(0)
+{
+}
+
+k8s_audit_replay::~k8s_audit_replay()
+{
+}
+
+void k8s_audit_replay::set_bench(replay_bench *bench)
+{
+	m_bench = bench;
+}
+
+bool k8s_audit_replay::replay(const std::string &filename, std::string &errstr)
+{
+	// gzopen also reads uncompressed files, as they are
+	gzFile file = gzopen(filename.c_str(), "rb");
+	if(file == NULL)
+	{
+		errstr = string("Could not open file: ") + strerror(errno);
+		return false;
+	}
+
+	gzbuffer(file, s_read_size);
+
+	auto start = std::chrono::steady_clock::now();
+
+	// The json values in the file are found by matching braces
+	// and brackets, skipping those within strings, and are then
+	// parsed one at a time. buf holds the data not processed yet,
+	// which begins at offset in the (uncompressed) file.
+	std::string buf;
+	uint64_t offset = 0;
+	size_t pos = 0;
+	size_t value_start = string::npos;
+	uint32_t depth = 0;
+	bool in_string = false;
+	bool escaped = false;
+	bool ok = true;
+
+	while(ok)
+	{
+		size_t size = buf.size();
+		buf.resize(size + s_read_size);
+
+		int n = gzread(file, &buf[size], s_read_size);
+		if(n < 0)
+		{
+			int err;
+			errstr = string("Could not read file: ") + gzerror(file, &err);
+			ok = false;
+			break;
+		}
+
+		buf.resize(size + n);
+		if(n == 0)
+		{
+			break;
+		}
+
+		m_num_bytes += n;
+
+		for(; ok && pos < buf.size(); pos++)
+		{
+			char c = buf[pos];
+
+			if(in_string)
+			{
+				if(escaped)
+				{
+					escaped = false;
+				}
+				else if(c == '\\')
+				{
+					escaped = true;
+				}
+				else if(c == '"')
+				{
+					in_string = false;
+				}
+				continue;
+			}
+
+			switch(c)
+			{
+			case '{':
+			case '[':
+				if(depth++ == 0)
+				{
+					value_start = pos;
+				}
+				break;
+			case '}':
+			case ']':
+				if(depth == 0)
+				{
+					ok = false;
+				}
+				else if(--depth == 0)
+				{
+					ok = process_data(buf.data() + value_start, pos + 1 - value_start, errstr);
+					value_start = string::npos;
+				}
+				break;
+			case '"':
+				in_string = true;
+				ok = (depth > 0);
+				break;
+			default:
+				ok = (depth > 0 || isspace((unsigned char) c));
+			}
+
+			if(!ok)
+			{
+				if(errstr.empty())
+				{
+					errstr = "Data not recognized as a k8s audit event";
+				}
+				errstr += " at offset " + to_string(offset + pos);
+			}
+		}
+
+		// Only keep the value being read, if any
+		size_t done = (value_start == string::npos ? buf.size() : value_start);
+		buf.erase(0, done);
+		offset += done;
+		pos -= done;
+		if(value_start != string::npos)
+		{
+			value_start = 0;
+		}
+	}
+
+	if(ok && depth > 0)
+	{
+		errstr = "Unexpected end of file at offset " + to_string(offset + pos);
+		ok = false;
+	}
+
+	gzclose(file);
+
+	m_duration_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+	return ok;
+}
+
+bool k8s_audit_replay::process_data(const char *data, size_t len, std::string &errstr)
+{
+	std::list<json_event> evts;
+
+#ifdef HAS_SIMDJSON
+	if(!falco_k8s_audit::parse_k8s_audit_data(m_parser, data, len, evts, errstr))
+	{
+		return false;
+	}
+#else
+	nlohmann::json j;
+
+	try
+	{
+		j = nlohmann::json::parse(data, data + len);
+	}
+	catch(nlohmann::json::parse_error &e)
+	{
+		errstr = string("Could not parse data: ") + e.what();
+		return false;
+	}
+
+	if(!falco_k8s_audit::parse_k8s_audit_json(j, evts))
+	{
+		errstr = "Data not recognized as a k8s audit event";
+		return false;
+	}
+#endif
+
+	for(auto &evt : evts)
+	{
+		std::unique_ptr<falco_engine::rule_result> res;
+
+		m_num_events++;
+
+		try
+		{
+			if(m_bench)
+			{
+				m_bench->process_event(s_k8s_audit_source, &evt);
+				continue;
+			}
+
+			res = m_engine->process_event(s_k8s_audit_source, &evt);
+
+			if(res)
+			{
+				m_num_alerts++;
+				m_outputs->handle_event(res->evt, res->rule,
+							res->source, res->priority_num,
+							res->format, res->tags);
+			}
+		}
+		catch(falco_exception &e)
+		{
+			errstr = string("Could not process event: ") + e.what();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void k8s_audit_replay::print_stats()
+{
+	double secs = m_duration_ns / 1000000000.0;
+
+	fprintf(stdout, "k8s audit events: %" PRIu64 ", alerts: %" PRIu64 ", bytes: %" PRIu64 "\n",
+		m_num_events, m_num_alerts, m_num_bytes);
+	fprintf(stdout, "Elapsed time: %.3lf, %.2lf events/s, %.2lf MB/s\n",
+		secs,
+		(secs > 0 ? m_num_events / secs : 0),
+		(secs > 0 ? m_num_bytes / secs / (1024 * 1024) : 0));
+
+	std::list<falco_ruleset::rule_profile> profile;
+	m_engine->get_rule_profile(profile);
+
+	if(profile.empty())
+	{
+		return;
+	}
+
+	profile.sort([](const falco_ruleset::rule_profile &a, const falco_ruleset::rule_profile &b) {
+		return a.eval_ns > b.eval_ns;
+	});
+
+	fprintf(stdout, "Time per rule:\n");
+	fprintf(stdout, "%12s %12s %10s %10s  %s\n", "total (ms)", "evals", "ns/eval", "matches", "rule");
+	for(auto &rp : profile)
+	{
+		fprintf(stdout, "%12.3lf %12" PRIu64 " %10" PRIu64 " %10" PRIu64 "  %s\n",
+			rp.eval_ns / 1000000.0,
+			rp.num_evals,
+			rp.eval_ns / rp.num_evals,
+			rp.num_matches,
+			rp.name.c_str());
+	}
+}
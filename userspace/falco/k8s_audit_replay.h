@@ -0,0 +1,67 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "falco_engine.h"
+#include "falco_outputs.h"
+#include "json_evt.h"
+#include "replay_bench.h"
+
+// Evaluates k8s audit events read from files as fast as possible,
+// without going through the webserver. Files can hold one audit
+// Event or EventList per line (as written by the API server's log
+// backend), or any sequence of Event/EventList objects, and can be
+// gzip-compressed.
+class k8s_audit_replay
+{
+public:
+	k8s_audit_replay(falco_engine *engine, falco_outputs *outputs);
+	virtual ~k8s_audit_replay();
+
+	// Read and evaluate all the events in filename. Returns
+	// false and fills in errstr on errors.
+	bool replay(const std::string &filename, std::string &errstr);
+
+	// Print the number of events and alerts, the event rate and
+	// the time spent in each rule (when rule profiling is
+	// enabled in the engine).
+	void print_stats();
+
+	// Pass the events to bench instead of evaluating them here,
+	// for --bench.
+	void set_bench(replay_bench *bench);
+
+private:
+	// Parse a single json value holding events, and evaluate
+	// them.
+	bool process_data(const char *data, size_t len, std::string &errstr);
+
+	falco_engine *m_engine;
+	falco_outputs *m_outputs;
+	replay_bench *m_bench;
+
+#ifdef HAS_SIMDJSON
+	simdjson::dom::parser m_parser;
+#endif
+
+	uint64_t m_num_bytes;
+	uint64_t m_num_events;
+	uint64_t m_num_alerts;
+	uint64_t m_duration_ns;
+};
@@ -0,0 +1,198 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+#include "latency_stats.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+using namespace std;
+
+const char *latency_stats::stage_read = "read";
+const char *latency_stats::stage_match = "match";
+const char *latency_stats::stage_format = "format";
+const char *latency_stats::stage_queue = "queue";
+const char *latency_stats::stage_output_prefix = "output.";
+
+// Bounds of the buckets exported to prometheus, in seconds
+static const double s_prometheus_buckets[] = {
+	0.00001, 0.00005, 0.0001, 0.0005,
+	0.001, 0.005, 0.01, 0.05,
+	0.1, 0.5, 1, 5, 10, 30, 60
+};
+
+latency_histogram::latency_histogram():
+	m_sum(0)
+{
+	for(uint32_t i = 0; i < num_buckets; i++)
+	{
+		m_counts[i].store(0, memory_order_relaxed);
+	}
+}
+
+uint64_t latency_histogram::bucket_upper_bound(uint32_t b)
+{
+	if(b < (1 << sub_bucket_bits))
+	{
+		return b + 1;
+	}
+	uint32_t shift = (b >> sub_bucket_bits) - 1;
+	uint64_t lower = ((uint64_t) ((b & ((1 << sub_bucket_bits) - 1)) | (1 << sub_bucket_bits))) << shift;
+	return lower + (1ULL << shift);
+}
+
+void latency_histogram::get_snapshot(snapshot &s) const
+{
+	s.counts.resize(num_buckets);
+	s.count = 0;
+	for(uint32_t i = 0; i < num_buckets; i++)
+	{
+		s.counts[i] = m_counts[i].load(memory_order_relaxed);
+		s.count += s.counts[i];
+	}
+	s.sum = m_sum.load(memory_order_relaxed);
+}
+
+uint64_t latency_histogram::snapshot::quantile(double q) const
+{
+	if(count == 0)
+	{
+		return 0;
+	}
+
+	uint64_t target = (uint64_t) ceil(q * count);
+	if(target == 0)
+	{
+		target = 1;
+	}
+
+	uint64_t seen = 0;
+	for(uint32_t i = 0; i < counts.size(); i++)
+	{
+		seen += counts[i];
+		if(seen >= target)
+		{
+			return bucket_upper_bound(i);
+		}
+	}
+
+	return bucket_upper_bound(num_buckets - 1);
+}
+
+uint64_t latency_histogram::snapshot::count_le(uint64_t ns) const
+{
+	uint64_t ret = 0;
+	for(uint32_t i = 0; i < counts.size(); i++)
+	{
+		if(bucket_upper_bound(i) > ns + 1)
+		{
+			break;
+		}
+		ret += counts[i];
+	}
+	return ret;
+}
+
+latency_histogram::snapshot latency_histogram::snapshot::delta(const snapshot &prev) const
+{
+	snapshot ret;
+	ret.counts = counts;
+	ret.count = count;
+	ret.sum = sum;
+	if(prev.counts.size() == counts.size())
+	{
+		for(uint32_t i = 0; i < counts.size(); i++)
+		{
+			ret.counts[i] -= prev.counts[i];
+		}
+		ret.count -= prev.count;
+		ret.sum -= prev.sum;
+	}
+	return ret;
+}
+
+latency_stats::latency_stats()
+{
+}
+
+latency_stats::~latency_stats()
+{
+}
+
+latency_histogram *latency_stats::stage(const string &name)
+{
+	unique_lock<mutex> lock(m_mtx);
+	for(auto &s : m_stages)
+	{
+		if(s.first == name)
+		{
+			return &s.second;
+		}
+	}
+	m_stages.emplace_back(piecewise_construct,
+			      forward_as_tuple(name),
+			      forward_as_tuple());
+	return &m_stages.back().second;
+}
+
+void latency_stats::get_snapshots(snapshots &s)
+{
+	unique_lock<mutex> lock(m_mtx);
+	s.resize(m_stages.size());
+	uint32_t i = 0;
+	for(auto &st : m_stages)
+	{
+		s[i].first = st.first;
+		st.second.get_snapshot(s[i].second);
+		i++;
+	}
+}
+
+string latency_stats::to_prometheus()
+{
+	snapshots snaps;
+	get_snapshots(snaps);
+
+	ostringstream os;
+	os << "# HELP falco_alert_latency_seconds Time elapsed from the event timestamp to each stage of the alert pipeline.\n";
+	os << "# TYPE falco_alert_latency_seconds histogram\n";
+	for(auto &s : snaps)
+	{
+		string labels;
+		size_t plen = strlen(stage_output_prefix);
+		if(s.first.compare(0, plen, stage_output_prefix) == 0)
+		{
+			labels = "stage=\"output\",output=\"" + s.first.substr(plen) + "\"";
+		}
+		else
+		{
+			labels = "stage=\"" + s.first + "\"";
+		}
+
+		for(auto le : s_prometheus_buckets)
+		{
+			os << "falco_alert_latency_seconds_bucket{" << labels << ",le=\"" << le << "\"} "
+			   << s.second.count_le((uint64_t) (le * 1000000000)) << "\n";
+		}
+		os << "falco_alert_latency_seconds_bucket{" << labels << ",le=\"+Inf\"} " << s.second.count << "\n";
+		os << "falco_alert_latency_seconds_sum{" << labels << "} " << (s.second.sum / 1000000000.0) << "\n";
+		os << "falco_alert_latency_seconds_count{" << labels << "} " << s.second.count << "\n";
+	}
+
+	return os.str();
+}
@@ -0,0 +1,139 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//
+// A histogram of latencies in nanoseconds, with log-linear buckets
+// as in HdrHistogram: each power of two is split in 16 buckets, so
+// that values are recorded with a precision of ~6% from 1ns to ~18
+// minutes (larger values go in the last bucket). record() only
+// increments two counters and can be called from any thread.
+//
+class latency_histogram
+{
+public:
+	static const uint32_t sub_bucket_bits = 4;
+	static const uint32_t max_bits = 40;
+	static const uint32_t num_buckets = (max_bits - sub_bucket_bits + 1) << sub_bucket_bits;
+
+	struct snapshot
+	{
+		std::vector<uint64_t> counts;
+		uint64_t count;
+		uint64_t sum;
+
+		// Returns the upper bound of the bucket holding the
+		// given quantile (0-1), or 0 if there are no values.
+		uint64_t quantile(double q) const;
+
+		// Number of values lower than or equal to ns, within
+		// the bucket precision.
+		uint64_t count_le(uint64_t ns) const;
+
+		// Values recorded between prev and this snapshot.
+		snapshot delta(const snapshot &prev) const;
+	};
+
+	latency_histogram();
+
+	inline void record(uint64_t ns)
+	{
+		m_counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+		m_sum.fetch_add(ns, std::memory_order_relaxed);
+	}
+
+	// Records the time elapsed since ts, in ns since the epoch
+	// (as event timestamps are). Events from the future count as 0.
+	inline void record_since(uint64_t ts)
+	{
+		uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		record(now > ts ? now - ts : 0);
+	}
+
+	void get_snapshot(snapshot &s) const;
+
+	static inline uint32_t bucket(uint64_t ns)
+	{
+		if(ns < (1 << sub_bucket_bits))
+		{
+			return (uint32_t) ns;
+		}
+		uint32_t msb = 63 - __builtin_clzll(ns);
+		if(msb >= max_bits)
+		{
+			return num_buckets - 1;
+		}
+		uint32_t shift = msb - sub_bucket_bits;
+		return ((shift + 1) << sub_bucket_bits) +
+			((ns >> shift) & ((1 << sub_bucket_bits) - 1));
+	}
+
+	// Exclusive upper bound of the values in the bucket
+	static uint64_t bucket_upper_bound(uint32_t b);
+
+private:
+	std::atomic<uint64_t> m_counts[num_buckets];
+	std::atomic<uint64_t> m_sum;
+};
+
+//
+// Histograms of the time elapsed from the event timestamp to each
+// stage of the alert pipeline: "read" (returned by the inspector,
+// for every event), "match" (a rule matched), "format" (the alert
+// was formatted and queued), "queue" (the alert was dequeued by the
+// outputs worker), and "output.<name>" (that output channel
+// finished delivering it). Stages measure the cumulative latency, so
+// the time spent in a stage is the difference with the previous one.
+//
+class latency_stats
+{
+public:
+	static const char *stage_read;
+	static const char *stage_match;
+	static const char *stage_format;
+	static const char *stage_queue;
+	static const char *stage_output_prefix;
+
+	latency_stats();
+	virtual ~latency_stats();
+
+	// Returns the histogram of a stage, creating it if needed.
+	// The returned pointer stays valid for the lifetime of this
+	// object, and should be kept by the callers instead of
+	// calling stage() for every event.
+	latency_histogram *stage(const std::string &name);
+
+	typedef std::vector<std::pair<std::string, latency_histogram::snapshot>> snapshots;
+
+	// In stage creation order
+	void get_snapshots(snapshots &s);
+
+	// Prometheus text exposition format
+	std::string to_prometheus();
+
+private:
+	std::mutex m_mtx;
+	std::list<std::pair<std::string, latency_histogram>> m_stages;
+};
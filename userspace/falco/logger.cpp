@@ -15,6 +15,12 @@ limitations under the License.
 */
 
 #include <ctime>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include "logger.h"
 
 #include "falco_common.h"
@@ -72,20 +78,167 @@ void falco_logger::set_level(string &level)
 bool falco_logger::log_stderr = true;
 bool falco_logger::log_syslog = true;
 
-void falco_logger::log(int priority, const string msg)
+namespace
 {
 
-	if(priority > falco_logger::level)
+// Messages up to this length are copied in the queue slot itself,
+// longer ones in a string owned by the slot and reused afterwards.
+const size_t s_inline_len = 512;
+
+// Must be a power of two
+const size_t s_queue_len = 1024;
+
+// Messages less severe than LOG_ERR are dropped past this number per
+// second, while the async writer is running.
+const uint32_t s_max_rate = 1000;
+
+struct log_record
+{
+	std::atomic<size_t> seq;
+	int priority;
+	std::time_t ts;
+	size_t len;
+	char buf[s_inline_len];
+	string overflow;
+};
+
+//
+// Bounded multi-producer, single-consumer queue. A producer claims a
+// slot with a CAS on the enqueue position and publishes it through
+// the slot sequence number, so producers never wait for each other
+// nor for the writer thread: when the queue is full, push() fails.
+//
+class log_queue
+{
+public:
+	log_queue():
+		m_enqueue_pos(0),
+		m_dequeue_pos(0)
 	{
-		return;
+		for(size_t i = 0; i < s_queue_len; i++)
+		{
+			m_records[i].seq.store(i, std::memory_order_relaxed);
+		}
 	}
 
-	string copy = msg;
+	bool push(int priority, std::time_t ts, const string &msg)
+	{
+		log_record *rec;
+		size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+		while(true)
+		{
+			rec = &m_records[pos & (s_queue_len - 1)];
+			size_t seq = rec->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+			if(diff == 0)
+			{
+				if(m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if(diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				pos = m_enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		rec->priority = priority;
+		rec->ts = ts;
+		rec->len = msg.size();
+		if(rec->len <= s_inline_len)
+		{
+			memcpy(rec->buf, msg.data(), rec->len);
+		}
+		else
+		{
+			rec->overflow.assign(msg);
+		}
+		rec->seq.store(pos + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Only called by the writer thread
+	bool empty()
+	{
+		log_record *rec = &m_records[m_dequeue_pos & (s_queue_len - 1)];
+		return (rec->seq.load(std::memory_order_acquire) != m_dequeue_pos + 1);
+	}
+
+	// Only called by the writer thread. Returns false if the
+	// queue is empty.
+	template<typename _F>
+	bool pop(_F f)
+	{
+		log_record *rec = &m_records[m_dequeue_pos & (s_queue_len - 1)];
+		if(rec->seq.load(std::memory_order_acquire) != m_dequeue_pos + 1)
+		{
+			return false;
+		}
+
+		f(rec->priority, rec->ts,
+		  (rec->len <= s_inline_len ? rec->buf : rec->overflow.data()),
+		  rec->len);
+
+		rec->seq.store(m_dequeue_pos + s_queue_len, std::memory_order_release);
+		m_dequeue_pos++;
+
+		return true;
+	}
+
+private:
+	log_record m_records[s_queue_len];
+	std::atomic<size_t> m_enqueue_pos;
+	size_t m_dequeue_pos;
+};
+
+// Allocated by the first start_async() and never freed, so that
+// concurrent log() calls never see it disappear.
+log_queue *s_queue = NULL;
+std::atomic<bool> s_async(false);
+std::atomic<bool> s_stop(false);
+std::atomic<uint64_t> s_dropped(0);
+std::atomic<int64_t> s_rate_sec(0);
+std::atomic<uint32_t> s_rate_count(0);
+std::mutex s_writer_mtx;
+std::thread s_writer;
+bool s_atexit_registered = false;
+
+// The number of log() calls that may queue their message, waited for
+// by stop_async() before the last drain of the queue
+std::atomic<uint32_t> s_producers(0);
+
+// The writer sleeps on s_wake when there's nothing to write, and the
+// producers only take s_wake_mtx to wake it up when it's waiting.
+std::mutex s_wake_mtx;
+std::condition_variable s_wake;
+std::atomic<bool> s_writer_waiting(false);
+
+// The counter reset is racy, which at worst lets a few more messages
+// through at the start of a second.
+bool over_rate(std::time_t now)
+{
+	if(s_rate_sec.load(std::memory_order_relaxed) != now)
+	{
+		s_rate_sec.store(now, std::memory_order_relaxed);
+		s_rate_count.store(0, std::memory_order_relaxed);
+	}
+	return s_rate_count.fetch_add(1, std::memory_order_relaxed) >= s_max_rate;
+}
+
+void write_record(int priority, std::time_t ts, const char *msg, size_t len)
+{
+	string copy(msg, len);
 
 	if (falco_logger::log_syslog)
 	{
 		// Syslog output should not have any trailing newline
-		if(copy.back() == '\n')
+		if(!copy.empty() && copy.back() == '\n')
 		{
 			copy.pop_back();
 		}
@@ -96,16 +249,15 @@ void falco_logger::log(int priority, const string msg)
 	if (falco_logger::log_stderr)
 	{
 		// log output should always have a trailing newline
-		if(copy.back() != '\n')
+		if(copy.empty() || copy.back() != '\n')
 		{
 			copy.push_back('\n');
 		}
 
-		std::time_t result = std::time(nullptr);
 		if(falco_logger::time_format_iso_8601)
 		{
 			char buf[sizeof "YYYY-MM-DDTHH:MM:SS-0000"];
-			struct tm *gtm = std::gmtime(&result);
+			struct tm *gtm = std::gmtime(&ts);
 			if(gtm != NULL &&
 			   (strftime(buf, sizeof(buf), "%FT%T%z", gtm) != 0))
 			{
@@ -114,7 +266,7 @@ void falco_logger::log(int priority, const string msg)
 		}
 		else
 		{
-			struct tm *ltm = std::localtime(&result);
+			struct tm *ltm = std::localtime(&ts);
 			char *atime = (ltm ? std::asctime(ltm) : NULL);
 			string tstr;
 			if(atime)
@@ -130,3 +282,140 @@ void falco_logger::log(int priority, const string msg)
 		}
 	}
 }
+
+void report_drops()
+{
+	uint64_t dropped = s_dropped.exchange(0, std::memory_order_relaxed);
+	if(dropped > 0)
+	{
+		string msg = "Dropped " + to_string(dropped) + " log messages (queue full or rate limited)";
+		write_record(LOG_WARNING, std::time(nullptr), msg.c_str(), msg.size());
+	}
+}
+
+// Called after queuing a message or dropping one. The fence pairs with
+// the one of writer(), so that either the writer sees the message or
+// this sees the writer waiting.
+void wake_writer()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(s_writer_waiting.load(std::memory_order_relaxed))
+	{
+		std::lock_guard<std::mutex> lock(s_wake_mtx);
+		s_wake.notify_one();
+	}
+}
+
+void writer()
+{
+	while(true)
+	{
+		// Check before draining, so that everything queued
+		// before stop_async() gets written
+		bool stop = s_stop.load(std::memory_order_acquire);
+
+		while(s_queue->pop(write_record))
+		{
+		}
+		report_drops();
+
+		if(stop)
+		{
+			break;
+		}
+
+		std::unique_lock<std::mutex> lock(s_wake_mtx);
+		s_writer_waiting.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		s_wake.wait(lock, []
+		{
+			return (s_stop.load(std::memory_order_acquire) ||
+				!s_queue->empty() ||
+				s_dropped.load(std::memory_order_relaxed) > 0);
+		});
+		s_writer_waiting.store(false, std::memory_order_relaxed);
+	}
+}
+
+}
+
+void falco_logger::start_async()
+{
+	std::unique_lock<std::mutex> lock(s_writer_mtx);
+	if(s_writer.joinable())
+	{
+		return;
+	}
+
+	if(s_queue == NULL)
+	{
+		s_queue = new log_queue();
+	}
+
+	if(!s_atexit_registered)
+	{
+		std::atexit(falco_logger::stop_async);
+		s_atexit_registered = true;
+	}
+
+	s_stop.store(false, std::memory_order_relaxed);
+	s_writer = std::thread(writer);
+	s_async.store(true, std::memory_order_release);
+}
+
+void falco_logger::stop_async()
+{
+	std::unique_lock<std::mutex> lock(s_writer_mtx);
+	if(!s_writer.joinable())
+	{
+		return;
+	}
+
+	// A log() call that saw s_async set before this store may
+	// still be queuing its message, so wait for it before the
+	// writer drains the queue for the last time. The producers
+	// never wait for room in the queue, so this is short.
+	s_async.store(false);
+	while(s_producers.load() != 0)
+	{
+		std::this_thread::yield();
+	}
+
+	s_stop.store(true, std::memory_order_release);
+	{
+		std::lock_guard<std::mutex> wake_lock(s_wake_mtx);
+		s_wake.notify_one();
+	}
+	s_writer.join();
+}
+
+void falco_logger::log(int priority, const string &msg)
+{
+
+	if(priority > falco_logger::level)
+	{
+		return;
+	}
+
+	std::time_t now = std::time(nullptr);
+
+	// Both seq_cst, with the store to s_async and the load of
+	// s_producers in stop_async(), so that either stop_async()
+	// waits for this message or this sees s_async unset
+	s_producers.fetch_add(1);
+	if(!s_async.load())
+	{
+		s_producers.fetch_sub(1, std::memory_order_release);
+		write_record(priority, now, msg.c_str(), msg.size());
+		return;
+	}
+
+	if((priority > LOG_ERR && over_rate(now)) ||
+	   !s_queue->push(priority, now, msg))
+	{
+		s_dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+	s_producers.fetch_sub(1, std::memory_order_release);
+
+	wake_writer();
+}
@@ -28,7 +28,20 @@ class falco_logger
 	// Will throw exception if level is unknown.
 	static void set_level(string &level);
 
-	static void log(int priority, const string msg);
+	// Level checks and rate limiting happen before the message is
+	// copied. Once start_async() has been called, the message is
+	// queued and written to syslog/stderr by a background thread,
+	// so that a slow syslog daemon or a blocked stderr can't stall
+	// the caller. Messages are dropped (and the drops reported
+	// later) rather than waiting for room in the queue.
+	static void log(int priority, const string &msg);
+
+	// Start/stop the background writer. stop_async() writes any
+	// queued message before returning, including those of the
+	// log() calls running concurrently. Both can be called more
+	// than once, and stop_async() is also called at exit.
+	static void start_async();
+	static void stop_async();
 
 	static int level;
 	static bool log_stderr;
@@ -0,0 +1,257 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+
+#include <nlohmann/json.hpp>
+
+#include "replay_bench.h"
+#include "statsfilewriter.h"
+#include "banned.h" // This raises a compilation error when certain functions are used
+
+using namespace std;
+
+#ifdef HAS_ALLOC_COUNTER
+// Counting the allocations of the whole process (the other
+// operator new variants end up calling this one). The counter is
+// constant-initialized, so it can be used before main().
+static std::atomic<uint64_t> s_num_allocations(0);
+
+void *operator new(std::size_t size)
+{
+	s_num_allocations.fetch_add(1, std::memory_order_relaxed);
+
+	void *p = malloc(size ? size : 1);
+	if(p == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, std::size_t size) noexcept
+{
+	free(p);
+}
+#endif
+
+static uint64_t timeval_ns(const struct timeval &tv)
+{
+	return tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+}
+
+replay_bench::replay_bench(falco_engine *engine, falco_outputs *outputs):
+	m_engine(engine),
+	m_outputs(outputs),
+	m_num_events(0),
+	m_num_alerts(0),
+	m_match_ns(0),
+	m_format_ns(0),
+	m_duration_ns(0),
+	m_start_allocs(-1),
+	m_stop_allocs(-1)
+{
+	memset(&m_start_usage, 0, sizeof(m_start_usage));
+	memset(&m_stop_usage, 0, sizeof(m_stop_usage));
+}
+
+replay_bench::~replay_bench()
+{
+}
+
+int64_t replay_bench::num_allocations()
+{
+#ifdef HAS_ALLOC_COUNTER
+	return s_num_allocations.load(std::memory_order_relaxed);
+#else
+	return -1;
+#endif
+}
+
+void replay_bench::start()
+{
+	getrusage(RUSAGE_SELF, &m_start_usage);
+	m_start_allocs = num_allocations();
+	m_start = std::chrono::steady_clock::now();
+}
+
+void replay_bench::stop()
+{
+	m_duration_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+	m_stop_allocs = num_allocations();
+	getrusage(RUSAGE_SELF, &m_stop_usage);
+}
+
+void replay_bench::process_event(std::string &source, gen_event *evt)
+{
+	auto t0 = std::chrono::steady_clock::now();
+
+	unique_ptr<falco_engine::rule_result> res = m_engine->process_event(source, evt);
+
+	auto t1 = std::chrono::steady_clock::now();
+	m_match_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+	m_num_events++;
+
+	if(res)
+	{
+		// This also formats the alert, the outputs only get
+		// the resulting message.
+		m_outputs->handle_event(res->evt, res->rule, res->source, res->priority_num, res->format, res->tags);
+
+		m_format_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t1).count();
+		m_num_alerts++;
+	}
+}
+
+bool replay_bench::replay_scap(sinsp *inspector, const std::string &filename,
+			       std::string &source, bool all_events,
+			       std::string &errstr)
+{
+	try
+	{
+		inspector->open(filename);
+	}
+	catch(sinsp_exception &e)
+	{
+		errstr = string("Could not open capture file: ") + e.what();
+		return false;
+	}
+
+	bool ok = true;
+	while(ok)
+	{
+		sinsp_evt *ev;
+		int32_t rc = inspector->next(&ev);
+
+		if(rc == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(rc == SCAP_EOF)
+		{
+			break;
+		}
+		else if(rc != SCAP_SUCCESS)
+		{
+			errstr = inspector->getlasterr();
+			ok = false;
+			break;
+		}
+
+		// Same as do_inspect()
+		if(!ev->simple_consumer_consider() && !all_events)
+		{
+			continue;
+		}
+
+		try
+		{
+			process_event(source, ev);
+		}
+		catch(falco_exception &e)
+		{
+			errstr = string("Could not process event: ") + e.what();
+			ok = false;
+		}
+	}
+
+	inspector->close();
+
+	return ok;
+}
+
+bool replay_bench::write_report(const std::string &filename,
+				const std::vector<std::string> &files,
+				uint32_t loops,
+				std::string &errstr)
+{
+	std::map<std::string, std::string> labels;
+	if(!StatsFileWriter::get_extra_labels(labels, errstr))
+	{
+		return false;
+	}
+
+	double secs = m_duration_ns / 1000000000.0;
+	uint64_t read_ns = m_duration_ns - std::min(m_duration_ns, m_match_ns + m_format_ns);
+
+	auto stage = [this](uint64_t ns) -> nlohmann::json {
+		nlohmann::json j;
+		j["secs"] = ns / 1000000000.0;
+		j["ns_per_event"] = (m_num_events > 0 ? (double) ns / m_num_events : 0);
+		return j;
+	};
+
+	nlohmann::json report;
+	report["files"] = files;
+	report["loops"] = loops;
+	report["events"] = m_num_events;
+	report["alerts"] = m_num_alerts;
+	report["secs"] = secs;
+	report["events_per_sec"] = (secs > 0 ? m_num_events / secs : 0);
+	report["alerts_per_sec"] = (secs > 0 ? m_num_alerts / secs : 0);
+
+	// Wall clock time, as the stages all run in this thread
+	report["stages"]["read"] = stage(read_ns);
+	report["stages"]["match"] = stage(m_match_ns);
+	report["stages"]["format"] = stage(m_format_ns);
+
+	// These also include the outputs thread
+	report["cpu_user_secs"] = (timeval_ns(m_stop_usage.ru_utime) - timeval_ns(m_start_usage.ru_utime)) / 1000000000.0;
+	report["cpu_sys_secs"] = (timeval_ns(m_stop_usage.ru_stime) - timeval_ns(m_start_usage.ru_stime)) / 1000000000.0;
+
+	// Of the whole process, loading the rules included
+	report["peak_rss_kb"] = m_stop_usage.ru_maxrss;
+
+	if(m_start_allocs >= 0 && m_num_events > 0)
+	{
+		report["allocs_per_event"] = (double) (m_stop_allocs - m_start_allocs) / m_num_events;
+	}
+	else
+	{
+		report["allocs_per_event"] = nullptr;
+	}
+
+	report["labels"] = labels;
+
+	if(filename.empty())
+	{
+		std::cout << report.dump(4) << std::endl;
+		return true;
+	}
+
+	std::ofstream out(filename);
+	out << report.dump(4) << std::endl;
+	if(!out.good())
+	{
+		errstr = "Could not write report to " + filename;
+		return false;
+	}
+
+	return true;
+}
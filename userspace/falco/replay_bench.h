@@ -0,0 +1,84 @@
+/*
+Copyright (C) 2022 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <sinsp.h>
+
+#include "falco_engine.h"
+#include "falco_outputs.h"
+
+// Measures the whole event pipeline (reading, rule matching and
+// alert formatting) over trace files replayed in a loop, for
+// --bench. Alerts go through falco_outputs as usual, but it is
+// expected to have no outputs configured.
+class replay_bench
+{
+public:
+	replay_bench(falco_engine *engine, falco_outputs *outputs);
+	virtual ~replay_bench();
+
+	// Mark the beginning and end of the measured replay. Any
+	// time not spent in process_event() in between is counted as
+	// reading the events.
+	void start();
+	void stop();
+
+	// Match an event against the rules, and format the alert if
+	// any. Throws falco_exception on errors.
+	void process_event(std::string &source, gen_event *evt);
+
+	// Read all the events in a capture file with inspector and
+	// pass them to process_event(). Returns false and fills in
+	// errstr on errors.
+	bool replay_scap(sinsp *inspector, const std::string &filename,
+			 std::string &source, bool all_events,
+			 std::string &errstr);
+
+	// Write the results as json to filename, or to the standard
+	// output if empty. Returns false and fills in errstr on
+	// errors.
+	bool write_report(const std::string &filename,
+			  const std::vector<std::string> &files,
+			  uint32_t loops,
+			  std::string &errstr);
+
+	// Number of allocations done by operator new so far, or -1
+	// if falco wasn't built with BUILD_FALCO_ALLOC_COUNTER.
+	static int64_t num_allocations();
+
+private:
+	falco_engine *m_engine;
+	falco_outputs *m_outputs;
+
+	uint64_t m_num_events;
+	uint64_t m_num_alerts;
+	uint64_t m_match_ns;
+	uint64_t m_format_ns;
+	uint64_t m_duration_ns;
+
+	std::chrono::steady_clock::time_point m_start;
+	struct rusage m_start_usage;
+	struct rusage m_stop_usage;
+	int64_t m_start_allocs;
+	int64_t m_stop_allocs;
+};
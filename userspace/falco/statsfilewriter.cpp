@@ -31,7 +31,7 @@ static void timer_handler (int signum)
 extern char **environ;
 
 StatsFileWriter::StatsFileWriter()
-	: m_num_stats(0), m_inspector(NULL)
+	: m_num_stats(0), m_inspector(NULL), m_latency(NULL)
 {
 }
 
@@ -40,12 +40,13 @@ StatsFileWriter::~StatsFileWriter()
 	m_output.close();
 }
 
-bool StatsFileWriter::init(sinsp *inspector, string &filename, uint32_t interval_msec, string &errstr)
+bool StatsFileWriter::init(sinsp *inspector, string &filename, uint32_t interval_msec, string &errstr, latency_stats *latency)
 {
 	struct itimerval timer;
 	struct sigaction handler;
 
 	m_inspector = inspector;
+	m_latency = latency;
 
 	m_output.exceptions ( ofstream::failbit | ofstream::badbit );
 	m_output.open(filename, ios_base::app);
@@ -67,9 +68,30 @@ bool StatsFileWriter::init(sinsp *inspector, string &filename, uint32_t interval
 		return false;
 	}
 
-	// (Undocumented) feature. Take any environment keys prefixed
-	// with FALCO_STATS_EXTRA_XXX and add them to the output. Used by
-	// run_performance_tests.sh.
+	std::map<std::string, std::string> labels;
+	if(!get_extra_labels(labels, errstr))
+	{
+		return false;
+	}
+
+	for(auto &it : labels)
+	{
+		if (m_extra != "")
+		{
+			m_extra += ", ";
+		}
+		m_extra += "\"" + it.first + "\": " + "\"" + it.second + "\"";
+	}
+
+	return true;
+}
+
+bool StatsFileWriter::get_extra_labels(std::map<std::string, std::string> &labels, string &errstr)
+{
+	// Take any environment keys prefixed with FALCO_STATS_EXTRA_XXX
+	// and return them as XXX. Used to tag the stats and the
+	// --bench reports with the details of a run (e.g. by
+	// test/utils/replay_bench.py).
 	for(uint32_t i=0; environ[i]; i++)
 	{
 		char *p = strstr(environ[i], "=");
@@ -82,12 +104,7 @@ bool StatsFileWriter::init(sinsp *inspector, string &filename, uint32_t interval
 		string val(p+1, strlen(environ[i])-(p-environ[i])-1);
 		if(key.compare(0, 18, "FALCO_STATS_EXTRA_") == 0)
 		{
-			string sub = key.substr(18);
-			if (m_extra != "")
-			{
-				m_extra += ", ";
-			}
-			m_extra += "\"" + sub + "\": " + "\"" + val + "\"";
+			labels[key.substr(18)] = val;
 		}
 	}
 
@@ -129,9 +146,49 @@ void StatsFileWriter::handle()
 			"\"events\": " << delta.n_evts <<
 			", \"drops\": " << delta.n_drops <<
 			", \"preemptions\": " << delta.n_preemptions <<
-			"}, \"drop_pct\": " << (delta.n_evts == 0 ? 0 : (100.0*delta.n_drops/delta.n_evts)) <<
-			"}," << endl;
+			"}, \"drop_pct\": " << (delta.n_evts == 0 ? 0 : (100.0*delta.n_drops/delta.n_evts));
+
+		if(m_latency)
+		{
+			write_latency();
+		}
+
+		m_output << "}," << endl;
 
 		m_last_stats = cstats;
 	}
 }
+
+void StatsFileWriter::write_latency()
+{
+	latency_stats::snapshots cur;
+	m_latency->get_snapshots(cur);
+
+	// Latencies (in ns) of the events seen since the last sample
+	m_output << ", \"latency\": {";
+	for(size_t i = 0; i < cur.size(); i++)
+	{
+		latency_histogram::snapshot delta;
+		if(i < m_last_latency.size())
+		{
+			delta = cur[i].second.delta(m_last_latency[i].second);
+		}
+		else
+		{
+			delta = cur[i].second;
+		}
+
+		m_output << (i == 0 ? "" : ", ") <<
+			"\"" << cur[i].first << "\": {" <<
+			"\"count\": " << delta.count <<
+			", \"p50\": " << delta.quantile(0.5) <<
+			", \"p90\": " << delta.quantile(0.9) <<
+			", \"p99\": " << delta.quantile(0.99) <<
+			", \"p999\": " << delta.quantile(0.999) <<
+			", \"max\": " << delta.quantile(1) <<
+			"}";
+	}
+	m_output << "}";
+
+	m_last_latency = cur;
+}
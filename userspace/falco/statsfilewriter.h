@@ -22,8 +22,11 @@ limitations under the License.
 
 #include <sinsp.h>
 
+#include "latency_stats.h"
+
 // Periodically collects scap stats files and writes them to a file as
-// json.
+// json, along with the alert latencies of the last interval if a
+// latency_stats is given.
 
 class StatsFileWriter {
 public:
@@ -33,16 +36,26 @@ public:
 	// Returns success as bool. On false fills in errstr.
 	bool init(sinsp *inspector, std::string &filename,
 		  uint32_t interval_msec,
-		  string &errstr);
+		  string &errstr,
+		  latency_stats *latency = NULL);
 
 	// Should be called often (like for each event in a sinsp
 	// loop).
 	void handle();
 
+	// Fills in labels with the FALCO_STATS_EXTRA_XXX environment
+	// variables, keyed by XXX. Returns false and fills in errstr
+	// on errors.
+	static bool get_extra_labels(std::map<std::string, std::string> &labels, std::string &errstr);
+
 protected:
+	void write_latency();
+
 	uint32_t m_num_stats;
 	sinsp *m_inspector;
 	std::ofstream m_output;
 	std::string m_extra;
 	scap_stats m_last_stats;
+	latency_stats *m_latency;
+	latency_stats::snapshots m_last_latency;
 };
@@ -14,17 +14,121 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#pragma once
+
 #include <chrono>
 #include <thread>
 #include <functional>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <list>
+#include <type_traits>
+
+//
+// A single thread checking the deadlines of all the watchdogs, so
+// that there's no thread per watchdog.
+//
+class watchdog_timer
+{
+public:
+	// Anything with a deadline, checked at every tick of the
+	// timer thread.
+	class client
+	{
+	public:
+		virtual ~client() {}
+		virtual void check(std::chrono::steady_clock::time_point now) = 0;
+	};
+
+	static watchdog_timer &instance()
+	{
+		static watchdog_timer s_timer;
+		return s_timer;
+	}
+
+	// Once remove() returns, check() isn't running on c and won't
+	// be called anymore.
+	void add(client *c)
+	{
+		std::unique_lock<std::mutex> lock(m_mtx);
+		m_clients.push_back(c);
+		if(!m_thread.joinable())
+		{
+			m_thread = std::thread(&watchdog_timer::run, this);
+		}
+	}
+
+	void remove(client *c)
+	{
+		std::unique_lock<std::mutex> lock(m_mtx);
+		m_clients.remove(c);
+	}
+
+private:
+	watchdog_timer():
+		m_stop(false)
+	{
+	}
 
+	~watchdog_timer()
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mtx);
+			m_stop = true;
+		}
+		m_cv.notify_one();
+		if(m_thread.joinable())
+		{
+			m_thread.join();
+		}
+	}
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(m_mtx);
+		while(!m_stop)
+		{
+			// Callbacks run with the lock held, which is
+			// what makes remove() synchronous.
+			auto now = std::chrono::steady_clock::now();
+			for(auto c : m_clients)
+			{
+				c->check(now);
+			}
+			// Deadlines are honored within this delay
+			m_cv.wait_for(lock, std::chrono::milliseconds(10));
+		}
+	}
+
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	std::list<client *> m_clients;
+	bool m_stop;
+	std::thread m_thread;
+};
+
+//
+// Calls a callback when a deadline passes without being cancelled
+// or replaced. set_timeout() and cancel_timeout() never allocate
+// nor block, so they can be called for every message: the deadline
+// and payload are published through a seqlock that the shared timer
+// thread reads. They must always be called from the same thread.
+//
+// The callback runs in the timer thread, so it should be quick.
+//
 template<typename _T>
-class watchdog
+class watchdog : private watchdog_timer::client
 {
+	static_assert(std::is_trivially_copyable<_T>::value,
+		      "watchdog payloads are copied without locks and must be trivially copyable");
+
 public:
 	watchdog():
-		m_timeout(nullptr),
+		m_seq(0),
+		m_deadline(0),
+		m_payload(_T()),
+		m_fired_seq(0),
 		m_is_running(false)
 	{
 	}
@@ -34,63 +138,82 @@ public:
 		stop();
 	}
 
-	void start(std::function<void(_T)> cb,
-		   std::chrono::milliseconds resolution = std::chrono::milliseconds(100))
+	void start(std::function<void(_T)> cb)
 	{
 		stop();
-		m_is_running.store(true, std::memory_order_release);
-		m_thread = std::thread([this, cb, resolution]() {
-			const auto no_deadline = time_point{};
-			timeout_data curr;
-			while(m_is_running.load(std::memory_order_acquire))
-			{
-				auto t = m_timeout.exchange(nullptr, std::memory_order_release);
-				if(t)
-				{
-					curr = *t;
-					delete t;
-				}
-				if(curr.deadline != no_deadline && curr.deadline < std::chrono::steady_clock::now())
-				{
-					cb(curr.payload);
-					curr.deadline = no_deadline;
-				}
-				std::this_thread::sleep_for(resolution);
-			}
-		});
+		m_cb = cb;
+		m_fired_seq = m_seq.load(std::memory_order_relaxed);
+		m_is_running = true;
+		watchdog_timer::instance().add(this);
 	}
 
 	void stop()
 	{
-		if(m_is_running.load(std::memory_order_acquire))
+		if(m_is_running)
 		{
-			m_is_running.store(false, std::memory_order_release);
-			if(m_thread.joinable())
-			{
-				m_thread.join();
-			}
-			delete m_timeout.exchange(nullptr, std::memory_order_release);
+			m_is_running = false;
+			watchdog_timer::instance().remove(this);
 		}
 	}
 
 	inline void set_timeout(std::chrono::milliseconds timeout, _T payload) noexcept
 	{
-		delete m_timeout.exchange(new timeout_data{std::chrono::steady_clock::now() + timeout, payload}, std::memory_order_release);
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		write(deadline.time_since_epoch().count(), payload);
 	}
 
 	inline void cancel_timeout() noexcept
 	{
-		delete m_timeout.exchange(new timeout_data, std::memory_order_release);
+		write(0, _T());
 	}
 
 private:
-	typedef std::chrono::time_point<std::chrono::steady_clock> time_point;
-	struct timeout_data
+	// Only called by the thread owning the watchdog
+	inline void write(int64_t deadline, _T payload) noexcept
 	{
-		time_point deadline;
-		_T payload;
-	};
-	std::atomic<timeout_data *> m_timeout;
-	std::atomic<bool> m_is_running;
-	std::thread m_thread;
-};
\ No newline at end of file
+		uint64_t seq = m_seq.load(std::memory_order_relaxed);
+
+		// An odd sequence number means a write is in progress
+		m_seq.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_deadline.store(deadline, std::memory_order_relaxed);
+		m_payload.store(payload, std::memory_order_relaxed);
+		m_seq.store(seq + 2, std::memory_order_release);
+	}
+
+	// Called by the timer thread
+	void check(std::chrono::steady_clock::time_point now) override
+	{
+		uint64_t seq = m_seq.load(std::memory_order_acquire);
+
+		// Being written (checked again at the next tick), or
+		// already fired for this deadline
+		if((seq & 1) || seq == m_fired_seq)
+		{
+			return;
+		}
+
+		int64_t deadline = m_deadline.load(std::memory_order_relaxed);
+		_T payload = m_payload.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if(m_seq.load(std::memory_order_relaxed) != seq ||
+		   deadline == 0 ||
+		   deadline > now.time_since_epoch().count())
+		{
+			return;
+		}
+
+		m_fired_seq = seq;
+		m_cb(payload);
+	}
+
+	std::atomic<uint64_t> m_seq;
+	std::atomic<int64_t> m_deadline;
+	std::atomic<_T> m_payload;
+
+	// Only used by the timer thread, after start()
+	uint64_t m_fired_seq;
+	std::function<void(_T)> m_cb;
+	bool m_is_running;
+};
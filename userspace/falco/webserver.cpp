@@ -14,12 +14,21 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <chrono>
 
 #include "falco_common.h"
 #include "webserver.h"
 #include "json_evt.h"
+#include "logger.h"
+#include "falco_probes.h"
 #include "banned.h" // This raises a compilation error when certain functions are used
 
 using json = nlohmann::json;
@@ -27,8 +36,237 @@ using namespace std;
 
 string k8s_audit_handler::m_k8s_audit_event_source = "k8s_audit";
 
-k8s_audit_handler::k8s_audit_handler(falco_engine *engine, falco_outputs *outputs):
-	m_engine(engine), m_outputs(outputs)
+#ifdef HAS_SIMDJSON
+// Http request bodies up to this size are read whole and parsed with
+// simdjson, larger ones are parsed as they're read
+static const uint64_t s_max_whole_body_size = 1024 * 1024;
+
+// Size of each read of a body read whole
+static const size_t s_body_read_size = 64 * 1024;
+#endif
+
+#ifdef HAS_SIMDJSON
+// Parse a whole request at once with simdjson, passing each event to cb.
+static bool parse_simd(const char *data, size_t len,
+		       falco_k8s_audit::event_stream_parser::callback_t cb,
+		       std::string &errstr)
+{
+	// Parsers keep their buffers between documents, so reuse
+	// one per thread.
+	static thread_local simdjson::dom::parser s_parser;
+	std::list<json_event> evts;
+
+	if(!falco_k8s_audit::parse_k8s_audit_data(s_parser, data, len, evts, errstr))
+	{
+		return false;
+	}
+
+	for(auto &evt : evts)
+	{
+		if(!cb(evt, errstr))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+#endif
+
+// Parse a buffer holding one or more events, passing each event to cb.
+static bool parse_buffer(const char *data, size_t len,
+			 falco_k8s_audit::event_stream_parser::callback_t cb,
+			 std::string &errstr)
+{
+#ifdef HAS_SIMDJSON
+	return parse_simd(data, len, cb, errstr);
+#else
+	falco_k8s_audit::event_stream_parser parser;
+	size_t pos = 0;
+
+	auto reader = [data, len, &pos](char *buf, size_t size) -> int64_t {
+		size_t n = std::min(size, len - pos);
+		memcpy(buf, data + pos, n);
+		pos += n;
+		return n;
+	};
+
+	return parser.parse(reader, cb, errstr);
+#endif
+}
+
+k8s_audit_worker_pool::k8s_audit_worker_pool(falco_outputs *outputs, uint64_t queue_size):
+	m_outputs(outputs),
+	m_queue_size(queue_size),
+	m_running(false),
+	m_waiting_producers(0)
+{
+	m_queue.set_capacity(m_queue_size);
+}
+
+k8s_audit_worker_pool::~k8s_audit_worker_pool()
+{
+	stop();
+}
+
+void k8s_audit_worker_pool::start(engine_factory_t engine_factory, uint32_t num_workers)
+{
+	// The engines are created up front so that any error loading
+	// rules is reported before the webserver accepts requests.
+	for(uint32_t i = 0; i < num_workers; i++)
+	{
+		m_engines.emplace_back(engine_factory());
+	}
+
+	for(auto &engine : m_engines)
+	{
+		m_threads.emplace_back(&k8s_audit_worker_pool::worker, this, engine.get());
+	}
+
+	m_running = true;
+}
+
+void k8s_audit_worker_pool::stop()
+{
+	if(!m_running)
+	{
+		return;
+	}
+
+	m_running = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_enqueue_mtx);
+		for(size_t i = 0; i < m_threads.size(); i++)
+		{
+			m_queue.push(std::shared_ptr<json_event>());
+		}
+		m_room.notify_all();
+	}
+
+	for(auto &thread : m_threads)
+	{
+		thread.join();
+	}
+
+	m_threads.clear();
+	m_engines.clear();
+}
+
+bool k8s_audit_worker_pool::running()
+{
+	return m_running;
+}
+
+bool k8s_audit_worker_pool::full()
+{
+	return m_queue.size() >= m_queue_size;
+}
+
+uint64_t k8s_audit_worker_pool::room()
+{
+	int64_t queued = std::max<int64_t>(m_queue.size(), 0);
+	return (uint64_t) std::max<int64_t>(m_queue_size - queued, 0);
+}
+
+uint64_t k8s_audit_worker_pool::queue_size()
+{
+	return m_queue_size;
+}
+
+bool k8s_audit_worker_pool::has_room(size_t num_evts)
+{
+	// size() includes pending pops as negative values, and only
+	// shrinks while we hold the lock, so the events are
+	// guaranteed to fit.
+	int64_t queued = std::max<int64_t>(m_queue.size(), 0);
+	return (queued + (int64_t) num_evts <= m_queue_size);
+}
+
+bool k8s_audit_worker_pool::enqueue(std::list<std::shared_ptr<json_event>> &evts)
+{
+	std::lock_guard<std::mutex> lock(m_enqueue_mtx);
+
+	if(!m_running || !has_room(evts.size()))
+	{
+		return false;
+	}
+
+	for(auto &evt : evts)
+	{
+		m_queue.push(evt);
+	}
+
+	return true;
+}
+
+bool k8s_audit_worker_pool::enqueue(std::list<std::shared_ptr<json_event>> &evts,
+				    std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lock(m_enqueue_mtx);
+
+	// The fence pairs with the one of worker(), so that either
+	// the room made by a worker is seen here or the worker sees
+	// this producer waiting and wakes it up.
+	m_waiting_producers++;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	bool room = m_room.wait_for(lock, timeout, [this, &evts]()
+	{
+		return (!m_running || has_room(evts.size()));
+	});
+	m_waiting_producers--;
+
+	if(!room || !m_running)
+	{
+		return false;
+	}
+
+	for(auto &evt : evts)
+	{
+		m_queue.push(evt);
+	}
+
+	return true;
+}
+
+void k8s_audit_worker_pool::worker(falco_engine *engine)
+{
+	std::shared_ptr<json_event> evt;
+	std::string errstr;
+
+	while(true)
+	{
+		m_queue.pop(evt);
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(m_waiting_producers.load(std::memory_order_relaxed) > 0)
+		{
+			std::lock_guard<std::mutex> lock(m_enqueue_mtx);
+			m_room.notify_all();
+		}
+
+		if(!evt)
+		{
+			break;
+		}
+
+		// Errors are reported by process_event(), and
+		// there's no client left to return them to.
+		k8s_audit_handler::process_event(engine, m_outputs, *evt, errstr);
+	}
+}
+
+k8s_audit_handler::k8s_audit_handler(falco_engine *engine, falco_outputs *outputs,
+				     k8s_audit_worker_pool *pool,
+				     uint64_t max_request_size, uint64_t max_event_size,
+				     uint64_t max_pending_size, uint32_t retry_after):
+	m_engine(engine),
+	m_outputs(outputs),
+	m_pool(pool),
+	m_max_request_size(max_request_size),
+	m_max_event_size(max_event_size),
+	m_max_pending_size(max_pending_size),
+	m_retry_after(retry_after)
 {
 }
 
@@ -45,140 +283,668 @@ bool k8s_healthz_handler::handleGet(CivetServer *server, struct mg_connection *c
 	return true;
 }
 
+bool metrics_handler::handleGet(CivetServer *server, struct mg_connection *conn)
+{
+	const std::string body = m_latency->to_prometheus();
+	mg_send_http_ok(conn, "text/plain; version=0.0.4", body.size());
+	mg_write(conn, body.data(), body.size());
+
+	return true;
+}
+
 bool k8s_audit_handler::accept_data(falco_engine *engine,
 				    falco_outputs *outputs,
 				    std::string &data,
 				    std::string &errstr)
 {
-	std::list<json_event> jevts;
-	json j;
+	auto process = [engine, outputs](json_event &jev, std::string &errstr) -> bool {
+		return process_event(engine, outputs, jev, errstr);
+	};
+
+	FALCO_PROBE1(k8s_audit_accept_entry, (int64_t) data.size());
+	bool ret = parse_buffer(data.data(), data.size(), process, errstr);
+	FALCO_PROBE2(k8s_audit_accept_return, (int64_t) data.size(), ret);
+
+	return ret;
+}
+
+bool k8s_audit_handler::accept_data(falco_engine *engine,
+				    falco_outputs *outputs,
+				    falco_k8s_audit::event_stream_parser &parser,
+				    falco_k8s_audit::event_stream_parser::reader_t reader,
+				    std::string &errstr)
+{
+	auto process = [engine, outputs](json_event &jev, std::string &errstr) -> bool {
+		return process_event(engine, outputs, jev, errstr);
+	};
+
+	// The size isn't known upfront when streaming
+	FALCO_PROBE1(k8s_audit_accept_entry, (int64_t) -1);
+	bool ret = parser.parse(reader, process, errstr);
+	FALCO_PROBE2(k8s_audit_accept_return, (int64_t) -1, ret);
+
+	return ret;
+}
+
+bool k8s_audit_handler::process_event(falco_engine *engine,
+				      falco_outputs *outputs,
+				      json_event &jev, std::string &errstr)
+{
+	std::unique_ptr<falco_engine::rule_result> res;
 
 	try
 	{
-		j = json::parse(data);
+		res = engine->process_event(m_k8s_audit_event_source, &jev);
 	}
-	catch(json::parse_error &e)
+	catch(...)
 	{
-		errstr = string("Could not parse data: ") + e.what();
+		errstr = string("unknown error processing audit event");
+		fprintf(stderr, "%s\n", errstr.c_str());
 		return false;
 	}
-	catch(json::out_of_range &e)
+
+	if(res)
 	{
-		errstr = string("Could not parse data: ") + e.what();
-		return false;
+		try
+		{
+			outputs->handle_event(res->evt, res->rule,
+					      res->source, res->priority_num,
+					      res->format, res->tags);
+		}
+		catch(falco_exception &e)
+		{
+			errstr = string("Internal error handling output: ") + e.what();
+			fprintf(stderr, "%s\n", errstr.c_str());
+			return false;
+		}
 	}
 
-	bool ok;
-	try
+	return true;
+}
+
+void k8s_audit_handler::send_retry_later(struct mg_connection *conn, int status, const std::string &msg)
+{
+	std::string retry_after = to_string(m_retry_after);
+	std::string content_length = to_string(msg.size());
+
+	mg_response_header_start(conn, status);
+	mg_response_header_add(conn, "Retry-After", retry_after.c_str(), -1);
+	mg_response_header_add(conn, "Content-Type", "text/plain; charset=utf-8", -1);
+	mg_response_header_add(conn, "Content-Length", content_length.c_str(), -1);
+	mg_response_header_send(conn);
+	mg_write(conn, msg.c_str(), msg.size());
+}
+
+bool k8s_audit_handler::handleGet(CivetServer *server, struct mg_connection *conn)
+{
+	mg_send_http_error(conn, 405, "GET method not allowed");
+
+	return true;
+}
+
+bool k8s_audit_handler::handlePost(CivetServer *server, struct mg_connection *conn)
+{
+	// Ensure that the content-type is application/json
+	const char *ct = server->getHeader(conn, string("Content-Type"));
+
+	// content type *must* start with application/json
+	if(ct == NULL || strncmp(ct, "application/json", strlen("application/json")) != 0)
 	{
-		ok = falco_k8s_audit::parse_k8s_audit_json(j, jevts);
+		mg_send_http_error(conn, 400, "Wrong Content Type");
+
+		return true;
 	}
-	catch(json::type_error &e)
+
+	// Reject requests that announce a body that's too large
+	// before reading any of it. Chunked requests have a
+	// content_length of -1 and are limited while reading.
+	const struct mg_request_info *info = mg_get_request_info(conn);
+	if(m_max_request_size > 0 &&
+	   info->content_length > 0 &&
+	   (uint64_t) info->content_length > m_max_request_size)
 	{
-		ok = false;
+		mg_send_http_error(conn, 413, "Payload Too Large: request exceeds the maximum size of %lu bytes", m_max_request_size);
+
+		return true;
 	}
-	if(!ok)
+
+	// Don't bother reading the request if it can't be queued
+	if(m_pool && !m_pool->running())
 	{
-		errstr = string("Data not recognized as a k8s audit event");
-		return false;
+		send_retry_later(conn, 503, "Service Unavailable: not accepting audit events");
+
+		return true;
 	}
 
-	for(auto &jev : jevts)
+	if(m_pool && m_pool->full())
 	{
-		std::unique_ptr<falco_engine::rule_result> res;
+		send_retry_later(conn, 429, "Too Many Requests: audit event queue is full");
 
-		try
+		return true;
+	}
+
+	falco_k8s_audit::event_stream_parser parser(m_max_request_size, m_max_event_size);
+	std::list<std::shared_ptr<json_event>> evts;
+	std::string errstr;
+	bool ok;
+
+	// The bytes of the body read so far
+	uint64_t body_read = 0;
+
+	// Set when the parsed events can't be queued, to stop parsing
+	// and reject the request with this status
+	int reject_status = 0;
+
+	// The body is parsed as it's read, so that the raw request is
+	// never held in memory, only the parsed events.
+	auto reader = [conn, &body_read](char *buf, size_t len) -> int64_t {
+		int n = mg_read(conn, buf, len);
+		body_read += std::max(n, 0);
+		return n;
+	};
+
+	falco_k8s_audit::event_stream_parser::callback_t cb;
+	if(m_pool)
+	{
+		// Events are only queued once the whole request has
+		// been parsed, so that a request is either queued or
+		// rejected as a whole and retrying it doesn't
+		// duplicate alerts. Parsing stops as soon as the
+		// request can't be queued, so the events held are
+		// bounded by the room in the queue and
+		// max_pending_size.
+		cb = [this, &evts, &body_read, &reject_status](json_event &jev, std::string &errstr) -> bool {
+			// A request that can't ever fit in the queue
+			// must not be retried
+			if(evts.size() >= m_pool->queue_size())
+			{
+				errstr = "request contains more than " + to_string(m_pool->queue_size()) + " events";
+				reject_status = 413;
+				return false;
+			}
+
+			if(m_max_pending_size > 0 && body_read > m_max_pending_size)
+			{
+				errstr = "request exceeds the maximum size of " + to_string(m_max_pending_size) + " bytes for queued events";
+				reject_status = 413;
+				return false;
+			}
+
+			if(evts.size() >= m_pool->room())
+			{
+				errstr = "audit event queue is full";
+				reject_status = 429;
+				return false;
+			}
+
+			evts.push_back(std::make_shared<json_event>(jev));
+			return true;
+		};
+	}
+	else
+	{
+		cb = [this](json_event &jev, std::string &errstr) -> bool {
+			return process_event(m_engine, m_outputs, jev, errstr);
+		};
+	}
+
+	// content_length is -1 for chunked requests
+	FALCO_PROBE1(k8s_audit_accept_entry, (int64_t) info->content_length);
+	mg_lock_connection(conn);
+#ifdef HAS_SIMDJSON
+	// Small bodies of a known size are faster to read whole and
+	// parse with simdjson. They're no larger than an event, so
+	// none of their events can exceed the maximum event size. The
+	// buffer grows as the body is read rather than up to its
+	// announced size, which a client could stall before sending.
+	if(info->content_length > 0 &&
+	   (uint64_t) info->content_length <= s_max_whole_body_size &&
+	   (m_max_event_size == 0 || (uint64_t) info->content_length <= m_max_event_size))
+	{
+		std::string body;
+		size_t len = 0;
+		int n = 1;
+
+		while(len < (size_t) info->content_length && n > 0)
+		{
+			body.resize(std::min<size_t>(len + s_body_read_size, info->content_length));
+			n = mg_read(conn, &body[len], body.size() - len);
+			len += std::max(n, 0);
+		}
+
+		if(len < (size_t) info->content_length)
 		{
-			res = engine->process_event(m_k8s_audit_event_source, &jev);
+			errstr = "Could not read data";
+			ok = false;
 		}
-		catch(...)
+		else
 		{
-			errstr = string("unknown error processing audit event");
-			fprintf(stderr, "%s\n", errstr.c_str());
-			return false;
+			body_read = len;
+			ok = parse_simd(body.data(), body.size(), cb, errstr);
+		}
+	}
+	else
+#endif
+	{
+		ok = parser.parse(reader, cb, errstr);
+	}
+	mg_unlock_connection(conn);
+	FALCO_PROBE2(k8s_audit_accept_return, (int64_t) info->content_length, ok);
+
+	if(!ok)
+	{
+		// The rest of the body isn't read, and the client is
+		// told to retry later only if the request could fit.
+		if(reject_status == 429)
+		{
+			send_retry_later(conn, 429, "Too Many Requests: " + errstr);
+		}
+		else if(reject_status == 413 || parser.limit_exceeded())
+		{
+			errstr = "Payload Too Large: " + errstr;
+			mg_send_http_error(conn, 413, "%s", errstr.c_str());
+		}
+		else
+		{
+			errstr = "Bad Request: " + errstr;
+			mg_send_http_error(conn, 400, "%s", errstr.c_str());
 		}
 
-		if(res)
+		return true;
+	}
+
+	if(m_pool)
+	{
+		if(!m_pool->enqueue(evts))
 		{
-			try
+			if(m_pool->running())
 			{
-				outputs->handle_event(res->evt, res->rule,
-						      res->source, res->priority_num,
-						      res->format, res->tags);
+				send_retry_later(conn, 429, "Too Many Requests: audit event queue is full");
 			}
-			catch(falco_exception &e)
+			else
 			{
-				errstr = string("Internal error handling output: ") + e.what();
-				fprintf(stderr, "%s\n", errstr.c_str());
-				return false;
+				send_retry_later(conn, 503, "Service Unavailable: not accepting audit events");
 			}
+
+			return true;
 		}
+
+		const std::string accepted_body = "<html><body>Accepted</body></html>";
+		mg_response_header_start(conn, 202);
+		mg_response_header_add(conn, "Content-Type", "text/html", -1);
+		mg_response_header_add(conn, "Content-Length", to_string(accepted_body.size()).c_str(), -1);
+		mg_response_header_send(conn);
+		mg_printf(conn, "%s", accepted_body.c_str());
+
+		return true;
 	}
 
+	const std::string ok_body = "<html><body>Ok</body></html>";
+	mg_send_http_ok(conn, "text/html", ok_body.size());
+	mg_printf(conn, "%s", ok_body.c_str());
+
 	return true;
 }
 
-bool k8s_audit_handler::accept_uploaded_data(std::string &post_data, std::string &errstr)
+// Size of each read from a client of k8s_audit_socket_server
+static const size_t s_socket_read_size = 64 * 1024;
+
+// Connections served at once by k8s_audit_socket_server. Further
+// clients wait in the listen backlog until one is closed.
+static const size_t s_max_socket_connections = 64;
+
+// Bounds of the delay before accepting connections again after a
+// transient error, e.g. when running out of descriptors
+static const std::chrono::milliseconds s_min_accept_backoff(10);
+static const std::chrono::milliseconds s_max_accept_backoff(1000);
+
+bool k8s_audit_socket_server::parse_framing(const std::string &name, framing &fr)
 {
-	return k8s_audit_handler::accept_data(m_engine, m_outputs, post_data, errstr);
+	if(name == "newline")
+	{
+		fr = FRAMING_NEWLINE;
+		return true;
+	}
+
+	if(name == "length")
+	{
+		fr = FRAMING_LENGTH;
+		return true;
+	}
+
+	return false;
 }
 
-bool k8s_audit_handler::handleGet(CivetServer *server, struct mg_connection *conn)
+k8s_audit_socket_server::k8s_audit_socket_server(k8s_audit_worker_pool *pool,
+						 uint64_t max_event_size, framing fr):
+	m_pool(pool),
+	m_max_event_size(max_event_size),
+	m_framing(fr),
+	m_listen_fd(-1),
+	m_running(false)
 {
-	mg_send_http_error(conn, 405, "GET method not allowed");
+}
 
-	return true;
+k8s_audit_socket_server::~k8s_audit_socket_server()
+{
+	stop();
 }
 
-// The version in CivetServer.cpp has valgrind complaints due to
-// unguarded initialization of c++ string from buffer.
-static void get_post_data(struct mg_connection *conn, std::string &postdata)
+void k8s_audit_socket_server::start(const std::string &path)
 {
-	mg_lock_connection(conn);
-	char buf[2048];
-	int r = mg_read(conn, buf, sizeof(buf));
-	while(r > 0)
+	struct sockaddr_un addr;
+
+	if(path.size() >= sizeof(addr.sun_path))
 	{
-		postdata.append(buf, r);
-		r = mg_read(conn, buf, sizeof(buf));
+		throw falco_exception("Could not create k8s audit socket " + path + ": path is too long");
 	}
-	mg_unlock_connection(conn);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path.c_str(), path.size());
+
+	// Remove any socket left behind by a previous run
+	unlink(path.c_str());
+
+	m_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(m_listen_fd < 0)
+	{
+		throw falco_exception("Could not create k8s audit socket " + path + ": " + strerror(errno));
+	}
+
+	if(bind(m_listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	   listen(m_listen_fd, SOMAXCONN) < 0)
+	{
+		std::string err = strerror(errno);
+		close(m_listen_fd);
+		m_listen_fd = -1;
+		throw falco_exception("Could not listen on k8s audit socket " + path + ": " + err);
+	}
+
+	m_path = path;
+	m_running = true;
+	m_accept_thread = std::thread(&k8s_audit_socket_server::accept_connections, this);
 }
 
-bool k8s_audit_handler::handlePost(CivetServer *server, struct mg_connection *conn)
+void k8s_audit_socket_server::stop()
 {
-	// Ensure that the content-type is application/json
-	const char *ct = server->getHeader(conn, string("Content-Type"));
+	if(!m_running)
+	{
+		return;
+	}
 
-	// content type *must* start with application/json
-	if(ct == NULL || strncmp(ct, "application/json", strlen("application/json")) != 0)
+	m_running = false;
+
+	// Wakes up the thread waiting to accept connections, either in
+	// accept() or for a connection to be closed
 	{
-		mg_send_http_error(conn, 400, "Wrong Content Type");
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_state_changed.notify_all();
+	}
+	shutdown(m_listen_fd, SHUT_RDWR);
+	m_accept_thread.join();
+	close(m_listen_fd);
+	m_listen_fd = -1;
 
-		return true;
+	// Wakes up the threads blocked in read(), and waits for them
+	// to remove their connection. The descriptors are only closed
+	// once their thread is done with them.
+	{
+		std::unique_lock<std::mutex> lock(m_mtx);
+		for(auto &conn : m_connections)
+		{
+			shutdown(conn->fd, SHUT_RDWR);
+		}
+
+		m_state_changed.wait(lock, [this]()
+		{
+			return m_connections.empty();
+		});
 	}
 
-	std::string post_data;
-	get_post_data(conn, post_data);
+	unlink(m_path.c_str());
+}
+
+void k8s_audit_socket_server::accept_connections()
+{
+	std::chrono::milliseconds backoff(0);
+
+	while(m_running)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mtx);
+			m_state_changed.wait(lock, [this]()
+			{
+				return (!m_running || m_connections.size() < s_max_socket_connections);
+			});
+		}
+
+		int fd = accept4(m_listen_fd, NULL, NULL, SOCK_CLOEXEC);
+		if(fd < 0)
+		{
+			if(errno == EINTR || errno == ECONNABORTED)
+			{
+				continue;
+			}
+
+			if(!m_running)
+			{
+				break;
+			}
+
+			// Running out of descriptors or memory doesn't
+			// last, so keep listening rather than leaving the
+			// socket without a listener. The error is only
+			// logged once until a connection is accepted.
+			if(errno == EMFILE || errno == ENFILE ||
+			   errno == ENOBUFS || errno == ENOMEM)
+			{
+				if(backoff.count() == 0)
+				{
+					falco_logger::log(LOG_ERR, string("Could not accept connection on k8s audit socket, retrying: ") + strerror(errno) + "\n");
+					backoff = s_min_accept_backoff;
+				}
+				else
+				{
+					backoff = std::min(backoff * 2, s_max_accept_backoff);
+				}
+
+				std::unique_lock<std::mutex> lock(m_mtx);
+				m_state_changed.wait_for(lock, backoff, [this]()
+				{
+					return !m_running;
+				});
+				continue;
+			}
+
+			falco_logger::log(LOG_ERR, string("Could not accept connection on k8s audit socket: ") + strerror(errno) + "\n");
+			break;
+		}
+
+		backoff = std::chrono::milliseconds(0);
+
+		std::lock_guard<std::mutex> lock(m_mtx);
+		if(!m_running)
+		{
+			close(fd);
+			break;
+		}
+
+		m_connections.emplace_back(new connection());
+		connection *conn = m_connections.back().get();
+		conn->fd = fd;
+		std::thread(&k8s_audit_socket_server::read_connection, this, conn).detach();
+	}
+}
+
+void k8s_audit_socket_server::read_connection(connection *conn)
+{
+	// Holds the data read but not processed yet. Messages are
+	// processed in place, and the consumed data is only removed
+	// after each read.
+	std::string buf;
 	std::string errstr;
+	bool ok = true;
+
+	while(ok && m_running)
+	{
+		size_t size = buf.size();
+		buf.resize(size + s_socket_read_size);
+
+		ssize_t n = read(conn->fd, &buf[size], s_socket_read_size);
+		if(n < 0 && errno == EINTR)
+		{
+			buf.resize(size);
+			continue;
+		}
+
+		buf.resize(size + std::max<ssize_t>(n, 0));
+		if(n <= 0)
+		{
+			// A last line without a newline is still a message
+			if(m_framing == FRAMING_NEWLINE &&
+			   buf.find_first_not_of(" \t\r\n") != string::npos &&
+			   !process_message(buf.data(), buf.size(), errstr))
+			{
+				falco_logger::log(LOG_WARNING, "Dropping k8s audit events from unix socket: " + errstr + "\n");
+			}
+			break;
+		}
+
+		size_t pos = 0;
+		while(ok)
+		{
+			const char *msg = buf.data() + pos;
+			size_t len;
+			size_t next;
+
+			if(m_framing == FRAMING_NEWLINE)
+			{
+				size_t eol = buf.find('\n', pos);
+				if(eol == string::npos)
+				{
+					if(m_max_event_size > 0 && buf.size() - pos > m_max_event_size)
+					{
+						errstr = "message exceeds the maximum size of " + to_string(m_max_event_size) + " bytes";
+						ok = false;
+					}
+					break;
+				}
+
+				len = eol - pos;
+				if(len > 0 && msg[len - 1] == '\r')
+				{
+					len--;
+				}
+				next = eol + 1;
+			}
+			else
+			{
+				if(buf.size() - pos < sizeof(uint32_t))
+				{
+					break;
+				}
+
+				uint32_t nlen;
+				memcpy(&nlen, msg, sizeof(nlen));
+				len = ntohl(nlen);
+				if(m_max_event_size > 0 && len > m_max_event_size)
+				{
+					errstr = "message exceeds the maximum size of " + to_string(m_max_event_size) + " bytes";
+					ok = false;
+					break;
+				}
+
+				if(buf.size() - pos - sizeof(uint32_t) < len)
+				{
+					break;
+				}
+
+				msg += sizeof(uint32_t);
+				next = pos + sizeof(uint32_t) + len;
+			}
+
+			// Bad messages are only logged, as there's no way
+			// to report them to the client, and the following
+			// ones are likely fine.
+			std::string msg_errstr;
+			if(len > 0 && !process_message(msg, len, msg_errstr))
+			{
+				falco_logger::log(LOG_WARNING, "Dropping k8s audit events from unix socket: " + msg_errstr + "\n");
+			}
 
-	if(!accept_uploaded_data(post_data, errstr))
+			pos = next;
+		}
+
+		buf.erase(0, pos);
+	}
+
+	if(!ok)
+	{
+		falco_logger::log(LOG_ERR, "Closing k8s audit unix socket connection: " + errstr + "\n");
+	}
+
+	// The connection is removed as soon as it's closed, rather
+	// than when the next one is accepted. stop() waits for this
+	// before returning, so the server is still there.
+	std::lock_guard<std::mutex> lock(m_mtx);
+	close(conn->fd);
+	m_connections.remove_if([conn](const std::unique_ptr<connection> &c)
 	{
-		errstr = "Bad Request: " + errstr;
-		mg_send_http_error(conn, 400, "%s", errstr.c_str());
+		return c.get() == conn;
+	});
+	m_state_changed.notify_all();
+}
 
+bool k8s_audit_socket_server::process_message(const char *data, size_t len, std::string &errstr)
+{
+	std::list<std::shared_ptr<json_event>> evts;
+
+	auto cb = [&evts](json_event &jev, std::string &errstr) -> bool {
+		evts.push_back(std::make_shared<json_event>(jev));
 		return true;
+	};
+
+	FALCO_PROBE1(k8s_audit_accept_entry, (int64_t) len);
+	bool ok = parse_buffer(data, len, cb, errstr);
+	FALCO_PROBE2(k8s_audit_accept_return, (int64_t) len, ok);
+	if(!ok)
+	{
+		return false;
 	}
 
-	const std::string ok_body = "<html><body>Ok</body></html>";
-	mg_send_http_ok(conn, "text/html", ok_body.size());
-	mg_printf(conn, "%s", ok_body.c_str());
+	if(evts.empty())
+	{
+		return true;
+	}
+
+	// As for http requests, a message is queued as a whole
+	if(evts.size() > m_pool->queue_size())
+	{
+		errstr = "message contains more than " + to_string(m_pool->queue_size()) + " events";
+		return false;
+	}
+
+	// Unlike with http, there's no way to tell the client to
+	// retry later, so wait for the workers to make room. This
+	// also stops reading from the socket, pushing back on the
+	// client. The wait is bounded to notice when the server is
+	// stopped.
+	while(!m_pool->enqueue(evts, std::chrono::milliseconds(100)))
+	{
+		if(!m_pool->running() || !m_running)
+		{
+			errstr = "not accepting audit events";
+			return false;
+		}
+	}
 
 	return true;
 }
 
 falco_webserver::falco_webserver():
-	m_config(NULL)
+	m_config(NULL),
+	m_latency(NULL)
 {
 }
 
@@ -189,11 +955,15 @@ falco_webserver::~falco_webserver()
 
 void falco_webserver::init(falco_configuration *config,
 			   falco_engine *engine,
-			   falco_outputs *outputs)
+			   falco_outputs *outputs,
+			   k8s_audit_worker_pool::engine_factory_t engine_factory,
+			   latency_stats *latency)
 {
 	m_config = config;
 	m_engine = engine;
 	m_outputs = outputs;
+	m_engine_factory = engine_factory;
+	m_latency = latency;
 }
 
 template<typename T, typename... Args>
@@ -253,10 +1023,46 @@ void falco_webserver::start()
 		throw falco_exception("Could not create embedded webserver");
 	}
 
-	m_k8s_audit_handler = make_unique<k8s_audit_handler>(m_engine, m_outputs);
+	if(m_config->m_webserver_k8s_audit_workers > 0)
+	{
+		m_k8s_audit_pool = make_unique<k8s_audit_worker_pool>(m_outputs,
+								      m_config->m_webserver_k8s_audit_queue_size);
+		m_k8s_audit_pool->start(m_engine_factory, m_config->m_webserver_k8s_audit_workers);
+	}
+
+	m_k8s_audit_handler = make_unique<k8s_audit_handler>(m_engine, m_outputs,
+							     m_k8s_audit_pool.get(),
+							     m_config->m_webserver_k8s_audit_max_request_size,
+							     m_config->m_webserver_k8s_audit_max_event_size,
+							     m_config->m_webserver_k8s_audit_max_pending_size,
+							     m_config->m_webserver_k8s_audit_retry_after);
 	m_server->addHandler(m_config->m_webserver_k8s_audit_endpoint, *m_k8s_audit_handler);
 	m_k8s_healthz_handler = make_unique<k8s_healthz_handler>();
 	m_server->addHandler(m_config->m_webserver_k8s_healthz_endpoint, *m_k8s_healthz_handler);
+	if(m_latency)
+	{
+		m_metrics_handler = make_unique<metrics_handler>(m_latency);
+		m_server->addHandler(m_config->m_webserver_metrics_endpoint, *m_metrics_handler);
+	}
+
+	if(!m_config->m_webserver_k8s_audit_unix_socket.empty())
+	{
+		if(!m_k8s_audit_pool)
+		{
+			throw falco_exception("The k8s audit unix socket requires k8s_audit_workers to be greater than 0");
+		}
+
+		k8s_audit_socket_server::framing fr;
+		if(!k8s_audit_socket_server::parse_framing(m_config->m_webserver_k8s_audit_unix_socket_framing, fr))
+		{
+			throw falco_exception("Unknown k8s audit unix socket framing: " + m_config->m_webserver_k8s_audit_unix_socket_framing);
+		}
+
+		m_k8s_audit_socket_server = make_unique<k8s_audit_socket_server>(m_k8s_audit_pool.get(),
+										 m_config->m_webserver_k8s_audit_max_event_size,
+										 fr);
+		m_k8s_audit_socket_server->start(m_config->m_webserver_k8s_audit_unix_socket);
+	}
 }
 
 void falco_webserver::stop()
@@ -266,5 +1072,12 @@ void falco_webserver::stop()
 		m_server = NULL;
 		m_k8s_audit_handler = NULL;
 		m_k8s_healthz_handler = NULL;
+		m_metrics_handler = NULL;
 	}
+
+	m_k8s_audit_socket_server = NULL;
+
+	// Stopped after the server, so that no more events are
+	// queued while the workers drain the queue.
+	m_k8s_audit_pool = NULL;
 }
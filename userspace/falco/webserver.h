@@ -14,18 +14,110 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "CivetServer.h"
+#include "tbb/concurrent_queue.h"
 
 #include "configuration.h"
 #include "falco_engine.h"
+#include "json_evt.h"
 #include "falco_outputs.h"
 
+//
+// A pool of threads that evaluate k8s audit events off the webserver
+// thread. Each worker has its own engine, so workers don't contend
+// with each other (or with the main event loop) on the engine's lua
+// state.
+//
+class k8s_audit_worker_pool
+{
+public:
+	// Returns a new engine with all rules loaded, owned by the caller.
+	typedef std::function<falco_engine *()> engine_factory_t;
+
+	k8s_audit_worker_pool(falco_outputs *outputs, uint64_t queue_size);
+	virtual ~k8s_audit_worker_pool();
+
+	// Create num_workers engines using engine_factory and start
+	// a worker thread for each of them.
+	void start(engine_factory_t engine_factory, uint32_t num_workers);
+
+	// Evaluate all events still in the queue, then stop the
+	// worker threads.
+	void stop();
+
+	bool running();
+
+	// Returns true if the queue can't take any more events.
+	bool full();
+
+	// The number of events that could be queued right now. Other
+	// producers and the workers can change it at any time.
+	uint64_t room();
+
+	uint64_t queue_size();
+
+	// Queue all of the provided events, or none of them if they
+	// don't all fit in the queue. Returns whether the events were
+	// queued.
+	bool enqueue(std::list<std::shared_ptr<json_event>> &evts);
+
+	// Same, waiting up to timeout for the workers to make room in
+	// the queue. Returns false on timeout or if the pool is
+	// stopped.
+	bool enqueue(std::list<std::shared_ptr<json_event>> &evts,
+		     std::chrono::milliseconds timeout);
+
+private:
+	void worker(falco_engine *engine);
+
+	// Whether the events fit in the queue. Called with
+	// m_enqueue_mtx held.
+	bool has_room(size_t num_evts);
+
+	falco_outputs *m_outputs;
+	int64_t m_queue_size;
+	std::atomic<bool> m_running;
+
+	// A null event tells a worker to exit.
+	tbb::concurrent_bounded_queue<std::shared_ptr<json_event>> m_queue;
+
+	// Makes checking for room in the queue and pushing a batch of
+	// events atomic with respect to other producers.
+	std::mutex m_enqueue_mtx;
+
+	// Notified by the workers when they pop an event while
+	// producers are waiting for room in the queue, or when the
+	// pool is stopped
+	std::condition_variable m_room;
+	std::atomic<uint32_t> m_waiting_producers;
+
+	std::vector<std::unique_ptr<falco_engine>> m_engines;
+	std::vector<std::thread> m_threads;
+};
+
 class k8s_audit_handler : public CivetHandler
 {
 public:
-	k8s_audit_handler(falco_engine *engine, falco_outputs *outputs);
+	// When pool is non-NULL, events are queued to it and
+	// evaluated asynchronously. Otherwise they're evaluated using
+	// engine before answering the request. The events of a
+	// request are only queued once it's fully parsed, and
+	// max_pending_size limits the bytes of the request read
+	// until then.
+	k8s_audit_handler(falco_engine *engine, falco_outputs *outputs,
+			  k8s_audit_worker_pool *pool,
+			  uint64_t max_request_size, uint64_t max_event_size,
+			  uint64_t max_pending_size, uint32_t retry_after);
 	virtual ~k8s_audit_handler();
 
 	bool handleGet(CivetServer *server, struct mg_connection *conn);
@@ -35,12 +127,100 @@ public:
 				falco_outputs *outputs,
 				std::string &post_data, std::string &errstr);
 
+	// Like the above, but reads the data incrementally using
+	// parser, processing each event as soon as it's read.
+	static bool accept_data(falco_engine *engine,
+				falco_outputs *outputs,
+				falco_k8s_audit::event_stream_parser &parser,
+				falco_k8s_audit::event_stream_parser::reader_t reader,
+				std::string &errstr);
+
+	// Match a single event against the rules in engine, sending
+	// any alert to outputs.
+	static bool process_event(falco_engine *engine,
+				  falco_outputs *outputs,
+				  json_event &evt, std::string &errstr);
+
 	static std::string m_k8s_audit_event_source;
 
 private:
+	// Reject the request with the provided status, asking the
+	// client to retry it later.
+	void send_retry_later(struct mg_connection *conn, int status, const std::string &msg);
+
 	falco_engine *m_engine;
 	falco_outputs *m_outputs;
-	bool accept_uploaded_data(std::string &post_data, std::string &errstr);
+	k8s_audit_worker_pool *m_pool;
+	uint64_t m_max_request_size;
+	uint64_t m_max_event_size;
+	uint64_t m_max_pending_size;
+	uint32_t m_retry_after;
+};
+
+//
+// Accepts k8s audit events from local clients on a unix socket,
+// avoiding the overhead of tcp and http for each event. Clients keep
+// their connection open and send a message for each Event or
+// EventList, either terminated by a newline or preceded by its size
+// as a 4 bytes big-endian integer. Nothing is sent back.
+//
+// Events are queued to the same worker pool as those sent to
+// k8s_audit_handler. When its queue is full, reading from the client
+// is paused until there's room. A bounded number of clients are
+// served at once, the others waiting to be accepted.
+//
+class k8s_audit_socket_server
+{
+public:
+	enum framing
+	{
+		FRAMING_NEWLINE,
+		FRAMING_LENGTH
+	};
+
+	// Returns false if name isn't "newline" or "length".
+	static bool parse_framing(const std::string &name, framing &fr);
+
+	k8s_audit_socket_server(k8s_audit_worker_pool *pool,
+				uint64_t max_event_size, framing fr);
+	virtual ~k8s_audit_socket_server();
+
+	// Listen on a socket at path, replacing any existing
+	// socket. Throws falco_exception on errors.
+	void start(const std::string &path);
+
+	// Close the socket and all client connections.
+	void stop();
+
+	// Queue the events in a single message, waiting for room in
+	// the queue if needed.
+	bool process_message(const char *data, size_t len, std::string &errstr);
+
+private:
+	// Read by a detached thread, which removes the connection
+	// once done with it
+	struct connection
+	{
+		int fd;
+	};
+
+	void accept_connections();
+	void read_connection(connection *conn);
+
+	k8s_audit_worker_pool *m_pool;
+	uint64_t m_max_event_size;
+	framing m_framing;
+
+	std::string m_path;
+	int m_listen_fd;
+	std::atomic<bool> m_running;
+	std::thread m_accept_thread;
+
+	// Protects m_connections, notified when a connection is
+	// removed or the server is stopped
+	std::mutex m_mtx;
+	std::condition_variable m_state_changed;
+	std::list<std::unique_ptr<connection>> m_connections;
 };
 
 class k8s_healthz_handler : public CivetHandler
@@ -57,15 +237,39 @@ public:
 	bool handleGet(CivetServer *server, struct mg_connection *conn);
 };
 
+// Serves the alert latency histograms in the Prometheus text format
+class metrics_handler : public CivetHandler
+{
+public:
+	metrics_handler(latency_stats *latency):
+		m_latency(latency)
+	{
+	}
+
+	virtual ~metrics_handler()
+	{
+	}
+
+	bool handleGet(CivetServer *server, struct mg_connection *conn);
+
+private:
+	latency_stats *m_latency;
+};
+
 class falco_webserver
 {
 public:
 	falco_webserver();
 	virtual ~falco_webserver();
 
+	// engine_factory is used to create the engines of the k8s
+	// audit workers, if any are configured. The metrics endpoint
+	// is only served if latency is not NULL.
 	void init(falco_configuration *config,
 		  falco_engine *engine,
-		  falco_outputs *outputs);
+		  falco_outputs *outputs,
+		  k8s_audit_worker_pool::engine_factory_t engine_factory,
+		  latency_stats *latency = NULL);
 
 	void start();
 	void stop();
@@ -74,7 +278,12 @@ private:
 	falco_engine *m_engine;
 	falco_configuration *m_config;
 	falco_outputs *m_outputs;
+	k8s_audit_worker_pool::engine_factory_t m_engine_factory;
+	latency_stats *m_latency;
 	unique_ptr<CivetServer> m_server;
+	unique_ptr<k8s_audit_worker_pool> m_k8s_audit_pool;
 	unique_ptr<k8s_audit_handler> m_k8s_audit_handler;
+	unique_ptr<k8s_audit_socket_server> m_k8s_audit_socket_server;
 	unique_ptr<k8s_healthz_handler> m_k8s_healthz_handler;
+	unique_ptr<metrics_handler> m_metrics_handler;
 };